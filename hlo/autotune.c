@@ -0,0 +1,296 @@
+// Compile option autotuner.
+//
+// Variants are produced by appending entries to the env_option_overrides map of
+// the serialized CompileOptionsProto, which the compiler applies to
+// DebugOptions by flag name. This keeps the rest of the options (layouts,
+// build options) exactly as dumped by write_options.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "hlo_test.h"
+
+// CompileOptionsProto: map<string, OptionOverrideProto> env_option_overrides = 7;
+#define COMPILE_OPTIONS_ENV_OVERRIDES_FIELD 7
+// OptionOverrideProto: oneof value { string string_field = 1; bool bool_field = 2; int64 int_field = 3; }
+#define OPTION_OVERRIDE_BOOL_FIELD 2
+#define OPTION_OVERRIDE_INT_FIELD 3
+
+// A variant must be this much faster than the current best to be kept.
+#define AUTOTUNE_MIN_GAIN 0.02
+#define AUTOTUNE_MAX_OVERRIDES 8
+
+enum tune_kind { TUNE_BOOL, TUNE_INT };
+
+struct tune_override {
+    const char* name;
+    enum tune_kind kind;
+    int64_t value;
+};
+
+struct tune_variant {
+    const char* label;
+    size_t num_overrides;
+    struct tune_override overrides[3];
+};
+
+static const struct tune_variant tune_variants[] = {
+    {"fast-math", 1, {{"xla_cpu_enable_fast_math", TUNE_BOOL, 1}}},
+    {"fast-math-finite", 3, {{"xla_cpu_enable_fast_math", TUNE_BOOL, 1},
+                             {"xla_cpu_fast_math_honor_nans", TUNE_BOOL, 0},
+                             {"xla_cpu_fast_math_honor_infs", TUNE_BOOL, 0}}},
+    {"vector-width-128", 1, {{"xla_cpu_prefer_vector_width", TUNE_INT, 128}}},
+    {"vector-width-256", 1, {{"xla_cpu_prefer_vector_width", TUNE_INT, 256}}},
+    {"vector-width-512", 1, {{"xla_cpu_prefer_vector_width", TUNE_INT, 512}}},
+    {"single-thread-eigen", 1, {{"xla_cpu_multi_thread_eigen", TUNE_BOOL, 0}}},
+    {"codegen-split-1", 1, {{"xla_cpu_parallel_codegen_split_count", TUNE_INT, 1}}},
+    {"codegen-split-8", 1, {{"xla_cpu_parallel_codegen_split_count", TUNE_INT, 8}}},
+    {"concurrency-scheduler", 1, {{"xla_cpu_enable_concurrency_optimized_scheduler", TUNE_BOOL, 1}}},
+    {"thunk-runtime", 1, {{"xla_cpu_use_thunk_runtime", TUNE_BOOL, 1}}},
+    {"legacy-runtime", 1, {{"xla_cpu_use_thunk_runtime", TUNE_BOOL, 0}}},
+};
+#define NUM_TUNE_VARIANTS (sizeof(tune_variants) / sizeof(tune_variants[0]))
+
+struct tune_result {
+    int ok;
+    double median_s;
+};
+
+
+// --- Serialize base options plus overrides ---
+static int build_compile_options(const struct file_data* base, const struct tune_override* const* overrides,
+                                 size_t num_overrides, struct proto_buf* out) {
+    out->size = 0;
+    if (proto_append(out, base->data, base->size)) return 1;
+    for (size_t i = 0; i < num_overrides; ++i) {
+        const struct tune_override* o = overrides[i];
+        struct proto_buf value = {0};
+        struct proto_buf entry = {0};
+        int rc = proto_put_varint_field(&value, o->kind == TUNE_BOOL ? OPTION_OVERRIDE_BOOL_FIELD : OPTION_OVERRIDE_INT_FIELD,
+                                        (uint64_t)o->value) ||
+                 proto_put_bytes_field(&entry, 1, o->name, strlen(o->name)) ||
+                 proto_put_bytes_field(&entry, 2, value.data, value.size) ||
+                 proto_put_bytes_field(out, COMPILE_OPTIONS_ENV_OVERRIDES_FIELD, entry.data, entry.size);
+        proto_buf_free(&value);
+        proto_buf_free(&entry);
+        if (rc) return 1;
+    }
+    return 0;
+}
+
+
+// --- Compile with the given options and time the execution ---
+// On the first call `expected` is empty and receives the reference outputs,
+// afterwards outputs are checked against it.
+static struct tune_result measure_variant(const PJRT_Api* api, PJRT_Client* client, const TestCase* test_case,
+                                          const struct file_data* program, const char* format,
+                                          const struct proto_buf* options, PJRT_Buffer** inputs,
+                                          struct host_tensor** expected, size_t* num_expected,
+                                          int iterations, double tolerance) {
+    struct tune_result result = {0, 0.0};
+    struct file_data options_data = {options->data, options->size};
+    double* samples = NULL;
+    PJRT_LoadedExecutable* executable = compile_program(api, client, program, format, &options_data);
+    if (executable == NULL) {
+        return result;
+    }
+
+    // Warm-up run, also used for the output check.
+    PJRT_Buffer** outputs = NULL;
+    size_t num_outputs = 0;
+    if (execute_hlo_program(api, executable, inputs, test_case->num_inputs, &outputs, &num_outputs) != 0) {
+        goto cleanup_variant;
+    }
+    int outputs_ok = 1;
+    if (*expected == NULL) {
+        *expected = (struct host_tensor*)calloc(num_outputs ? num_outputs : 1, sizeof(struct host_tensor));
+        *num_expected = num_outputs;
+        for (size_t i = 0; i < num_outputs && *expected != NULL && outputs_ok; ++i) {
+            outputs_ok = buffer_to_host(api, outputs[i], &(*expected)[i]) == 0;
+        }
+        outputs_ok = outputs_ok && *expected != NULL;
+    } else if (num_outputs != *num_expected) {
+        fprintf(stderr, "  output count %zu differs from baseline %zu\n", num_outputs, *num_expected);
+        outputs_ok = 0;
+    } else {
+        for (size_t i = 0; i < num_outputs && outputs_ok; ++i) {
+            struct host_tensor actual;
+            if (buffer_to_host(api, outputs[i], &actual) != 0) {
+                outputs_ok = 0;
+                break;
+            }
+            if (!host_tensors_match(&(*expected)[i], &actual, tolerance)) {
+                fprintf(stderr, "  output %zu differs from baseline beyond tolerance %g\n", i, tolerance);
+                outputs_ok = 0;
+            }
+            free_host_tensor(&actual);
+        }
+    }
+    destroy_buffers(api, outputs, num_outputs, "PJRT_Buffer_Destroy (autotune output)");
+    if (!outputs_ok) goto cleanup_variant;
+
+    samples = (double*)calloc(iterations, sizeof(double));
+    if (samples == NULL) goto cleanup_variant;
+    for (int i = 0; i < iterations; ++i) {
+        double start = now_seconds();
+        if (execute_hlo_program(api, executable, inputs, test_case->num_inputs, &outputs, &num_outputs) != 0 ||
+            await_buffers_ready(api, outputs, num_outputs) != 0) {
+            destroy_buffers(api, outputs, num_outputs, "PJRT_Buffer_Destroy (autotune output)");
+            goto cleanup_variant;
+        }
+        samples[i] = now_seconds() - start;
+        destroy_buffers(api, outputs, num_outputs, "PJRT_Buffer_Destroy (autotune output)");
+    }
+    result.median_s = median_of(samples, iterations);
+    result.ok = 1;
+
+cleanup_variant:
+    free(samples);
+    destroy_loaded_executable(api, executable);
+    return result;
+}
+
+
+static int has_override(const struct tune_override* const* overrides, size_t num_overrides, const char* name) {
+    for (size_t i = 0; i < num_overrides; ++i) {
+        if (strcmp(overrides[i]->name, name) == 0) return 1;
+    }
+    return 0;
+}
+
+
+// --- Output file name: "<dir>/add.3x2.xla.pb" -> "add.3x2.compile_options.tuned.pb" ---
+static void tuned_options_path(const char* program_path, char* out, size_t out_size) {
+    const char* base = strrchr(program_path, '/');
+    base = base ? base + 1 : program_path;
+    size_t len = strlen(base);
+    static const char* const suffixes[] = {".xla.pb", ".mlir.bc", ".mlir", ".pb"};
+    for (size_t i = 0; i < sizeof(suffixes) / sizeof(suffixes[0]); ++i) {
+        size_t n = strlen(suffixes[i]);
+        if (len > n && strcmp(base + len - n, suffixes[i]) == 0) {
+            len -= n;
+            break;
+        }
+    }
+    snprintf(out, out_size, "%.*s.compile_options.tuned.pb", (int)len, base);
+}
+
+
+// --- Function to autotune the compile options of one test case ---
+// Every variant is compiled and benchmarked on its own, then the variants that
+// beat the baseline are greedily combined, fastest first. The winning options
+// are written next to the working directory for production use.
+int autotune_test_case(const PJRT_Api* api, PJRT_Client* client, PJRT_Device* device,
+                       const TestCase* test_case, int iterations, double tolerance) {
+    int rc = 1;
+    struct file_data program = {NULL, 0};
+    struct file_data base_options = {NULL, 0};
+    struct proto_buf options = {0};
+    PJRT_Buffer** inputs = NULL;
+    struct host_tensor* expected = NULL;
+    size_t num_expected = 0;
+    struct tune_result single[NUM_TUNE_VARIANTS];
+    const struct tune_override* best[AUTOTUNE_MAX_OVERRIDES];
+    size_t num_best = 0;
+    const char* format = test_case->format ? test_case->format : program_format_from_path(test_case->hlo_path);
+
+    printf("\n--- Autotuning compile options: %s ---\n", test_case->name);
+    if (read_file_to_buffer(test_case->hlo_path, &program) != 0 ||
+        read_file_to_buffer(test_case->compile_options_path, &base_options) != 0) {
+        goto cleanup_autotune;
+    }
+    inputs = create_input_buffers(api, client, device, test_case);
+    if (inputs == NULL) goto cleanup_autotune;
+
+    if (build_compile_options(&base_options, NULL, 0, &options)) goto cleanup_autotune;
+    struct tune_result baseline = measure_variant(api, client, test_case, &program, format, &options, inputs,
+                                                  &expected, &num_expected, iterations, tolerance);
+    if (!baseline.ok) {
+        fprintf(stderr, "Baseline compile options failed, nothing to tune.\n");
+        goto cleanup_autotune;
+    }
+    printf("  %-24s %12s %9s\n", "variant", "median(ms)", "speedup");
+    printf("  %-24s %12.4f %9.3f\n", "baseline", baseline.median_s * 1e3, 1.0);
+
+    for (size_t v = 0; v < NUM_TUNE_VARIANTS; ++v) {
+        const struct tune_override* overrides[3];
+        for (size_t i = 0; i < tune_variants[v].num_overrides; ++i) overrides[i] = &tune_variants[v].overrides[i];
+        if (build_compile_options(&base_options, overrides, tune_variants[v].num_overrides, &options)) {
+            goto cleanup_autotune;
+        }
+        single[v] = measure_variant(api, client, test_case, &program, format, &options, inputs,
+                                    &expected, &num_expected, iterations, tolerance);
+        if (single[v].ok) {
+            printf("  %-24s %12.4f %9.3f\n", tune_variants[v].label, single[v].median_s * 1e3,
+                   baseline.median_s / single[v].median_s);
+        } else {
+            printf("  %-24s %12s %9s\n", tune_variants[v].label, "rejected", "-");
+        }
+    }
+
+    // Greedy combination of the winners, best single-variant time first.
+    double best_s = baseline.median_s;
+    int tried[NUM_TUNE_VARIANTS] = {0};
+    for (;;) {
+        size_t pick = NUM_TUNE_VARIANTS;
+        for (size_t v = 0; v < NUM_TUNE_VARIANTS; ++v) {
+            if (tried[v] || !single[v].ok || single[v].median_s > baseline.median_s * (1.0 - AUTOTUNE_MIN_GAIN)) continue;
+            if (pick == NUM_TUNE_VARIANTS || single[v].median_s < single[pick].median_s) pick = v;
+        }
+        if (pick == NUM_TUNE_VARIANTS) break;
+        tried[pick] = 1;
+
+        const struct tune_variant* variant = &tune_variants[pick];
+        const struct tune_override* combined[AUTOTUNE_MAX_OVERRIDES];
+        size_t num_combined = num_best;
+        int conflict = num_best + variant->num_overrides > AUTOTUNE_MAX_OVERRIDES;
+        memcpy(combined, best, num_best * sizeof(best[0]));
+        for (size_t i = 0; i < variant->num_overrides && !conflict; ++i) {
+            conflict = has_override(best, num_best, variant->overrides[i].name);
+            combined[num_combined++] = &variant->overrides[i];
+        }
+        if (conflict) continue;
+
+        struct tune_result result = {1, single[pick].median_s};
+        if (num_best > 0) {
+            if (build_compile_options(&base_options, combined, num_combined, &options)) goto cleanup_autotune;
+            result = measure_variant(api, client, test_case, &program, format, &options, inputs,
+                                     &expected, &num_expected, iterations, tolerance);
+        }
+        if (result.ok && result.median_s < best_s * (1.0 - AUTOTUNE_MIN_GAIN)) {
+            memcpy(best, combined, num_combined * sizeof(combined[0]));
+            num_best = num_combined;
+            best_s = result.median_s;
+            printf("  + %-22s %12.4f %9.3f\n", variant->label, result.median_s * 1e3, baseline.median_s / result.median_s);
+        }
+    }
+
+    char out_path[512];
+    tuned_options_path(test_case->hlo_path, out_path, sizeof(out_path));
+    if (build_compile_options(&base_options, best, num_best, &options)) goto cleanup_autotune;
+    FILE* out = fopen(out_path, "wb");
+    if (out == NULL || fwrite(options.data, 1, options.size, out) != options.size) {
+        fprintf(stderr, "Failed to write tuned compile options '%s'\n", out_path);
+        if (out) fclose(out);
+        goto cleanup_autotune;
+    }
+    fclose(out);
+    printf("Best options (%.3fx over baseline):", baseline.median_s / best_s);
+    if (num_best == 0) printf(" baseline");
+    for (size_t i = 0; i < num_best; ++i) {
+        printf(" %s=%lld", best[i]->name, (long long)best[i]->value);
+    }
+    printf("\nWritten %s (%zu bytes)\n", out_path, options.size);
+    rc = 0;
+
+cleanup_autotune:
+    if (expected != NULL) {
+        for (size_t i = 0; i < num_expected; ++i) free_host_tensor(&expected[i]);
+        free(expected);
+    }
+    destroy_buffers(api, inputs, test_case->num_inputs, "PJRT_Buffer_Destroy (autotune input)");
+    proto_buf_free(&options);
+    free_file_data(&program);
+    free_file_data(&base_options);
+    return rc;
+}
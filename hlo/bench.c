@@ -0,0 +1,313 @@
+// Benchmark results and regression check against a stored baseline.
+//
+// Every registered test case is compiled once and executed `iterations`
+// times. The raw execution times go to a JSON results file so that two runs
+// can be compared sample by sample. With a baseline file each workload is
+// compared with a one-sided Mann-Whitney U test: a workload regresses when
+// its times are significantly larger than the baseline's (p < BENCH_ALPHA)
+// and the median slowed down by more than BENCH_MIN_SLOWDOWN, which keeps
+// tiny but consistent shifts from failing the run.
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "hlo_test.h"
+
+#define BENCH_FORMAT_VERSION 1
+#define BENCH_ALPHA 0.01
+#define BENCH_MIN_SLOWDOWN 0.05
+#define BENCH_MAX_WORKLOADS 32
+#define BENCH_NAME_SIZE 128
+
+struct bench_workload {
+    char name[BENCH_NAME_SIZE];
+    double* samples;
+    size_t num_samples;
+};
+
+
+static void free_workloads(struct bench_workload* workloads, size_t num_workloads) {
+    for (size_t i = 0; i < num_workloads; ++i) free(workloads[i].samples);
+}
+
+
+// --- Function to time one test case ---
+static int bench_test_case(const PJRT_Api* api, PJRT_Client* client, PJRT_Device* device,
+                           const TestCase* test_case, int iterations, struct bench_workload* workload) {
+    int rc = 1;
+    struct file_data program = {NULL, 0};
+    struct file_data compile_options = {NULL, 0};
+    PJRT_LoadedExecutable* executable = NULL;
+    PJRT_Buffer** inputs = NULL;
+
+    snprintf(workload->name, sizeof(workload->name), "%s", test_case->name);
+    stage_timers_set_workload(test_case->name);
+    workload->samples = (double*)calloc(iterations, sizeof(double));
+    workload->num_samples = iterations;
+    if (workload->samples == NULL) goto cleanup_bench_case;
+    if (read_file_to_buffer(test_case->hlo_path, &program) != 0 ||
+        read_file_to_buffer(test_case->compile_options_path, &compile_options) != 0) {
+        goto cleanup_bench_case;
+    }
+    const char* format = test_case->format ? test_case->format : program_format_from_path(test_case->hlo_path);
+    executable = compile_program(api, client, &program, format, &compile_options);
+    if (executable == NULL) goto cleanup_bench_case;
+    inputs = create_input_buffers(api, client, device, test_case);
+    if (inputs == NULL) goto cleanup_bench_case;
+    rc = benchmark_executable_samples(api, executable, inputs, test_case->num_inputs, iterations,
+                                      workload->samples);
+
+cleanup_bench_case:
+    destroy_buffers(api, inputs, test_case->num_inputs, "PJRT_Buffer_Destroy (bench input)");
+    if (executable != NULL) destroy_loaded_executable(api, executable);
+    free_file_data(&program);
+    free_file_data(&compile_options);
+    return rc;
+}
+
+
+// --- Function to write results as JSON ---
+static int write_results(const char* path, const struct bench_workload* workloads, size_t num_workloads,
+                         int iterations) {
+    FILE* file = fopen(path, "w");
+    if (file == NULL) {
+        fprintf(stderr, "Error creating '%s'\n", path);
+        return 1;
+    }
+    fprintf(file, "{\n  \"version\": %d,\n  \"iterations\": %d,\n  \"workloads\": [\n", BENCH_FORMAT_VERSION,
+            iterations);
+    for (size_t w = 0; w < num_workloads; ++w) {
+        fprintf(file, "    {\"name\": \"");
+        for (const char* c = workloads[w].name; *c; ++c) {
+            if (*c == '"' || *c == '\\') fputc('\\', file);
+            fputc(*c, file);
+        }
+        fprintf(file, "\", \"samples_s\": [");
+        for (size_t i = 0; i < workloads[w].num_samples; ++i) {
+            fprintf(file, "%s%.9g", i ? ", " : "", workloads[w].samples[i]);
+        }
+        fprintf(file, "]}%s\n", w + 1 < num_workloads ? "," : "");
+    }
+    fprintf(file, "  ]\n}\n");
+    if (fclose(file) != 0) {
+        fprintf(stderr, "Error writing '%s'\n", path);
+        return 1;
+    }
+    return 0;
+}
+
+
+// --- Function to read results written by write_results ---
+// Only the keys this file writes are looked at: each "name" string is paired
+// with the "samples_s" array that follows it.
+static int read_results(const char* path, struct bench_workload* workloads, size_t* num_workloads_ptr) {
+    struct file_data file = {NULL, 0};
+    if (read_file_to_buffer(path, &file) != 0) return 1;
+    char* text = (char*)malloc(file.size + 1);
+    if (text == NULL) {
+        free_file_data(&file);
+        return 1;
+    }
+    memcpy(text, file.data, file.size);
+    text[file.size] = '\0';
+    free_file_data(&file);
+
+    int rc = 0;
+    size_t num_workloads = 0;
+    const char* p = text;
+    while (rc == 0 && (p = strstr(p, "\"name\"")) != NULL) {
+        if (num_workloads == BENCH_MAX_WORKLOADS) break;
+        struct bench_workload* workload = &workloads[num_workloads];
+        p = strchr(p + 6, '"');
+        size_t n = 0;
+        for (++p; p != NULL && *p && *p != '"'; ++p) {
+            if (*p == '\\' && p[1]) ++p;
+            if (n + 1 < sizeof(workload->name)) workload->name[n++] = *p;
+        }
+        workload->name[n] = '\0';
+        const char* samples = p ? strstr(p, "\"samples_s\"") : NULL;
+        const char* open = samples ? strchr(samples, '[') : NULL;
+        const char* close = open ? strchr(open, ']') : NULL;
+        if (close == NULL) {
+            rc = 1;
+            break;
+        }
+        size_t capacity = 1;
+        for (const char* c = open; c < close; ++c) capacity += *c == ',';
+        workload->samples = (double*)calloc(capacity, sizeof(double));
+        workload->num_samples = 0;
+        if (workload->samples == NULL) {
+            rc = 1;
+            break;
+        }
+        num_workloads++;
+        for (const char* c = open + 1; c < close;) {
+            char* end = NULL;
+            double value = strtod(c, &end);
+            if (end == c) break;
+            workload->samples[workload->num_samples++] = value;
+            c = end;
+            while (c < close && (*c == ',' || *c == ' ' || *c == '\n')) ++c;
+        }
+        p = close;
+    }
+    free(text);
+    if (rc != 0) {
+        fprintf(stderr, "Malformed benchmark results in '%s'\n", path);
+        free_workloads(workloads, num_workloads);
+        return 1;
+    }
+    *num_workloads_ptr = num_workloads;
+    return 0;
+}
+
+
+struct ranked_sample {
+    double value;
+    int current; // 1 for the current run, 0 for the baseline
+};
+
+
+static int compare_ranked(const void* a, const void* b) {
+    double x = ((const struct ranked_sample*)a)->value;
+    double y = ((const struct ranked_sample*)b)->value;
+    return (x > y) - (x < y);
+}
+
+
+// --- One-sided Mann-Whitney U test ---
+// Returns the p-value of "current times are stochastically larger than
+// baseline times", from the normal approximation with tie correction and
+// continuity correction. Suitable from about 8 samples per side.
+static double mann_whitney_p(const double* baseline, size_t n0, const double* current, size_t n1) {
+    size_t n = n0 + n1;
+    struct ranked_sample* all = (struct ranked_sample*)malloc(n * sizeof(struct ranked_sample));
+    if (all == NULL) return 1.0;
+    for (size_t i = 0; i < n0; ++i) all[i] = (struct ranked_sample){baseline[i], 0};
+    for (size_t i = 0; i < n1; ++i) all[n0 + i] = (struct ranked_sample){current[i], 1};
+    qsort(all, n, sizeof(all[0]), compare_ranked);
+
+    double rank_sum = 0.0; // Sum of the current run's ranks
+    double tie_term = 0.0;
+    for (size_t i = 0; i < n;) {
+        size_t j = i;
+        while (j < n && all[j].value == all[i].value) ++j;
+        double rank = 0.5 * (double)(i + 1 + j); // Average of ranks i+1 .. j
+        for (size_t k = i; k < j; ++k) {
+            if (all[k].current) rank_sum += rank;
+        }
+        double t = (double)(j - i);
+        tie_term += t * t * t - t;
+        i = j;
+    }
+    free(all);
+
+    double u = rank_sum - 0.5 * (double)n1 * (double)(n1 + 1);
+    double mean = 0.5 * (double)n0 * (double)n1;
+    double variance = (double)n0 * (double)n1 / 12.0 * ((double)(n + 1) - tie_term / ((double)n * (double)(n - 1)));
+    if (variance <= 0.0) return 1.0; // Every sample is equal
+    double z = (u - mean - 0.5) / sqrt(variance);
+    return 0.5 * erfc(z / sqrt(2.0));
+}
+
+
+static double median_of_copy(const double* samples, size_t count) {
+    double* copy = (double*)malloc(count * sizeof(double));
+    if (copy == NULL) return 0.0;
+    memcpy(copy, samples, count * sizeof(double));
+    double median = median_of(copy, count);
+    free(copy);
+    return median;
+}
+
+
+// --- Function to compare results with a baseline; returns the number of regressions ---
+static int compare_with_baseline(const struct bench_workload* current, size_t num_current,
+                                 const struct bench_workload* baseline, size_t num_baseline) {
+    int regressions = 0;
+    printf("  %-32s %13s %13s %9s %10s  %s\n", "workload", "baseline(ms)", "current(ms)", "change", "p", "verdict");
+    for (size_t w = 0; w < num_current; ++w) {
+        const struct bench_workload* base = NULL;
+        for (size_t b = 0; b < num_baseline && base == NULL; ++b) {
+            if (strcmp(baseline[b].name, current[w].name) == 0) base = &baseline[b];
+        }
+        if (base == NULL || base->num_samples == 0) {
+            printf("  %-32s %13s %13.4f %9s %10s  %s\n", current[w].name, "-",
+                   median_of_copy(current[w].samples, current[w].num_samples) * 1e3, "-", "-", "new");
+            continue;
+        }
+        double base_median = median_of_copy(base->samples, base->num_samples);
+        double current_median = median_of_copy(current[w].samples, current[w].num_samples);
+        double change = base_median > 0.0 ? current_median / base_median - 1.0 : 0.0;
+        double p = mann_whitney_p(base->samples, base->num_samples, current[w].samples, current[w].num_samples);
+        const char* verdict = "ok";
+        if (p < BENCH_ALPHA && change > BENCH_MIN_SLOWDOWN) {
+            verdict = "REGRESSION";
+            regressions++;
+        } else if (mann_whitney_p(current[w].samples, current[w].num_samples, base->samples,
+                                  base->num_samples) < BENCH_ALPHA && change < -BENCH_MIN_SLOWDOWN) {
+            verdict = "faster";
+        }
+        printf("  %-32s %13.4f %13.4f %+8.1f%% %10.2g  %s\n", current[w].name, base_median * 1e3,
+               current_median * 1e3, change * 100, p, verdict);
+    }
+    for (size_t b = 0; b < num_baseline; ++b) {
+        int found = 0;
+        for (size_t w = 0; w < num_current && !found; ++w) found = strcmp(baseline[b].name, current[w].name) == 0;
+        if (!found) printf("  %-32s missing from this run\n", baseline[b].name);
+    }
+    return regressions;
+}
+
+
+// --- Function to benchmark all test cases and check them against a baseline ---
+int run_bench(const PJRT_Api* api, PJRT_Client* client, PJRT_Device* device, const TestCase* const* tests,
+              size_t num_tests, int iterations, const char* results_path, const char* baseline_path) {
+    struct bench_workload current[BENCH_MAX_WORKLOADS];
+    struct bench_workload baseline[BENCH_MAX_WORKLOADS];
+    size_t num_current = 0;
+    size_t num_baseline = 0;
+    int rc = 1;
+
+    printf("\n--- Benchmark: %zu workloads, %d iterations each ---\n", num_tests, iterations);
+    if (num_tests > BENCH_MAX_WORKLOADS) num_tests = BENCH_MAX_WORKLOADS;
+    for (size_t i = 0; i < num_tests; ++i) {
+        memset(&current[num_current], 0, sizeof(current[0]));
+        int case_rc = bench_test_case(api, client, device, tests[i], iterations, &current[num_current]);
+        num_current++;
+        if (case_rc != 0) {
+            fprintf(stderr, "Benchmark of '%s' failed.\n", tests[i]->name);
+            goto cleanup_bench;
+        }
+    }
+    if (write_results(results_path, current, num_current, iterations) != 0) goto cleanup_bench;
+    printf("Results written to %s\n", results_path);
+
+    if (baseline_path == NULL) {
+        rc = 0;
+        goto cleanup_bench;
+    }
+    FILE* probe = fopen(baseline_path, "r");
+    if (probe == NULL) {
+        printf("No baseline at %s; record one with `make bench.update`.\n", baseline_path);
+        rc = 0;
+        goto cleanup_bench;
+    }
+    fclose(probe);
+    if (read_results(baseline_path, baseline, &num_baseline) != 0) goto cleanup_bench;
+    printf("Compared with %s (one-sided Mann-Whitney U, p < %.2g and median slower by more than %.0f%%):\n",
+           baseline_path, BENCH_ALPHA, BENCH_MIN_SLOWDOWN * 100);
+    int regressions = compare_with_baseline(current, num_current, baseline, num_baseline);
+    if (regressions > 0) {
+        fprintf(stderr, "%d workload(s) regressed against %s.\n", regressions, baseline_path);
+        rc = 2;
+    } else {
+        rc = 0;
+    }
+
+cleanup_bench:
+    free_workloads(current, num_current);
+    free_workloads(baseline, num_baseline);
+    return rc;
+}
@@ -0,0 +1,699 @@
+// Single-file model bundles.
+//
+// A bundle holds the programs, compile options, serialized executables and
+// input tensors of a set of test cases:
+//
+//   offset 0                  struct bundle_header
+//   sizeof(header)            struct bundle_entry[num_sections]
+//   multiple of 4096          section data, each section page-aligned
+//
+// Sections are stored as they are or zstd compressed (libzstd is loaded with
+// dlopen, so it is only needed to write or read compressed sections). Every
+// test case has a text section "<name>/test" naming its program, compile
+// options, executable and input sections:
+//
+//   name Add 3x2
+//   program add.3x2.xla.pb
+//   options compile_options.0.pb
+//   executable add.3x2.xla.pb.executable
+//   input Add 3x2/input0
+//
+// Program and options sections keep the base name of their file unless a
+// different file already took it (every corpus entry is module.xla.pb); then
+// the name is tagged with a hash of the contents, as in module.xla.pb~<hash>.
+//
+// bundle_open maps the whole file without reading it; only the header page
+// and the sections a run asks for are faulted in. Uncompressed sections are
+// used in place. Test cases refer to sections through "bundle:<name>" paths,
+// which read_file_to_buffer resolves with bundle_read_section.
+#include <dlfcn.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "hlo_test.h"
+
+#define BUNDLE_MAGIC "HLOBNDL1"
+#define BUNDLE_VERSION 1
+#define BUNDLE_ALIGNMENT 4096
+#define BUNDLE_NAME_SIZE 96
+#define BUNDLE_MAX_SECTIONS 1024
+#define BUNDLE_MAX_TESTS 64
+#define BUNDLE_MAX_INPUTS 64
+
+enum bundle_kind {
+    BUNDLE_KIND_HLO = 1, // Serialized HloModuleProto
+    BUNDLE_KIND_MLIR = 2, // StableHLO bytecode
+    BUNDLE_KIND_COMPILE_OPTIONS = 3, // Serialized CompileOptionsProto
+    BUNDLE_KIND_EXECUTABLE = 4, // PJRT_Executable_Serialize output
+    BUNDLE_KIND_TENSOR = 5, // Row-major tensor, type and dims in the entry
+    BUNDLE_KIND_TEST = 6, // Test case manifest
+};
+
+enum bundle_compression {
+    BUNDLE_STORED = 0,
+    BUNDLE_ZSTD = 1,
+};
+
+// On-disk structures, little-endian with explicit padding.
+struct bundle_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t num_sections;
+    uint64_t file_size;
+};
+
+struct bundle_entry {
+    char name[BUNDLE_NAME_SIZE]; // NUL-terminated
+    uint32_t kind;
+    uint32_t compression;
+    uint64_t offset; // Multiple of BUNDLE_ALIGNMENT
+    uint64_t stored_size; // Bytes in the file
+    uint64_t size; // Bytes after decompression
+    uint32_t tensor_type; // PJRT_Buffer_Type of BUNDLE_KIND_TENSOR
+    uint32_t tensor_num_dims;
+    int64_t tensor_dims[HOST_TENSOR_MAX_DIMS];
+};
+
+// --- zstd, loaded on first use ---
+typedef size_t (*zstd_compress_bound_fn)(size_t);
+typedef size_t (*zstd_compress_fn)(void*, size_t, const void*, size_t, int);
+typedef size_t (*zstd_decompress_fn)(void*, size_t, const void*, size_t);
+typedef unsigned (*zstd_is_error_fn)(size_t);
+typedef const char* (*zstd_error_name_fn)(size_t);
+
+static struct {
+    int loaded; // 1 loaded, -1 unavailable
+    zstd_compress_bound_fn compress_bound;
+    zstd_compress_fn compress;
+    zstd_decompress_fn decompress;
+    zstd_is_error_fn is_error;
+    zstd_error_name_fn error_name;
+} zstd;
+
+// --- The open bundle ---
+static struct {
+    const uint8_t* map;
+    size_t size;
+    const struct bundle_entry* entries;
+    uint32_t num_sections;
+    unsigned char* touched; // Per section: read at least once
+} bundle;
+
+// A loaded bundle test case owns everything its TestCase points to.
+struct bundle_case {
+    TestCase test_case;
+    char name[BUNDLE_NAME_SIZE];
+    char* paths[3]; // Program, compile options, executable
+    size_t num_inputs;
+    struct file_data input_files[BUNDLE_MAX_INPUTS];
+    void* input_data[BUNDLE_MAX_INPUTS];
+    int64_t* input_dims[BUNDLE_MAX_INPUTS];
+    size_t input_num_dims[BUNDLE_MAX_INPUTS];
+    PJRT_Buffer_Type input_types[BUNDLE_MAX_INPUTS];
+    int64_t dims[BUNDLE_MAX_INPUTS][HOST_TENSOR_MAX_DIMS];
+};
+
+
+static int zstd_load(void) {
+    if (zstd.loaded != 0) return zstd.loaded < 0;
+    zstd.loaded = -1;
+    void* handle = dlopen("libzstd.so.1", RTLD_NOW | RTLD_LOCAL);
+    if (handle == NULL) {
+        fprintf(stderr, "zstd is not available: %s\n", dlerror());
+        return 1;
+    }
+    zstd.compress_bound = (zstd_compress_bound_fn)dlsym(handle, "ZSTD_compressBound");
+    zstd.compress = (zstd_compress_fn)dlsym(handle, "ZSTD_compress");
+    zstd.decompress = (zstd_decompress_fn)dlsym(handle, "ZSTD_decompress");
+    zstd.is_error = (zstd_is_error_fn)dlsym(handle, "ZSTD_isError");
+    zstd.error_name = (zstd_error_name_fn)dlsym(handle, "ZSTD_getErrorName");
+    if (zstd.compress_bound == NULL || zstd.compress == NULL || zstd.decompress == NULL ||
+        zstd.is_error == NULL || zstd.error_name == NULL) {
+        fprintf(stderr, "libzstd.so.1 lacks the simple API\n");
+        dlclose(handle);
+        return 1;
+    }
+    zstd.loaded = 1; // The handle stays open for the life of the process
+    return 0;
+}
+
+
+// --- Writing ---
+
+// A section being written; `data` is freed when `owned`. `key` identifies the contents: a hash of
+// the bytes, or for executables a hash of the program and compile options they were built from.
+struct pending_section {
+    struct bundle_entry entry;
+    const void* data;
+    int owned;
+    uint64_t key;
+};
+
+struct bundle_writer {
+    struct pending_section sections[BUNDLE_MAX_SECTIONS];
+    size_t num_sections;
+    int compression_level; // 0 stores sections as they are
+};
+
+
+static const struct pending_section* find_pending(const struct bundle_writer* writer, const char* name) {
+    for (size_t i = 0; i < writer->num_sections; ++i) {
+        if (strcmp(writer->sections[i].entry.name, name) == 0) return &writer->sections[i];
+    }
+    return NULL;
+}
+
+
+// FNV-1a 64, continuing from `hash` (start with 14695981039346656037).
+static uint64_t fnv1a(uint64_t hash, const void* data, size_t size) {
+    const uint8_t* bytes = (const uint8_t*)data;
+    for (size_t i = 0; i < size; ++i) hash = (hash ^ bytes[i]) * 1099511628211ull;
+    return hash;
+}
+
+
+static uint64_t content_key(const void* data, size_t size) {
+    return fnv1a(14695981039346656037ull, data, size);
+}
+
+
+// Picks the section name for contents `key`: `base` followed by `suffix` when that fits and is free or
+// already holds the same contents, otherwise `base` cut to fit and tagged with the key. Different
+// files share base names (every corpus entry is module.xla.pb), so the tag keeps them apart.
+static int pick_section_name(const struct bundle_writer* writer, char name[BUNDLE_NAME_SIZE], const char* base,
+                             const char* suffix, uint64_t key) {
+    const struct pending_section* existing = NULL;
+    if ((size_t)snprintf(name, BUNDLE_NAME_SIZE, "%s%s", base, suffix) < BUNDLE_NAME_SIZE) {
+        existing = find_pending(writer, name);
+        if (existing == NULL || existing->key == key) return 0;
+    }
+    int room = BUNDLE_NAME_SIZE - 1 - 17 - (int)strlen(suffix);
+    if (room < 0) room = 0;
+    snprintf(name, BUNDLE_NAME_SIZE, "%.*s~%016llx%s", room, base, (unsigned long long)key, suffix);
+    existing = find_pending(writer, name);
+    if (existing != NULL && existing->key != key) {
+        fprintf(stderr, "Bundle section '%s' already holds different contents\n", name);
+        return 1;
+    }
+    return 0;
+}
+
+
+// Adds a section, compressing it when that makes it smaller. Takes `data` over when `owned`,
+// also on errors. Adding a name again is a no-op for the same `key` and an error otherwise.
+static int add_section(struct bundle_writer* writer, const char* name, enum bundle_kind kind, const void* data,
+                       size_t size, int owned, const struct host_tensor* tensor, uint64_t key) {
+    const struct pending_section* existing = find_pending(writer, name);
+    if (existing != NULL) {
+        if (owned) free((void*)data);
+        if (existing->key == key) return 0;
+        fprintf(stderr, "Bundle section '%s' already holds different contents\n", name);
+        return 1;
+    }
+    if (writer->num_sections == BUNDLE_MAX_SECTIONS || strlen(name) >= BUNDLE_NAME_SIZE) {
+        fprintf(stderr, "Cannot add bundle section '%s'\n", name);
+        if (owned) free((void*)data);
+        return 1;
+    }
+    struct pending_section* section = &writer->sections[writer->num_sections];
+    memset(section, 0, sizeof(*section));
+    snprintf(section->entry.name, sizeof(section->entry.name), "%s", name);
+    section->entry.kind = kind;
+    section->entry.size = size;
+    section->entry.stored_size = size;
+    section->data = data;
+    section->owned = owned;
+    section->key = key;
+    if (tensor != NULL) {
+        section->entry.tensor_type = tensor->type;
+        section->entry.tensor_num_dims = (uint32_t)tensor->num_dims;
+        memcpy(section->entry.tensor_dims, tensor->dims, tensor->num_dims * sizeof(int64_t));
+    }
+    writer->num_sections++;
+
+    if (writer->compression_level <= 0 || size == 0 || zstd_load() != 0) return 0;
+    size_t bound = zstd.compress_bound(size);
+    void* compressed = malloc(bound);
+    if (compressed == NULL) return 0; // Stored as it is
+    size_t compressed_size = zstd.compress(compressed, bound, data, size, writer->compression_level);
+    if (zstd.is_error(compressed_size) || compressed_size >= size) {
+        free(compressed);
+        return 0;
+    }
+    if (owned) free((void*)data);
+    section->data = compressed;
+    section->owned = 1;
+    section->entry.compression = BUNDLE_ZSTD;
+    section->entry.stored_size = compressed_size;
+    return 0;
+}
+
+
+// Adds the file at `path` under a name derived from `base`, which is returned in `name`, and its key in `key`.
+static int add_file_section(struct bundle_writer* writer, char name[BUNDLE_NAME_SIZE], const char* base,
+                            enum bundle_kind kind, const char* path, uint64_t* key) {
+    struct file_data file = {NULL, 0};
+    if (read_file_to_buffer(path, &file) != 0) return 1;
+    *key = content_key(file.data, file.size);
+    if (pick_section_name(writer, name, base, "", *key) != 0) {
+        free_file_data(&file);
+        return 1;
+    }
+    if (find_pending(writer, name) != NULL) { // Same contents already added
+        free_file_data(&file);
+        return 0;
+    }
+    if (bundle_contains(file.data)) { // Re-bundling sections of an open bundle
+        void* copy = malloc(file.size ? file.size : 1);
+        if (copy == NULL) return 1;
+        memcpy(copy, file.data, file.size);
+        file.data = copy;
+    }
+    return add_section(writer, name, kind, file.data, file.size, 1, NULL, *key);
+}
+
+
+// Compiles the test case program and adds its serialized form; skipped when the plugin cannot serialize.
+static void add_executable_section(struct bundle_writer* writer, const PJRT_Api* api, PJRT_Client* client,
+                                   const char* name, const TestCase* test_case, uint64_t key) {
+    if (find_pending(writer, name) != NULL) return;
+    struct file_data program = {NULL, 0};
+    struct file_data compile_options = {NULL, 0};
+    PJRT_LoadedExecutable* executable = NULL;
+    if (read_file_to_buffer(test_case->hlo_path, &program) == 0 &&
+        read_file_to_buffer(test_case->compile_options_path, &compile_options) == 0) {
+        const char* format = test_case->format ? test_case->format : program_format_from_path(test_case->hlo_path);
+        executable = compile_program(api, client, &program, format, &compile_options);
+    }
+    free_file_data(&program);
+    free_file_data(&compile_options);
+    if (executable == NULL) return;
+
+    PJRT_LoadedExecutable_GetExecutable_Args get_exec_args = {0};
+    get_exec_args.struct_size = PJRT_LoadedExecutable_GetExecutable_Args_STRUCT_SIZE;
+    get_exec_args.loaded_executable = executable;
+    if (!handle_error(api->PJRT_LoadedExecutable_GetExecutable(&get_exec_args), api,
+                      "PJRT_LoadedExecutable_GetExecutable")) {
+        PJRT_Executable_Serialize_Args serialize_args = {0};
+        serialize_args.struct_size = PJRT_Executable_Serialize_Args_STRUCT_SIZE;
+        serialize_args.executable = get_exec_args.executable;
+        if (!handle_error(api->PJRT_Executable_Serialize(&serialize_args), api, "PJRT_Executable_Serialize")) {
+            void* copy = malloc(serialize_args.serialized_bytes_size ? serialize_args.serialized_bytes_size : 1);
+            if (copy != NULL) {
+                memcpy(copy, serialize_args.serialized_bytes, serialize_args.serialized_bytes_size);
+                add_section(writer, name, BUNDLE_KIND_EXECUTABLE, copy, serialize_args.serialized_bytes_size, 1,
+                            NULL, key);
+            }
+            serialize_args.serialized_executable_deleter(serialize_args.serialized_executable);
+        }
+        PJRT_Executable_Destroy_Args destroy_args = {0};
+        destroy_args.struct_size = PJRT_Executable_Destroy_Args_STRUCT_SIZE;
+        destroy_args.executable = get_exec_args.executable;
+        handle_error(api->PJRT_Executable_Destroy(&destroy_args), api, "PJRT_Executable_Destroy");
+    }
+    destroy_loaded_executable(api, executable);
+}
+
+
+// Section names of files start from their base names; sections of an open bundle keep theirs.
+static const char* section_name_of(const char* path) {
+    if (strncmp(path, BUNDLE_PATH_PREFIX, strlen(BUNDLE_PATH_PREFIX)) == 0) return path + strlen(BUNDLE_PATH_PREFIX);
+    const char* slash = strrchr(path, '/');
+    return slash != NULL ? slash + 1 : path;
+}
+
+
+static int add_test_case(struct bundle_writer* writer, const PJRT_Api* api, PJRT_Client* client,
+                         const TestCase* test_case) {
+    char manifest[8192];
+    size_t used = 0;
+    char name[BUNDLE_NAME_SIZE];
+    const char* format = test_case->format ? test_case->format : program_format_from_path(test_case->hlo_path);
+    char program[BUNDLE_NAME_SIZE], options[BUNDLE_NAME_SIZE], executable[BUNDLE_NAME_SIZE];
+    uint64_t program_key = 0, options_key = 0;
+
+    if (add_file_section(writer, program, section_name_of(test_case->hlo_path),
+                         strcmp(format, "mlir") == 0 ? BUNDLE_KIND_MLIR : BUNDLE_KIND_HLO, test_case->hlo_path,
+                         &program_key) != 0 ||
+        add_file_section(writer, options, section_name_of(test_case->compile_options_path),
+                         BUNDLE_KIND_COMPILE_OPTIONS, test_case->compile_options_path, &options_key) != 0) {
+        return 1;
+    }
+    uint64_t executable_key = fnv1a(fnv1a(program_key, &options_key, sizeof(options_key)), format, strlen(format));
+    if (pick_section_name(writer, executable, program, ".executable", executable_key) != 0) return 1;
+    add_executable_section(writer, api, client, executable, test_case, executable_key);
+
+    // Test and input sections live under the test name, tagged with its hash when it is too long.
+    char prefix[65];
+    if ((size_t)snprintf(prefix, sizeof(prefix), "%s", test_case->name) >= sizeof(prefix)) {
+        snprintf(prefix, sizeof(prefix), "%.47s~%016llx", test_case->name,
+                 (unsigned long long)content_key(test_case->name, strlen(test_case->name)));
+    }
+    snprintf(name, sizeof(name), "%s/test", prefix);
+    if (find_pending(writer, name) != NULL) {
+        fprintf(stderr, "The bundle already has a test case named '%s'\n", test_case->name);
+        return 1;
+    }
+    used += snprintf(manifest + used, sizeof(manifest) - used, "name %s\nprogram %s\noptions %s\n",
+                     test_case->name, program, options);
+    if (find_pending(writer, executable) != NULL) {
+        used += snprintf(manifest + used, sizeof(manifest) - used, "executable %s\n", executable);
+    }
+    for (size_t i = 0; i < test_case->num_inputs && used < sizeof(manifest); ++i) {
+        struct host_tensor tensor = {0};
+        tensor.type = test_case->input_types[i];
+        tensor.num_dims = test_case->input_num_dims[i];
+        tensor.size = buffer_type_size(tensor.type);
+        for (size_t d = 0; d < tensor.num_dims; ++d) {
+            tensor.dims[d] = test_case->input_dims[i][d];
+            tensor.size *= (size_t)tensor.dims[d];
+        }
+        snprintf(name, sizeof(name), "%s/input%zu", prefix, i);
+        if (add_section(writer, name, BUNDLE_KIND_TENSOR, test_case->input_data[i], tensor.size, 0, &tensor,
+                        content_key(test_case->input_data[i], tensor.size)) != 0) {
+            return 1;
+        }
+        used += snprintf(manifest + used, sizeof(manifest) - used, "input %s\n", name);
+    }
+    if (used >= sizeof(manifest)) return 1;
+    char* text = strdup(manifest);
+    snprintf(name, sizeof(name), "%s/test", prefix);
+    return text == NULL ||
+           add_section(writer, name, BUNDLE_KIND_TEST, text, used, 1, NULL, content_key(text, used)) != 0;
+}
+
+
+static int write_padding(FILE* file, uint64_t offset) {
+    static const uint8_t zeros[BUNDLE_ALIGNMENT];
+    uint64_t padding = (BUNDLE_ALIGNMENT - offset % BUNDLE_ALIGNMENT) % BUNDLE_ALIGNMENT;
+    return fwrite(zeros, 1, padding, file) != padding;
+}
+
+
+// --- Function to write the test cases into a bundle ---
+// `compression_level` > 0 zstd-compresses every section that shrinks.
+int bundle_create(const PJRT_Api* api, PJRT_Client* client, const char* path, const TestCase* const* tests,
+                  size_t num_tests, int compression_level) {
+    struct bundle_writer* writer = (struct bundle_writer*)calloc(1, sizeof(*writer));
+    if (writer == NULL) return 1;
+    writer->compression_level = compression_level;
+    int rc = 0;
+    for (size_t t = 0; t < num_tests && rc == 0; ++t) {
+        rc = add_test_case(writer, api, client, tests[t]);
+        if (rc != 0) fprintf(stderr, "Failed to add test case '%s' to the bundle\n", tests[t]->name);
+    }
+
+    // Lay the sections out after the index, each on its own page.
+    struct bundle_header header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, BUNDLE_MAGIC, sizeof(header.magic));
+    header.version = BUNDLE_VERSION;
+    header.num_sections = (uint32_t)writer->num_sections;
+    uint64_t offset = sizeof(header) + writer->num_sections * sizeof(struct bundle_entry);
+    for (size_t i = 0; i < writer->num_sections; ++i) {
+        offset = (offset + BUNDLE_ALIGNMENT - 1) / BUNDLE_ALIGNMENT * BUNDLE_ALIGNMENT;
+        writer->sections[i].entry.offset = offset;
+        offset += writer->sections[i].entry.stored_size;
+    }
+    header.file_size = offset;
+
+    FILE* file = rc == 0 ? fopen(path, "wb") : NULL;
+    if (rc == 0 && file == NULL) {
+        fprintf(stderr, "Error creating '%s': %s\n", path, strerror(errno));
+        rc = 1;
+    }
+    if (file != NULL) {
+        rc = fwrite(&header, sizeof(header), 1, file) != 1;
+        for (size_t i = 0; i < writer->num_sections && rc == 0; ++i) {
+            rc = fwrite(&writer->sections[i].entry, sizeof(struct bundle_entry), 1, file) != 1;
+        }
+        offset = sizeof(header) + writer->num_sections * sizeof(struct bundle_entry);
+        for (size_t i = 0; i < writer->num_sections && rc == 0; ++i) {
+            const struct pending_section* section = &writer->sections[i];
+            rc = write_padding(file, offset) ||
+                 fwrite(section->data, 1, section->entry.stored_size, file) != section->entry.stored_size;
+            offset = section->entry.offset + section->entry.stored_size;
+        }
+        rc |= fclose(file) != 0;
+        if (rc != 0) fprintf(stderr, "Error writing '%s'\n", path);
+    }
+
+    if (rc == 0) {
+        uint64_t stored = 0, size = 0;
+        printf("Wrote %s: %zu test case(s), %zu section(s)\n", path, num_tests, writer->num_sections);
+        printf("  %-48s %-6s %12s %12s\n", "section", "codec", "bytes", "stored");
+        for (size_t i = 0; i < writer->num_sections; ++i) {
+            const struct bundle_entry* entry = &writer->sections[i].entry;
+            printf("  %-48s %-6s %12llu %12llu\n", entry->name, entry->compression == BUNDLE_ZSTD ? "zstd" : "-",
+                   (unsigned long long)entry->size, (unsigned long long)entry->stored_size);
+            stored += entry->stored_size;
+            size += entry->size;
+        }
+        printf("  %-48s %-6s %12llu %12llu (file %llu)\n", "total", "", (unsigned long long)size,
+               (unsigned long long)stored, (unsigned long long)header.file_size);
+    }
+    for (size_t i = 0; i < writer->num_sections; ++i) {
+        if (writer->sections[i].owned) free((void*)writer->sections[i].data);
+    }
+    free(writer);
+    return rc;
+}
+
+
+// --- Reading ---
+
+// --- Function to map a bundle and check its index; sections are read on demand ---
+int bundle_open(const char* path) {
+    bundle_close();
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        fprintf(stderr, "Error opening bundle '%s': %s\n", path, strerror(errno));
+        return 1;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(struct bundle_header)) {
+        fprintf(stderr, "'%s' is too small for a bundle\n", path);
+        close(fd);
+        return 1;
+    }
+    void* map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        fprintf(stderr, "Error mapping bundle '%s': %s\n", path, strerror(errno));
+        return 1;
+    }
+    bundle.map = (const uint8_t*)map;
+    bundle.size = (size_t)st.st_size;
+
+    const struct bundle_header* header = (const struct bundle_header*)bundle.map;
+    size_t index_end = sizeof(*header) + (size_t)header->num_sections * sizeof(struct bundle_entry);
+    if (memcmp(header->magic, BUNDLE_MAGIC, sizeof(header->magic)) != 0 || header->version != BUNDLE_VERSION ||
+        header->num_sections > BUNDLE_MAX_SECTIONS || index_end > bundle.size || header->file_size != bundle.size) {
+        fprintf(stderr, "'%s' is not a version %d bundle or is truncated\n", path, BUNDLE_VERSION);
+        bundle_close();
+        return 1;
+    }
+    bundle.entries = (const struct bundle_entry*)(bundle.map + sizeof(*header));
+    bundle.num_sections = header->num_sections;
+    for (uint32_t i = 0; i < bundle.num_sections; ++i) {
+        const struct bundle_entry* entry = &bundle.entries[i];
+        if (entry->offset % BUNDLE_ALIGNMENT != 0 || entry->offset > bundle.size ||
+            entry->stored_size > bundle.size - entry->offset || memchr(entry->name, '\0', BUNDLE_NAME_SIZE) == NULL ||
+            (entry->compression == BUNDLE_STORED && entry->stored_size != entry->size) ||
+            entry->compression > BUNDLE_ZSTD || entry->tensor_num_dims > HOST_TENSOR_MAX_DIMS) {
+            fprintf(stderr, "Bundle '%s' has a bad index entry %u\n", path, i);
+            bundle_close();
+            return 1;
+        }
+    }
+    bundle.touched = (unsigned char*)calloc(bundle.num_sections ? bundle.num_sections : 1, 1);
+    if (bundle.touched == NULL) {
+        bundle_close();
+        return 1;
+    }
+    printf("Mapped bundle %s (%zu bytes, %u sections)\n", path, bundle.size, bundle.num_sections);
+    return 0;
+}
+
+
+static const struct bundle_entry* find_entry(const char* name) {
+    for (uint32_t i = 0; i < bundle.num_sections; ++i) {
+        if (strcmp(bundle.entries[i].name, name) == 0) return &bundle.entries[i];
+    }
+    return NULL;
+}
+
+
+// --- Function to read a section of the open bundle ---
+// Stored sections point into the mapping, which free_file_data leaves alone; compressed ones are decompressed.
+int bundle_read_section(const char* name, struct file_data* file_data) {
+    const struct bundle_entry* entry = bundle.map != NULL ? find_entry(name) : NULL;
+    if (entry == NULL) {
+        fprintf(stderr, "No section '%s' in the bundle\n", name);
+        return 1;
+    }
+    bundle.touched[entry - bundle.entries] = 1;
+    const uint8_t* stored = bundle.map + entry->offset;
+    if (entry->compression == BUNDLE_STORED) {
+        file_data->data = (void*)stored;
+        file_data->size = entry->size;
+        return 0;
+    }
+    if (zstd_load() != 0) return 1;
+    void* data = malloc(entry->size ? entry->size : 1);
+    if (data == NULL) {
+        fprintf(stderr, "Error allocating %llu bytes for section '%s'\n", (unsigned long long)entry->size, name);
+        return 1;
+    }
+    size_t size = zstd.decompress(data, entry->size, stored, entry->stored_size);
+    if (zstd.is_error(size) || size != entry->size) {
+        fprintf(stderr, "Error decompressing section '%s': %s\n", name,
+                zstd.is_error(size) ? zstd.error_name(size) : "size mismatch");
+        free(data);
+        return 1;
+    }
+    file_data->data = data;
+    file_data->size = size;
+    return 0;
+}
+
+
+// --- Function to tell whether data points into the open bundle ---
+int bundle_contains(const void* data) {
+    return bundle.map != NULL && (const uint8_t*)data >= bundle.map && (const uint8_t*)data < bundle.map + bundle.size;
+}
+
+
+static void free_bundle_case(struct bundle_case* c) {
+    for (size_t i = 0; i < c->num_inputs; ++i) free_file_data(&c->input_files[i]);
+    for (int i = 0; i < 3; ++i) free(c->paths[i]);
+    free(c);
+}
+
+
+static char* bundle_path(const char* section) {
+    size_t size = strlen(BUNDLE_PATH_PREFIX) + strlen(section) + 1;
+    char* path = (char*)malloc(size);
+    if (path != NULL) snprintf(path, size, "%s%s", BUNDLE_PATH_PREFIX, section);
+    return path;
+}
+
+
+// Builds a test case from a manifest; only the input tensors are touched here.
+static struct bundle_case* load_bundle_case(const struct file_data* manifest) {
+    struct bundle_case* c = (struct bundle_case*)calloc(1, sizeof(*c));
+    if (c == NULL) return NULL;
+    TestCase* t = &c->test_case;
+    const char* text = (const char*)manifest->data;
+    const char* end = text + manifest->size;
+    int rc = 0;
+    while (text < end && rc == 0) {
+        const char* newline = memchr(text, '\n', (size_t)(end - text));
+        size_t length = newline != NULL ? (size_t)(newline - text) : (size_t)(end - text);
+        const char* space = memchr(text, ' ', length);
+        char value[BUNDLE_NAME_SIZE];
+        if (space != NULL && length - (size_t)(space + 1 - text) < sizeof(value)) {
+            size_t key_length = (size_t)(space - text);
+            snprintf(value, sizeof(value), "%.*s", (int)(length - key_length - 1), space + 1);
+            const struct bundle_entry* entry = key_length == 4 && memcmp(text, "name", 4) == 0 ? NULL
+                                                                                            : find_entry(value);
+            if (key_length == 4 && memcmp(text, "name", 4) == 0) {
+                snprintf(c->name, sizeof(c->name), "%s", value);
+            } else if (entry == NULL) {
+                fprintf(stderr, "Bundle test case refers to a missing section '%s'\n", value);
+                rc = 1;
+            } else if (key_length == 7 && memcmp(text, "program", 7) == 0) {
+                c->paths[0] = bundle_path(value);
+                t->format = entry->kind == BUNDLE_KIND_MLIR ? "mlir" : "hlo";
+                rc = c->paths[0] == NULL;
+            } else if (key_length == 7 && memcmp(text, "options", 7) == 0) {
+                c->paths[1] = bundle_path(value);
+                rc = c->paths[1] == NULL;
+            } else if (key_length == 10 && memcmp(text, "executable", 10) == 0) {
+                c->paths[2] = bundle_path(value);
+                rc = c->paths[2] == NULL;
+            } else if (key_length == 5 && memcmp(text, "input", 5) == 0) {
+                size_t i = c->num_inputs;
+                if (i == BUNDLE_MAX_INPUTS || entry->kind != BUNDLE_KIND_TENSOR ||
+                    bundle_read_section(value, &c->input_files[i]) != 0) {
+                    rc = 1;
+                    break;
+                }
+                c->num_inputs++;
+                c->input_data[i] = c->input_files[i].data;
+                memcpy(c->dims[i], entry->tensor_dims, sizeof(c->dims[i]));
+                c->input_dims[i] = c->dims[i];
+                c->input_num_dims[i] = entry->tensor_num_dims;
+                c->input_types[i] = (PJRT_Buffer_Type)entry->tensor_type;
+            }
+        }
+        text += length + 1;
+    }
+    if (rc != 0 || c->paths[0] == NULL || c->paths[1] == NULL) {
+        free_bundle_case(c);
+        return NULL;
+    }
+    t->name = c->name;
+    t->hlo_path = c->paths[0];
+    t->compile_options_path = c->paths[1];
+    t->executable_path = c->paths[2];
+    t->num_inputs = c->num_inputs;
+    t->input_data = c->input_data;
+    t->input_dims = c->input_dims;
+    t->input_num_dims = c->input_num_dims;
+    t->input_types = c->input_types;
+    return c;
+}
+
+
+// --- Function to build the test cases of the open bundle ---
+// They stay valid until bundle_close; free the returned array with free().
+int bundle_load_tests(const TestCase*** tests_ptr, size_t* num_tests_ptr) {
+    const TestCase** tests = (const TestCase**)calloc(BUNDLE_MAX_TESTS, sizeof(*tests));
+    size_t num_tests = 0;
+    if (tests == NULL) return 1;
+    for (uint32_t i = 0; i < bundle.num_sections && num_tests < BUNDLE_MAX_TESTS; ++i) {
+        if (bundle.entries[i].kind != BUNDLE_KIND_TEST) continue;
+        struct file_data manifest = {NULL, 0};
+        if (bundle_read_section(bundle.entries[i].name, &manifest) != 0) continue;
+        struct bundle_case* c = load_bundle_case(&manifest);
+        free_file_data(&manifest);
+        if (c != NULL) tests[num_tests++] = &c->test_case;
+    }
+    *tests_ptr = tests;
+    *num_tests_ptr = num_tests;
+    printf("Loaded %zu test case(s) from the bundle\n", num_tests);
+    return 0;
+}
+
+
+void bundle_free_tests(const TestCase** tests, size_t num_tests) {
+    for (size_t i = 0; i < num_tests; ++i) free_bundle_case((struct bundle_case*)tests[i]);
+    free(tests);
+}
+
+
+// --- Function to unmap the bundle, reporting how much of it was read ---
+void bundle_close(void) {
+    if (bundle.map == NULL) return;
+    if (bundle.touched != NULL) {
+        uint32_t touched = 0;
+        uint64_t touched_bytes = 0;
+        for (uint32_t i = 0; i < bundle.num_sections; ++i) {
+            if (!bundle.touched[i]) continue;
+            touched++;
+            touched_bytes += bundle.entries[i].stored_size;
+        }
+        printf("Bundle: read %u of %u section(s), %llu of %zu bytes\n", touched, bundle.num_sections,
+               (unsigned long long)touched_bytes, bundle.size);
+    }
+    munmap((void*)bundle.map, bundle.size);
+    free(bundle.touched);
+    memset(&bundle, 0, sizeof(bundle));
+}
@@ -0,0 +1,420 @@
+// Client creation options.
+//
+// Options are given as NAME=VALUE strings, on the command line or one per
+// line in a file, and passed to PJRT_Client_Create as PJRT_NamedValues. The
+// value type is inferred: true/false is a bool, an integer an int64, a
+// comma-separated list of integers an int64 list, another number a float and
+// anything else a string. Which names are accepted is up to the plugin; the
+// CPU plugin knows "cpu_device_count", for example.
+//
+// The sweep creates a client for every combination of swept values and
+// reports, per combination, the number of devices, single-request latency
+// and closed-loop throughput with several requests in flight. The program is
+// compiled with one replica per device in use and every device gets its own
+// input set; worker w runs on device w % devices, so the throughput scales
+// with the device count as far as the host allows.
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "hlo_test.h"
+
+#define CLIENT_SWEEP_MAX_VALUES 16
+#define CLIENT_SWEEP_MAX_WORKERS 64
+#define COMPILE_OPTIONS_BUILD_OPTIONS_FIELD 3 // CompileOptionsProto.executable_build_options
+#define BUILD_OPTIONS_NUM_REPLICAS_FIELD 4 // ExecutableBuildOptionsProto.num_replicas
+
+
+static void clear_value(PJRT_NamedValue* value, char** spec) {
+    free(*spec);
+    *spec = NULL;
+    if (value->type == PJRT_NamedValue_kString) free((void*)value->string_value);
+    if (value->type == PJRT_NamedValue_kInt64List) free((void*)value->int64_array_value);
+    memset(value, 0, sizeof(*value));
+}
+
+
+static int parse_int64(const char* text, int64_t* value) {
+    char* end = NULL;
+    errno = 0;
+    long long parsed = strtoll(text, &end, 0);
+    if (end == text || *end != '\0' || errno != 0) return 1;
+    *value = parsed;
+    return 0;
+}
+
+
+static int parse_float(const char* text, float* value) {
+    char* end = NULL;
+    float parsed = strtof(text, &end);
+    if (end == text || *end != '\0') return 1;
+    *value = parsed;
+    return 0;
+}
+
+
+// --- Function to set one option from NAME=VALUE, replacing an earlier value of NAME ---
+int client_options_set(struct client_options* options, const char* spec) {
+    const char* equals = strchr(spec, '=');
+    if (equals == NULL || equals == spec) {
+        fprintf(stderr, "Client option '%s' is not NAME=VALUE\n", spec);
+        return 1;
+    }
+    size_t name_size = (size_t)(equals - spec);
+    size_t index = 0;
+    while (index < options->count &&
+           !(options->values[index].name_size == name_size && strncmp(options->specs[index], spec, name_size) == 0)) {
+        ++index;
+    }
+    if (index == CLIENT_OPTIONS_MAX) {
+        fprintf(stderr, "Too many client options (at most %d)\n", CLIENT_OPTIONS_MAX);
+        return 1;
+    }
+    if (index < options->count) clear_value(&options->values[index], &options->specs[index]);
+
+    char* copy = strdup(spec);
+    if (copy == NULL) return 1;
+    const char* text = copy + name_size + 1;
+    PJRT_NamedValue* value = &options->values[index];
+    value->struct_size = PJRT_NamedValue_STRUCT_SIZE;
+    value->name = copy; // NAME is the prefix of the stored spec
+    value->name_size = name_size;
+    value->value_size = 1;
+    int64_t number;
+    float real;
+    if (strcmp(text, "true") == 0 || strcmp(text, "false") == 0) {
+        value->type = PJRT_NamedValue_kBool;
+        value->bool_value = text[0] == 't';
+    } else if (parse_int64(text, &number) == 0) {
+        value->type = PJRT_NamedValue_kInt64;
+        value->int64_value = number;
+    } else if (strchr(text, ',') != NULL && strspn(text, "0123456789-, ") == strlen(text)) {
+        size_t count = 1;
+        for (const char* c = text; *c; ++c) count += *c == ',';
+        int64_t* list = (int64_t*)calloc(count, sizeof(int64_t));
+        if (list == NULL) {
+            free(copy);
+            return 1;
+        }
+        const char* item = text;
+        for (size_t i = 0; i < count; ++i) {
+            char* end = NULL;
+            list[i] = strtoll(item, &end, 0);
+            item = end + (*end == ',');
+        }
+        value->type = PJRT_NamedValue_kInt64List;
+        value->int64_array_value = list;
+        value->value_size = count;
+    } else if (parse_float(text, &real) == 0) {
+        value->type = PJRT_NamedValue_kFloat;
+        value->float_value = real;
+    } else {
+        char* string = strdup(text);
+        if (string == NULL) {
+            free(copy);
+            return 1;
+        }
+        value->type = PJRT_NamedValue_kString;
+        value->string_value = string;
+        value->value_size = strlen(string);
+    }
+    options->specs[index] = copy;
+    if (index == options->count) options->count++;
+    return 0;
+}
+
+
+// --- Function to read NAME=VALUE lines from a file; '#' starts a comment ---
+int client_options_load(struct client_options* options, const char* path) {
+    FILE* file = fopen(path, "r");
+    if (file == NULL) {
+        fprintf(stderr, "Error opening client options '%s'\n", path);
+        return 1;
+    }
+    char line[1024];
+    int rc = 0;
+    while (rc == 0 && fgets(line, sizeof(line), file) != NULL) {
+        char* hash = strchr(line, '#');
+        if (hash != NULL) *hash = '\0';
+        char* start = line + strspn(line, " \t");
+        size_t length = strlen(start);
+        while (length > 0 && strchr(" \t\r\n", start[length - 1]) != NULL) start[--length] = '\0';
+        if (length > 0) rc = client_options_set(options, start);
+    }
+    fclose(file);
+    return rc;
+}
+
+
+int client_options_copy(struct client_options* dst, const struct client_options* src) {
+    memset(dst, 0, sizeof(*dst));
+    for (size_t i = 0; i < src->count; ++i) {
+        if (client_options_set(dst, src->specs[i]) != 0) return 1;
+    }
+    return 0;
+}
+
+
+void client_options_free(struct client_options* options) {
+    for (size_t i = 0; i < options->count; ++i) clear_value(&options->values[i], &options->specs[i]);
+    options->count = 0;
+}
+
+
+// --- Function to describe options as "a=1 b=true", or "(defaults)" ---
+void client_options_describe(const struct client_options* options, char* out, size_t size) {
+    size_t used = 0;
+    out[0] = '\0';
+    for (size_t i = 0; i < options->count && used < size; ++i) {
+        used += snprintf(out + used, size - used, "%s%s", i ? " " : "", options->specs[i]);
+    }
+    if (options->count == 0) snprintf(out, size, "(defaults)");
+}
+
+
+struct closed_loop {
+    const PJRT_Api* api;
+    PJRT_LoadedExecutable* executable;
+    PJRT_Device* devices[CLIENT_SWEEP_MAX_WORKERS]; // NULL runs on the compiled device
+    PJRT_Buffer** inputs[CLIENT_SWEEP_MAX_WORKERS]; // One input set per device
+    size_t num_devices;
+    size_t num_inputs;
+    int iterations;
+    int rc;
+};
+
+struct closed_loop_worker_arg {
+    struct closed_loop* loop;
+    size_t device; // Index into the loop's devices and input sets
+};
+
+
+static void* closed_loop_worker(void* arg) {
+    const struct closed_loop_worker_arg* worker = (const struct closed_loop_worker_arg*)arg;
+    struct closed_loop* loop = worker->loop;
+    int rc = 0;
+    for (int i = 0; i < loop->iterations && rc == 0; ++i) {
+        PJRT_Buffer** outputs = NULL;
+        size_t num_outputs = 0;
+        rc = execute_hlo_program_on_device(loop->api, loop->executable, loop->inputs[worker->device],
+                                           loop->num_inputs, NULL, loop->devices[worker->device], &outputs,
+                                           &num_outputs) ||
+             await_buffers_ready(loop->api, outputs, num_outputs);
+        destroy_buffers(loop->api, outputs, num_outputs, "PJRT_Buffer_Destroy (sweep output)");
+    }
+    if (rc != 0) __atomic_store_n(&loop->rc, 1, __ATOMIC_RELAXED);
+    return NULL;
+}
+
+
+// --- Serialize compile options for `replicas` independent replicas ---
+// The default device assignment puts replica k on device k, so a worker can run its replica alone by passing
+// that device to Execute. The test programs have no collectives, so replicas do not wait for each other.
+static int build_replicated_options(const struct file_data* base, size_t replicas, struct proto_buf* out) {
+    struct proto_buf build_options = {0};
+    int rc = proto_append(out, base->data, base->size) ||
+             proto_put_varint_field(&build_options, BUILD_OPTIONS_NUM_REPLICAS_FIELD, replicas) ||
+             proto_put_bytes_field(out, COMPILE_OPTIONS_BUILD_OPTIONS_FIELD, build_options.data, build_options.size);
+    proto_buf_free(&build_options);
+    return rc;
+}
+
+
+// --- Function to measure one option combination ---
+// Worker w runs on addressable device w % devices with an input set of its own on that device.
+// Returns 1 when the plugin rejects the options; the row is still printed.
+static int measure_combination(const PJRT_Api* api, const struct client_options* options,
+                               const TestCase* test_case, const struct file_data* program,
+                               const struct file_data* compile_options, int iterations, int workers,
+                               double* throughput) {
+    char description[512];
+    client_options_describe(options, description, sizeof(description));
+    PJRT_Client* client = create_client(api, options);
+    if (client == NULL) {
+        printf("  %-48s %8s %12s %14s %14s\n", description, "-", "rejected", "-", "-");
+        return 1;
+    }
+    struct closed_loop loop;
+    memset(&loop, 0, sizeof(loop));
+    loop.api = api;
+    loop.num_inputs = test_case->num_inputs;
+    loop.iterations = iterations;
+    struct proto_buf replicated = {0};
+    double* samples = NULL;
+    int rc = 1;
+    PJRT_Client_AddressableDevices_Args devices_args = {0};
+    devices_args.struct_size = PJRT_Client_AddressableDevices_Args_STRUCT_SIZE;
+    devices_args.client = client;
+    if (handle_error(api->PJRT_Client_AddressableDevices(&devices_args), api, "PJRT_Client_AddressableDevices") ||
+        devices_args.num_addressable_devices == 0) {
+        goto cleanup_combination;
+    }
+    if (workers > CLIENT_SWEEP_MAX_WORKERS) workers = CLIENT_SWEEP_MAX_WORKERS;
+    if (workers < 1) workers = 1;
+    loop.num_devices = devices_args.num_addressable_devices < (size_t)workers ? devices_args.num_addressable_devices
+                                                                             : (size_t)workers;
+
+    const char* format = test_case->format ? test_case->format : program_format_from_path(test_case->hlo_path);
+    struct file_data options_data = *compile_options;
+    if (loop.num_devices > 1) {
+        if (build_replicated_options(compile_options, loop.num_devices, &replicated) != 0) goto cleanup_combination;
+        options_data.data = replicated.data;
+        options_data.size = replicated.size;
+    }
+    loop.executable = compile_program(api, client, program, format, &options_data);
+    if (loop.executable == NULL) goto cleanup_combination;
+    for (size_t d = 0; d < loop.num_devices; ++d) {
+        loop.devices[d] = loop.num_devices > 1 ? devices_args.addressable_devices[d] : NULL;
+        loop.inputs[d] = create_input_buffers(api, client, devices_args.addressable_devices[d], test_case);
+        if (loop.inputs[d] == NULL) goto cleanup_combination;
+    }
+
+    // Single-request latency on the first device, after one warm-up run.
+    samples = (double*)calloc(iterations, sizeof(double));
+    if (samples == NULL) goto cleanup_combination;
+    for (int i = -1; i < iterations; ++i) {
+        PJRT_Buffer** outputs = NULL;
+        size_t num_outputs = 0;
+        double start = now_seconds();
+        int run_rc = execute_hlo_program_on_device(api, loop.executable, loop.inputs[0], loop.num_inputs, NULL,
+                                                   loop.devices[0], &outputs, &num_outputs) ||
+                     await_buffers_ready(api, outputs, num_outputs);
+        if (i >= 0) samples[i] = now_seconds() - start;
+        destroy_buffers(api, outputs, num_outputs, "PJRT_Buffer_Destroy (sweep output)");
+        if (run_rc != 0) goto cleanup_combination;
+    }
+    double median_s = median_of(samples, iterations);
+
+    struct closed_loop_worker_arg args[CLIENT_SWEEP_MAX_WORKERS];
+    pthread_t threads[CLIENT_SWEEP_MAX_WORKERS];
+    int started = 0;
+    double start = now_seconds();
+    for (; started < workers; ++started) {
+        args[started].loop = &loop;
+        args[started].device = (size_t)started % loop.num_devices;
+        if (pthread_create(&threads[started], NULL, closed_loop_worker, &args[started]) != 0) break;
+    }
+    for (int t = 0; t < started; ++t) pthread_join(threads[t], NULL);
+    double elapsed = now_seconds() - start;
+    if (started == 0 || loop.rc != 0) goto cleanup_combination;
+    *throughput = (double)started * iterations / elapsed;
+    size_t busy_devices = (size_t)started < loop.num_devices ? (size_t)started : loop.num_devices;
+    printf("  %-48s %8zu %12.4f %14.1f %14.1f\n", description, devices_args.num_addressable_devices,
+           median_s * 1e3, *throughput, *throughput / busy_devices);
+    rc = 0;
+
+cleanup_combination:
+    if (rc != 0) printf("  %-48s %8s %12s %14s %14s\n", description, "-", "failed", "-", "-");
+    free(samples);
+    for (size_t d = 0; d < loop.num_devices; ++d) {
+        destroy_buffers(api, loop.inputs[d], test_case->num_inputs, "PJRT_Buffer_Destroy (sweep input)");
+    }
+    if (loop.executable != NULL) destroy_loaded_executable(api, loop.executable);
+    proto_buf_free(&replicated);
+    destroy_client(api, client);
+    return rc;
+}
+
+
+// --- Function to benchmark a test case under every combination of swept client options ---
+// Each sweep is NAME=V1|V2|...; without sweeps cpu_device_count goes through
+// powers of two up to the number of online CPUs. `base` applies to every run.
+int run_client_option_sweep(const PJRT_Api* api, const struct client_options* base, const char* const* sweeps,
+                            size_t num_sweeps, const TestCase* test_case, int iterations, int workers) {
+    char default_sweep[256];
+    const char* default_sweeps[1] = {default_sweep};
+    if (num_sweeps == 0) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        size_t used = snprintf(default_sweep, sizeof(default_sweep), "cpu_device_count=1");
+        for (long n = 2; n < cpus && used < sizeof(default_sweep); n *= 2) {
+            used += snprintf(default_sweep + used, sizeof(default_sweep) - used, "|%ld", n);
+        }
+        if (cpus > 1 && used < sizeof(default_sweep)) {
+            snprintf(default_sweep + used, sizeof(default_sweep) - used, "|%ld", cpus);
+        }
+        sweeps = default_sweeps;
+        num_sweeps = 1;
+    }
+
+    // Split every sweep into its name and values, in place in a copy.
+    char* names[CLIENT_OPTIONS_MAX];
+    char* values[CLIENT_OPTIONS_MAX][CLIENT_SWEEP_MAX_VALUES];
+    size_t num_values[CLIENT_OPTIONS_MAX];
+    char* copies[CLIENT_OPTIONS_MAX] = {NULL};
+    struct file_data program = {NULL, 0};
+    struct file_data compile_options = {NULL, 0};
+    int rc = 1;
+    if (num_sweeps > CLIENT_OPTIONS_MAX) num_sweeps = CLIENT_OPTIONS_MAX;
+    size_t num_combinations = 1;
+    for (size_t s = 0; s < num_sweeps; ++s) {
+        copies[s] = strdup(sweeps[s]);
+        char* equals = copies[s] ? strchr(copies[s], '=') : NULL;
+        if (equals == NULL) {
+            fprintf(stderr, "Sweep '%s' is not NAME=V1|V2|...\n", sweeps[s]);
+            goto cleanup_sweep;
+        }
+        *equals = '\0';
+        names[s] = copies[s];
+        num_values[s] = 0;
+        for (char* v = strtok(equals + 1, "|"); v != NULL && num_values[s] < CLIENT_SWEEP_MAX_VALUES;
+             v = strtok(NULL, "|")) {
+            values[s][num_values[s]++] = v;
+        }
+        if (num_values[s] == 0) {
+            fprintf(stderr, "Sweep '%s' has no values\n", sweeps[s]);
+            goto cleanup_sweep;
+        }
+        num_combinations *= num_values[s];
+    }
+
+    printf("\n--- Client option sweep: %s (%zu combinations, %d workers) ---\n", test_case->name,
+           num_combinations, workers);
+    if (read_file_to_buffer(test_case->hlo_path, &program) != 0 ||
+        read_file_to_buffer(test_case->compile_options_path, &compile_options) != 0) {
+        goto cleanup_sweep;
+    }
+    printf("  %-48s %8s %12s %14s %14s\n", "options", "devices", "median(ms)", "throughput(/s)", "per device(/s)");
+    double best = 0.0;
+    size_t best_combination = 0;
+    for (size_t combination = 0; combination < num_combinations; ++combination) {
+        struct client_options options;
+        if (client_options_copy(&options, base) != 0) goto cleanup_sweep;
+        size_t rest = combination;
+        for (size_t s = 0; s < num_sweeps; ++s) {
+            char spec[512];
+            snprintf(spec, sizeof(spec), "%s=%s", names[s], values[s][rest % num_values[s]]);
+            rest /= num_values[s];
+            if (client_options_set(&options, spec) != 0) {
+                client_options_free(&options);
+                goto cleanup_sweep;
+            }
+        }
+        double throughput = 0.0;
+        if (measure_combination(api, &options, test_case, &program, &compile_options, iterations, workers,
+                                &throughput) == 0 && throughput > best) {
+            best = throughput;
+            best_combination = combination;
+        }
+        client_options_free(&options);
+    }
+    if (best > 0.0) {
+        printf("Highest throughput with");
+        size_t rest = best_combination;
+        for (size_t s = 0; s < num_sweeps; ++s) {
+            printf(" %s=%s", names[s], values[s][rest % num_values[s]]);
+            rest /= num_values[s];
+        }
+        printf(": %.1f req/s\n", best);
+        rc = 0;
+    } else {
+        fprintf(stderr, "No option combination could run %s.\n", test_case->name);
+    }
+
+cleanup_sweep:
+    for (size_t s = 0; s < num_sweeps; ++s) free(copies[s]);
+    free_file_data(&program);
+    free_file_data(&compile_options);
+    return rc;
+}
@@ -0,0 +1,796 @@
+// Host-side dtype conversion on upload and download.
+//
+// F32 host data is converted to BF16, F16 or S8 before BufferFromHostBuffer,
+// and device buffers of those types are widened back to F32 after the copy to
+// the host. Every conversion has a scalar reference kernel, an AVX2 kernel
+// (F16C for the half-precision instructions) and an AVX-512 kernel, picked at
+// run time; tensors of at least CONVERT_MIN_BYTES_PER_THREAD per thread are
+// split over up to one thread per CPU. All kernels produce the same bits:
+//
+//   BF16  round to nearest even, NaN stays a quiet NaN
+//   F16   round to nearest even with subnormals, overflow to infinity
+//   S8    symmetric quantization q = round_even(clamp(x / scale, -128, 127)),
+//         read back as q * scale; NaN becomes 127
+//
+// The benchmark compares the kernels with each other, and host conversion
+// around a narrow upload or download with uploading F32 and letting XLA do
+// the convert inside the computation.
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HAVE_X86_KERNELS 1
+#endif
+
+#include "hlo_test.h"
+
+#define CONVERT_MIN_BYTES_PER_THREAD (1 << 20) // Of F32 data
+#define CONVERT_MAX_THREADS 64
+#define CONVERT_PROGRAM_TEXT_SIZE 2048
+
+// Converts `count` elements; `scale` is only used by S8.
+typedef void (*convert_from_f32_fn)(const float* src, void* dst, size_t count, float scale);
+typedef void (*convert_to_f32_fn)(const void* src, float* dst, size_t count, float scale);
+
+struct convert_kernels {
+    convert_from_f32_fn from_f32;
+    convert_to_f32_fn to_f32;
+};
+
+enum convert_target {
+    CONVERT_BF16,
+    CONVERT_F16,
+    CONVERT_S8,
+    NUM_CONVERT_TARGETS
+};
+
+struct convert_impl {
+    const char* name;
+    struct convert_kernels kernels[NUM_CONVERT_TARGETS];
+};
+
+
+// --- Scalar reference kernels ---
+static uint16_t float_to_bf16(float value) {
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    if ((bits & 0x7fffffff) > 0x7f800000) return (uint16_t)((bits >> 16) | 0x40); // Quiet NaN
+    bits += 0x7fff + ((bits >> 16) & 1);
+    return (uint16_t)(bits >> 16);
+}
+
+static float bf16_to_float(uint16_t value) {
+    uint32_t bits = (uint32_t)value << 16;
+    float result;
+    memcpy(&result, &bits, sizeof(result));
+    return result;
+}
+
+static uint16_t float_to_f16(float value) {
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    uint16_t sign = (uint16_t)((bits >> 16) & 0x8000);
+    uint32_t exponent = (bits >> 23) & 0xff;
+    uint32_t mantissa = bits & 0x7fffff;
+    if (exponent == 0xff) { // Infinity, or NaN made quiet as F16C does
+        return sign | 0x7c00 | (mantissa ? 0x200 | (mantissa >> 13) : 0);
+    }
+    if (exponent >= 143) return sign | 0x7c00; // 2^16 and up overflow
+    if (exponent >= 113) { // Normal, the rounding carry may reach infinity
+        uint32_t half = ((exponent - 112) << 10) | (mantissa >> 13);
+        uint32_t rest = mantissa & 0x1fff;
+        if (rest > 0x1000 || (rest == 0x1000 && (half & 1))) half++;
+        return sign | (uint16_t)half;
+    }
+    if (exponent < 102) return sign; // Below half the smallest subnormal
+    uint32_t significand = mantissa | 0x800000;
+    uint32_t shift = 126 - exponent; // 14..24
+    uint32_t half = significand >> shift;
+    uint32_t rest = significand & ((1u << shift) - 1);
+    uint32_t halfway = 1u << (shift - 1);
+    if (rest > halfway || (rest == halfway && (half & 1))) half++;
+    return sign | (uint16_t)half;
+}
+
+static float f16_to_float(uint16_t value) {
+    uint32_t sign = (uint32_t)(value & 0x8000) << 16;
+    uint32_t exponent = (value >> 10) & 0x1f;
+    uint32_t mantissa = value & 0x3ff;
+    uint32_t bits;
+    if (exponent == 0x1f) {
+        bits = sign | 0x7f800000 | (mantissa << 13);
+    } else if (exponent != 0) {
+        bits = sign | ((exponent + 112) << 23) | (mantissa << 13);
+    } else if (mantissa == 0) {
+        bits = sign;
+    } else { // Subnormal: normalize
+        exponent = 113;
+        while (!(mantissa & 0x400)) {
+            mantissa <<= 1;
+            exponent--;
+        }
+        bits = sign | (exponent << 23) | ((mantissa & 0x3ff) << 13);
+    }
+    float result;
+    memcpy(&result, &bits, sizeof(result));
+    return result;
+}
+
+static int8_t float_to_s8(float value, float inverse_scale) {
+    float scaled = value * inverse_scale;
+    if (!(scaled <= 127.0f)) scaled = 127.0f; // Also NaN, as the SIMD min/max order does
+    if (scaled < -128.0f) scaled = -128.0f;
+    return (int8_t)nearbyintf(scaled);
+}
+
+static void bf16_from_f32_scalar(const float* src, void* dst, size_t count, float scale) {
+    (void)scale;
+    uint16_t* out = (uint16_t*)dst;
+    for (size_t i = 0; i < count; ++i) out[i] = float_to_bf16(src[i]);
+}
+
+static void bf16_to_f32_scalar(const void* src, float* dst, size_t count, float scale) {
+    (void)scale;
+    const uint16_t* in = (const uint16_t*)src;
+    for (size_t i = 0; i < count; ++i) dst[i] = bf16_to_float(in[i]);
+}
+
+static void f16_from_f32_scalar(const float* src, void* dst, size_t count, float scale) {
+    (void)scale;
+    uint16_t* out = (uint16_t*)dst;
+    for (size_t i = 0; i < count; ++i) out[i] = float_to_f16(src[i]);
+}
+
+static void f16_to_f32_scalar(const void* src, float* dst, size_t count, float scale) {
+    (void)scale;
+    const uint16_t* in = (const uint16_t*)src;
+    for (size_t i = 0; i < count; ++i) dst[i] = f16_to_float(in[i]);
+}
+
+static void s8_from_f32_scalar(const float* src, void* dst, size_t count, float scale) {
+    int8_t* out = (int8_t*)dst;
+    float inverse_scale = 1.0f / scale;
+    for (size_t i = 0; i < count; ++i) out[i] = float_to_s8(src[i], inverse_scale);
+}
+
+static void s8_to_f32_scalar(const void* src, float* dst, size_t count, float scale) {
+    const int8_t* in = (const int8_t*)src;
+    for (size_t i = 0; i < count; ++i) dst[i] = (float)in[i] * scale;
+}
+
+#ifdef HAVE_X86_KERNELS
+// --- AVX2 kernels: 16 elements per step for 16-bit types, 32 for S8 ---
+__attribute__((target("avx2")))
+static inline __m256i bf16_round_avx2(__m256i bits) {
+    const __m256i abs_mask = _mm256_set1_epi32(0x7fffffff);
+    __m256i is_nan = _mm256_cmpgt_epi32(_mm256_and_si256(bits, abs_mask), _mm256_set1_epi32(0x7f800000));
+    __m256i lsb = _mm256_and_si256(_mm256_srli_epi32(bits, 16), _mm256_set1_epi32(1));
+    __m256i rounded = _mm256_srli_epi32(_mm256_add_epi32(bits, _mm256_add_epi32(lsb, _mm256_set1_epi32(0x7fff))), 16);
+    __m256i quiet = _mm256_or_si256(_mm256_srli_epi32(bits, 16), _mm256_set1_epi32(0x40));
+    return _mm256_blendv_epi8(rounded, quiet, is_nan);
+}
+
+__attribute__((target("avx2")))
+static void bf16_from_f32_avx2(const float* src, void* dst, size_t count, float scale) {
+    uint16_t* out = (uint16_t*)dst;
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16) {
+        __m256i lo = bf16_round_avx2(_mm256_loadu_si256((const __m256i*)(src + i)));
+        __m256i hi = bf16_round_avx2(_mm256_loadu_si256((const __m256i*)(src + i + 8)));
+        // packus works per 128-bit lane; put the quadwords back in order.
+        __m256i packed = _mm256_permute4x64_epi64(_mm256_packus_epi32(lo, hi), 0xd8);
+        _mm256_storeu_si256((__m256i*)(out + i), packed);
+    }
+    bf16_from_f32_scalar(src + i, out + i, count - i, scale);
+}
+
+__attribute__((target("avx2")))
+static void bf16_to_f32_avx2(const void* src, float* dst, size_t count, float scale) {
+    const uint16_t* in = (const uint16_t*)src;
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m256i wide = _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i*)(in + i)));
+        _mm256_storeu_si256((__m256i*)(dst + i), _mm256_slli_epi32(wide, 16));
+    }
+    bf16_to_f32_scalar(in + i, dst + i, count - i, scale);
+}
+
+__attribute__((target("avx2,f16c")))
+static void f16_from_f32_avx2(const float* src, void* dst, size_t count, float scale) {
+    uint16_t* out = (uint16_t*)dst;
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16) {
+        __m128i lo = _mm256_cvtps_ph(_mm256_loadu_ps(src + i), _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+        __m128i hi = _mm256_cvtps_ph(_mm256_loadu_ps(src + i + 8), _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+        _mm_storeu_si128((__m128i*)(out + i), lo);
+        _mm_storeu_si128((__m128i*)(out + i + 8), hi);
+    }
+    f16_from_f32_scalar(src + i, out + i, count - i, scale);
+}
+
+__attribute__((target("avx2,f16c")))
+static void f16_to_f32_avx2(const void* src, float* dst, size_t count, float scale) {
+    const uint16_t* in = (const uint16_t*)src;
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        _mm256_storeu_ps(dst + i, _mm256_cvtph_ps(_mm_loadu_si128((const __m128i*)(in + i))));
+    }
+    f16_to_f32_scalar(in + i, dst + i, count - i, scale);
+}
+
+__attribute__((target("avx2")))
+static inline __m256i s8_quantize_avx2(const float* src, __m256 inverse_scale) {
+    __m256 scaled = _mm256_mul_ps(_mm256_loadu_ps(src), inverse_scale);
+    scaled = _mm256_min_ps(scaled, _mm256_set1_ps(127.0f)); // NaN takes the second operand
+    scaled = _mm256_max_ps(scaled, _mm256_set1_ps(-128.0f));
+    return _mm256_cvtps_epi32(scaled); // Rounds to nearest even
+}
+
+__attribute__((target("avx2")))
+static void s8_from_f32_avx2(const float* src, void* dst, size_t count, float scale) {
+    int8_t* out = (int8_t*)dst;
+    __m256 inverse_scale = _mm256_set1_ps(1.0f / scale);
+    const __m256i order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+    size_t i = 0;
+    for (; i + 32 <= count; i += 32) {
+        __m256i q0 = s8_quantize_avx2(src + i, inverse_scale);
+        __m256i q1 = s8_quantize_avx2(src + i + 8, inverse_scale);
+        __m256i q2 = s8_quantize_avx2(src + i + 16, inverse_scale);
+        __m256i q3 = s8_quantize_avx2(src + i + 24, inverse_scale);
+        __m256i packed = _mm256_packs_epi16(_mm256_packs_epi32(q0, q1), _mm256_packs_epi32(q2, q3));
+        _mm256_storeu_si256((__m256i*)(out + i), _mm256_permutevar8x32_epi32(packed, order));
+    }
+    s8_from_f32_scalar(src + i, out + i, count - i, scale);
+}
+
+__attribute__((target("avx2")))
+static void s8_to_f32_avx2(const void* src, float* dst, size_t count, float scale) {
+    const int8_t* in = (const int8_t*)src;
+    __m256 vscale = _mm256_set1_ps(scale);
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m256i wide = _mm256_cvtepi8_epi32(_mm_loadl_epi64((const __m128i*)(in + i)));
+        _mm256_storeu_ps(dst + i, _mm256_mul_ps(_mm256_cvtepi32_ps(wide), vscale));
+    }
+    s8_to_f32_scalar(in + i, dst + i, count - i, scale);
+}
+
+// --- AVX-512 kernels: 16 elements per step, narrowing with vpmovdw/vpmovdb ---
+__attribute__((target("avx512f")))
+static void bf16_from_f32_avx512(const float* src, void* dst, size_t count, float scale) {
+    uint16_t* out = (uint16_t*)dst;
+    const __m512i abs_mask = _mm512_set1_epi32(0x7fffffff);
+    const __m512i infinity = _mm512_set1_epi32(0x7f800000);
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16) {
+        __m512i bits = _mm512_loadu_si512(src + i);
+        __mmask16 is_nan = _mm512_cmpgt_epi32_mask(_mm512_and_si512(bits, abs_mask), infinity);
+        __m512i lsb = _mm512_and_si512(_mm512_srli_epi32(bits, 16), _mm512_set1_epi32(1));
+        __m512i rounded = _mm512_srli_epi32(_mm512_add_epi32(bits, _mm512_add_epi32(lsb, _mm512_set1_epi32(0x7fff))),
+                                            16);
+        __m512i quiet = _mm512_or_si512(_mm512_srli_epi32(bits, 16), _mm512_set1_epi32(0x40));
+        __m512i result = _mm512_mask_blend_epi32(is_nan, rounded, quiet);
+        _mm256_storeu_si256((__m256i*)(out + i), _mm512_cvtepi32_epi16(result));
+    }
+    bf16_from_f32_scalar(src + i, out + i, count - i, scale);
+}
+
+__attribute__((target("avx512f")))
+static void bf16_to_f32_avx512(const void* src, float* dst, size_t count, float scale) {
+    const uint16_t* in = (const uint16_t*)src;
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16) {
+        __m512i wide = _mm512_cvtepu16_epi32(_mm256_loadu_si256((const __m256i*)(in + i)));
+        _mm512_storeu_si512(dst + i, _mm512_slli_epi32(wide, 16));
+    }
+    bf16_to_f32_scalar(in + i, dst + i, count - i, scale);
+}
+
+__attribute__((target("avx512f")))
+static void f16_from_f32_avx512(const float* src, void* dst, size_t count, float scale) {
+    uint16_t* out = (uint16_t*)dst;
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16) {
+        __m256i half = _mm512_cvtps_ph(_mm512_loadu_ps(src + i), _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+        _mm256_storeu_si256((__m256i*)(out + i), half);
+    }
+    f16_from_f32_scalar(src + i, out + i, count - i, scale);
+}
+
+__attribute__((target("avx512f")))
+static void f16_to_f32_avx512(const void* src, float* dst, size_t count, float scale) {
+    const uint16_t* in = (const uint16_t*)src;
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16) {
+        _mm512_storeu_ps(dst + i, _mm512_cvtph_ps(_mm256_loadu_si256((const __m256i*)(in + i))));
+    }
+    f16_to_f32_scalar(in + i, dst + i, count - i, scale);
+}
+
+__attribute__((target("avx512f")))
+static void s8_from_f32_avx512(const float* src, void* dst, size_t count, float scale) {
+    int8_t* out = (int8_t*)dst;
+    __m512 inverse_scale = _mm512_set1_ps(1.0f / scale);
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16) {
+        __m512 scaled = _mm512_mul_ps(_mm512_loadu_ps(src + i), inverse_scale);
+        scaled = _mm512_min_ps(scaled, _mm512_set1_ps(127.0f));
+        scaled = _mm512_max_ps(scaled, _mm512_set1_ps(-128.0f));
+        _mm_storeu_si128((__m128i*)(out + i), _mm512_cvtepi32_epi8(_mm512_cvtps_epi32(scaled)));
+    }
+    s8_from_f32_scalar(src + i, out + i, count - i, scale);
+}
+
+__attribute__((target("avx512f")))
+static void s8_to_f32_avx512(const void* src, float* dst, size_t count, float scale) {
+    const int8_t* in = (const int8_t*)src;
+    __m512 vscale = _mm512_set1_ps(scale);
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16) {
+        __m512i wide = _mm512_cvtepi8_epi32(_mm_loadu_si128((const __m128i*)(in + i)));
+        _mm512_storeu_ps(dst + i, _mm512_mul_ps(_mm512_cvtepi32_ps(wide), vscale));
+    }
+    s8_to_f32_scalar(in + i, dst + i, count - i, scale);
+}
+#endif
+
+// Available implementations, best last.
+static struct convert_impl convert_impls[3];
+static size_t num_convert_impls;
+
+static void select_convert_kernels(void) {
+    if (num_convert_impls != 0) return;
+    convert_impls[num_convert_impls++] = (struct convert_impl){"scalar", {
+        {bf16_from_f32_scalar, bf16_to_f32_scalar},
+        {f16_from_f32_scalar, f16_to_f32_scalar},
+        {s8_from_f32_scalar, s8_to_f32_scalar}}};
+#ifdef HAVE_X86_KERNELS
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("f16c")) {
+        convert_impls[num_convert_impls++] = (struct convert_impl){"avx2", {
+            {bf16_from_f32_avx2, bf16_to_f32_avx2},
+            {f16_from_f32_avx2, f16_to_f32_avx2},
+            {s8_from_f32_avx2, s8_to_f32_avx2}}};
+    }
+    if (__builtin_cpu_supports("avx512f")) {
+        convert_impls[num_convert_impls++] = (struct convert_impl){"avx512", {
+            {bf16_from_f32_avx512, bf16_to_f32_avx512},
+            {f16_from_f32_avx512, f16_to_f32_avx512},
+            {s8_from_f32_avx512, s8_to_f32_avx512}}};
+    }
+#endif
+}
+
+
+static int convert_target_of(PJRT_Buffer_Type type, enum convert_target* target) {
+    switch (type) {
+        case PJRT_Buffer_Type_BF16: *target = CONVERT_BF16; return 0;
+        case PJRT_Buffer_Type_F16: *target = CONVERT_F16; return 0;
+        case PJRT_Buffer_Type_S8: *target = CONVERT_S8; return 0;
+        default:
+            fprintf(stderr, "No host conversion between F32 and buffer type %d\n", (int)type);
+            return 1;
+    }
+}
+
+
+// --- Splitting a conversion over threads ---
+struct convert_job {
+    const struct convert_kernels* kernels;
+    int to_f32;
+    const void* src;
+    void* dst;
+    size_t count;
+    float scale;
+};
+
+static void run_convert_job(const struct convert_job* job) {
+    if (job->to_f32) {
+        job->kernels->to_f32(job->src, (float*)job->dst, job->count, job->scale);
+    } else {
+        job->kernels->from_f32((const float*)job->src, job->dst, job->count, job->scale);
+    }
+}
+
+static void* convert_thread(void* arg) {
+    run_convert_job((const struct convert_job*)arg);
+    return NULL;
+}
+
+// Threads worth using for `count` elements, at most `max_threads` (0: the number of CPUs).
+static size_t convert_threads_for(size_t count, size_t max_threads) {
+    if (max_threads == 0) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        max_threads = cpus > 0 ? (size_t)cpus : 1;
+    }
+    size_t threads = count * sizeof(float) / CONVERT_MIN_BYTES_PER_THREAD;
+    if (threads > max_threads) threads = max_threads;
+    if (threads > CONVERT_MAX_THREADS) threads = CONVERT_MAX_THREADS;
+    return threads < 1 ? 1 : threads;
+}
+
+static void convert_parallel(const struct convert_kernels* kernels, int to_f32, const void* src, void* dst,
+                             size_t count, size_t element_size, float scale, size_t threads) {
+    struct convert_job jobs[CONVERT_MAX_THREADS];
+    size_t src_size = to_f32 ? element_size : sizeof(float);
+    size_t dst_size = to_f32 ? sizeof(float) : element_size;
+    for (size_t t = 0; t < threads; ++t) {
+        // Blocks start on a multiple of 64 elements, so every SIMD step but the last is full.
+        size_t begin = count * t / threads / 64 * 64;
+        size_t end = t + 1 == threads ? count : count * (t + 1) / threads / 64 * 64;
+        jobs[t].kernels = kernels;
+        jobs[t].to_f32 = to_f32;
+        jobs[t].src = (const uint8_t*)src + begin * src_size;
+        jobs[t].dst = (uint8_t*)dst + begin * dst_size;
+        jobs[t].count = end - begin;
+        jobs[t].scale = scale;
+    }
+    run_parallel_jobs(convert_thread, jobs, sizeof(jobs[0]), threads);
+}
+
+
+// --- Function to convert F32 host data to BF16, F16 or S8 ---
+// `scale` is the S8 quantization step (x is stored as round(x / scale)); other types ignore it.
+int convert_from_f32(const float* src, void* dst, size_t count, PJRT_Buffer_Type type, float scale) {
+    enum convert_target target;
+    if (convert_target_of(type, &target) != 0) return 1;
+    select_convert_kernels();
+    const struct convert_kernels* kernels = &convert_impls[num_convert_impls - 1].kernels[target];
+    convert_parallel(kernels, 0, src, dst, count, buffer_type_size(type), scale, convert_threads_for(count, 0));
+    return 0;
+}
+
+
+// --- Function to widen BF16, F16 or S8 host data to F32 ---
+int convert_to_f32(const void* src, float* dst, size_t count, PJRT_Buffer_Type type, float scale) {
+    enum convert_target target;
+    if (convert_target_of(type, &target) != 0) return 1;
+    select_convert_kernels();
+    const struct convert_kernels* kernels = &convert_impls[num_convert_impls - 1].kernels[target];
+    convert_parallel(kernels, 1, src, dst, count, buffer_type_size(type), scale, convert_threads_for(count, 0));
+    return 0;
+}
+
+
+// --- Function to upload F32 host data as a buffer of another type ---
+PJRT_Buffer* create_buffer_from_f32(const PJRT_Api* api, PJRT_Client* client, PJRT_Device* device,
+                                    const float* host_data, PJRT_Buffer_Type type, const int64_t* dims,
+                                    size_t num_dims, float scale, const char* context_prefix) {
+    size_t count = 1;
+    for (size_t d = 0; d < num_dims; ++d) count *= (size_t)dims[d];
+    void* converted = malloc(count * buffer_type_size(type) + 1);
+    if (converted == NULL || convert_from_f32(host_data, converted, count, type, scale) != 0) {
+        free(converted);
+        return NULL;
+    }
+    // The host data is only needed during the call.
+    PJRT_Buffer* buffer = create_buffer_from_host(api, client, device, converted, type, dims, num_dims,
+                                                  context_prefix);
+    free(converted);
+    return buffer;
+}
+
+
+// --- Function to copy a BF16, F16 or S8 buffer to the host as F32 ---
+// `out` must hold the element count of the buffer.
+int buffer_to_host_f32(const PJRT_Api* api, PJRT_Buffer* buffer, float* out, float scale) {
+    struct host_tensor tensor;
+    if (buffer_to_host(api, buffer, &tensor) != 0) return 1;
+    size_t element_size = buffer_type_size(tensor.type);
+    int rc = element_size == 0 || convert_to_f32(tensor.data, out, tensor.size / element_size, tensor.type, scale);
+    free_host_tensor(&tensor);
+    return rc;
+}
+
+
+// --- Benchmark ---
+
+struct convert_case {
+    const char* name;
+    PJRT_Buffer_Type type;
+    const char* mlir_type;
+};
+
+static const struct convert_case convert_cases[NUM_CONVERT_TARGETS] = {
+    {"BF16", PJRT_Buffer_Type_BF16, "bf16"},
+    {"F16", PJRT_Buffer_Type_F16, "f16"},
+    {"S8", PJRT_Buffer_Type_S8, "i8"},
+};
+
+static const size_t convert_bench_sizes[] = {1 << 16, 1 << 20, 1 << 24};
+#define NUM_CONVERT_BENCH_SIZES (sizeof(convert_bench_sizes) / sizeof(convert_bench_sizes[0]))
+#define CONVERT_BENCH_RANGE 4.0f // Inputs are uniform in [-RANGE, RANGE), with specials at the start
+
+
+// --- StableHLO of the in-computation converts, F32 -> type and back ---
+static int render_convert(const struct convert_case* c, size_t count, int to_f32, float scale, char* text,
+                          size_t size) {
+    char narrow[64], wide[64];
+    snprintf(narrow, sizeof(narrow), "tensor<%zux%s>", count, c->mlir_type);
+    snprintf(wide, sizeof(wide), "tensor<%zuxf32>", count);
+    int length;
+    if (c->type != PJRT_Buffer_Type_S8) {
+        length = snprintf(text, size,
+            "module @convert {\n"
+            "  func.func public @main(%%x: %1$s) -> %2$s {\n"
+            "    %%y = stablehlo.convert %%x : (%1$s) -> %2$s\n"
+            "    return %%y : %2$s\n"
+            "  }\n"
+            "}\n",
+            to_f32 ? narrow : wide, to_f32 ? wide : narrow);
+    } else if (to_f32) {
+        length = snprintf(text, size,
+            "module @dequantize {\n"
+            "  func.func public @main(%%q: %1$s) -> %2$s {\n"
+            "    %%scale = stablehlo.constant dense<%3$.9e> : %2$s\n"
+            "    %%x = stablehlo.convert %%q : (%1$s) -> %2$s\n"
+            "    %%y = stablehlo.multiply %%x, %%scale : %2$s\n"
+            "    return %%y : %2$s\n"
+            "  }\n"
+            "}\n",
+            narrow, wide, scale);
+    } else {
+        length = snprintf(text, size,
+            "module @quantize {\n"
+            "  func.func public @main(%%x: %2$s) -> %1$s {\n"
+            "    %%inverse_scale = stablehlo.constant dense<%3$.9e> : %2$s\n"
+            "    %%lo = stablehlo.constant dense<-1.280000e+02> : %2$s\n"
+            "    %%hi = stablehlo.constant dense<1.270000e+02> : %2$s\n"
+            "    %%scaled = stablehlo.multiply %%x, %%inverse_scale : %2$s\n"
+            "    %%clamped = stablehlo.clamp %%lo, %%scaled, %%hi : %2$s\n"
+            "    %%rounded = stablehlo.round_nearest_even %%clamped : %2$s\n"
+            "    %%q = stablehlo.convert %%rounded : (%2$s) -> %1$s\n"
+            "    return %%q : %1$s\n"
+            "  }\n"
+            "}\n",
+            narrow, wide, 1.0f / scale);
+    }
+    return length > 0 && (size_t)length < size ? length : -1;
+}
+
+
+static PJRT_LoadedExecutable* compile_convert(const PJRT_Api* api, PJRT_Client* client,
+                                              const struct file_data* compile_options, const struct convert_case* c,
+                                              size_t count, int to_f32, float scale) {
+    char text[CONVERT_PROGRAM_TEXT_SIZE];
+    int length = render_convert(c, count, to_f32, scale, text, sizeof(text));
+    if (length < 0) return NULL;
+    struct file_data code = {text, (size_t)length};
+    return compile_program(api, client, &code, "mlir", compile_options);
+}
+
+
+// Deterministic inputs with a few special values first: signed zeros, infinities, a NaN,
+// halfway cases and values beyond the F16 range.
+static void fill_convert_input(float* data, size_t count) {
+    static const float specials[] = {0.0f, -0.0f, INFINITY, -INFINITY, NAN, 65504.0f, 65520.0f, 1e-8f, -6e-8f,
+                                     1.00390625f, 1.01171875f, 0.5f, 1.5f, -2.5f};
+    uint64_t state = 0x9e3779b97f4a7c15ull;
+    for (size_t i = 0; i < count; ++i) {
+        state = state * 6364136223846793005ull + 1442695040888963407ull;
+        data[i] = ((float)(state >> 40) / (float)(1 << 24) * 2.0f - 1.0f) * CONVERT_BENCH_RANGE;
+    }
+    size_t num_specials = sizeof(specials) / sizeof(specials[0]);
+    memcpy(data, specials, (count < num_specials ? count : num_specials) * sizeof(float));
+}
+
+
+// Time `iterations` runs of one kernel over `count` elements and return the median.
+static double time_kernel(const struct convert_kernels* kernels, int to_f32, const void* src, void* dst,
+                          size_t count, size_t element_size, float scale, size_t threads, int iterations,
+                          double* samples) {
+    for (int i = -1; i < iterations; ++i) { // One warm-up run
+        double start = now_seconds();
+        convert_parallel(kernels, to_f32, src, dst, count, element_size, scale, threads);
+        if (i >= 0) samples[i] = now_seconds() - start;
+    }
+    return median_of(samples, iterations);
+}
+
+
+// --- Function to compare every kernel with the scalar one, and time it ---
+static int bench_kernels(enum convert_target target, const float* input, size_t count, float scale,
+                         int iterations, double* samples) {
+    const struct convert_case* c = &convert_cases[target];
+    size_t element_size = buffer_type_size(c->type);
+    void* reference = malloc(count * element_size);
+    void* narrow = malloc(count * element_size);
+    float* wide_reference = (float*)malloc(count * sizeof(float));
+    float* wide = (float*)malloc(count * sizeof(float));
+    int rc = 0;
+    if (reference == NULL || narrow == NULL || wide_reference == NULL || wide == NULL) {
+        rc = 1;
+        goto cleanup_kernels;
+    }
+    const struct convert_kernels* scalar = &convert_impls[0].kernels[target];
+    convert_parallel(scalar, 0, input, reference, count, element_size, scale, 1);
+    convert_parallel(scalar, 1, reference, wide_reference, count, element_size, scale, 1);
+    size_t max_threads = convert_threads_for(count, 0);
+    for (size_t k = 0; k < num_convert_impls; ++k) {
+        const struct convert_kernels* kernels = &convert_impls[k].kernels[target];
+        for (size_t threads = 1;; threads = max_threads) {
+            double to_s = time_kernel(kernels, 0, input, narrow, count, element_size, scale, threads, iterations,
+                                      samples);
+            double from_s = time_kernel(kernels, 1, narrow, wide, count, element_size, scale, threads, iterations,
+                                        samples);
+            int same = memcmp(narrow, reference, count * element_size) == 0 &&
+                       memcmp(wide, wide_reference, count * sizeof(float)) == 0;
+            printf("  %10zu %-8s %7zu %12.2f %12.2f  %s\n", count, convert_impls[k].name, threads,
+                   count * sizeof(float) / to_s / 1e9, count * sizeof(float) / from_s / 1e9,
+                   same ? "bit-exact" : "MISMATCH");
+            if (!same) rc = 1;
+            if (threads == max_threads) break;
+        }
+    }
+
+cleanup_kernels:
+    free(reference);
+    free(narrow);
+    free(wide_reference);
+    free(wide);
+    return rc;
+}
+
+
+// Mismatching elements, comparing bits; NaNs only need to be NaN on both sides.
+static size_t count_mismatches(const void* a, const void* b, size_t count, PJRT_Buffer_Type type) {
+    size_t mismatches = 0;
+    for (size_t i = 0; i < count; ++i) {
+        if (type == PJRT_Buffer_Type_F32) {
+            float x = ((const float*)a)[i], y = ((const float*)b)[i];
+            mismatches += !(isnan(x) && isnan(y)) && memcmp(&x, &y, sizeof(x)) != 0;
+        } else if (type == PJRT_Buffer_Type_S8) {
+            mismatches += ((const int8_t*)a)[i] != ((const int8_t*)b)[i];
+        } else {
+            uint16_t x = ((const uint16_t*)a)[i], y = ((const uint16_t*)b)[i];
+            int x_nan = (x & 0x7fff) > (type == PJRT_Buffer_Type_BF16 ? 0x7f80 : 0x7c00);
+            int y_nan = (y & 0x7fff) > (type == PJRT_Buffer_Type_BF16 ? 0x7f80 : 0x7c00);
+            mismatches += !(x_nan && y_nan) && x != y;
+        }
+    }
+    return mismatches;
+}
+
+
+// --- Function to time host conversion around a narrow transfer against converting in XLA ---
+// Upload: host F32 -> device buffer of the narrow type. Download: device narrow buffer -> host F32.
+static int bench_transfers(const PJRT_Api* api, PJRT_Client* client, PJRT_Device* device,
+                           const struct file_data* compile_options, enum convert_target target, const float* input,
+                           size_t count, float scale, int iterations, double* samples) {
+    const struct convert_case* c = &convert_cases[target];
+    size_t element_size = buffer_type_size(c->type);
+    int64_t dims[1] = {(int64_t)count};
+    int rc = 1;
+    PJRT_LoadedExecutable* narrow_executable = compile_convert(api, client, compile_options, c, count, 0, scale);
+    PJRT_LoadedExecutable* widen_executable = compile_convert(api, client, compile_options, c, count, 1, scale);
+    PJRT_Buffer* narrow_buffer = NULL;
+    void* host_narrow = malloc(count * element_size);
+    float* host_wide = (float*)malloc(count * sizeof(float));
+    struct host_tensor xla_narrow = {0}, xla_wide = {0};
+    double medians[4];
+    if (narrow_executable == NULL || widen_executable == NULL || host_narrow == NULL || host_wide == NULL) {
+        goto cleanup_transfers;
+    }
+    // The narrow device buffer every download starts from.
+    narrow_buffer = create_buffer_from_f32(api, client, device, input, c->type, dims, 1, scale, "Convert input");
+    if (narrow_buffer == NULL) goto cleanup_transfers;
+
+    for (int mode = 0; mode < 4; ++mode) {
+        for (int i = -1; i < iterations; ++i) { // One warm-up run
+            PJRT_Buffer** outputs = NULL;
+            size_t num_outputs = 0;
+            PJRT_Buffer* buffer = NULL;
+            struct host_tensor* xla_result = mode == 1 ? &xla_narrow : &xla_wide;
+            int run_rc = 0;
+            double start = now_seconds();
+            if (mode == 0) { // Host conversion, narrow upload
+                buffer = create_buffer_from_f32(api, client, device, input, c->type, dims, 1, scale, "Convert");
+                run_rc = buffer == NULL || await_buffers_ready(api, &buffer, 1);
+            } else if (mode == 1) { // F32 upload, XLA converts
+                buffer = create_buffer_from_host(api, client, device, (void*)input, PJRT_Buffer_Type_F32, dims, 1,
+                                                 "Convert");
+                run_rc = buffer == NULL ||
+                         execute_hlo_program(api, narrow_executable, &buffer, 1, &outputs, &num_outputs) ||
+                         await_buffers_ready(api, outputs, num_outputs);
+            } else if (mode == 2) { // Narrow download, host conversion
+                run_rc = buffer_to_host_f32(api, narrow_buffer, host_wide, scale);
+            } else { // XLA converts, F32 download
+                run_rc = execute_hlo_program(api, widen_executable, &narrow_buffer, 1, &outputs, &num_outputs) ||
+                         num_outputs != 1;
+                if (run_rc == 0) {
+                    free_host_tensor(&xla_wide);
+                    run_rc = buffer_to_host(api, outputs[0], &xla_wide);
+                }
+            }
+            double elapsed = now_seconds() - start;
+            if (run_rc == 0 && mode == 1 && i == iterations - 1) {
+                run_rc = num_outputs != 1 || buffer_to_host(api, outputs[0], xla_result);
+            }
+            if (run_rc == 0 && mode == 0 && i == iterations - 1) {
+                struct host_tensor uploaded;
+                run_rc = buffer_to_host(api, buffer, &uploaded);
+                if (run_rc == 0) {
+                    memcpy(host_narrow, uploaded.data, count * element_size);
+                    free_host_tensor(&uploaded);
+                }
+            }
+            destroy_buffers(api, outputs, num_outputs, "PJRT_Buffer_Destroy (convert output)");
+            destroy_buffer(api, buffer, "PJRT_Buffer_Destroy (convert)");
+            if (run_rc != 0) goto cleanup_transfers;
+            if (i >= 0) samples[i] = elapsed;
+        }
+        medians[mode] = median_of(samples, iterations);
+    }
+
+    size_t upload_mismatches = xla_narrow.data != NULL
+                                   ? count_mismatches(host_narrow, xla_narrow.data, count, c->type) : count;
+    size_t download_mismatches = xla_wide.data != NULL
+                                     ? count_mismatches(host_wide, xla_wide.data, count, PJRT_Buffer_Type_F32)
+                                     : count;
+    printf("  %10zu %12.3f %12.3f %14.3f %14.3f %10zu %10zu\n", count, medians[0] * 1e3, medians[1] * 1e3,
+           medians[2] * 1e3, medians[3] * 1e3, upload_mismatches, download_mismatches);
+    rc = 0;
+
+cleanup_transfers:
+    destroy_buffer(api, narrow_buffer, "PJRT_Buffer_Destroy (convert input)");
+    if (narrow_executable != NULL) destroy_loaded_executable(api, narrow_executable);
+    if (widen_executable != NULL) destroy_loaded_executable(api, widen_executable);
+    free_host_tensor(&xla_narrow);
+    free_host_tensor(&xla_wide);
+    free(host_narrow);
+    free(host_wide);
+    return rc;
+}
+
+
+// --- Function to run the conversion benchmark ---
+int run_convert_benchmark(const PJRT_Api* api, PJRT_Client* client, PJRT_Device* device, int iterations) {
+    int rc = 0;
+    struct file_data compile_options = {NULL, 0};
+    size_t max_count = convert_bench_sizes[NUM_CONVERT_BENCH_SIZES - 1];
+    float* input = (float*)malloc(max_count * sizeof(float));
+    double* samples = (double*)calloc(iterations > 0 ? iterations : 1, sizeof(double));
+    if (iterations < 1) iterations = 1;
+    if (input == NULL || samples == NULL ||
+        read_file_to_buffer("./compile_options.0.pb", &compile_options) != 0) {
+        free(input);
+        free(samples);
+        return 1;
+    }
+    select_convert_kernels();
+    fill_convert_input(input, max_count);
+
+    for (int t = 0; t < NUM_CONVERT_TARGETS; ++t) {
+        // S8 covers the input range; values outside saturate.
+        float scale = t == CONVERT_S8 ? CONVERT_BENCH_RANGE / 127.0f : 1.0f;
+        printf("\n--- F32 <-> %s host kernels (GB/s of F32 data, median of %d) ---\n", convert_cases[t].name,
+               iterations);
+        printf("  %10s %-8s %7s %12s %12s  %s\n", "elements", "kernel", "threads", "to type", "to F32",
+               "vs scalar");
+        for (size_t s = 0; s < NUM_CONVERT_BENCH_SIZES; ++s) {
+            if (bench_kernels((enum convert_target)t, input, convert_bench_sizes[s], scale, iterations, samples)) {
+                rc = 1;
+            }
+        }
+        printf("\n--- F32 <-> %s: host conversion vs. convert in XLA (ms, median of %d) ---\n",
+               convert_cases[t].name, iterations);
+        printf("  %10s %12s %12s %14s %14s %10s %10s\n", "elements", "host up", "XLA up", "host down", "XLA down",
+               "up diff", "down diff");
+        for (size_t s = 0; s < NUM_CONVERT_BENCH_SIZES; ++s) {
+            if (bench_transfers(api, client, device, &compile_options, (enum convert_target)t, input,
+                                convert_bench_sizes[s], scale, iterations, samples)) {
+                rc = 1;
+            }
+        }
+    }
+    printf("\nup: F32 host data to a device buffer of the type; down: that buffer to F32 host data.\n"
+           "diff: elements whose bits differ between the host and XLA results (NaNs only need to be NaN).\n");
+    free_file_data(&compile_options);
+    free(input);
+    free(samples);
+    return rc;
+}
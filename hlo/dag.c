@@ -0,0 +1,526 @@
+// DAG executor: several executables chained through device-resident buffers.
+//
+// A dag lists nodes, each an executable whose inputs are graph inputs or
+// outputs of other nodes. dag_run hands those outputs on as PJRT_Buffer
+// handles without copying them to the host. Up to `workers` nodes whose inputs
+// are ready run at once, the calling thread being one of the workers. Every
+// intermediate is reference counted by its consumers and destroyed as soon as
+// the last of them has completed; only the dag's outputs outlive the run.
+//
+// The benchmark runs a fan-out/fan-in graph three ways: copying every
+// intermediate to the host and back as the per-program tests do, device
+// resident on one worker, and device resident on `workers` workers.
+#include <math.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "hlo_test.h"
+
+#define DAG_BRANCHES 4
+#define DAG_BRANCH_DEPTH 8 // tanh(sin(r) + x) steps per branch
+#define DAG_ELEMENTS (1 << 20)
+#define DAG_PROGRAM_TEXT_SIZE 8192
+#define DAG_REFERENCE_TOLERANCE 1e-3 // XLA's sin and tanh are approximations
+
+struct dag_run {
+    const PJRT_Api* api;
+    const struct dag* dag;
+    PJRT_Buffer** inputs;
+    size_t* value_base; // Per node, index of its first output in values
+    PJRT_Buffer** values; // Node outputs, NULL until produced and after release
+    int* refs; // Per value, consumers still to complete plus dag outputs
+    int* pending; // Per node, inputs whose producer has not completed
+    int* ready; // Queue of nodes that can run
+    size_t ready_head;
+    size_t ready_tail;
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+    size_t completed;
+    size_t running;
+    int failed;
+    struct dag_stats stats; // Guarded by lock
+};
+
+
+// Marks the consumers of `node` and enqueues those left with nothing to wait for. Called with the lock held.
+static void dag_node_completed(struct dag_run* run, size_t node) {
+    for (size_t m = 0; m < run->dag->num_nodes; ++m) {
+        const struct dag_node* consumer = &run->dag->nodes[m];
+        for (size_t i = 0; i < consumer->num_inputs; ++i) {
+            if (consumer->inputs[i].node == (int)node && --run->pending[m] == 0) {
+                run->ready[run->ready_tail++] = (int)m;
+            }
+        }
+    }
+    run->completed++;
+}
+
+
+static void* dag_worker(void* arg) {
+    struct dag_run* run = (struct dag_run*)arg;
+    const struct dag* dag = run->dag;
+    pthread_mutex_lock(&run->lock);
+    for (;;) {
+        if (run->failed || run->completed == dag->num_nodes) break;
+        if (run->ready_head == run->ready_tail) {
+            if (run->running == 0) {
+                fprintf(stderr, "DAG has a cycle: %zu of %zu node(s) can never run\n",
+                        dag->num_nodes - run->completed, dag->num_nodes);
+                run->failed = 1;
+                pthread_cond_broadcast(&run->changed);
+                break;
+            }
+            pthread_cond_wait(&run->changed, &run->lock);
+            continue;
+        }
+        size_t n = (size_t)run->ready[run->ready_head++];
+        const struct dag_node* node = &dag->nodes[n];
+        PJRT_Buffer* args[DAG_MAX_ARGS];
+        for (size_t i = 0; i < node->num_inputs; ++i) {
+            const struct dag_value* v = &node->inputs[i];
+            args[i] = v->node < 0 ? run->inputs[v->output] : run->values[run->value_base[v->node] + v->output];
+        }
+        if (++run->running > run->stats.max_running) run->stats.max_running = run->running;
+        pthread_mutex_unlock(&run->lock);
+
+        // Execute returns once the work is enqueued; the node has completed when its outputs are ready.
+        PJRT_Buffer** outputs = NULL;
+        size_t num_outputs = 0;
+        int rc = execute_hlo_program(run->api, node->executable, args, node->num_inputs, &outputs, &num_outputs) ||
+                 await_buffers_ready(run->api, outputs, num_outputs);
+        if (rc == 0 && num_outputs != node->num_outputs) {
+            fprintf(stderr, "DAG node '%s' produced %zu output(s), %zu expected\n", node->name, num_outputs,
+                    node->num_outputs);
+            rc = 1;
+        }
+
+        PJRT_Buffer* released[2 * DAG_MAX_ARGS];
+        size_t num_released = 0;
+        pthread_mutex_lock(&run->lock);
+        run->running--;
+        if (rc != 0) {
+            run->failed = 1;
+        } else {
+            size_t base = run->value_base[n];
+            for (size_t o = 0; o < num_outputs; ++o) {
+                run->values[base + o] = outputs[o];
+                if (run->refs[base + o] == 0) { // Nothing consumes it
+                    released[num_released++] = outputs[o];
+                    run->values[base + o] = NULL;
+                }
+            }
+            // The outputs and the inputs they were computed from are all on the device at this point.
+            run->stats.live += num_outputs;
+            if (run->stats.live > run->stats.max_live) run->stats.max_live = run->stats.live;
+            run->stats.live -= num_released;
+            for (size_t i = 0; i < node->num_inputs; ++i) {
+                const struct dag_value* v = &node->inputs[i];
+                if (v->node < 0) continue; // Owned by the caller
+                size_t index = run->value_base[v->node] + v->output;
+                if (--run->refs[index] == 0) {
+                    released[num_released++] = run->values[index];
+                    run->values[index] = NULL;
+                    run->stats.live--;
+                    run->stats.freed_early++;
+                }
+            }
+            dag_node_completed(run, n);
+        }
+        pthread_cond_broadcast(&run->changed);
+        pthread_mutex_unlock(&run->lock);
+        for (size_t i = 0; i < num_released; ++i) {
+            destroy_buffer(run->api, released[i], "PJRT_Buffer_Destroy (DAG intermediate)");
+        }
+        if (rc != 0) {
+            destroy_buffers(run->api, outputs, num_outputs, "PJRT_Buffer_Destroy (DAG output)");
+        } else {
+            free(outputs);
+        }
+        pthread_mutex_lock(&run->lock);
+    }
+    pthread_mutex_unlock(&run->lock);
+    return NULL;
+}
+
+
+static int dag_check(const struct dag* dag) {
+    for (size_t n = 0; n < dag->num_nodes; ++n) {
+        const struct dag_node* node = &dag->nodes[n];
+        if (node->num_inputs > DAG_MAX_ARGS || node->num_outputs > DAG_MAX_ARGS) {
+            fprintf(stderr, "DAG node '%s' has more than %d inputs or outputs\n", node->name, DAG_MAX_ARGS);
+            return 1;
+        }
+        for (size_t i = 0; i < node->num_inputs; ++i) {
+            const struct dag_value* v = &node->inputs[i];
+            int valid = v->node < 0 ? (size_t)v->output < dag->num_inputs
+                                    : (size_t)v->node < dag->num_nodes &&
+                                          (size_t)v->output < dag->nodes[v->node].num_outputs;
+            if (!valid) {
+                fprintf(stderr, "DAG node '%s' input %zu refers to no value\n", node->name, i);
+                return 1;
+            }
+        }
+    }
+    for (size_t i = 0; i < dag->num_outputs; ++i) {
+        const struct dag_value* v = &dag->outputs[i];
+        if (v->node < 0 || (size_t)v->node >= dag->num_nodes ||
+            (size_t)v->output >= dag->nodes[v->node].num_outputs) {
+            fprintf(stderr, "DAG output %zu is not the output of a node\n", i);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+
+// --- Function to run a DAG with device-resident intermediates ---
+// `outputs` receives dag->num_outputs buffers owned by the caller; `inputs` stay owned by the caller.
+int dag_run(const PJRT_Api* api, const struct dag* dag, PJRT_Buffer** inputs, int workers, PJRT_Buffer** outputs,
+            struct dag_stats* stats) {
+    if (dag_check(dag) != 0) return 1;
+    int rc = 1;
+    size_t num_values = 0;
+    struct dag_run run;
+    memset(&run, 0, sizeof(run));
+    run.api = api;
+    run.dag = dag;
+    run.inputs = inputs;
+    run.value_base = (size_t*)calloc(dag->num_nodes + 1, sizeof(size_t));
+    run.pending = (int*)calloc(dag->num_nodes + 1, sizeof(int));
+    run.ready = (int*)calloc(dag->num_nodes + 1, sizeof(int));
+    if (run.value_base == NULL || run.pending == NULL || run.ready == NULL) goto cleanup_dag;
+    for (size_t n = 0; n < dag->num_nodes; ++n) {
+        run.value_base[n] = num_values;
+        num_values += dag->nodes[n].num_outputs;
+    }
+    run.values = (PJRT_Buffer**)calloc(num_values + 1, sizeof(PJRT_Buffer*));
+    run.refs = (int*)calloc(num_values + 1, sizeof(int));
+    if (run.values == NULL || run.refs == NULL) goto cleanup_dag;
+    for (size_t n = 0; n < dag->num_nodes; ++n) {
+        const struct dag_node* node = &dag->nodes[n];
+        for (size_t i = 0; i < node->num_inputs; ++i) {
+            if (node->inputs[i].node < 0) continue;
+            run.refs[run.value_base[node->inputs[i].node] + node->inputs[i].output]++;
+            run.pending[n]++;
+        }
+        if (run.pending[n] == 0) run.ready[run.ready_tail++] = (int)n;
+    }
+    for (size_t i = 0; i < dag->num_outputs; ++i) {
+        run.refs[run.value_base[dag->outputs[i].node] + dag->outputs[i].output]++;
+    }
+
+    pthread_mutex_init(&run.lock, NULL);
+    pthread_cond_init(&run.changed, NULL);
+    if (workers < 1) workers = 1;
+    pthread_t* threads = (pthread_t*)calloc((size_t)workers, sizeof(pthread_t));
+    int* started = (int*)calloc((size_t)workers, sizeof(int));
+    for (int w = 0; threads != NULL && started != NULL && w + 1 < workers; ++w) {
+        started[w] = pthread_create(&threads[w], NULL, dag_worker, &run) == 0;
+    }
+    dag_worker(&run); // The calling thread is the last worker
+    for (int w = 0; threads != NULL && started != NULL && w + 1 < workers; ++w) {
+        if (started[w]) pthread_join(threads[w], NULL);
+    }
+    free(threads);
+    free(started);
+    pthread_cond_destroy(&run.changed);
+    pthread_mutex_destroy(&run.lock);
+
+    if (!run.failed) {
+        for (size_t i = 0; i < dag->num_outputs; ++i) {
+            size_t index = run.value_base[dag->outputs[i].node] + dag->outputs[i].output;
+            outputs[i] = run.values[index];
+            run.values[index] = NULL; // Handed over
+        }
+    }
+    // After a failure this destroys every value still held; after success, nothing is left.
+    for (size_t v = 0; v < num_values; ++v) {
+        destroy_buffer(api, run.values[v], "PJRT_Buffer_Destroy (DAG intermediate)");
+    }
+    if (stats != NULL) *stats = run.stats;
+    rc = run.failed;
+
+cleanup_dag:
+    free(run.value_base);
+    free(run.pending);
+    free(run.ready);
+    free(run.values);
+    free(run.refs);
+    return rc;
+}
+
+
+// --- Baseline: every intermediate goes to the host and back, one node after another ---
+// Nodes must be listed so that producers come before their consumers.
+static int dag_run_via_host(const PJRT_Api* api, PJRT_Client* client, PJRT_Device* device, const struct dag* dag,
+                            PJRT_Buffer** inputs, struct host_tensor* outputs) {
+    int rc = 1;
+    size_t num_values = 0;
+    size_t* value_base = (size_t*)calloc(dag->num_nodes + 1, sizeof(size_t));
+    for (size_t n = 0; value_base != NULL && n < dag->num_nodes; ++n) {
+        value_base[n] = num_values;
+        num_values += dag->nodes[n].num_outputs;
+    }
+    struct host_tensor* values = (struct host_tensor*)calloc(num_values + 1, sizeof(struct host_tensor));
+    if (value_base == NULL || values == NULL) goto cleanup_via_host;
+
+    for (size_t n = 0; n < dag->num_nodes; ++n) {
+        const struct dag_node* node = &dag->nodes[n];
+        PJRT_Buffer* args[DAG_MAX_ARGS] = {NULL};
+        PJRT_Buffer* uploaded[DAG_MAX_ARGS] = {NULL};
+        for (size_t i = 0; i < node->num_inputs; ++i) {
+            const struct dag_value* v = &node->inputs[i];
+            if (v->node < 0) {
+                args[i] = inputs[v->output];
+                continue;
+            }
+            struct host_tensor* value = &values[value_base[v->node] + v->output];
+            uploaded[i] = create_buffer_from_host(api, client, device, value->data, value->type, value->dims,
+                                                  value->num_dims, "DAG intermediate");
+            args[i] = uploaded[i];
+        }
+        struct host_tensor* node_outputs = NULL;
+        size_t num_outputs = 0;
+        int node_rc = execute_to_host(api, node->executable, args, node->num_inputs, &node_outputs, &num_outputs);
+        for (size_t i = 0; i < node->num_inputs; ++i) {
+            destroy_buffer(api, uploaded[i], "PJRT_Buffer_Destroy (DAG intermediate)");
+        }
+        if (node_rc != 0 || num_outputs != node->num_outputs) {
+            free_host_tensors(node_outputs, num_outputs);
+            goto cleanup_via_host;
+        }
+        memcpy(&values[value_base[n]], node_outputs, num_outputs * sizeof(struct host_tensor));
+        free(node_outputs);
+    }
+    for (size_t i = 0; i < dag->num_outputs; ++i) {
+        struct host_tensor* value = &values[value_base[dag->outputs[i].node] + dag->outputs[i].output];
+        outputs[i] = *value;
+        memset(value, 0, sizeof(*value));
+    }
+    rc = 0;
+
+cleanup_via_host:
+    for (size_t v = 0; values != NULL && v < num_values; ++v) free_host_tensor(&values[v]);
+    free(values);
+    free(value_base);
+    return rc;
+}
+
+
+// --- Benchmark graph: split into DAG_BRANCHES scaled copies, a branch on each, then a pairwise sum ---
+enum dag_program {
+    DAG_SPLIT,
+    DAG_BRANCH,
+    DAG_COMBINE,
+    NUM_DAG_PROGRAMS
+};
+
+static const float dag_branch_scales[DAG_BRANCHES] = {1.0f, -1.0f, 0.5f, 2.0f};
+
+
+static int render_dag_program(enum dag_program program, char* text, size_t size) {
+    char t[64];
+    snprintf(t, sizeof(t), "tensor<%dxf32>", DAG_ELEMENTS);
+    int length = -1;
+    if (program == DAG_SPLIT) {
+        length = snprintf(text, size, "module @split {\n  func.func public @main(%%x: %s) -> (", t);
+        for (int b = 0; b < DAG_BRANCHES && length > 0 && (size_t)length < size; ++b) {
+            length += snprintf(text + length, size - length, "%s%s", b ? ", " : "", t);
+        }
+        if (length > 0 && (size_t)length < size) length += snprintf(text + length, size - length, ") {\n");
+        for (int b = 0; b < DAG_BRANCHES && length > 0 && (size_t)length < size; ++b) {
+            length += snprintf(text + length, size - length,
+                               "    %%s%d = stablehlo.constant dense<%.9e> : %s\n"
+                               "    %%y%d = stablehlo.multiply %%x, %%s%d : %s\n",
+                               b, dag_branch_scales[b], t, b, b, t);
+        }
+        if (length > 0 && (size_t)length < size) length += snprintf(text + length, size - length, "    return");
+        for (int b = 0; b < DAG_BRANCHES && length > 0 && (size_t)length < size; ++b) {
+            length += snprintf(text + length, size - length, "%s %%y%d", b ? "," : "", b);
+        }
+        if (length > 0 && (size_t)length < size) length += snprintf(text + length, size - length, " :");
+        for (int b = 0; b < DAG_BRANCHES && length > 0 && (size_t)length < size; ++b) {
+            length += snprintf(text + length, size - length, "%s %s", b ? "," : "", t);
+        }
+        if (length > 0 && (size_t)length < size) length += snprintf(text + length, size - length, "\n  }\n}\n");
+    } else if (program == DAG_BRANCH) {
+        length = snprintf(text, size, "module @branch {\n  func.func public @main(%%x: %1$s) -> %1$s {\n", t);
+        for (int d = 0; d < DAG_BRANCH_DEPTH && length > 0 && (size_t)length < size; ++d) {
+            char r[16];
+            snprintf(r, sizeof(r), d ? "%%r%d" : "%%x", d - 1);
+            length += snprintf(text + length, size - length,
+                               "    %%s%1$d = stablehlo.sine %2$s : %3$s\n"
+                               "    %%a%1$d = stablehlo.add %%s%1$d, %%x : %3$s\n"
+                               "    %%r%1$d = stablehlo.tanh %%a%1$d : %3$s\n",
+                               d, r, t);
+        }
+        if (length > 0 && (size_t)length < size) {
+            length += snprintf(text + length, size - length, "    return %%r%d : %s\n  }\n}\n",
+                               DAG_BRANCH_DEPTH - 1, t);
+        }
+    } else {
+        length = snprintf(text, size,
+            "module @combine {\n"
+            "  func.func public @main(%%a: %1$s, %%b: %1$s) -> %1$s {\n"
+            "    %%y = stablehlo.add %%a, %%b : %1$s\n"
+            "    return %%y : %1$s\n"
+            "  }\n"
+            "}\n",
+            t);
+    }
+    return length > 0 && (size_t)length < size ? length : -1;
+}
+
+
+// Split, DAG_BRANCHES branches, then a binary tree of combines; the last node is the output.
+static size_t build_dag(PJRT_LoadedExecutable* const* executables, struct dag_node* nodes) {
+    size_t n = 0;
+    memset(nodes, 0, (2 * DAG_BRANCHES + 1) * sizeof(struct dag_node));
+    nodes[n].name = "split";
+    nodes[n].executable = executables[DAG_SPLIT];
+    nodes[n].num_inputs = 1;
+    nodes[n].inputs[0].node = -1;
+    nodes[n].num_outputs = DAG_BRANCHES;
+    n++;
+    size_t level = n;
+    for (int b = 0; b < DAG_BRANCHES; ++b, ++n) {
+        nodes[n].name = "branch";
+        nodes[n].executable = executables[DAG_BRANCH];
+        nodes[n].num_inputs = 1;
+        nodes[n].inputs[0].node = 0;
+        nodes[n].inputs[0].output = b;
+        nodes[n].num_outputs = 1;
+    }
+    for (size_t width = DAG_BRANCHES; width > 1; width /= 2) {
+        size_t next = n;
+        for (size_t i = 0; i < width; i += 2, ++n) {
+            nodes[n].name = "combine";
+            nodes[n].executable = executables[DAG_COMBINE];
+            nodes[n].num_inputs = 2;
+            nodes[n].inputs[0].node = (int)(level + i);
+            nodes[n].inputs[1].node = (int)(level + i + 1);
+            nodes[n].num_outputs = 1;
+        }
+        level = next;
+    }
+    return n;
+}
+
+
+// The graph's result computed on the host in double precision.
+static void dag_reference(const float* x, float* out) {
+    for (size_t e = 0; e < DAG_ELEMENTS; ++e) {
+        double sum = 0.0;
+        for (int b = 0; b < DAG_BRANCHES; ++b) {
+            double v = (double)(float)(x[e] * dag_branch_scales[b]);
+            double r = v;
+            for (int d = 0; d < DAG_BRANCH_DEPTH; ++d) r = tanh(sin(r) + v);
+            sum += r;
+        }
+        out[e] = (float)sum;
+    }
+}
+
+
+// --- Function to compare host round trips with device-resident DAG execution ---
+int run_dag_benchmark(const PJRT_Api* api, PJRT_Client* client, PJRT_Device* device, int workers, int iterations,
+                      double tolerance) {
+    int rc = 1;
+    struct file_data compile_options = {NULL, 0};
+    PJRT_LoadedExecutable* executables[NUM_DAG_PROGRAMS] = {NULL};
+    PJRT_Buffer* input = NULL;
+    struct host_tensor results[3];
+    double* samples = (double*)calloc(iterations, sizeof(double));
+    float* x = (float*)malloc(DAG_ELEMENTS * sizeof(float));
+    float* reference = (float*)malloc(DAG_ELEMENTS * sizeof(float));
+    memset(results, 0, sizeof(results));
+    if (samples == NULL || x == NULL || reference == NULL ||
+        read_file_to_buffer("./compile_options.0.pb", &compile_options) != 0) {
+        goto cleanup_dag_benchmark;
+    }
+    for (int p = 0; p < NUM_DAG_PROGRAMS; ++p) {
+        char text[DAG_PROGRAM_TEXT_SIZE];
+        int length = render_dag_program((enum dag_program)p, text, sizeof(text));
+        struct file_data code = {text, length > 0 ? (size_t)length : 0};
+        executables[p] = length > 0 ? compile_program(api, client, &code, "mlir", &compile_options) : NULL;
+        if (executables[p] == NULL) goto cleanup_dag_benchmark;
+    }
+    struct dag_node nodes[2 * DAG_BRANCHES + 1];
+    struct dag_value output = {0, 0};
+    struct dag dag = {nodes, build_dag(executables, nodes), 1, &output, 1};
+    output.node = (int)dag.num_nodes - 1;
+
+    for (size_t e = 0; e < DAG_ELEMENTS; ++e) x[e] = (float)((double)e / DAG_ELEMENTS * 8.0 - 4.0);
+    int64_t dims[1] = {DAG_ELEMENTS};
+    input = create_buffer_from_host(api, client, device, x, PJRT_Buffer_Type_F32, dims, 1, "DAG input");
+    if (input == NULL) goto cleanup_dag_benchmark;
+    dag_reference(x, reference);
+
+    printf("\n--- DAG: %zu nodes, %d branch(es) of %d steps over %d elements, %d iteration(s) ---\n", dag.num_nodes,
+           DAG_BRANCHES, DAG_BRANCH_DEPTH, DAG_ELEMENTS, iterations);
+    printf("  %-30s %10s %10s %10s %12s %10s\n", "mode", "median ms", "max live", "max busy", "freed early",
+           "max error");
+    static const char* const modes[3] = {"via host, sequential", "device-resident, 1 worker", "device-resident"};
+    int mode_workers[3] = {1, 1, workers};
+    for (int mode = 0; mode < 3; ++mode) {
+        struct dag_stats stats;
+        memset(&stats, 0, sizeof(stats));
+        for (int i = 0; i < iterations; ++i) {
+            free_host_tensor(&results[mode]);
+            double start = now_seconds();
+            if (mode == 0) {
+                if (dag_run_via_host(api, client, device, &dag, &input, &results[mode]) != 0) {
+                    goto cleanup_dag_benchmark;
+                }
+            } else {
+                PJRT_Buffer* out = NULL;
+                int run_rc = dag_run(api, &dag, &input, mode_workers[mode], &out, &stats) ||
+                             buffer_to_host(api, out, &results[mode]);
+                destroy_buffer(api, out, "PJRT_Buffer_Destroy (DAG output)");
+                if (run_rc != 0) goto cleanup_dag_benchmark;
+            }
+            samples[i] = now_seconds() - start;
+        }
+        double max_error = 0.0;
+        const float* y = (const float*)results[mode].data;
+        for (size_t e = 0; e < DAG_ELEMENTS && results[mode].size == DAG_ELEMENTS * sizeof(float); ++e) {
+            double error = fabs((double)y[e] - reference[e]);
+            if (!(error <= max_error)) max_error = error; // NaN sticks
+        }
+        char name[64];
+        if (mode == 2) {
+            snprintf(name, sizeof(name), "%s, %d workers", modes[mode], workers);
+        } else {
+            snprintf(name, sizeof(name), "%s", modes[mode]);
+        }
+        if (mode == 0) {
+            printf("  %-30s %10.3f %10s %10s %12s %10.2e\n", name, median_of(samples, iterations) * 1e3, "-", "1",
+                   "-", max_error);
+        } else {
+            printf("  %-30s %10.3f %10zu %10zu %12zu %10.2e\n", name, median_of(samples, iterations) * 1e3,
+                   stats.max_live, stats.max_running, stats.freed_early, max_error);
+        }
+        if (!(max_error <= DAG_REFERENCE_TOLERANCE * DAG_BRANCHES) ||
+            (mode > 0 && !host_tensors_match(&results[0], &results[mode], tolerance))) {
+            fprintf(stderr, "DAG result of '%s' does not match\n", name);
+            goto cleanup_dag_benchmark;
+        }
+    }
+    printf("  max live: intermediates held at once, of %d bytes each; max busy: nodes running at once.\n",
+           DAG_ELEMENTS * (int)sizeof(float));
+    rc = 0;
+
+cleanup_dag_benchmark:
+    for (int mode = 0; mode < 3; ++mode) free_host_tensor(&results[mode]);
+    destroy_buffer(api, input, "PJRT_Buffer_Destroy (DAG input)");
+    for (int p = 0; p < NUM_DAG_PROGRAMS; ++p) {
+        if (executables[p] != NULL) destroy_loaded_executable(api, executables[p]);
+    }
+    free_file_data(&compile_options);
+    free(samples);
+    free(x);
+    free(reference);
+    return rc;
+}
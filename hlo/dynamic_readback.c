@@ -0,0 +1,135 @@
+// Readback of bounded-dynamic outputs.
+//
+// dynamic_rows.mlir returns a tensor<?x256xf32> bounded by 1024 rows whose
+// unpadded size is an input. The benchmark reads the same output back with
+// buffer_to_host, which copies the padded extent, and with
+// buffer_to_host_unpadded, which copies only the valid rows.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "hlo_test.h"
+
+#define DYNAMIC_ROWS_PATH "./dynamic_rows.mlir"
+#define DYNAMIC_ROWS_BOUND 1024
+#define DYNAMIC_ROWS_COLS 256
+
+
+// --- Function to time both readback paths for one valid row count ---
+// `rows` is the row count the unpadded copy should have: the valid rows, or the bound when the plugin
+// reports no dynamic dimensions.
+static int time_readbacks(const PJRT_Api* api, PJRT_Buffer* output, int iterations, int32_t rows,
+                          double* padded_s, size_t* padded_bytes, double* unpadded_s, size_t* unpadded_bytes) {
+    double* samples = (double*)calloc(iterations, sizeof(double));
+    if (samples == NULL) return 1;
+    int rc = 0;
+    struct host_tensor full = {0};
+    struct host_tensor valid = {0};
+    for (int path = 0; path < 2 && rc == 0; ++path) {
+        for (int i = 0; i < iterations && rc == 0; ++i) {
+            struct host_tensor* tensor = path == 0 ? &full : &valid;
+            free_host_tensor(tensor);
+            double start = now_seconds();
+            rc = path == 0 ? buffer_to_host(api, output, tensor)
+                           : buffer_to_host_unpadded(api, output, tensor, unpadded_bytes);
+            samples[i] = now_seconds() - start;
+        }
+        if (rc == 0) *(path == 0 ? padded_s : unpadded_s) = median_of(samples, iterations);
+    }
+    if (rc == 0) {
+        *padded_bytes = full.size;
+        // The valid rows are the leading rows of the padded copy.
+        size_t valid_size = (size_t)rows * DYNAMIC_ROWS_COLS * sizeof(float);
+        if (valid.num_dims != 2 || valid.dims[0] != rows || valid.dims[1] != DYNAMIC_ROWS_COLS ||
+            valid.size != valid_size || full.size < valid_size || memcmp(full.data, valid.data, valid_size) != 0) {
+            fprintf(stderr, "Unpadded readback of %d rows does not match the padded copy.\n", rows);
+            rc = 1;
+        }
+    }
+    free_host_tensor(&full);
+    free_host_tensor(&valid);
+    free(samples);
+    return rc;
+}
+
+
+// --- Function to compare padded and unpadded readback of a dynamic output ---
+int run_dynamic_readback_benchmark(const PJRT_Api* api, PJRT_Client* client, PJRT_Device* device,
+                                   int iterations) {
+    static const int32_t valid_rows[] = {1, 16, 128, 512, DYNAMIC_ROWS_BOUND};
+    int rc = 1;
+    struct file_data program = {NULL, 0};
+    struct file_data compile_options = {NULL, 0};
+    PJRT_LoadedExecutable* executable = NULL;
+    PJRT_Buffer* inputs[2] = {NULL, NULL};
+    int64_t x_dims[2] = {DYNAMIC_ROWS_BOUND, DYNAMIC_ROWS_COLS};
+    int dynamic_dims = 1;
+    float* x = (float*)malloc(sizeof(float) * DYNAMIC_ROWS_BOUND * DYNAMIC_ROWS_COLS);
+
+    printf("\n--- Dynamic-dimension readback: %s ---\n", DYNAMIC_ROWS_PATH);
+    if (x == NULL) goto cleanup_dynamic;
+    for (size_t i = 0; i < (size_t)DYNAMIC_ROWS_BOUND * DYNAMIC_ROWS_COLS; ++i) x[i] = (float)(i % 97) * 0.01f;
+    if (read_file_to_buffer(DYNAMIC_ROWS_PATH, &program) != 0 ||
+        read_file_to_buffer("./compile_options.0.pb", &compile_options) != 0) {
+        goto cleanup_dynamic;
+    }
+    executable = compile_program(api, client, &program, "mlir", &compile_options);
+    if (executable == NULL) goto cleanup_dynamic;
+    inputs[0] = create_buffer_from_host(api, client, device, x, PJRT_Buffer_Type_F32, x_dims, 2, "Input x");
+    if (inputs[0] == NULL) goto cleanup_dynamic;
+
+    printf("  %-10s %12s %12s %11s %13s %8s\n", "rows", "padded(KiB)", "copied(KiB)", "padded(ms)",
+           "unpadded(ms)", "saved");
+    for (size_t r = 0; r < sizeof(valid_rows) / sizeof(valid_rows[0]); ++r) {
+        int32_t rows = valid_rows[r];
+        inputs[1] = create_buffer_from_host(api, client, device, &rows, PJRT_Buffer_Type_S32, NULL, 0, "Input n");
+        if (inputs[1] == NULL) goto cleanup_dynamic;
+        PJRT_Buffer** outputs = NULL;
+        size_t num_outputs = 0;
+        int run_rc = execute_hlo_program(api, executable, inputs, 2, &outputs, &num_outputs) ||
+                     await_buffers_ready(api, outputs, num_outputs);
+        if (run_rc == 0 && num_outputs != 1) {
+            fprintf(stderr, "Expected one output, got %zu.\n", num_outputs);
+            run_rc = 1;
+        }
+        if (run_rc == 0 && r == 0) {
+            PJRT_Buffer_DynamicDimensionIndices_Args dynamic_args = {0};
+            dynamic_args.struct_size = PJRT_Buffer_DynamicDimensionIndices_Args_STRUCT_SIZE;
+            dynamic_args.buffer = outputs[0];
+            if (!handle_error(api->PJRT_Buffer_DynamicDimensionIndices(&dynamic_args), api,
+                              "PJRT_Buffer_DynamicDimensionIndices") &&
+                dynamic_args.num_dynamic_dims == 0) {
+                printf("Note: the plugin reports no dynamic dimensions; both paths copy the full extent.\n");
+                dynamic_dims = 0;
+            }
+        }
+
+        double padded_s = 0.0, unpadded_s = 0.0;
+        size_t padded_bytes = 0, unpadded_bytes = 0;
+        if (run_rc == 0) {
+            run_rc = time_readbacks(api, outputs[0], iterations, dynamic_dims ? rows : DYNAMIC_ROWS_BOUND, &padded_s,
+                                    &padded_bytes, &unpadded_s, &unpadded_bytes);
+        }
+        destroy_buffers(api, outputs, num_outputs, "PJRT_Buffer_Destroy (dynamic output)");
+        destroy_buffer(api, inputs[1], "PJRT_Buffer_Destroy (dynamic size)");
+        inputs[1] = NULL;
+        if (run_rc != 0) goto cleanup_dynamic;
+        printf("  %-10d %12.1f %12.1f %11.4f %13.4f ", rows, padded_bytes / 1024.0, unpadded_bytes / 1024.0,
+               padded_s * 1e3, unpadded_s * 1e3);
+        if (dynamic_dims) {
+            printf("%7.1f%%\n", padded_s > 0.0 ? 100.0 * (padded_s - unpadded_s) / padded_s : 0.0);
+        } else {
+            printf("%8s\n", "n/a"); // Nothing to save when the full extent is valid
+        }
+    }
+    rc = 0;
+
+cleanup_dynamic:
+    destroy_buffer(api, inputs[0], "PJRT_Buffer_Destroy (dynamic input)");
+    destroy_buffer(api, inputs[1], "PJRT_Buffer_Destroy (dynamic size)");
+    free(x);
+    if (executable != NULL) destroy_loaded_executable(api, executable);
+    free_file_data(&program);
+    free_file_data(&compile_options);
+    return rc;
+}
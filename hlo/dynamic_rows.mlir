@@ -0,0 +1,9 @@
+// Squares the first %n rows of %x and returns them as a bounded-dynamic
+// result: the buffer keeps the 1024-row bound, its unpadded size is %n rows.
+module @dynamic_rows {
+  func.func public @main(%x: tensor<1024x256xf32>, %n: tensor<i32>) -> tensor<?x256xf32, #stablehlo.bounds<1024, ?>> {
+    %sq = stablehlo.multiply %x, %x : tensor<1024x256xf32>
+    %y = "stablehlo.set_dimension_size"(%sq, %n) {dimension = 0 : i64} : (tensor<1024x256xf32>, tensor<i32>) -> tensor<?x256xf32, #stablehlo.bounds<1024, ?>>
+    return %y : tensor<?x256xf32, #stablehlo.bounds<1024, ?>>
+  }
+}
@@ -0,0 +1,249 @@
+// Pooled per-request PJRT_ExecuteContext objects.
+//
+// Each pooled context gets its request_state attached as FFI user data once,
+// when it is created. Acquiring a context only resets the scratch arena and
+// stores the caller's user data pointer, so the request path neither creates
+// contexts nor allocates.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "hlo_test.h"
+
+#define SCRATCH_ALIGNMENT 64
+
+
+static struct execute_context* create_execute_context(struct execute_context_pool* pool) {
+    struct execute_context* ctx = (struct execute_context*)calloc(1, sizeof(*ctx));
+    if (ctx == NULL) {
+        fprintf(stderr, "Failed to allocate execute context.\n");
+        return NULL;
+    }
+    if (pool->scratch_size > 0) {
+        size_t size = (pool->scratch_size + SCRATCH_ALIGNMENT - 1) & ~(size_t)(SCRATCH_ALIGNMENT - 1);
+        ctx->state.scratch = (uint8_t*)aligned_alloc(SCRATCH_ALIGNMENT, size);
+        if (ctx->state.scratch == NULL) {
+            fprintf(stderr, "Failed to allocate %zu byte scratch arena.\n", size);
+            free(ctx);
+            return NULL;
+        }
+        ctx->state.scratch_size = size;
+    }
+
+    PJRT_ExecuteContext_Create_Args create_args = {0};
+    create_args.struct_size = PJRT_ExecuteContext_Create_Args_STRUCT_SIZE;
+    if (handle_error(pool->api->PJRT_ExecuteContext_Create(&create_args), pool->api, "PJRT_ExecuteContext_Create")) {
+        free(ctx->state.scratch);
+        free(ctx);
+        return NULL;
+    }
+    ctx->context = create_args.context;
+    // Pool misses create contexts outside the lock, so the flag is read and cleared atomically.
+    if (__atomic_load_n(&pool->with_user_data, __ATOMIC_RELAXED) &&
+        ffi_attach_request_state(pool->api, ctx->context, &ctx->state) != 0 &&
+        __atomic_exchange_n(&pool->with_user_data, 0, __ATOMIC_RELAXED)) {
+        fprintf(stderr, "Execute contexts will not carry request state (FFI user data unavailable).\n");
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    ctx->next_all = pool->all;
+    pool->all = ctx;
+    pool->created++;
+    pthread_mutex_unlock(&pool->lock);
+    return ctx;
+}
+
+
+// --- Function to create a pool with `count` ready contexts ---
+int execute_context_pool_init(struct execute_context_pool* pool, const PJRT_Api* api, size_t count,
+                              size_t scratch_size) {
+    memset(pool, 0, sizeof(*pool));
+    pool->api = api;
+    pool->scratch_size = scratch_size;
+    pool->with_user_data = 1;
+    pthread_mutex_init(&pool->lock, NULL);
+    for (size_t i = 0; i < count; ++i) {
+        struct execute_context* ctx = create_execute_context(pool);
+        if (ctx == NULL) {
+            execute_context_pool_destroy(pool);
+            return 1;
+        }
+        ctx->next_free = pool->free_list;
+        pool->free_list = ctx;
+    }
+    return 0;
+}
+
+
+// --- Function to take a context for one request ---
+// Falls back to creating a new context when the pool is empty; it joins the
+// pool on release.
+struct execute_context* execute_context_acquire(struct execute_context_pool* pool, void* user_data) {
+    pthread_mutex_lock(&pool->lock);
+    struct execute_context* ctx = pool->free_list;
+    if (ctx != NULL) {
+        pool->free_list = ctx->next_free;
+    } else {
+        pool->misses++;
+    }
+    pool->acquired++;
+    pthread_mutex_unlock(&pool->lock);
+
+    if (ctx == NULL) {
+        ctx = create_execute_context(pool);
+        if (ctx == NULL) return NULL;
+    }
+    ctx->next_free = NULL;
+    ctx->state.user_data = user_data;
+    ctx->state.scratch_used = 0;
+    return ctx;
+}
+
+
+// --- Function to return a context once its execution has completed ---
+void execute_context_release(struct execute_context_pool* pool, struct execute_context* ctx) {
+    ctx->state.user_data = NULL;
+    pthread_mutex_lock(&pool->lock);
+    ctx->next_free = pool->free_list;
+    pool->free_list = ctx;
+    pthread_mutex_unlock(&pool->lock);
+}
+
+
+void execute_context_pool_destroy(struct execute_context_pool* pool) {
+    struct execute_context* ctx = pool->all;
+    while (ctx != NULL) {
+        struct execute_context* next = ctx->next_all;
+        PJRT_ExecuteContext_Destroy_Args destroy_args = {0};
+        destroy_args.struct_size = PJRT_ExecuteContext_Destroy_Args_STRUCT_SIZE;
+        destroy_args.context = ctx->context;
+        handle_error(pool->api->PJRT_ExecuteContext_Destroy(&destroy_args), pool->api, "PJRT_ExecuteContext_Destroy");
+        free(ctx->state.scratch);
+        free(ctx);
+        ctx = next;
+    }
+    pool->all = NULL;
+    pool->free_list = NULL;
+    pthread_mutex_destroy(&pool->lock);
+}
+
+
+// --- Bump allocation from the request's scratch arena ---
+// Returns NULL when the arena is exhausted; memory is reclaimed on the next acquire.
+void* request_scratch_alloc(struct request_state* state, size_t size, size_t alignment) {
+    size_t offset = (state->scratch_used + alignment - 1) & ~(alignment - 1);
+    if (state->scratch == NULL || offset + size > state->scratch_size) {
+        return NULL;
+    }
+    state->scratch_used = offset + size;
+    return state->scratch + offset;
+}
+
+
+// --- Function to compare request paths with and without execute contexts ---
+// Runs the FFI custom-call test case with no context, with a context created
+// and destroyed per request, and with contexts taken from the pool.
+int run_execute_context_benchmark(const PJRT_Api* api, PJRT_Client* client, PJRT_Device* device,
+                                  int iterations) {
+    enum { MODE_NONE, MODE_PER_REQUEST, MODE_POOLED, NUM_MODES };
+    static const char* const mode_names[NUM_MODES] = {"no context", "created per request", "pooled"};
+    const size_t scratch_size = 1 << 20;
+    int rc = 1;
+    struct file_data program = {NULL, 0};
+    struct file_data compile_options = {NULL, 0};
+    PJRT_LoadedExecutable* executable = NULL;
+    PJRT_Buffer** inputs = NULL;
+    double* samples = NULL;
+    struct execute_context_pool pool;
+    int pool_ready = 0;
+
+    printf("\n--- Execute context benchmark ---\n");
+    if (register_ffi_handlers(api) != 0) return 1;
+    const TestCase* test_case = ffi_rms_norm_test_case(1);
+    if (read_file_to_buffer(test_case->hlo_path, &program) != 0 ||
+        read_file_to_buffer(test_case->compile_options_path, &compile_options) != 0) {
+        goto cleanup_context_bench;
+    }
+    executable = compile_program(api, client, &program, program_format_from_path(test_case->hlo_path),
+                                 &compile_options);
+    if (executable == NULL) goto cleanup_context_bench;
+    inputs = create_input_buffers(api, client, device, test_case);
+    if (inputs == NULL) goto cleanup_context_bench;
+    if (execute_context_pool_init(&pool, api, 2, scratch_size) != 0) goto cleanup_context_bench;
+    pool_ready = 1;
+    samples = (double*)calloc(iterations, sizeof(double));
+    if (samples == NULL) goto cleanup_context_bench;
+
+    printf("  %-22s %12s\n", "request path", "median(ms)");
+    struct ffi_call_stats stats = {0, 0, NULL};
+    for (int mode = 0; mode < NUM_MODES; ++mode) {
+        for (int i = -1; i < iterations; ++i) { // i == -1 is the warm-up run
+            struct execute_context* pooled = NULL;
+            PJRT_ExecuteContext* context = NULL;
+            struct request_state owned = {0};
+            double start = now_seconds();
+            if (mode == MODE_PER_REQUEST) {
+                PJRT_ExecuteContext_Create_Args create_args = {0};
+                create_args.struct_size = PJRT_ExecuteContext_Create_Args_STRUCT_SIZE;
+                if (handle_error(api->PJRT_ExecuteContext_Create(&create_args), api, "PJRT_ExecuteContext_Create")) {
+                    goto cleanup_context_bench;
+                }
+                context = create_args.context;
+                owned.scratch = (uint8_t*)malloc(scratch_size);
+                owned.scratch_size = owned.scratch ? scratch_size : 0;
+                owned.user_data = &stats;
+                ffi_attach_request_state(api, context, &owned);
+            } else if (mode == MODE_POOLED) {
+                pooled = execute_context_acquire(&pool, &stats);
+                if (pooled == NULL) goto cleanup_context_bench;
+                context = pooled->context;
+            }
+
+            PJRT_Buffer** outputs = NULL;
+            size_t num_outputs = 0;
+            stats.row_scales = NULL; // May still point into the freed scratch of the previous request
+            int exec_rc = execute_hlo_program_with_context(api, executable, inputs, test_case->num_inputs, context,
+                                                           &outputs, &num_outputs) ||
+                          await_buffers_ready(api, outputs, num_outputs);
+            destroy_buffers(api, outputs, num_outputs, "PJRT_Buffer_Destroy (context output)");
+            if (exec_rc == 0 && pooled != NULL && __atomic_load_n(&pool.with_user_data, __ATOMIC_RELAXED) &&
+                (stats.row_scales == NULL || !(stats.row_scales[0] > 0.0f))) {
+                fprintf(stderr, "Custom call did not write its row scales to the request scratch arena.\n");
+                exec_rc = 1;
+            }
+
+            if (pooled != NULL) {
+                execute_context_release(&pool, pooled);
+            } else if (context != NULL) {
+                PJRT_ExecuteContext_Destroy_Args destroy_args = {0};
+                destroy_args.struct_size = PJRT_ExecuteContext_Destroy_Args_STRUCT_SIZE;
+                destroy_args.context = context;
+                handle_error(api->PJRT_ExecuteContext_Destroy(&destroy_args), api, "PJRT_ExecuteContext_Destroy");
+                free(owned.scratch);
+            }
+            if (exec_rc != 0) goto cleanup_context_bench;
+            if (i >= 0) samples[i] = now_seconds() - start;
+        }
+        printf("  %-22s %12.4f\n", mode_names[mode], median_of(samples, iterations) * 1e3);
+    }
+
+    printf("Pool: %zu context(s) created, %zu acquisitions, %zu miss(es).\n", pool.created, pool.acquired,
+           pool.misses);
+    if (__atomic_load_n(&pool.with_user_data, __ATOMIC_RELAXED)) {
+        // Two context modes ran iterations + 1 requests each.
+        uint64_t expected_calls = 2 * (uint64_t)(iterations + 1);
+        printf("Custom call saw request state in %llu of %llu context requests.\n",
+               (unsigned long long)stats.calls, (unsigned long long)expected_calls);
+        if (stats.calls != expected_calls) goto cleanup_context_bench;
+    }
+    rc = 0;
+
+cleanup_context_bench:
+    free(samples);
+    if (pool_ready) execute_context_pool_destroy(&pool);
+    destroy_buffers(api, inputs, test_case->num_inputs, "PJRT_Buffer_Destroy (context input)");
+    if (executable != NULL) destroy_loaded_executable(api, executable);
+    free_file_data(&program);
+    free_file_data(&compile_options);
+    return rc;
+}
@@ -0,0 +1,417 @@
+// Host custom-call kernels registered through the PJRT FFI extension.
+//
+// The sample kernel is RMS normalization over the last dimension,
+// y = x * rsqrt(mean(x * x) + eps) * w, with scalar, AVX2 and AVX-512
+// implementations selected at run time. ffi_rms_norm.mlir calls it as the
+// typed FFI custom call "hlo_test_rms_norm"; rms_norm.mlir is the same
+// computation in plain StableHLO for comparison.
+//
+// The FFI glue needs pjrt_c_api_ffi_extension.h and xla/ffi/api/c_api.h, which
+// `make run.exec` copies next to pjrt_c_api.h. Without them hlo_test is built
+// without custom-call support.
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HAVE_X86_KERNELS 1
+#endif
+
+#if __has_include("xla/ffi/api/c_api.h") && __has_include("xla/pjrt/c/pjrt_c_api_ffi_extension.h")
+#include "xla/ffi/api/c_api.h"
+#include "xla/pjrt/c/pjrt_c_api_ffi_extension.h"
+#define HAVE_XLA_FFI 1
+#endif
+
+#include "hlo_test.h"
+
+#define RMS_NORM_TARGET "hlo_test_rms_norm"
+#define RMS_NORM_ROWS 256
+#define RMS_NORM_COLS 4096
+#define RMS_NORM_EPS 1e-6f
+
+// `row_scales`, when not NULL, receives the per-row rsqrt(mean(x * x) + eps).
+typedef void (*rms_norm_fn)(const float* x, const float* w, float* y, float* row_scales,
+                            int64_t rows, int64_t cols, float eps);
+
+// --- Scalar reference kernel ---
+static void rms_norm_scalar(const float* x, const float* w, float* y, float* row_scales,
+                            int64_t rows, int64_t cols, float eps) {
+    for (int64_t r = 0; r < rows; ++r) {
+        const float* xr = x + r * cols;
+        float* yr = y + r * cols;
+        float sum = 0.0f;
+        for (int64_t c = 0; c < cols; ++c) sum += xr[c] * xr[c];
+        float scale = 1.0f / sqrtf(sum / (float)cols + eps);
+        if (row_scales) row_scales[r] = scale;
+        for (int64_t c = 0; c < cols; ++c) yr[c] = xr[c] * scale * w[c];
+    }
+}
+
+#ifdef HAVE_X86_KERNELS
+// --- AVX2/FMA kernel: four independent accumulators hide the FMA latency ---
+__attribute__((target("avx2,fma")))
+static void rms_norm_avx2(const float* x, const float* w, float* y, float* row_scales,
+                          int64_t rows, int64_t cols, float eps) {
+    for (int64_t r = 0; r < rows; ++r) {
+        const float* xr = x + r * cols;
+        float* yr = y + r * cols;
+        __m256 acc0 = _mm256_setzero_ps(), acc1 = _mm256_setzero_ps();
+        __m256 acc2 = _mm256_setzero_ps(), acc3 = _mm256_setzero_ps();
+        int64_t c = 0;
+        for (; c + 32 <= cols; c += 32) {
+            __m256 v0 = _mm256_loadu_ps(xr + c);
+            __m256 v1 = _mm256_loadu_ps(xr + c + 8);
+            __m256 v2 = _mm256_loadu_ps(xr + c + 16);
+            __m256 v3 = _mm256_loadu_ps(xr + c + 24);
+            acc0 = _mm256_fmadd_ps(v0, v0, acc0);
+            acc1 = _mm256_fmadd_ps(v1, v1, acc1);
+            acc2 = _mm256_fmadd_ps(v2, v2, acc2);
+            acc3 = _mm256_fmadd_ps(v3, v3, acc3);
+        }
+        __m256 acc = _mm256_add_ps(_mm256_add_ps(acc0, acc1), _mm256_add_ps(acc2, acc3));
+        __m128 sum4 = _mm_add_ps(_mm256_castps256_ps128(acc), _mm256_extractf128_ps(acc, 1));
+        sum4 = _mm_add_ps(sum4, _mm_movehl_ps(sum4, sum4));
+        sum4 = _mm_add_ss(sum4, _mm_movehdup_ps(sum4));
+        float sum = _mm_cvtss_f32(sum4);
+        for (; c < cols; ++c) sum += xr[c] * xr[c];
+
+        float scale = 1.0f / sqrtf(sum / (float)cols + eps);
+        if (row_scales) row_scales[r] = scale;
+        __m256 vscale = _mm256_set1_ps(scale);
+        for (c = 0; c + 8 <= cols; c += 8) {
+            __m256 v = _mm256_mul_ps(_mm256_loadu_ps(xr + c), vscale);
+            _mm256_storeu_ps(yr + c, _mm256_mul_ps(v, _mm256_loadu_ps(w + c)));
+        }
+        for (; c < cols; ++c) yr[c] = xr[c] * scale * w[c];
+    }
+}
+
+// --- AVX-512 kernel ---
+__attribute__((target("avx512f")))
+static void rms_norm_avx512(const float* x, const float* w, float* y, float* row_scales,
+                            int64_t rows, int64_t cols, float eps) {
+    for (int64_t r = 0; r < rows; ++r) {
+        const float* xr = x + r * cols;
+        float* yr = y + r * cols;
+        __m512 acc0 = _mm512_setzero_ps(), acc1 = _mm512_setzero_ps();
+        __m512 acc2 = _mm512_setzero_ps(), acc3 = _mm512_setzero_ps();
+        int64_t c = 0;
+        for (; c + 64 <= cols; c += 64) {
+            __m512 v0 = _mm512_loadu_ps(xr + c);
+            __m512 v1 = _mm512_loadu_ps(xr + c + 16);
+            __m512 v2 = _mm512_loadu_ps(xr + c + 32);
+            __m512 v3 = _mm512_loadu_ps(xr + c + 48);
+            acc0 = _mm512_fmadd_ps(v0, v0, acc0);
+            acc1 = _mm512_fmadd_ps(v1, v1, acc1);
+            acc2 = _mm512_fmadd_ps(v2, v2, acc2);
+            acc3 = _mm512_fmadd_ps(v3, v3, acc3);
+        }
+        float sum = _mm512_reduce_add_ps(_mm512_add_ps(_mm512_add_ps(acc0, acc1), _mm512_add_ps(acc2, acc3)));
+        for (; c < cols; ++c) sum += xr[c] * xr[c];
+
+        float scale = 1.0f / sqrtf(sum / (float)cols + eps);
+        if (row_scales) row_scales[r] = scale;
+        __m512 vscale = _mm512_set1_ps(scale);
+        for (c = 0; c + 16 <= cols; c += 16) {
+            __m512 v = _mm512_mul_ps(_mm512_loadu_ps(xr + c), vscale);
+            _mm512_storeu_ps(yr + c, _mm512_mul_ps(v, _mm512_loadu_ps(w + c)));
+        }
+        for (; c < cols; ++c) yr[c] = xr[c] * scale * w[c];
+    }
+}
+#endif
+
+struct rms_norm_impl {
+    const char* name;
+    rms_norm_fn fn;
+};
+
+// Available implementations, best last.
+static struct rms_norm_impl rms_norm_impls[3];
+static size_t num_rms_norm_impls;
+// Implementation the custom call dispatches to.
+static rms_norm_fn rms_norm_kernel = rms_norm_scalar;
+
+static void select_rms_norm_kernels(void) {
+    if (num_rms_norm_impls != 0) return;
+    rms_norm_impls[num_rms_norm_impls++] = (struct rms_norm_impl){"scalar", rms_norm_scalar};
+#ifdef HAVE_X86_KERNELS
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+        rms_norm_impls[num_rms_norm_impls++] = (struct rms_norm_impl){"avx2", rms_norm_avx2};
+    }
+    if (__builtin_cpu_supports("avx512f")) {
+        rms_norm_impls[num_rms_norm_impls++] = (struct rms_norm_impl){"avx512", rms_norm_avx512};
+    }
+#endif
+    rms_norm_kernel = rms_norm_impls[num_rms_norm_impls - 1].fn;
+}
+
+
+#ifdef HAVE_XLA_FFI
+// FFI type id of struct request_state, assigned by PJRT_FFI_TypeID_Register.
+static int64_t request_state_type_id;
+
+static XLA_FFI_Error* ffi_error(const XLA_FFI_Api* api, XLA_FFI_Error_Code code, const char* message) {
+    XLA_FFI_Error_Create_Args args = {0};
+    args.struct_size = XLA_FFI_Error_Create_Args_STRUCT_SIZE;
+    args.message = message;
+    args.errc = code;
+    return api->XLA_FFI_Error_Create(&args);
+}
+
+// --- Look up the request_state attached to the execute context, if any ---
+static struct request_state* ffi_request_state(XLA_FFI_CallFrame* call_frame) {
+    if (request_state_type_id == 0 || call_frame->ctx == NULL) return NULL;
+    XLA_FFI_TypeId type_id = {request_state_type_id};
+    XLA_FFI_ExecutionContext_Get_Args args = {0};
+    args.struct_size = XLA_FFI_ExecutionContext_Get_Args_STRUCT_SIZE;
+    args.ctx = call_frame->ctx;
+    args.type_id = &type_id;
+    XLA_FFI_Error* error = call_frame->api->XLA_FFI_ExecutionContext_Get(&args);
+    if (error != NULL) {
+        // No user data of this type: the request runs without a pooled context.
+        XLA_FFI_Error_Destroy_Args destroy_args = {0};
+        destroy_args.struct_size = XLA_FFI_Error_Destroy_Args_STRUCT_SIZE;
+        destroy_args.error = error;
+        call_frame->api->XLA_FFI_Error_Destroy(&destroy_args);
+        return NULL;
+    }
+    return (struct request_state*)args.data;
+}
+
+// --- Typed FFI handler for "hlo_test_rms_norm": (f32[R,C] x, f32[C] w) -> f32[R,C] ---
+static XLA_FFI_Error* rms_norm_ffi_handler(XLA_FFI_CallFrame* call_frame) {
+    // XLA first calls the handler with a metadata extension to learn its API version.
+    if (call_frame->extension_start != NULL && call_frame->extension_start->type == XLA_FFI_Extension_Metadata) {
+        XLA_FFI_Metadata_Extension* extension = (XLA_FFI_Metadata_Extension*)call_frame->extension_start;
+        extension->metadata->api_version.major_version = XLA_FFI_API_MAJOR;
+        extension->metadata->api_version.minor_version = XLA_FFI_API_MINOR;
+        extension->metadata->traits = 0;
+        return NULL;
+    }
+    if (call_frame->stage != XLA_FFI_ExecutionStage_EXECUTE) {
+        return NULL;
+    }
+    if (call_frame->args.size != 2 || call_frame->rets.size != 1 ||
+        call_frame->args.types[0] != XLA_FFI_ArgType_BUFFER || call_frame->args.types[1] != XLA_FFI_ArgType_BUFFER ||
+        call_frame->rets.types[0] != XLA_FFI_RetType_BUFFER) {
+        return ffi_error(call_frame->api, XLA_FFI_Error_Code_INVALID_ARGUMENT,
+                         RMS_NORM_TARGET ": expected two buffer arguments and one buffer result");
+    }
+    const XLA_FFI_Buffer* x = (const XLA_FFI_Buffer*)call_frame->args.args[0];
+    const XLA_FFI_Buffer* w = (const XLA_FFI_Buffer*)call_frame->args.args[1];
+    XLA_FFI_Buffer* y = (XLA_FFI_Buffer*)call_frame->rets.rets[0];
+    if (x->dtype != XLA_FFI_DataType_F32 || w->dtype != XLA_FFI_DataType_F32 || y->dtype != XLA_FFI_DataType_F32 ||
+        x->rank != 2 || w->rank != 1 || y->rank != 2 || w->dims[0] != x->dims[1] ||
+        y->dims[0] != x->dims[0] || y->dims[1] != x->dims[1]) {
+        return ffi_error(call_frame->api, XLA_FFI_Error_Code_INVALID_ARGUMENT,
+                         RMS_NORM_TARGET ": expected f32[R,C], f32[C] -> f32[R,C]");
+    }
+    // With a request context the per-row scales land in the request's scratch
+    // arena and the call is accounted in its ffi_call_stats user data.
+    float* row_scales = NULL;
+    struct request_state* state = ffi_request_state(call_frame);
+    if (state != NULL) {
+        row_scales = (float*)request_scratch_alloc(state, x->dims[0] * sizeof(float), 64);
+        struct ffi_call_stats* stats = (struct ffi_call_stats*)state->user_data;
+        if (stats != NULL) {
+            stats->calls++;
+            stats->elements += x->dims[0] * x->dims[1];
+            stats->row_scales = row_scales;
+        }
+    }
+    rms_norm_kernel((const float*)x->data, (const float*)w->data, (float*)y->data, row_scales,
+                    x->dims[0], x->dims[1], RMS_NORM_EPS);
+    return NULL;
+}
+#endif
+
+
+// --- Function to register the host custom-call handlers with the plugin ---
+// Safe to call more than once; handlers are registered process wide.
+int register_ffi_handlers(const PJRT_Api* api) {
+#ifdef HAVE_XLA_FFI
+    static int registered = 0;
+    if (registered) return 0;
+    select_rms_norm_kernels();
+    const PJRT_FFI_Extension* ffi = (const PJRT_FFI_Extension*)find_extension(api, PJRT_Extension_Type_FFI);
+    if (ffi == NULL) {
+        fprintf(stderr, "PJRT plugin does not provide the FFI extension, custom calls are disabled.\n");
+        return 1;
+    }
+    PJRT_FFI_Register_Handler_Args args = {0};
+    args.struct_size = PJRT_FFI_Register_Handler_Args_STRUCT_SIZE;
+    args.target_name = RMS_NORM_TARGET;
+    args.target_name_size = strlen(RMS_NORM_TARGET);
+    args.api_version = 1; // Typed FFI
+    args.handler = (void*)rms_norm_ffi_handler;
+    args.platform_name = "Host";
+    args.platform_name_size = strlen(args.platform_name);
+    if (handle_error(ffi->register_handler(&args), api, "PJRT_FFI_Register_Handler")) {
+        return 1;
+    }
+    static const char type_name[] = "hlo_test::request_state";
+    PJRT_FFI_TypeID_Register_Args type_args = {0};
+    type_args.struct_size = PJRT_FFI_TypeID_Register_Args_STRUCT_SIZE;
+    type_args.type_name = type_name;
+    type_args.type_name_size = strlen(type_name);
+    if (!handle_error(ffi->type_id_register(&type_args), api, "PJRT_FFI_TypeID_Register")) {
+        request_state_type_id = type_args.type_id;
+    }
+    registered = 1;
+    printf("Registered custom call '%s' (%s kernel).\n", RMS_NORM_TARGET,
+           rms_norm_impls[num_rms_norm_impls - 1].name);
+    return 0;
+#else
+    (void)api;
+    fprintf(stderr, "hlo_test was built without the XLA FFI headers, custom calls are disabled.\n");
+    return 1;
+#endif
+}
+
+
+// --- Function to attach a request_state to an execute context as FFI user data ---
+int ffi_attach_request_state(const PJRT_Api* api, PJRT_ExecuteContext* context, struct request_state* state) {
+#ifdef HAVE_XLA_FFI
+    const PJRT_FFI_Extension* ffi = (const PJRT_FFI_Extension*)find_extension(api, PJRT_Extension_Type_FFI);
+    if (ffi == NULL || request_state_type_id == 0) {
+        return 1;
+    }
+    PJRT_FFI_UserData_Add_Args args = {0};
+    args.struct_size = PJRT_FFI_UserData_Add_Args_STRUCT_SIZE;
+    args.context = context;
+    args.user_data.type_id = request_state_type_id;
+    args.user_data.data = state;
+    return handle_error(ffi->user_data_add(&args), api, "PJRT_FFI_UserData_Add");
+#else
+    (void)api;
+    (void)context;
+    (void)state;
+    return 1;
+#endif
+}
+
+
+// --- Test cases for the custom call and its pure StableHLO reference ---
+static float rms_norm_x[RMS_NORM_ROWS * RMS_NORM_COLS];
+static float rms_norm_w[RMS_NORM_COLS];
+static void* rms_norm_inputs[] = {rms_norm_x, rms_norm_w};
+static int64_t rms_norm_x_dims[] = {RMS_NORM_ROWS, RMS_NORM_COLS};
+static int64_t rms_norm_w_dims[] = {RMS_NORM_COLS};
+static int64_t* rms_norm_input_dims[] = {rms_norm_x_dims, rms_norm_w_dims};
+static size_t rms_norm_num_dims[] = {2, 1};
+static PJRT_Buffer_Type rms_norm_types[] = {PJRT_Buffer_Type_F32, PJRT_Buffer_Type_F32};
+static TestCase rms_norm_tests[2] = {
+    {
+        .name = "RMS norm (StableHLO)",
+        .hlo_path = "./rms_norm.mlir",
+        .compile_options_path = "./compile_options.0.pb",
+        .num_inputs = 2,
+        .input_data = rms_norm_inputs,
+        .input_dims = rms_norm_input_dims,
+        .input_num_dims = rms_norm_num_dims,
+        .input_types = rms_norm_types,
+    },
+    {
+        .name = "RMS norm (FFI custom call)",
+        .hlo_path = "./ffi_rms_norm.mlir",
+        .compile_options_path = "./compile_options.0.pb",
+        .num_inputs = 2,
+        .input_data = rms_norm_inputs,
+        .input_dims = rms_norm_input_dims,
+        .input_num_dims = rms_norm_num_dims,
+        .input_types = rms_norm_types,
+    },
+};
+
+const TestCase* ffi_rms_norm_test_case(int use_custom_call) {
+    static int initialized = 0;
+    if (!initialized) {
+        select_rms_norm_kernels();
+        uint32_t state = 12345;
+        for (size_t i = 0; i < RMS_NORM_ROWS * RMS_NORM_COLS; ++i) {
+            state = state * 1664525u + 1013904223u;
+            rms_norm_x[i] = (float)(state >> 8) * (2.0f / 16777216.0f) - 1.0f;
+        }
+        for (size_t i = 0; i < RMS_NORM_COLS; ++i) {
+            rms_norm_w[i] = 0.5f + (float)i / RMS_NORM_COLS;
+        }
+        initialized = 1;
+    }
+    return &rms_norm_tests[use_custom_call ? 1 : 0];
+}
+
+
+// --- Function to benchmark the custom call against the pure StableHLO module ---
+// The custom call is timed once per available kernel implementation; every
+// result is checked against the StableHLO output.
+int run_ffi_benchmark(const PJRT_Api* api, PJRT_Client* client, PJRT_Device* device,
+                      int iterations, double tolerance) {
+    int rc = 1;
+    PJRT_Buffer** inputs = NULL;
+    PJRT_LoadedExecutable* executables[2] = {NULL, NULL};
+    struct host_tensor* reference = NULL;
+    size_t num_reference = 0;
+    struct file_data compile_options = {NULL, 0};
+    // Different summation order than XLA's reduction, allow for it.
+    double check_tolerance = tolerance > 1e-4 ? tolerance : 1e-4;
+
+    printf("\n--- FFI custom call benchmark: %s ---\n", RMS_NORM_TARGET);
+    if (register_ffi_handlers(api) != 0) return 1;
+    const TestCase* tests[2] = {ffi_rms_norm_test_case(0), ffi_rms_norm_test_case(1)};
+    if (read_file_to_buffer(tests[0]->compile_options_path, &compile_options) != 0) goto cleanup_ffi;
+    for (int t = 0; t < 2; ++t) {
+        struct file_data program = {NULL, 0};
+        if (read_file_to_buffer(tests[t]->hlo_path, &program) != 0) goto cleanup_ffi;
+        executables[t] = compile_program(api, client, &program, program_format_from_path(tests[t]->hlo_path),
+                                         &compile_options);
+        free_file_data(&program);
+        if (executables[t] == NULL) goto cleanup_ffi;
+    }
+    inputs = create_input_buffers(api, client, device, tests[0]);
+    if (inputs == NULL) goto cleanup_ffi;
+
+    double hlo_s = 0.0;
+    if (execute_to_host(api, executables[0], inputs, tests[0]->num_inputs, &reference, &num_reference) != 0 ||
+        benchmark_executable(api, executables[0], inputs, tests[0]->num_inputs, iterations, &hlo_s) != 0) {
+        goto cleanup_ffi;
+    }
+    double bytes = 2.0 * sizeof(rms_norm_x) + sizeof(rms_norm_w);
+    printf("  %-24s %12s %10s %9s\n", "implementation", "median(ms)", "GB/s", "speedup");
+    printf("  %-24s %12.4f %10.2f %9.3f\n", "stablehlo", hlo_s * 1e3, bytes / hlo_s * 1e-9, 1.0);
+
+    rc = 0;
+    rms_norm_fn selected = rms_norm_kernel;
+    for (size_t k = 0; k < num_rms_norm_impls; ++k) {
+        rms_norm_kernel = rms_norm_impls[k].fn;
+        struct host_tensor* outputs = NULL;
+        size_t num_outputs = 0;
+        double ffi_s = 0.0;
+        if (execute_to_host(api, executables[1], inputs, tests[1]->num_inputs, &outputs, &num_outputs) != 0 ||
+            benchmark_executable(api, executables[1], inputs, tests[1]->num_inputs, iterations, &ffi_s) != 0) {
+            rc = 1;
+            break;
+        }
+        int match = num_outputs == num_reference && host_tensors_match(&reference[0], &outputs[0], check_tolerance);
+        free_host_tensors(outputs, num_outputs);
+        char label[64];
+        snprintf(label, sizeof(label), "custom call (%s)", rms_norm_impls[k].name);
+        printf("  %-24s %12.4f %10.2f %9.3f%s\n", label, ffi_s * 1e3, bytes / ffi_s * 1e-9, hlo_s / ffi_s,
+               match ? "" : "  MISMATCH");
+        if (!match) rc = 1;
+    }
+    rms_norm_kernel = selected;
+
+cleanup_ffi:
+    free_host_tensors(reference, num_reference);
+    destroy_buffers(api, inputs, tests[0]->num_inputs, "PJRT_Buffer_Destroy (ffi input)");
+    for (int t = 0; t < 2; ++t) {
+        if (executables[t] != NULL) destroy_loaded_executable(api, executables[t]);
+    }
+    free_file_data(&compile_options);
+    return rc;
+}
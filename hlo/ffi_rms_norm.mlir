@@ -0,0 +1,8 @@
+// RMS normalization over the last dimension, computed by the host custom call
+// registered by hlo_test (see ffi_kernels.c).
+module @ffi_rms_norm {
+  func.func public @main(%x: tensor<256x4096xf32>, %w: tensor<4096xf32>) -> tensor<256x4096xf32> {
+    %y = stablehlo.custom_call @hlo_test_rms_norm(%x, %w) {api_version = 4 : i32} : (tensor<256x4096xf32>, tensor<4096xf32>) -> tensor<256x4096xf32>
+    return %y : tensor<256x4096xf32>
+  }
+}
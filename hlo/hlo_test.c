@@ -1,53 +1,32 @@
 #include <assert.h>
 #include <dlfcn.h>
+#include <getopt.h>
+#include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h> // Added for general string handling
+#include <time.h>
 
-#include "pjrt_c_api.h"
+#include "hlo_test.h"
 
 typedef const PJRT_Api* (*pjrt_init)();
 
-struct file_data {
-    void* data;
-    size_t size;
-};
-
-// --- Test Case Definition ---
-typedef struct {
-    const char* name;
-    const char* hlo_path;
-    const char* compile_options_path;
-    size_t num_inputs;
-    void** input_data; // Array of pointers to host data arrays
-    int64_t** input_dims; // Array of pointers to dimension arrays
-    size_t* input_num_dims; // Array of number of dimensions per input
-    PJRT_Buffer_Type* input_types; // Array of buffer types per input
-    // TODO: Add fields for expected output verification if needed
-} TestCase;
+int verbose = 1;
 
 
 // --- Forward Declarations ---
-static int handle_error(PJRT_Error* error, const PJRT_Api* api, const char* context);
 static void print_plugin_attributes(const PJRT_Api* api);
 static int close_plugin(void* handle, const char* plugin, const char* message);
-static int read_file_to_buffer(const char* filename, struct file_data* file_data);
-static void free_file_data(struct file_data* file_data);
-static PJRT_Buffer* create_buffer_from_host(const PJRT_Api* api, PJRT_Client* client, PJRT_Device* device,
-                                            void* host_data, PJRT_Buffer_Type type,
-                                            const int64_t* dims, size_t num_dims,
-                                            const char* context_prefix);
 static void print_float_buffer(float* data, const int64_t* dims, size_t num_dims); // Updated signature
-static int execute_hlo_program(const PJRT_Api* api, PJRT_LoadedExecutable* executable,
-                               PJRT_Buffer** input_buffers, size_t num_inputs,
-                               PJRT_Buffer*** output_buffers_ptr, size_t* num_outputs_ptr);
 static int run_computation_test(const PJRT_Api* api, PJRT_Client* client, PJRT_Device* device,
-                                const TestCase* test_case);
+                                const TestCase* test_case, double tolerance);
+static int compare_program_formats(const PJRT_Api* api, PJRT_Client* client,
+                                   const TestCase* test_case, int iterations);
 
 
 // --- Helper function to handle PJRT errors ---
 // (handle_error function remains the same)
-static int handle_error(PJRT_Error* error, const PJRT_Api* api, const char* context) {
+int handle_error(PJRT_Error* error, const PJRT_Api* api, const char* context) {
   if (error == NULL) {
     return 0; // No error
   }
@@ -164,7 +143,13 @@ static int close_plugin(void* handle, const char* plugin, const char* message) {
 
 // --- Function to read a file into a buffer ---
 // (read_file_to_buffer function remains the same)
-static int read_file_to_buffer(const char* filename, struct file_data* file_data) {
+int read_file_to_buffer(const char* filename, struct file_data* file_data) {
+    uint64_t timer = stage_timer_start();
+    if (strncmp(filename, BUNDLE_PATH_PREFIX, strlen(BUNDLE_PATH_PREFIX)) == 0) {
+        if (bundle_read_section(filename + strlen(BUNDLE_PATH_PREFIX), file_data) != 0) return 1;
+        stage_timer_stop(TIMER_STAGE_FILE_READ, timer);
+        return 0;
+    }
     FILE* file = fopen(filename, "rb");
     if (file == NULL) {
         fprintf(stderr, "Error opening file '%s'\n", filename);
@@ -202,27 +187,173 @@ static int read_file_to_buffer(const char* filename, struct file_data* file_data
         return 1;
     }
 
+    stage_timer_stop(TIMER_STAGE_FILE_READ, timer);
     return 0; // Success
 }
 
 
 // --- Function to free file data ---
 // (free_file_data function remains the same)
-static void free_file_data(struct file_data* file_data) {
+void free_file_data(struct file_data* file_data) {
     if (file_data->data != NULL) {
-        free(file_data->data);
+        if (!bundle_contains(file_data->data)) free(file_data->data); // Sections are used in place
         file_data->data = NULL;
         file_data->size = 0;
     }
 }
 
 
+// --- Monotonic wall clock in seconds ---
+double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+
+// --- Function to run `count` jobs of `job_size` bytes each, one thread per job ---
+// Jobs 0..count-2 get a thread each. The calling thread runs the last job, then any job a thread could
+// not be started for. Returns 1 when some thread could not be started, so that timed callers can tell.
+int run_parallel_jobs(void* (*run_job)(void*), void* jobs, size_t job_size, size_t count) {
+    if (count == 0) return 0;
+    pthread_t* thread_ids = (pthread_t*)calloc(count, sizeof(pthread_t));
+    unsigned char* started = (unsigned char*)calloc(count, 1);
+    int rc = thread_ids == NULL || started == NULL;
+    for (size_t j = 0; j + 1 < count && rc == 0; ++j) {
+        started[j] = pthread_create(&thread_ids[j], NULL, run_job, (char*)jobs + j * job_size) == 0;
+        if (!started[j]) rc = 1;
+    }
+    run_job((char*)jobs + (count - 1) * job_size);
+    for (size_t j = 0; j + 1 < count; ++j) {
+        if (started != NULL && started[j]) {
+            pthread_join(thread_ids[j], NULL);
+        } else {
+            run_job((char*)jobs + j * job_size);
+        }
+    }
+    free(thread_ids);
+    free(started);
+    return rc;
+}
+
+
+// --- Function to derive the program format from a file name ---
+// MLIR programs (text ".mlir" or bytecode ".mlir.bc") use the "mlir" format,
+// everything else is treated as a serialized HloModuleProto.
+const char* program_format_from_path(const char* path) {
+    if (strstr(path, ".mlir") != NULL) {
+        return "mlir";
+    }
+    return "hlo";
+}
+
+
+// --- Helper function to compile a program ---
+PJRT_LoadedExecutable* compile_program(const PJRT_Api* api, PJRT_Client* client,
+                                       const struct file_data* code, const char* format,
+                                       const struct file_data* compile_options) {
+    PJRT_Program program = {0};
+    program.struct_size = PJRT_Program_STRUCT_SIZE;
+    program.extension_start = NULL;
+    program.format = format;
+    program.format_size = strlen(format);
+    program.code = code->data;
+    program.code_size = code->size;
+
+    PJRT_Client_Compile_Args compile_args = {0};
+    compile_args.struct_size = PJRT_Client_Compile_Args_STRUCT_SIZE;
+    compile_args.extension_start = NULL;
+    compile_args.client = client;
+    compile_args.program = &program;
+    compile_args.compile_options = compile_options->data;
+    compile_args.compile_options_size = compile_options->size;
+
+    uint64_t timer = stage_timer_start();
+    PJRT_Error* error = api->PJRT_Client_Compile(&compile_args);
+    stage_timer_stop(TIMER_STAGE_COMPILE, timer);
+    if (handle_error(error, api, "PJRT_Client_Compile")) {
+        return NULL;
+    }
+    return compile_args.executable;
+}
+
+
+// --- Helper function to create a client ---
+// `options` may be NULL for the plugin defaults. The plugin's worker threads
+// inherit the CPU affinity of the calling thread.
+PJRT_Client* create_client(const PJRT_Api* api, const struct client_options* options) {
+    PJRT_Client_Create_Args create_args = {0};
+    create_args.struct_size = PJRT_Client_Create_Args_STRUCT_SIZE;
+    if (options != NULL) {
+        create_args.create_options = options->values;
+        create_args.num_options = options->count;
+    }
+    PJRT_Error* error = api->PJRT_Client_Create(&create_args);
+    if (handle_error(error, api, "PJRT_Client_Create")) {
+        return NULL;
+    }
+    return create_args.client;
+}
+
+
+void destroy_client(const PJRT_Api* api, PJRT_Client* client) {
+    PJRT_Client_Destroy_Args destroy_args = {0};
+    destroy_args.struct_size = PJRT_Client_Destroy_Args_STRUCT_SIZE;
+    destroy_args.client = client;
+    handle_error(api->PJRT_Client_Destroy(&destroy_args), api, "PJRT_Client_Destroy");
+}
+
+
+// --- Helper function to get the first addressable device of a client ---
+PJRT_Device* first_addressable_device(const PJRT_Api* api, PJRT_Client* client) {
+    PJRT_Client_AddressableDevices_Args devices_args = {0};
+    devices_args.struct_size = PJRT_Client_AddressableDevices_Args_STRUCT_SIZE;
+    devices_args.client = client;
+    if (handle_error(api->PJRT_Client_AddressableDevices(&devices_args), api, "PJRT_Client_AddressableDevices")) {
+        return NULL;
+    }
+    if (devices_args.num_addressable_devices == 0) {
+        fprintf(stderr, "Error: No addressable devices found.\n");
+        return NULL;
+    }
+    return devices_args.addressable_devices[0];
+}
+
+
+// --- Helper function to destroy a loaded executable ---
+void destroy_loaded_executable(const PJRT_Api* api, PJRT_LoadedExecutable* executable) {
+    PJRT_LoadedExecutable_Destroy_Args destroy_exec_args = {0};
+    destroy_exec_args.struct_size = PJRT_LoadedExecutable_Destroy_Args_STRUCT_SIZE;
+    destroy_exec_args.executable = executable;
+    PJRT_Error* destroy_exec_err = api->PJRT_LoadedExecutable_Destroy(&destroy_exec_args);
+    handle_error(destroy_exec_err, api, "PJRT_LoadedExecutable_Destroy");
+}
+
+
+// --- Helper function to load an executable serialized with PJRT_Executable_Serialize ---
+PJRT_LoadedExecutable* load_serialized_executable(const PJRT_Api* api, PJRT_Client* client, const char* path) {
+    struct file_data serialized = {NULL, 0};
+    if (read_file_to_buffer(path, &serialized) != 0) return NULL;
+    PJRT_Executable_DeserializeAndLoad_Args load_args = {0};
+    load_args.struct_size = PJRT_Executable_DeserializeAndLoad_Args_STRUCT_SIZE;
+    load_args.client = client;
+    load_args.serialized_executable = (const char*)serialized.data;
+    load_args.serialized_executable_size = serialized.size;
+    PJRT_Error* error = api->PJRT_Executable_DeserializeAndLoad(&load_args);
+    free_file_data(&serialized);
+    if (handle_error(error, api, "PJRT_Executable_DeserializeAndLoad")) return NULL;
+    return load_args.loaded_executable;
+}
+
+
 // --- Helper function to create a buffer from host data ---
-// (create_buffer_from_host function remains the same)
-static PJRT_Buffer* create_buffer_from_host(const PJRT_Api* api, PJRT_Client* client, PJRT_Device* device,
-                                            void* host_data, PJRT_Buffer_Type type,
-                                            const int64_t* dims, size_t num_dims,
-                                            const char* context_prefix) {
+// With `done_with_host` set the transfer is asynchronous: `host_data` must stay
+// unchanged until the returned event fires, and the caller destroys the event.
+// kImmutableUntilTransferCompletes and kImmutableZeroCopy need `done_with_host`.
+static PJRT_Buffer* buffer_from_host(const PJRT_Api* api, PJRT_Client* client, PJRT_Device* device,
+                                     PJRT_Memory* memory, void* host_data, PJRT_Buffer_Type type,
+                                     const int64_t* dims, size_t num_dims, PJRT_HostBufferSemantics semantics,
+                                     PJRT_Event** done_with_host, const char* context_prefix) {
     PJRT_Client_BufferFromHostBuffer_Args create_buf_args = {0};
     create_buf_args.struct_size = PJRT_Client_BufferFromHostBuffer_Args_STRUCT_SIZE;
     create_buf_args.extension_start = NULL;
@@ -235,35 +366,104 @@ static PJRT_Buffer* create_buffer_from_host(const PJRT_Api* api, PJRT_Client* cl
     create_buf_args.num_byte_strides = 0;
     create_buf_args.device_layout = NULL; // Use default layout
     // create_buf_args.device_layout_size = 0; // Field does not exist
-    create_buf_args.host_buffer_semantics = PJRT_HostBufferSemantics_kImmutableOnlyDuringCall;
+    create_buf_args.host_buffer_semantics = semantics;
     create_buf_args.device = device;
-    create_buf_args.memory = NULL; // Use default memory for the device
+    create_buf_args.memory = memory; // NULL for the default memory of the device
 
+    uint64_t timer = stage_timer_start();
     PJRT_Error* create_buf_error = api->PJRT_Client_BufferFromHostBuffer(&create_buf_args);
+    stage_timer_stop(TIMER_STAGE_BUFFER_FROM_HOST, timer);
     char error_context[100];
     snprintf(error_context, sizeof(error_context), "%s: PJRT_Client_BufferFromHostBuffer", context_prefix);
     if (handle_error(create_buf_error, api, error_context)) {
         return NULL; // Error creating buffer
     }
-    printf("%s: Buffer created successfully.\n", context_prefix);
+    if (done_with_host != NULL) {
+        *done_with_host = create_buf_args.done_with_host_buffer;
+    } else if (create_buf_args.done_with_host_buffer != NULL) {
+        destroy_event(api, create_buf_args.done_with_host_buffer);
+    }
+    if (verbose) printf("%s: Buffer created successfully.\n", context_prefix);
     return create_buf_args.buffer;
 }
 
 
+PJRT_Buffer* create_buffer_from_host(const PJRT_Api* api, PJRT_Client* client, PJRT_Device* device,
+                                     void* host_data, PJRT_Buffer_Type type,
+                                     const int64_t* dims, size_t num_dims,
+                                     const char* context_prefix) {
+    return buffer_from_host(api, client, device, NULL, host_data, type, dims, num_dims,
+                            PJRT_HostBufferSemantics_kImmutableOnlyDuringCall, NULL, context_prefix);
+}
+
+
+// --- Helper function to create a buffer from host data in a given memory ---
+PJRT_Buffer* create_buffer_in_memory(const PJRT_Api* api, PJRT_Client* client, PJRT_Memory* memory,
+                                     void* host_data, PJRT_Buffer_Type type,
+                                     const int64_t* dims, size_t num_dims,
+                                     const char* context_prefix) {
+    return buffer_from_host(api, client, NULL, memory, host_data, type, dims, num_dims,
+                            PJRT_HostBufferSemantics_kImmutableOnlyDuringCall, NULL, context_prefix);
+}
+
+
+PJRT_Buffer* create_buffer_from_host_async(const PJRT_Api* api, PJRT_Client* client, PJRT_Device* device,
+                                           void* host_data, PJRT_Buffer_Type type,
+                                           const int64_t* dims, size_t num_dims,
+                                           PJRT_Event** done_with_host, const char* context_prefix) {
+    *done_with_host = NULL;
+    return buffer_from_host(api, client, device, NULL, host_data, type, dims, num_dims,
+                            PJRT_HostBufferSemantics_kImmutableUntilTransferCompletes, done_with_host,
+                            context_prefix);
+}
+
+
+// --- Helper function to create a buffer that may alias host data ---
+// `host_data` must stay valid and unchanged until `*done_with_host` fires, which
+// happens when the buffer is destroyed if the plugin aliased the data.
+PJRT_Buffer* create_buffer_zero_copy(const PJRT_Api* api, PJRT_Client* client, PJRT_Device* device,
+                                     const void* host_data, PJRT_Buffer_Type type,
+                                     const int64_t* dims, size_t num_dims,
+                                     PJRT_Event** done_with_host, const char* context_prefix) {
+    *done_with_host = NULL;
+    return buffer_from_host(api, client, device, NULL, (void*)host_data, type, dims, num_dims,
+                            PJRT_HostBufferSemantics_kImmutableZeroCopy, done_with_host, context_prefix);
+}
+
+
+// --- Helper function to tell whether a buffer aliases host memory at `host_data` ---
+// Returns 0 when it does not or the plugin cannot tell.
+int buffer_aliases_host(const PJRT_Api* api, PJRT_Buffer* buffer, const void* host_data) {
+    PJRT_Buffer_UnsafePointer_Args pointer_args = {0};
+    pointer_args.struct_size = PJRT_Buffer_UnsafePointer_Args_STRUCT_SIZE;
+    pointer_args.buffer = buffer;
+    if (handle_error(api->PJRT_Buffer_UnsafePointer(&pointer_args), api, "PJRT_Buffer_UnsafePointer")) {
+        return 0;
+    }
+    return pointer_args.buffer_pointer == (uintptr_t)host_data;
+}
+
+
 // --- Helper function to print a float buffer ---
 // Updated to handle generic dimensions
 static void print_float_buffer(float* data, const int64_t* dims, size_t num_dims) {
-    if (num_dims == 2) {
+    if (num_dims == 0) {
+        printf("Buffer Contents (scalar):\n  %f\n", data[0]);
+    } else if (num_dims == 2) {
         int rows = dims[0];
         int cols = dims[1];
+        // Large tensors (the FFI and corpus cases) only show their leading corner, as the N-D branch does
+        int print_rows = rows < 8 ? rows : 8;
+        int print_cols = cols < 8 ? cols : 8;
         printf("Buffer Contents (%dx%d):\n", rows, cols);
-        for (int i = 0; i < rows; ++i) {
+        for (int i = 0; i < print_rows; ++i) {
             printf("  [");
-            for (int j = 0; j < cols; ++j) {
-                printf("%f%s", data[i * cols + j], (j == cols - 1) ? "" : ", ");
+            for (int j = 0; j < print_cols; ++j) {
+                printf("%f%s", data[(size_t)i * cols + j], (j == cols - 1) ? "" : ", ");
             }
-            printf("]\n");
+            printf("%s]\n", print_cols < cols ? "..." : "");
         }
+        if (print_rows < rows) printf("  ... (%d more rows)\n", rows - print_rows);
     } else {
         // Basic print for other dimensions
         printf("Buffer Contents (Num Dims: %zu, First Dim: %ld, ...):\n  [", num_dims, dims[0]); // Use %ld for int64_t (long int)
@@ -281,16 +481,40 @@ static void print_float_buffer(float* data, const int64_t* dims, size_t num_dims
 
 // --- Function to execute the HLO program ---
 // Removed client parameter as it's not used here
-static int execute_hlo_program(const PJRT_Api* api, PJRT_LoadedExecutable* executable,
-                               PJRT_Buffer** input_buffers, size_t num_inputs,
-                               PJRT_Buffer*** output_buffers_ptr, size_t* num_outputs_ptr) {
-    printf("Preparing arguments for PJRT_LoadedExecutable_Execute...\n");
+int execute_hlo_program(const PJRT_Api* api, PJRT_LoadedExecutable* executable,
+                        PJRT_Buffer** input_buffers, size_t num_inputs,
+                        PJRT_Buffer*** output_buffers_ptr, size_t* num_outputs_ptr) {
+    return execute_hlo_program_with_context(api, executable, input_buffers, num_inputs, NULL,
+                                            output_buffers_ptr, num_outputs_ptr);
+}
+
+
+// --- Function to execute the HLO program with a per-request execute context ---
+// `context` may be NULL; otherwise custom calls can reach the user data attached to it.
+int execute_hlo_program_with_context(const PJRT_Api* api, PJRT_LoadedExecutable* executable,
+                                     PJRT_Buffer** input_buffers, size_t num_inputs,
+                                     PJRT_ExecuteContext* context,
+                                     PJRT_Buffer*** output_buffers_ptr, size_t* num_outputs_ptr) {
+    return execute_hlo_program_on_device(api, executable, input_buffers, num_inputs, context, NULL,
+                                         output_buffers_ptr, num_outputs_ptr);
+}
+
+
+// --- Function to execute the HLO program on one device ---
+// `device` NULL runs on the device chosen at compile time. Otherwise the inputs must live on `device`,
+// which must be one of the executable's devices; a replicated executable then runs only that replica.
+int execute_hlo_program_on_device(const PJRT_Api* api, PJRT_LoadedExecutable* executable,
+                                  PJRT_Buffer** input_buffers, size_t num_inputs,
+                                  PJRT_ExecuteContext* context, PJRT_Device* device,
+                                  PJRT_Buffer*** output_buffers_ptr, size_t* num_outputs_ptr) {
+    if (verbose) printf("Preparing arguments for PJRT_LoadedExecutable_Execute...\n");
 
     // --- 1. Prepare Execute Options ---
     PJRT_ExecuteOptions options = {0};
     options.struct_size = PJRT_ExecuteOptions_STRUCT_SIZE;
     options.extension_start = NULL;
     options.launch_id = 0; // Example launch ID
+    options.context = context;
     // Set other options as needed, e.g., options.strict_shape_checking = true;
 
     // --- 2. Prepare Argument Lists ---
@@ -321,14 +545,20 @@ static int execute_hlo_program(const PJRT_Api* api, PJRT_LoadedExecutable* execu
     num_outputs_args.extension_start = NULL;
     num_outputs_args.executable = base_executable; // Use the base executable
     PJRT_Error* num_outputs_error = api->PJRT_Executable_NumOutputs(&num_outputs_args);
+    // GetExecutable hands out a new PJRT_Executable on every call, so it is ours to destroy.
+    PJRT_Executable_Destroy_Args destroy_exec_args = {0};
+    destroy_exec_args.struct_size = PJRT_Executable_Destroy_Args_STRUCT_SIZE;
+    destroy_exec_args.executable = base_executable;
      if (handle_error(num_outputs_error, api, "PJRT_Executable_NumOutputs")) {
+        handle_error(api->PJRT_Executable_Destroy(&destroy_exec_args), api, "PJRT_Executable_Destroy");
         return 1; // Failed to get number of outputs
     }
     size_t num_outputs_per_device = num_outputs_args.num_outputs;
-    printf("Executable has %zu output(s) per device.\n", num_outputs_per_device);
+    handle_error(api->PJRT_Executable_Destroy(&destroy_exec_args), api, "PJRT_Executable_Destroy");
+    if (verbose) printf("Executable has %zu output(s) per device.\n", num_outputs_per_device);
 
     if (num_outputs_per_device == 0) {
-        printf("Executable has no outputs.\n");
+        if (verbose) printf("Executable has no outputs.\n");
         *output_buffers_ptr = NULL;
         *num_outputs_ptr = 0;
         // Execution might still be valid (e.g., for side effects), proceed.
@@ -366,13 +596,19 @@ static int execute_hlo_program(const PJRT_Api* api, PJRT_LoadedExecutable* execu
     // Cast to expected type: PJRT_Buffer* const* const*
     execute_args.argument_lists = (PJRT_Buffer* const* const*)&argument_list;
     execute_args.output_lists = output_lists_array; // Pointer to the array holding the output list(s)
-    execute_args.execute_device = NULL; // Let PJRT manage device placement for multi-device execution
-                                        // For single-device, could specify the device.
-    execute_args.device_complete_events = NULL; // Not requesting completion events for now
+    execute_args.execute_device = device; // NULL lets PJRT use the compiled device assignment
+    PJRT_Event* complete_event = NULL;
+    // Completion events are only needed to time whole executions.
+    execute_args.device_complete_events = stage_timers_enabled ? &complete_event : NULL;
 
     // --- 5. Execute ---
-    printf("Calling PJRT_LoadedExecutable_Execute...\n");
+    if (verbose) printf("Calling PJRT_LoadedExecutable_Execute...\n");
+    uint64_t timer = stage_timer_start();
     PJRT_Error* execute_error = api->PJRT_LoadedExecutable_Execute(&execute_args);
+    stage_timer_stop(TIMER_STAGE_EXECUTE, timer);
+    if (execute_error == NULL && stage_timers_enabled) {
+        stage_timer_stop_on_ready(api, TIMER_STAGE_EXECUTE_COMPLETE, timer, complete_event);
+    }
 
     // --- 6. Handle Errors and Outputs ---
     if (handle_error(execute_error, api, "PJRT_LoadedExecutable_Execute")) {
@@ -393,7 +629,7 @@ static int execute_hlo_program(const PJRT_Api* api, PJRT_LoadedExecutable* execu
         return 1; // Execution failed
     }
 
-    printf("PJRT_LoadedExecutable_Execute call successful.\n");
+    if (verbose) printf("PJRT_LoadedExecutable_Execute call successful.\n");
 
     // Pass the ownership of the output list back to the caller
     *output_buffers_ptr = output_list;
@@ -403,9 +639,628 @@ static int execute_hlo_program(const PJRT_Api* api, PJRT_LoadedExecutable* execu
 }
 
 
+// --- Helper function to get the size of a buffer element ---
+// Returns 0 for sub-byte and unsupported types.
+size_t buffer_type_size(PJRT_Buffer_Type type) {
+    switch (type) {
+        case PJRT_Buffer_Type_PRED:
+        case PJRT_Buffer_Type_S8:
+        case PJRT_Buffer_Type_U8:
+        case PJRT_Buffer_Type_F8E5M2:
+        case PJRT_Buffer_Type_F8E4M3FN:
+        case PJRT_Buffer_Type_F8E4M3B11FNUZ:
+        case PJRT_Buffer_Type_F8E5M2FNUZ:
+        case PJRT_Buffer_Type_F8E4M3FNUZ:
+        case PJRT_Buffer_Type_F8E4M3:
+        case PJRT_Buffer_Type_F8E3M4:
+        case PJRT_Buffer_Type_F8E8M0FNU:
+            return 1;
+        case PJRT_Buffer_Type_S16:
+        case PJRT_Buffer_Type_U16:
+        case PJRT_Buffer_Type_F16:
+        case PJRT_Buffer_Type_BF16:
+            return 2;
+        case PJRT_Buffer_Type_S32:
+        case PJRT_Buffer_Type_U32:
+        case PJRT_Buffer_Type_F32:
+            return 4;
+        case PJRT_Buffer_Type_S64:
+        case PJRT_Buffer_Type_U64:
+        case PJRT_Buffer_Type_F64:
+        case PJRT_Buffer_Type_C64:
+            return 8;
+        case PJRT_Buffer_Type_C128:
+            return 16;
+        default:
+            return 0;
+    }
+}
+
+
+// --- Helper function to create all input buffers of a test case ---
+PJRT_Buffer** create_input_buffers(const PJRT_Api* api, PJRT_Client* client, PJRT_Device* device,
+                                   const TestCase* test_case) {
+    PJRT_Buffer** input_buffers = (PJRT_Buffer**)calloc(test_case->num_inputs ? test_case->num_inputs : 1,
+                                                        sizeof(PJRT_Buffer*));
+    if (input_buffers == NULL) {
+        fprintf(stderr, "Failed to allocate memory for input buffer array.\n");
+        return NULL;
+    }
+    for (size_t i = 0; i < test_case->num_inputs; ++i) {
+        char context[50];
+        snprintf(context, sizeof(context), "Input %zu", i);
+        const char* kind = test_case->input_memory_kinds ? test_case->input_memory_kinds[i] : NULL;
+        if (kind != NULL) {
+            PJRT_Memory* memory = find_device_memory(api, device, kind);
+            input_buffers[i] = memory == NULL ? NULL
+                                              : create_buffer_in_memory(api, client, memory,
+                                                                        test_case->input_data[i],
+                                                                        test_case->input_types[i],
+                                                                        test_case->input_dims[i],
+                                                                        test_case->input_num_dims[i],
+                                                                        context);
+        } else {
+            input_buffers[i] = create_buffer_from_host(api, client, device,
+                                                       test_case->input_data[i],
+                                                       test_case->input_types[i],
+                                                       test_case->input_dims[i],
+                                                       test_case->input_num_dims[i],
+                                                       context);
+        }
+        if (input_buffers[i] == NULL) {
+            destroy_buffers(api, input_buffers, i, "PJRT_Buffer_Destroy (input)");
+            return NULL;
+        }
+    }
+    return input_buffers;
+}
+
+
+// --- Helper function to find the memory of a given kind attached to a device ---
+// Prints the kinds the device has when none matches.
+PJRT_Memory* find_device_memory(const PJRT_Api* api, PJRT_Device* device, const char* kind) {
+    PJRT_Device_AddressableMemories_Args memories_args = {0};
+    memories_args.struct_size = PJRT_Device_AddressableMemories_Args_STRUCT_SIZE;
+    memories_args.device = device;
+    if (handle_error(api->PJRT_Device_AddressableMemories(&memories_args), api,
+                     "PJRT_Device_AddressableMemories")) {
+        return NULL;
+    }
+    for (size_t i = 0; i < memories_args.num_memories; ++i) {
+        const char* memory_kind = NULL;
+        size_t memory_kind_size = 0;
+        if (memory_kind_of(api, memories_args.memories[i], &memory_kind, &memory_kind_size) == 0 &&
+            memory_kind_size == strlen(kind) && strncmp(memory_kind, kind, memory_kind_size) == 0) {
+            return memories_args.memories[i];
+        }
+    }
+    fprintf(stderr, "Device has no memory of kind '%s'; available:", kind);
+    for (size_t i = 0; i < memories_args.num_memories; ++i) {
+        const char* memory_kind = NULL;
+        size_t memory_kind_size = 0;
+        if (memory_kind_of(api, memories_args.memories[i], &memory_kind, &memory_kind_size) == 0) {
+            fprintf(stderr, " '%.*s'", (int)memory_kind_size, memory_kind);
+        }
+    }
+    fprintf(stderr, "\n");
+    return NULL;
+}
+
+
+// --- Helper function to get the kind of a memory, e.g. "device" or "pinned_host" ---
+// `*kind` is not NUL terminated and has the lifetime of `memory`.
+int memory_kind_of(const PJRT_Api* api, PJRT_Memory* memory, const char** kind, size_t* kind_size) {
+    PJRT_Memory_Kind_Args kind_args = {0};
+    kind_args.struct_size = PJRT_Memory_Kind_Args_STRUCT_SIZE;
+    kind_args.memory = memory;
+    if (handle_error(api->PJRT_Memory_Kind(&kind_args), api, "PJRT_Memory_Kind")) {
+        return 1;
+    }
+    *kind = kind_args.kind;
+    *kind_size = kind_args.kind_size;
+    return 0;
+}
+
+
+// --- Helper function to describe the memory kinds of an executable's outputs ---
+// Writes a comma separated list such as "device, pinned_host" into `out`.
+int describe_output_memory_kinds(const PJRT_Api* api, PJRT_LoadedExecutable* executable, char* out, size_t size) {
+    PJRT_LoadedExecutable_GetExecutable_Args get_exec_args = {0};
+    get_exec_args.struct_size = PJRT_LoadedExecutable_GetExecutable_Args_STRUCT_SIZE;
+    get_exec_args.loaded_executable = executable;
+    if (handle_error(api->PJRT_LoadedExecutable_GetExecutable(&get_exec_args), api,
+                     "PJRT_LoadedExecutable_GetExecutable")) {
+        return 1;
+    }
+    PJRT_Executable_OutputMemoryKinds_Args kinds_args = {0};
+    kinds_args.struct_size = PJRT_Executable_OutputMemoryKinds_Args_STRUCT_SIZE;
+    kinds_args.executable = get_exec_args.executable;
+    int rc = handle_error(api->PJRT_Executable_OutputMemoryKinds(&kinds_args), api,
+                          "PJRT_Executable_OutputMemoryKinds");
+    if (size > 0) out[0] = '\0';
+    size_t used = 0;
+    for (size_t i = 0; rc == 0 && i < kinds_args.num_outputs && used < size; ++i) {
+        int written = snprintf(out + used, size - used, "%s%.*s", i ? ", " : "",
+                               (int)kinds_args.memory_kind_sizes[i], kinds_args.memory_kinds[i]);
+        if (written < 0) break;
+        used += (size_t)written;
+    }
+    PJRT_Executable_Destroy_Args destroy_args = {0};
+    destroy_args.struct_size = PJRT_Executable_Destroy_Args_STRUCT_SIZE;
+    destroy_args.executable = get_exec_args.executable;
+    handle_error(api->PJRT_Executable_Destroy(&destroy_args), api, "PJRT_Executable_Destroy");
+    return rc;
+}
+
+
+// --- Helper function to read the bytes in use and the peak of a device ---
+// `*peak_bytes` is -1 when the plugin does not track it.
+int device_memory_stats(const PJRT_Api* api, PJRT_Device* device, int64_t* bytes_in_use, int64_t* peak_bytes) {
+    PJRT_Device_MemoryStats_Args stats_args = {0};
+    stats_args.struct_size = PJRT_Device_MemoryStats_Args_STRUCT_SIZE;
+    stats_args.device = device;
+    if (handle_error(api->PJRT_Device_MemoryStats(&stats_args), api, "PJRT_Device_MemoryStats")) {
+        return 1;
+    }
+    *bytes_in_use = stats_args.bytes_in_use;
+    *peak_bytes = stats_args.peak_bytes_in_use_is_set ? stats_args.peak_bytes_in_use : -1;
+    return 0;
+}
+
+
+// --- Helper function to destroy an array of buffers ---
+// Destroys every non-NULL buffer and frees the array itself.
+void destroy_buffers(const PJRT_Api* api, PJRT_Buffer** buffers, size_t num_buffers, const char* context) {
+    if (buffers == NULL) return;
+    for (size_t i = 0; i < num_buffers; ++i) {
+        destroy_buffer(api, buffers[i], context);
+    }
+    free(buffers);
+}
+
+
+// --- Helper function to destroy a single buffer, NULL is ignored ---
+void destroy_buffer(const PJRT_Api* api, PJRT_Buffer* buffer, const char* context) {
+    if (buffer == NULL) return;
+    PJRT_Buffer_Destroy_Args destroy_buf_args = {0};
+    destroy_buf_args.struct_size = PJRT_Buffer_Destroy_Args_STRUCT_SIZE;
+    destroy_buf_args.buffer = buffer;
+    uint64_t timer = stage_timer_start();
+    PJRT_Error* destroy_buf_err = api->PJRT_Buffer_Destroy(&destroy_buf_args);
+    stage_timer_stop(TIMER_STAGE_BUFFER_DESTROY, timer);
+    handle_error(destroy_buf_err, api, context);
+}
+
+
+// --- Helper function to start copying a device buffer to a newly allocated host tensor ---
+// The copy may still be in flight on return; `tensor->data` is valid once
+// `*event` fires. `*event` may be NULL for a copy that already completed.
+int buffer_to_host_async(const PJRT_Api* api, PJRT_Buffer* buffer, struct host_tensor* tensor,
+                         PJRT_Event** event) {
+    memset(tensor, 0, sizeof(*tensor));
+    *event = NULL;
+
+    PJRT_Buffer_ElementType_Args type_args = {0};
+    type_args.struct_size = PJRT_Buffer_ElementType_Args_STRUCT_SIZE;
+    type_args.buffer = buffer;
+    if (handle_error(api->PJRT_Buffer_ElementType(&type_args), api, "PJRT_Buffer_ElementType")) {
+        return 1;
+    }
+    tensor->type = type_args.type;
+
+    PJRT_Buffer_Dimensions_Args dim_args = {0};
+    dim_args.struct_size = PJRT_Buffer_Dimensions_Args_STRUCT_SIZE;
+    dim_args.buffer = buffer;
+    if (handle_error(api->PJRT_Buffer_Dimensions(&dim_args), api, "PJRT_Buffer_Dimensions")) {
+        return 1;
+    }
+    if (dim_args.num_dims > HOST_TENSOR_MAX_DIMS) {
+        fprintf(stderr, "buffer_to_host: rank %zu is not supported.\n", dim_args.num_dims);
+        return 1;
+    }
+    tensor->num_dims = dim_args.num_dims;
+    size_t total_elements = 1;
+    for (size_t i = 0; i < dim_args.num_dims; ++i) {
+        tensor->dims[i] = dim_args.dims[i];
+        total_elements *= dim_args.dims[i];
+    }
+    size_t element_size = buffer_type_size(tensor->type);
+    if (element_size == 0) {
+        fprintf(stderr, "buffer_to_host: element type %d is not supported.\n", tensor->type);
+        return 1;
+    }
+    tensor->size = total_elements * element_size;
+    tensor->data = malloc(tensor->size ? tensor->size : 1);
+    if (tensor->data == NULL) {
+        fprintf(stderr, "Failed to allocate host memory for output buffer.\n");
+        return 1;
+    }
+
+    PJRT_Buffer_ToHostBuffer_Args to_host_args = {0};
+    to_host_args.struct_size = PJRT_Buffer_ToHostBuffer_Args_STRUCT_SIZE;
+    to_host_args.src = buffer;
+    to_host_args.dst = tensor->data;
+    to_host_args.dst_size = tensor->size;
+    if (handle_error(api->PJRT_Buffer_ToHostBuffer(&to_host_args), api, "PJRT_Buffer_ToHostBuffer")) {
+        free_host_tensor(tensor);
+        return 1;
+    }
+    *event = to_host_args.event;
+    return 0;
+}
+
+
+// --- Helper function to copy a device buffer to a newly allocated host tensor ---
+int buffer_to_host(const PJRT_Api* api, PJRT_Buffer* buffer, struct host_tensor* tensor) {
+    uint64_t timer = stage_timer_start();
+    PJRT_Event* event = NULL;
+    if (buffer_to_host_async(api, buffer, tensor, &event) != 0) {
+        return 1;
+    }
+    if (await_event(api, event, "PJRT_Event_Await (ToHostBuffer)") != 0) {
+        free_host_tensor(tensor);
+        return 1;
+    }
+    stage_timer_stop(TIMER_STAGE_TO_HOST, timer);
+    return 0;
+}
+
+
+// --- Helper function to copy the valid region of a device buffer to a new host tensor ---
+// For buffers with bounded-dynamic dimensions the host tensor gets the
+// unpadded dimensions and only the valid region is transferred, with one
+// PJRT_Buffer_CopyRawToHost per contiguous run of the (row-major) device
+// buffer. Static buffers go through buffer_to_host, and so does a plugin
+// without raw copies, compacting on the host. `copied_bytes` (may be NULL)
+// receives the number of bytes transferred from the device.
+int buffer_to_host_unpadded(const PJRT_Api* api, PJRT_Buffer* buffer, struct host_tensor* tensor,
+                            size_t* copied_bytes) {
+    PJRT_Buffer_DynamicDimensionIndices_Args dynamic_args = {0};
+    dynamic_args.struct_size = PJRT_Buffer_DynamicDimensionIndices_Args_STRUCT_SIZE;
+    dynamic_args.buffer = buffer;
+    if (handle_error(api->PJRT_Buffer_DynamicDimensionIndices(&dynamic_args), api,
+                     "PJRT_Buffer_DynamicDimensionIndices")) {
+        return 1;
+    }
+    if (dynamic_args.num_dynamic_dims == 0) {
+        if (buffer_to_host(api, buffer, tensor) != 0) return 1;
+        if (copied_bytes != NULL) *copied_bytes = tensor->size;
+        return 0;
+    }
+
+    PJRT_Buffer_UnpaddedDimensions_Args unpadded_args = {0};
+    unpadded_args.struct_size = PJRT_Buffer_UnpaddedDimensions_Args_STRUCT_SIZE;
+    unpadded_args.buffer = buffer;
+    if (handle_error(api->PJRT_Buffer_UnpaddedDimensions(&unpadded_args), api, "PJRT_Buffer_UnpaddedDimensions")) {
+        return 1;
+    }
+    PJRT_Buffer_Dimensions_Args dim_args = {0};
+    dim_args.struct_size = PJRT_Buffer_Dimensions_Args_STRUCT_SIZE;
+    dim_args.buffer = buffer;
+    if (handle_error(api->PJRT_Buffer_Dimensions(&dim_args), api, "PJRT_Buffer_Dimensions")) {
+        return 1;
+    }
+    PJRT_Buffer_ElementType_Args type_args = {0};
+    type_args.struct_size = PJRT_Buffer_ElementType_Args_STRUCT_SIZE;
+    type_args.buffer = buffer;
+    if (handle_error(api->PJRT_Buffer_ElementType(&type_args), api, "PJRT_Buffer_ElementType")) {
+        return 1;
+    }
+    size_t num_dims = dim_args.num_dims;
+    size_t element_size = buffer_type_size(type_args.type);
+    if (num_dims > HOST_TENSOR_MAX_DIMS || unpadded_args.num_dims != num_dims || element_size == 0) {
+        fprintf(stderr, "buffer_to_host_unpadded: unsupported buffer (rank %zu, type %d).\n", num_dims,
+                type_args.type);
+        return 1;
+    }
+    const int64_t* padded = dim_args.dims;
+    const int64_t* unpadded = unpadded_args.unpadded_dims;
+
+    memset(tensor, 0, sizeof(*tensor));
+    tensor->type = type_args.type;
+    tensor->num_dims = num_dims;
+    size_t total_elements = 1;
+    for (size_t i = 0; i < num_dims; ++i) {
+        tensor->dims[i] = unpadded[i];
+        total_elements *= unpadded[i];
+    }
+    tensor->size = total_elements * element_size;
+    tensor->data = malloc(tensor->size ? tensor->size : 1);
+    if (tensor->data == NULL) {
+        fprintf(stderr, "Failed to allocate host memory for output buffer.\n");
+        return 1;
+    }
+    if (total_elements == 0) {
+        if (copied_bytes != NULL) *copied_bytes = 0;
+        return 0;
+    }
+
+    // A run starts at dimension `first`: every dimension after it is fully valid.
+    size_t first = num_dims - 1;
+    while (first > 0 && unpadded[first] == padded[first]) --first;
+    size_t run_elements = unpadded[first];
+    for (size_t d = first + 1; d < num_dims; ++d) run_elements *= padded[d];
+    size_t run_bytes = run_elements * element_size;
+    size_t num_runs = total_elements / run_elements;
+
+    PJRT_Event** events = (PJRT_Event**)calloc(num_runs, sizeof(PJRT_Event*));
+    if (events == NULL) {
+        free_host_tensor(tensor);
+        return 1;
+    }
+    int rc = 0;
+    int64_t index[HOST_TENSOR_MAX_DIMS] = {0};
+    size_t issued = 0;
+    uint64_t timer = stage_timer_start();
+    for (; issued < num_runs; ++issued) {
+        int64_t offset = 0;
+        for (size_t d = 0; d < num_dims; ++d) offset = offset * padded[d] + (d < first ? index[d] : 0);
+        PJRT_Buffer_CopyRawToHost_Args raw_args = {0};
+        raw_args.struct_size = PJRT_Buffer_CopyRawToHost_Args_STRUCT_SIZE;
+        raw_args.buffer = buffer;
+        raw_args.dst = (char*)tensor->data + issued * run_bytes;
+        raw_args.offset = offset * (int64_t)element_size;
+        raw_args.transfer_size = (int64_t)run_bytes;
+        if (handle_error(api->PJRT_Buffer_CopyRawToHost(&raw_args), api, "PJRT_Buffer_CopyRawToHost")) {
+            rc = 1;
+            break;
+        }
+        events[issued] = raw_args.event;
+        for (int d = (int)first - 1; d >= 0; --d) {
+            if (++index[d] < unpadded[d]) break;
+            index[d] = 0;
+        }
+    }
+    for (size_t i = 0; i < issued; ++i) {
+        if (await_event(api, events[i], "PJRT_Event_Await (CopyRawToHost)") != 0) rc = 1;
+    }
+    free(events);
+    if (rc == 0) {
+        stage_timer_stop(TIMER_STAGE_TO_HOST, timer);
+        if (copied_bytes != NULL) *copied_bytes = tensor->size;
+        return 0;
+    }
+
+    // No raw copies: transfer the padded extent and compact it on the host.
+    if (issued == 0) {
+        struct host_tensor full;
+        if (buffer_to_host(api, buffer, &full) == 0) {
+            copy_box(tensor->data, tensor->dims, full.data, full.dims, tensor->dims, num_dims, element_size);
+            if (copied_bytes != NULL) *copied_bytes = full.size;
+            free_host_tensor(&full);
+            return 0;
+        }
+    }
+    free_host_tensor(tensor);
+    return 1;
+}
+
+
+// --- Helper function to copy the leading `box` corner between row-major arrays ---
+// Elements of `dst` outside the box are left untouched.
+void copy_box(void* dst, const int64_t* dst_dims, const void* src, const int64_t* src_dims,
+              const int64_t* box, size_t num_dims, size_t element_size) {
+    if (num_dims == 0) {
+        memcpy(dst, src, element_size);
+        return;
+    }
+    size_t row_bytes = (size_t)box[num_dims - 1] * element_size;
+    int64_t outer = 1;
+    for (size_t d = 0; d + 1 < num_dims; ++d) outer *= box[d];
+    int64_t index[HOST_TENSOR_MAX_DIMS] = {0};
+    for (int64_t n = 0; n < outer; ++n) {
+        int64_t src_offset = 0;
+        int64_t dst_offset = 0;
+        for (size_t d = 0; d < num_dims; ++d) {
+            src_offset = src_offset * src_dims[d] + index[d];
+            dst_offset = dst_offset * dst_dims[d] + index[d];
+        }
+        memcpy((char*)dst + dst_offset * element_size, (const char*)src + src_offset * element_size, row_bytes);
+        for (int d = (int)num_dims - 2; d >= 0; --d) {
+            if (++index[d] < box[d]) break;
+            index[d] = 0;
+        }
+    }
+}
+
+
+// --- Helper function to wait for an event and destroy it ---
+// A NULL event counts as already completed.
+int await_event(const PJRT_Api* api, PJRT_Event* event, const char* context) {
+    if (event == NULL) return 0;
+    PJRT_Event_Await_Args await_args = {0};
+    await_args.struct_size = PJRT_Event_Await_Args_STRUCT_SIZE;
+    await_args.event = event;
+    PJRT_Error* await_error = api->PJRT_Event_Await(&await_args);
+    destroy_event(api, event);
+    return handle_error(await_error, api, context);
+}
+
+
+void destroy_event(const PJRT_Api* api, PJRT_Event* event) {
+    PJRT_Event_Destroy_Args destroy_event_args = {0};
+    destroy_event_args.struct_size = PJRT_Event_Destroy_Args_STRUCT_SIZE;
+    destroy_event_args.event = event;
+    handle_error(api->PJRT_Event_Destroy(&destroy_event_args), api, "PJRT_Event_Destroy");
+}
+
+
+// --- Function to free a host tensor ---
+void free_host_tensor(struct host_tensor* tensor) {
+    free(tensor->data);
+    tensor->data = NULL;
+    tensor->size = 0;
+}
+
+
+// --- Helper function to look up a plugin extension by type ---
+const PJRT_Extension_Base* find_extension(const PJRT_Api* api, PJRT_Extension_Type type) {
+    for (const PJRT_Extension_Base* ext = api->extension_start; ext != NULL; ext = ext->next) {
+        if (ext->type == type) return ext;
+    }
+    return NULL;
+}
+
+
+// --- Helper function to execute once and copy all outputs to the host ---
+int execute_to_host(const PJRT_Api* api, PJRT_LoadedExecutable* executable,
+                    PJRT_Buffer** inputs, size_t num_inputs,
+                    struct host_tensor** outputs_ptr, size_t* num_outputs_ptr) {
+    PJRT_Buffer** outputs = NULL;
+    size_t num_outputs = 0;
+    if (execute_hlo_program(api, executable, inputs, num_inputs, &outputs, &num_outputs) != 0) {
+        return 1;
+    }
+    struct host_tensor* tensors = (struct host_tensor*)calloc(num_outputs ? num_outputs : 1, sizeof(struct host_tensor));
+    int rc = tensors == NULL;
+    for (size_t i = 0; i < num_outputs && rc == 0; ++i) {
+        rc = buffer_to_host(api, outputs[i], &tensors[i]);
+    }
+    destroy_buffers(api, outputs, num_outputs, "PJRT_Buffer_Destroy (output)");
+    if (rc != 0) {
+        free_host_tensors(tensors, num_outputs);
+        return 1;
+    }
+    *outputs_ptr = tensors;
+    *num_outputs_ptr = num_outputs;
+    return 0;
+}
+
+
+// --- Function to free an array of host tensors ---
+void free_host_tensors(struct host_tensor* tensors, size_t num_tensors) {
+    if (tensors == NULL) return;
+    for (size_t i = 0; i < num_tensors; ++i) free_host_tensor(&tensors[i]);
+    free(tensors);
+}
+
+
+// --- Helper function to time executions of a loaded executable ---
+// One warm-up run, then `iterations` runs each waiting for all outputs to be
+// ready. Stores the wall time of each timed execution in samples.
+int benchmark_executable_samples(const PJRT_Api* api, PJRT_LoadedExecutable* executable,
+                                 PJRT_Buffer** inputs, size_t num_inputs, int iterations, double* samples) {
+    int rc = 0;
+    for (int i = -1; i < iterations && rc == 0; ++i) {
+        PJRT_Buffer** outputs = NULL;
+        size_t num_outputs = 0;
+        double start = now_seconds();
+        rc = execute_hlo_program(api, executable, inputs, num_inputs, &outputs, &num_outputs) ||
+             await_buffers_ready(api, outputs, num_outputs);
+        if (i >= 0) samples[i] = now_seconds() - start;
+        destroy_buffers(api, outputs, num_outputs, "PJRT_Buffer_Destroy (benchmark output)");
+    }
+    return rc;
+}
+
+
+// --- Helper function to report the median execution time ---
+int benchmark_executable(const PJRT_Api* api, PJRT_LoadedExecutable* executable,
+                         PJRT_Buffer** inputs, size_t num_inputs, int iterations, double* median_s) {
+    double* samples = (double*)calloc(iterations, sizeof(double));
+    if (samples == NULL) return 1;
+    int rc = benchmark_executable_samples(api, executable, inputs, num_inputs, iterations, samples);
+    if (rc == 0) *median_s = median_of(samples, iterations);
+    free(samples);
+    return rc;
+}
+
+
+// --- Helper function to wait until buffers are ready ---
+int await_buffers_ready(const PJRT_Api* api, PJRT_Buffer** buffers, size_t num_buffers) {
+    int rc = 0;
+    for (size_t i = 0; i < num_buffers; ++i) {
+        if (buffers[i] == NULL) continue;
+        PJRT_Buffer_ReadyEvent_Args ready_args = {0};
+        ready_args.struct_size = PJRT_Buffer_ReadyEvent_Args_STRUCT_SIZE;
+        ready_args.buffer = buffers[i];
+        if (handle_error(api->PJRT_Buffer_ReadyEvent(&ready_args), api, "PJRT_Buffer_ReadyEvent")) {
+            rc = 1;
+            continue;
+        }
+        if (await_event(api, ready_args.event, "PJRT_Event_Await (buffer ready)")) rc = 1;
+    }
+    return rc;
+}
+
+
+// --- Helpers to widen 16-bit floats for comparison ---
+static float bf16_to_float(uint16_t value) {
+    uint32_t bits = (uint32_t)value << 16;
+    float result;
+    memcpy(&result, &bits, sizeof(result));
+    return result;
+}
+
+static float f16_to_float(uint16_t value) {
+    uint32_t sign = (uint32_t)(value & 0x8000) << 16;
+    int exponent = (value >> 10) & 0x1f;
+    uint32_t mantissa = value & 0x3ff;
+    float magnitude;
+    if (exponent == 0) {
+        magnitude = (float)mantissa * (1.0f / 16777216.0f); // Subnormal: mantissa * 2^-24
+    } else if (exponent == 31) {
+        magnitude = mantissa ? NAN : INFINITY;
+    } else {
+        magnitude = ldexpf((float)(mantissa | 0x400), exponent - 25);
+    }
+    float result;
+    uint32_t bits;
+    memcpy(&bits, &magnitude, sizeof(bits));
+    bits |= sign;
+    memcpy(&result, &bits, sizeof(result));
+    return result;
+}
+
+static double host_element(const struct host_tensor* tensor, size_t i) {
+    switch (tensor->type) {
+        case PJRT_Buffer_Type_F32: return ((const float*)tensor->data)[i];
+        case PJRT_Buffer_Type_F64: return ((const double*)tensor->data)[i];
+        case PJRT_Buffer_Type_BF16: return bf16_to_float(((const uint16_t*)tensor->data)[i]);
+        case PJRT_Buffer_Type_F16: return f16_to_float(((const uint16_t*)tensor->data)[i]);
+        default: return 0.0;
+    }
+}
+
+
+// --- Function to compare two host tensors ---
+// Floating point elements match when |a - b| <= tolerance * max(1, |a|),
+// NaNs match NaNs; all other types must be bit identical.
+int host_tensors_match(const struct host_tensor* expected, const struct host_tensor* actual, double tolerance) {
+    if (expected->type != actual->type || expected->num_dims != actual->num_dims ||
+        expected->size != actual->size) {
+        return 0;
+    }
+    for (size_t i = 0; i < expected->num_dims; ++i) {
+        if (expected->dims[i] != actual->dims[i]) return 0;
+    }
+    switch (expected->type) {
+        case PJRT_Buffer_Type_F32:
+        case PJRT_Buffer_Type_F64:
+        case PJRT_Buffer_Type_BF16:
+        case PJRT_Buffer_Type_F16: {
+            size_t count = expected->size / buffer_type_size(expected->type);
+            for (size_t i = 0; i < count; ++i) {
+                double a = host_element(expected, i);
+                double b = host_element(actual, i);
+                if (isnan(a) || isnan(b)) {
+                    if (isnan(a) != isnan(b)) return 0;
+                    continue;
+                }
+                if (a == b) continue; // Also covers matching infinities
+                if (fabs(a - b) > tolerance * fmax(1.0, fabs(a))) return 0;
+            }
+            return 1;
+        }
+        default:
+            return memcmp(expected->data, actual->data, expected->size) == 0;
+    }
+}
+
+
 // --- Function to run a specific computation test case ---
 static int run_computation_test(const PJRT_Api* api, PJRT_Client* client, PJRT_Device* device,
-                                const TestCase* test_case) {
+                                const TestCase* test_case, double tolerance) {
     printf("\n--- Running Test Case: %s ---\n", test_case->name);
     int rc = 1; // Default to failure
     struct file_data hlo_data = {NULL, 0};
@@ -415,40 +1270,39 @@ static int run_computation_test(const PJRT_Api* api, PJRT_Client* client, PJRT_D
     PJRT_Buffer** output_buffers = NULL;
     size_t num_outputs = 0;
 
-    // --- Read Files ---
-    if (read_file_to_buffer(test_case->hlo_path, &hlo_data) != 0) {
-        fprintf(stderr, "Failed to read HLO program file: %s\n", test_case->hlo_path);
-        goto cleanup_test;
+    // --- Load a serialized executable, when the test case has one ---
+    if (test_case->executable_path != NULL) {
+        loaded_executable = load_serialized_executable(api, client, test_case->executable_path);
+        if (loaded_executable != NULL) {
+            printf("Loaded serialized executable '%s'.\n", test_case->executable_path);
+        } else {
+            printf("Serialized executable '%s' not usable, compiling instead.\n", test_case->executable_path);
+        }
     }
-    printf("Read HLO program '%s' (%zu bytes).\n", test_case->hlo_path, hlo_data.size);
 
-    if (read_file_to_buffer(test_case->compile_options_path, &compile_options_data) != 0) {
-        fprintf(stderr, "Failed to read compile options file: %s\n", test_case->compile_options_path);
-        goto cleanup_test;
+    // --- Read Files ---
+    if (loaded_executable == NULL) {
+        if (read_file_to_buffer(test_case->hlo_path, &hlo_data) != 0) {
+            fprintf(stderr, "Failed to read HLO program file: %s\n", test_case->hlo_path);
+            goto cleanup_test;
+        }
+        printf("Read HLO program '%s' (%zu bytes).\n", test_case->hlo_path, hlo_data.size);
+
+        if (read_file_to_buffer(test_case->compile_options_path, &compile_options_data) != 0) {
+            fprintf(stderr, "Failed to read compile options file: %s\n", test_case->compile_options_path);
+            goto cleanup_test;
+        }
+        printf("Read compile options proto '%s' (%zu bytes).\n", test_case->compile_options_path,
+               compile_options_data.size);
     }
-    printf("Read compile options proto '%s' (%zu bytes).\n", test_case->compile_options_path, compile_options_data.size);
 
     // --- Create Input Buffers ---
-    input_buffers = (PJRT_Buffer**)malloc(test_case->num_inputs * sizeof(PJRT_Buffer*));
-    if (input_buffers == NULL) {
-        fprintf(stderr, "Failed to allocate memory for input buffer array.\n");
-        goto cleanup_test;
-    }
-    for(size_t i=0; i<test_case->num_inputs; ++i) input_buffers[i] = NULL; // Initialize
+    input_buffers = create_input_buffers(api, client, device, test_case);
+    if (input_buffers == NULL) goto cleanup_test;
 
     for (size_t i = 0; i < test_case->num_inputs; ++i) {
-        char context[50];
-        snprintf(context, sizeof(context), "Input %zu", i);
-        input_buffers[i] = create_buffer_from_host(api, client, device,
-                                                   test_case->input_data[i],
-                                                   test_case->input_types[i],
-                                                   test_case->input_dims[i],
-                                                   test_case->input_num_dims[i],
-                                                   context);
-        if (input_buffers[i] == NULL) goto cleanup_test;
-
         // Print input buffer
-        printf("--- %s Data ---\n", context);
+        printf("--- Input %zu Data ---\n", i);
         // Assuming F32 for now, might need type switching later
         if (test_case->input_types[i] == PJRT_Buffer_Type_F32) {
              print_float_buffer((float*)test_case->input_data[i], test_case->input_dims[i], test_case->input_num_dims[i]);
@@ -459,30 +1313,19 @@ static int run_computation_test(const PJRT_Api* api, PJRT_Client* client, PJRT_D
     }
 
 
-    // --- Compile HLO program ---
-    {
-        PJRT_Program program = {0};
-        program.struct_size = PJRT_Program_STRUCT_SIZE;
-        program.extension_start = NULL;
-        program.format = "hlo"; // Assuming HLO format
-        program.format_size = strlen(program.format);
-        program.code = hlo_data.data;
-        program.code_size = hlo_data.size;
-
-        PJRT_Client_Compile_Args compile_args = {0};
-        compile_args.struct_size = PJRT_Client_Compile_Args_STRUCT_SIZE;
-        compile_args.extension_start = NULL;
-        compile_args.client = client;
-        compile_args.program = &program;
-        compile_args.compile_options = compile_options_data.data;
-        compile_args.compile_options_size = compile_options_data.size;
-
-        PJRT_Error* error = api->PJRT_Client_Compile(&compile_args);
-        if (handle_error(error, api, "PJRT_Client_Compile")) {
+    // --- Compile program ---
+    if (loaded_executable == NULL) {
+        const char* format = test_case->format ? test_case->format
+                                               : program_format_from_path(test_case->hlo_path);
+        loaded_executable = compile_program(api, client, &hlo_data, format, &compile_options_data);
+        if (loaded_executable == NULL) {
             goto cleanup_test;
         }
-        loaded_executable = compile_args.executable;
-        printf("PJRT_Client_Compile successful.\n");
+        printf("PJRT_Client_Compile successful (format '%s').\n", format);
+        char output_kinds[256];
+        if (describe_output_memory_kinds(api, loaded_executable, output_kinds, sizeof(output_kinds)) == 0) {
+            printf("Output memory kinds: %s\n", output_kinds);
+        }
     }
 
     // --- Execute the program ---
@@ -500,43 +1343,19 @@ static int run_computation_test(const PJRT_Api* api, PJRT_Client* client, PJRT_D
          // --- Process Output Buffers ---
          if (num_outputs > 0 && output_buffers != NULL && output_buffers[0] != NULL) {
              printf("Processing output buffer 0...\n");
-             PJRT_Buffer* out_buf = output_buffers[0];
-
-             PJRT_Buffer_Dimensions_Args dim_args = {0};
-             dim_args.struct_size = PJRT_Buffer_Dimensions_Args_STRUCT_SIZE;
-             dim_args.buffer = out_buf;
-             PJRT_Error* dim_err = api->PJRT_Buffer_Dimensions(&dim_args);
-             if (handle_error(dim_err, api, "PJRT_Buffer_Dimensions (output)")) {
-                 // Error getting dimensions, cannot proceed with copy/print
+             struct host_tensor output;
+             size_t copied_bytes = 0;
+             if (buffer_to_host_unpadded(api, output_buffers[0], &output, &copied_bytes) != 0) {
+                 fprintf(stderr, "Failed to copy output buffer to host.\n");
              } else {
-                 printf("Output buffer dimensions: %zu\n", dim_args.num_dims);
-                 // Calculate size based on dimensions and type (assuming F32 for now)
-                 size_t total_elements = 1;
-                 for(size_t i=0; i<dim_args.num_dims; ++i) total_elements *= dim_args.dims[i];
-                 // TODO: Get buffer type instead of assuming F32
-                 size_t expected_byte_size = total_elements * sizeof(float);
-
-                 float* host_output_data = (float*)malloc(expected_byte_size);
-                 if (host_output_data == NULL) {
-                     fprintf(stderr, "Failed to allocate host memory for output buffer.\n");
+                 printf("Output buffer dimensions: %zu\n", output.num_dims);
+                 printf("Output buffer copied to host successfully (%zu bytes transferred).\n", copied_bytes);
+                 if (output.type == PJRT_Buffer_Type_F32) {
+                     print_float_buffer((float*)output.data, output.dims, output.num_dims);
                  } else {
-                     PJRT_Buffer_ToHostBuffer_Args to_host_args = {0};
-                     to_host_args.struct_size = PJRT_Buffer_ToHostBuffer_Args_STRUCT_SIZE;
-                     to_host_args.src = out_buf;
-                     to_host_args.dst = host_output_data;
-                     to_host_args.dst_size = expected_byte_size;
-
-                     PJRT_Error* to_host_error = api->PJRT_Buffer_ToHostBuffer(&to_host_args);
-
-                     if (handle_error(to_host_error, api, "PJRT_Buffer_ToHostBuffer")) {
-                         fprintf(stderr, "Failed to copy output buffer to host.\n");
-                     } else {
-                         printf("Output buffer copied to host successfully.\n");
-                         // Assuming F32 for printing
-                         print_float_buffer(host_output_data, dim_args.dims, dim_args.num_dims);
-                     }
-                     free(host_output_data);
+                     printf("  (Printing not implemented for this type)\n");
                  }
+                 free_host_tensor(&output);
              }
          } else if (num_outputs > 0) {
               fprintf(stderr, "Output buffer list exists, but buffer 0 is NULL.\n");
@@ -545,6 +1364,25 @@ static int run_computation_test(const PJRT_Api* api, PJRT_Client* client, PJRT_D
          }
          // --- End of processing output buffers ---
 
+         // --- Check outputs against the expected results ---
+         if (test_case->expected_outputs != NULL) {
+             if (num_outputs != test_case->num_expected_outputs) {
+                 fprintf(stderr, "Expected %zu output(s), got %zu.\n", test_case->num_expected_outputs, num_outputs);
+                 goto cleanup_test;
+             }
+             for (size_t i = 0; i < num_outputs; ++i) {
+                 struct host_tensor output;
+                 if (buffer_to_host_unpadded(api, output_buffers[i], &output, NULL) != 0) goto cleanup_test;
+                 int match = host_tensors_match(&test_case->expected_outputs[i], &output, tolerance);
+                 free_host_tensor(&output);
+                 if (!match) {
+                     fprintf(stderr, "Output %zu does not match the expected result.\n", i);
+                     goto cleanup_test;
+                 }
+             }
+             printf("All %zu output(s) match the expected results.\n", num_outputs);
+         }
+
     } else {
          fprintf(stderr, "Executable is NULL, cannot execute.\n");
          goto cleanup_test;
@@ -558,39 +1396,17 @@ cleanup_test:
     // Destroy output buffers
     if (output_buffers != NULL && api != NULL) {
         printf("Destroying output buffers.\n");
-        for (size_t i = 0; i < num_outputs; ++i) {
-            if (output_buffers[i] != NULL) {
-                PJRT_Buffer_Destroy_Args destroy_buf_args = {0};
-                destroy_buf_args.struct_size = PJRT_Buffer_Destroy_Args_STRUCT_SIZE;
-                destroy_buf_args.buffer = output_buffers[i];
-                PJRT_Error* destroy_buf_err = api->PJRT_Buffer_Destroy(&destroy_buf_args);
-                handle_error(destroy_buf_err, api, "PJRT_Buffer_Destroy (output)");
-            }
-        }
-        free(output_buffers);
+        destroy_buffers(api, output_buffers, num_outputs, "PJRT_Buffer_Destroy (output)");
     }
     // Destroy input buffers
-     if (input_buffers != NULL && api != NULL) {
-         printf("Destroying input buffers.\n");
-         for (size_t i = 0; i < test_case->num_inputs; ++i) {
-             if (input_buffers[i] != NULL) {
-                 PJRT_Buffer_Destroy_Args destroy_buf_args = {0};
-                 destroy_buf_args.struct_size = PJRT_Buffer_Destroy_Args_STRUCT_SIZE;
-                 destroy_buf_args.buffer = input_buffers[i];
-                 PJRT_Error* destroy_buf_err = api->PJRT_Buffer_Destroy(&destroy_buf_args);
-                 handle_error(destroy_buf_err, api, "PJRT_Buffer_Destroy (input)");
-             }
-         }
-         free(input_buffers);
-     }
+    if (input_buffers != NULL && api != NULL) {
+        printf("Destroying input buffers.\n");
+        destroy_buffers(api, input_buffers, test_case->num_inputs, "PJRT_Buffer_Destroy (input)");
+    }
     // Destroy loaded executable
     if (loaded_executable != NULL && api != NULL) {
         printf("Destroying loaded executable.\n");
-        PJRT_LoadedExecutable_Destroy_Args destroy_exec_args = {0};
-        destroy_exec_args.struct_size = PJRT_LoadedExecutable_Destroy_Args_STRUCT_SIZE;
-        destroy_exec_args.executable = loaded_executable;
-        PJRT_Error* destroy_exec_err = api->PJRT_LoadedExecutable_Destroy(&destroy_exec_args);
-        handle_error(destroy_exec_err, api, "PJRT_LoadedExecutable_Destroy");
+        destroy_loaded_executable(api, loaded_executable);
     }
     // Free file buffers
     free_file_data(&hlo_data);
@@ -601,11 +1417,497 @@ cleanup_test:
 }
 
 
+// --- Helpers for the program format comparison ---
+static int compare_doubles(const void* a, const void* b) {
+    double x = *(const double*)a;
+    double y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+double median_of(double* samples, size_t count) {
+    qsort(samples, count, sizeof(samples[0]), compare_doubles);
+    return count % 2 ? samples[count / 2] : 0.5 * (samples[count / 2 - 1] + samples[count / 2]);
+}
+
+static void print_format_row(const char* artifact, const char* format, size_t bytes,
+                             double* read_s, double* load_s, int iterations) {
+    double total_min = -1.0;
+    for (int i = 0; i < iterations; ++i) {
+        double total = read_s[i] + load_s[i];
+        if (total_min < 0.0 || total < total_min) total_min = total;
+    }
+    double read_median = median_of(read_s, iterations);
+    double load_median = median_of(load_s, iterations);
+    printf("  %-32s %-6s %10zu %10.3f %12.3f %12.3f\n", artifact, format, bytes,
+           read_median * 1e3, load_median * 1e3, total_min * 1e3);
+}
+
+
+// --- Function to compare the load cost of one computation in different formats ---
+// Every program in the test case (hlo_path plus program_variants) is read and compiled
+// `iterations` times, then the executable compiled from hlo_path is serialized and
+// reloaded with PJRT_Executable_DeserializeAndLoad.
+static int compare_program_formats(const PJRT_Api* api, PJRT_Client* client,
+                                   const TestCase* test_case, int iterations) {
+    int rc = 0;
+    struct file_data compile_options_data = {NULL, 0};
+    double* read_s = NULL;
+    double* load_s = NULL;
+    PJRT_Executable_Serialize_Args serialize_args = {0};
+
+    printf("\n--- Comparing program formats: %s ---\n", test_case->name);
+    if (read_file_to_buffer(test_case->compile_options_path, &compile_options_data) != 0) {
+        return 1;
+    }
+    read_s = (double*)calloc(iterations, sizeof(double));
+    load_s = (double*)calloc(iterations, sizeof(double));
+    if (read_s == NULL || load_s == NULL) {
+        fprintf(stderr, "Failed to allocate timing samples.\n");
+        rc = 1;
+        goto cleanup_compare;
+    }
+
+    printf("  %-32s %-6s %10s %10s %12s %12s\n", "artifact", "format", "bytes",
+           "read(ms)", "compile(ms)", "total-min(ms)");
+    for (size_t p = 0;; ++p) {
+        const char* path = p == 0 ? test_case->hlo_path
+                                  : (test_case->program_variants ? test_case->program_variants[p - 1] : NULL);
+        if (path == NULL) break;
+        const char* format = (p == 0 && test_case->format) ? test_case->format : program_format_from_path(path);
+        size_t bytes = 0;
+        int ok = 1;
+        for (int i = 0; i < iterations && ok; ++i) {
+            struct file_data program_data = {NULL, 0};
+            double start = now_seconds();
+            if (read_file_to_buffer(path, &program_data) != 0) {
+                ok = 0;
+                break;
+            }
+            double read_end = now_seconds();
+            PJRT_LoadedExecutable* executable = compile_program(api, client, &program_data, format,
+                                                                &compile_options_data);
+            double load_end = now_seconds();
+            bytes = program_data.size;
+            free_file_data(&program_data);
+            if (executable == NULL) {
+                ok = 0;
+                break;
+            }
+            read_s[i] = read_end - start;
+            load_s[i] = load_end - read_end;
+            if (p == 0 && i == iterations - 1) {
+                // Keep the last executable around to produce the serialized form.
+                PJRT_LoadedExecutable_GetExecutable_Args get_exec_args = {0};
+                get_exec_args.struct_size = PJRT_LoadedExecutable_GetExecutable_Args_STRUCT_SIZE;
+                get_exec_args.loaded_executable = executable;
+                if (!handle_error(api->PJRT_LoadedExecutable_GetExecutable(&get_exec_args), api,
+                                  "PJRT_LoadedExecutable_GetExecutable")) {
+                    serialize_args.struct_size = PJRT_Executable_Serialize_Args_STRUCT_SIZE;
+                    serialize_args.executable = get_exec_args.executable;
+                    if (handle_error(api->PJRT_Executable_Serialize(&serialize_args), api,
+                                     "PJRT_Executable_Serialize")) {
+                        serialize_args.serialized_executable = NULL;
+                    }
+                    PJRT_Executable_Destroy_Args destroy_args = {0};
+                    destroy_args.struct_size = PJRT_Executable_Destroy_Args_STRUCT_SIZE;
+                    destroy_args.executable = get_exec_args.executable;
+                    handle_error(api->PJRT_Executable_Destroy(&destroy_args), api, "PJRT_Executable_Destroy");
+                }
+            }
+            destroy_loaded_executable(api, executable);
+        }
+        if (!ok) {
+            printf("  %-32s %-6s (skipped: not available)\n", path, format);
+            if (p == 0) rc = 1;
+            continue;
+        }
+        print_format_row(path, format, bytes, read_s, load_s, iterations);
+    }
+
+    if (serialize_args.serialized_executable != NULL) {
+        int ok = 1;
+        for (int i = 0; i < iterations; ++i) {
+            PJRT_Executable_DeserializeAndLoad_Args load_args = {0};
+            load_args.struct_size = PJRT_Executable_DeserializeAndLoad_Args_STRUCT_SIZE;
+            load_args.client = client;
+            load_args.serialized_executable = serialize_args.serialized_bytes;
+            load_args.serialized_executable_size = serialize_args.serialized_bytes_size;
+            double start = now_seconds();
+            if (handle_error(api->PJRT_Executable_DeserializeAndLoad(&load_args), api,
+                             "PJRT_Executable_DeserializeAndLoad")) {
+                ok = 0;
+                break;
+            }
+            load_s[i] = now_seconds() - start;
+            read_s[i] = 0.0; // Already in memory, the read cost is the same as for any file of this size
+            destroy_loaded_executable(api, load_args.loaded_executable);
+        }
+        if (ok) {
+            print_format_row("(serialized executable)", "exec", serialize_args.serialized_bytes_size,
+                             read_s, load_s, iterations);
+        }
+        serialize_args.serialized_executable_deleter(serialize_args.serialized_executable);
+    }
+
+cleanup_compare:
+    free(read_s);
+    free(load_s);
+    free_file_data(&compile_options_data);
+    return rc;
+}
+
+
 // --- Main Function ---
-int main(int argc, const char **argv)
+static void print_usage(const char* program) {
+    printf("Usage: %s [options]\n"
+           "  --compare-formats    Compare parse+compile time of HLO proto, MLIR and serialized executables\n"
+           "  --autotune           Sweep XLA CPU compile options and write <module>.compile_options.tuned.pb\n"
+           "  --tolerance T        Relative tolerance for output checks (default 1e-5)\n"
+           "  --ffi                Benchmark the host SIMD custom call against the pure StableHLO module\n"
+           "  --execute-context    Compare pooled, per-request and no PJRT_ExecuteContext for the custom call\n"
+           "  --pipeline           Stream frames through an overlapped upload/execute/readback pipeline\n"
+           "  --frames N           Number of frames for --pipeline (default 64)\n"
+           "  --shape-cache        Run variable-shape requests through exact-shape and bucketed executable caches\n"
+           "  --requests N         Requests for --shape-cache, per --load step and per --numa measurement (default 256)\n"
+           "  --dynamic            Compare padded and unpadded readback of a bounded-dynamic output\n"
+           "  --transfer           Measure copy latency and bandwidth between all devices and memories\n"
+           "  --convert            Benchmark SIMD host conversion of F32 to and from BF16, F16 and S8 on upload and\n"
+           "                       download against converting inside the XLA computation\n"
+           "  --weights FILE       Load a .npy or safetensors file zero-copy from its mapping and compare with\n"
+           "                       reading and copying it (repeatable)\n"
+           "  --dag                Run a fan-out/fan-in graph of executables with device-resident intermediates\n"
+           "                       against copying every intermediate through the host\n"
+           "  --roofline DIR       Time the kernels in DIR (from --roofline-generate and xla-translate) against the\n"
+           "                       host's STREAM bandwidth and peak FLOPs; writes roofline.csv and roofline.gp\n"
+           "  --roofline-generate DIR  Write the HLO text of the roofline kernels to DIR and exit\n"
+           "  --memory-kinds       Compare placing the RMS norm activation in each memory kind of the device\n"
+           "  --memory-kind KIND   Place every input of the built-in test cases in memory kind KIND\n"
+           "  --load               Sweep open-loop offered load and report tail latency and the saturation knee\n"
+           "  --rate R             Offer R requests per second instead of sweeping for --load\n"
+           "  --trace FILE         Replay arrival offsets (seconds, one per line) instead of Poisson arrivals\n"
+           "  --workers N          Maximum concurrent requests for --load, nodes for --dag (default 4)\n"
+           "  --bench FILE         Time every test case and write the raw samples to FILE as JSON\n"
+           "  --baseline FILE      Compare --bench results with FILE and exit with 2 on a significant regression\n"
+           "  --stage-timers       Time file reads, uploads, compiles, executes, readbacks and buffer destruction\n"
+           "                       per test case and print their histograms at exit\n"
+           "  --perf-counters      Read cycles, instructions, LLC/branch/dTLB misses around each execution\n"
+           "  --numa               Compare node-local and cross-node clients and host memory, one client per node\n"
+           "  --client-option N=V  Pass N=V to PJRT_Client_Create (e.g. cpu_device_count=4); may be repeated\n"
+           "  --client-options F   Read client options from file F, one NAME=VALUE per line\n"
+           "  --client-sweep       Benchmark every test case under each combination of swept client options\n"
+           "  --sweep-option N=V1|V2  Values of client option N for --client-sweep; may be repeated\n"
+           "                       (default: cpu_device_count over powers of two up to the CPU count)\n"
+           "  --import-snapshots DIR  Turn the HloSnapshots XLA dumped into DIR into a --corpus directory and exit\n"
+           "  --corpus DIR         Also run the test cases of corpus DIR (default ./corpus for --import-snapshots)\n"
+           "  --synthetic FILE     Also run program FILE with inputs generated for its parameter shapes; repeatable\n"
+           "  --seed N             Seed of the --synthetic input values (default 1)\n"
+           "  --bundle-create FILE Write the test cases, their serialized executables and inputs into bundle FILE\n"
+           "  --bundle-zstd LEVEL  Compress bundle sections with zstd at LEVEL when that makes them smaller\n"
+           "  --bundle FILE        Run the test cases of bundle FILE instead of the built-in ones\n"
+           "  --prewarm N          Compare first-request latency of cold executables and ones warmed by N\n"
+           "                       background runs on synthetic inputs before requests are admitted\n"
+           "  --soak N             Repeat the read/upload/compile/execute/destroy cycle N times (0: until SIGINT),\n"
+           "                       tracking RSS, device memory and latency per window and flagging drift\n"
+           "  --soak-window S      Length of a --soak window in seconds (default 10)\n"
+           "  --iterations N       Number of repetitions for timed modes (default 5)\n"
+           "  -h, --help           Show this help\n",
+           program);
+}
+
+
+int main(int argc, char **argv)
 {
-    (void)argc; // Suppress unused parameter warning
-    (void)argv; // Suppress unused parameter warning
+    static const struct option long_options[] = {
+        {"compare-formats", no_argument, NULL, 'c'},
+        {"autotune", no_argument, NULL, 'a'},
+        {"tolerance", required_argument, NULL, 't'},
+        {"ffi", no_argument, NULL, 'f'},
+        {"execute-context", no_argument, NULL, 'x'},
+        {"pipeline", no_argument, NULL, 'p'},
+        {"frames", required_argument, NULL, 'F'},
+        {"shape-cache", no_argument, NULL, 's'},
+        {"requests", required_argument, NULL, 'r'},
+        {"dynamic", no_argument, NULL, 'd'},
+        {"transfer", no_argument, NULL, 'T'},
+        {"convert", no_argument, NULL, 'u'},
+        {"weights", required_argument, NULL, 'q'},
+        {"dag", no_argument, NULL, 'D'},
+        {"roofline", required_argument, NULL, 'l'},
+        {"roofline-generate", required_argument, NULL, 'G'},
+        {"memory-kinds", no_argument, NULL, 'm'},
+        {"memory-kind", required_argument, NULL, 'M'},
+        {"load", no_argument, NULL, 'L'},
+        {"rate", required_argument, NULL, 'R'},
+        {"trace", required_argument, NULL, 'A'},
+        {"workers", required_argument, NULL, 'W'},
+        {"bench", required_argument, NULL, 'B'},
+        {"baseline", required_argument, NULL, 'b'},
+        {"stage-timers", no_argument, NULL, 'S'},
+        {"perf-counters", no_argument, NULL, 'P'},
+        {"numa", no_argument, NULL, 'N'},
+        {"client-option", required_argument, NULL, 'o'},
+        {"client-options", required_argument, NULL, 'O'},
+        {"client-sweep", no_argument, NULL, 'w'},
+        {"sweep-option", required_argument, NULL, 'v'},
+        {"import-snapshots", required_argument, NULL, 'I'},
+        {"corpus", required_argument, NULL, 'C'},
+        {"synthetic", required_argument, NULL, 'Y'},
+        {"seed", required_argument, NULL, 'e'},
+        {"bundle-create", required_argument, NULL, 'K'},
+        {"bundle-zstd", required_argument, NULL, 'z'},
+        {"bundle", required_argument, NULL, 'k'},
+        {"prewarm", required_argument, NULL, 'g'},
+        {"soak", required_argument, NULL, 'j'},
+        {"soak-window", required_argument, NULL, 'J'},
+        {"iterations", required_argument, NULL, 'n'},
+        {"help", no_argument, NULL, 'h'},
+        {NULL, 0, NULL, 0}
+    };
+    int compare_formats = 0;
+    int autotune = 0;
+    int ffi_benchmark = 0;
+    int context_benchmark = 0;
+    int pipeline = 0;
+    long frames = 64;
+    int shape_cache = 0;
+    long requests = 256;
+    int dynamic_readback = 0;
+    int transfer = 0;
+    int convert = 0;
+    const char* weight_paths[WEIGHTS_MAX_FILES];
+    size_t num_weights = 0;
+    int dag = 0;
+    const char* roofline_dir = NULL;
+    const char* roofline_output = NULL;
+    int memory_kinds = 0;
+    const char* memory_kind = NULL;
+    int load = 0;
+    struct load_options load_options = {4, 0, 0.0, NULL};
+    int perf_counters = 0;
+    int numa = 0;
+    struct client_options client_options = {0};
+    int client_sweep = 0;
+    const char* sweep_options[CLIENT_OPTIONS_MAX];
+    size_t num_sweep_options = 0;
+    const char* bench_path = NULL;
+    const char* baseline_path = NULL;
+    const char* snapshot_dir = NULL;
+    const char* corpus_dir = NULL;
+    const char* synthetic_paths[SYNTHETIC_MAX_PROGRAMS];
+    size_t num_synthetic = 0;
+    uint64_t seed = 1;
+    const char* bundle_output = NULL;
+    int bundle_zstd_level = 0;
+    const char* bundle_input = NULL;
+    int prewarm_runs = 0;
+    int soak = 0;
+    struct soak_options soak_options = {0, 10.0, 0.0};
+    int iterations = 5;
+    double tolerance = 1e-5;
+    for (int opt; (opt = getopt_long(argc, argv, "h", long_options, NULL)) != -1;) {
+        switch (opt) {
+            case 'c':
+                compare_formats = 1;
+                break;
+            case 'a':
+                autotune = 1;
+                break;
+            case 'f':
+                ffi_benchmark = 1;
+                break;
+            case 'x':
+                context_benchmark = 1;
+                break;
+            case 'p':
+                pipeline = 1;
+                break;
+            case 'F':
+                frames = atol(optarg);
+                if (frames < 1) {
+                    fprintf(stderr, "Invalid --frames value '%s'\n", optarg);
+                    return 1;
+                }
+                break;
+            case 's':
+                shape_cache = 1;
+                break;
+            case 'r':
+                requests = atol(optarg);
+                if (requests < 1) {
+                    fprintf(stderr, "Invalid --requests value '%s'\n", optarg);
+                    return 1;
+                }
+                break;
+            case 'd':
+                dynamic_readback = 1;
+                break;
+            case 'T':
+                transfer = 1;
+                break;
+            case 'u':
+                convert = 1;
+                break;
+            case 'q':
+                if (num_weights == WEIGHTS_MAX_FILES) {
+                    fprintf(stderr, "Too many --weights files (at most %d)\n", WEIGHTS_MAX_FILES);
+                    return 1;
+                }
+                weight_paths[num_weights++] = optarg;
+                break;
+            case 'D':
+                dag = 1;
+                break;
+            case 'l':
+                roofline_dir = optarg;
+                break;
+            case 'G':
+                roofline_output = optarg;
+                break;
+            case 'm':
+                memory_kinds = 1;
+                break;
+            case 'M':
+                memory_kind = optarg;
+                break;
+            case 'L':
+                load = 1;
+                break;
+            case 'R':
+                load_options.rate = atof(optarg);
+                if (load_options.rate <= 0.0) {
+                    fprintf(stderr, "Invalid --rate value '%s'\n", optarg);
+                    return 1;
+                }
+                break;
+            case 'A':
+                load_options.trace_path = optarg;
+                break;
+            case 'B':
+                bench_path = optarg;
+                break;
+            case 'S':
+                stage_timers_enable();
+                break;
+            case 'P':
+                perf_counters = 1;
+                break;
+            case 'N':
+                numa = 1;
+                break;
+            case 'o':
+                if (client_options_set(&client_options, optarg) != 0) return 1;
+                break;
+            case 'O':
+                if (client_options_load(&client_options, optarg) != 0) return 1;
+                break;
+            case 'w':
+                client_sweep = 1;
+                break;
+            case 'v':
+                if (num_sweep_options == CLIENT_OPTIONS_MAX) {
+                    fprintf(stderr, "Too many --sweep-option values (at most %d)\n", CLIENT_OPTIONS_MAX);
+                    return 1;
+                }
+                sweep_options[num_sweep_options++] = optarg;
+                break;
+            case 'b':
+                baseline_path = optarg;
+                break;
+            case 'I':
+                snapshot_dir = optarg;
+                break;
+            case 'C':
+                corpus_dir = optarg;
+                break;
+            case 'Y':
+                if (num_synthetic == SYNTHETIC_MAX_PROGRAMS) {
+                    fprintf(stderr, "Too many --synthetic programs (at most %d)\n", SYNTHETIC_MAX_PROGRAMS);
+                    return 1;
+                }
+                synthetic_paths[num_synthetic++] = optarg;
+                break;
+            case 'e':
+                seed = strtoull(optarg, NULL, 0);
+                break;
+            case 'K':
+                bundle_output = optarg;
+                break;
+            case 'z':
+                bundle_zstd_level = atoi(optarg);
+                break;
+            case 'k':
+                bundle_input = optarg;
+                break;
+            case 'j':
+                soak = 1;
+                soak_options.cycles = atol(optarg);
+                break;
+            case 'J':
+                soak_options.window_s = atof(optarg);
+                if (soak_options.window_s <= 0.0) {
+                    fprintf(stderr, "--soak-window needs a positive number of seconds\n");
+                    return 1;
+                }
+                break;
+            case 'g':
+                prewarm_runs = atoi(optarg);
+                if (prewarm_runs < 1) {
+                    fprintf(stderr, "--prewarm needs at least one run\n");
+                    return 1;
+                }
+                break;
+            case 'W':
+                load_options.workers = atoi(optarg);
+                if (load_options.workers < 1) {
+                    fprintf(stderr, "Invalid --workers value '%s'\n", optarg);
+                    return 1;
+                }
+                break;
+            case 't':
+                tolerance = atof(optarg);
+                break;
+            case 'n':
+                iterations = atoi(optarg);
+                if (iterations < 1) {
+                    fprintf(stderr, "Invalid --iterations value '%s'\n", optarg);
+                    return 1;
+                }
+                break;
+            case 'h':
+                print_usage(argv[0]);
+                return 0;
+            default:
+                print_usage(argv[0]);
+                return 1;
+        }
+    }
+    verbose = !(compare_formats || autotune || ffi_benchmark || context_benchmark || pipeline || shape_cache ||
+                dynamic_readback || transfer || convert || num_weights > 0 || dag || roofline_dir != NULL ||
+                memory_kinds || load || bench_path != NULL || perf_counters || numa || client_sweep ||
+                prewarm_runs > 0 || soak);
+    load_options.requests = requests;
+    soak_options.tolerance = tolerance;
+
+    // Importing snapshots and generating the roofline kernels are offline steps; they do not need the plugin.
+    if (snapshot_dir != NULL) {
+        return import_snapshots(snapshot_dir, corpus_dir != NULL ? corpus_dir : "./corpus");
+    }
+    if (roofline_output != NULL) {
+        return roofline_generate(roofline_output);
+    }
+    const TestCase** corpus_tests = NULL;
+    size_t num_corpus_tests = 0;
+    if (corpus_dir != NULL && load_corpus(corpus_dir, &corpus_tests, &num_corpus_tests) != 0) {
+        return 1;
+    }
+    const TestCase** bundle_tests = NULL;
+    size_t num_bundle_tests = 0;
+    if (bundle_input != NULL &&
+        (bundle_open(bundle_input) != 0 || bundle_load_tests(&bundle_tests, &num_bundle_tests) != 0)) {
+        bundle_close();
+        free_corpus(corpus_tests, num_corpus_tests);
+        return 1;
+    }
 
     static const char plugin_path[] = "./pjrt_c_api_cpu_plugin.so";
     pjrt_init init_fn;
@@ -615,6 +1917,11 @@ int main(int argc, const char **argv)
     PJRT_Device* target_device = NULL;
     int overall_rc = 0; // Track overall success/failure
 
+    // Counters must exist before the plugin starts its threads so that they inherit them.
+    if (perf_counters && perf_counters_open() == 0) {
+        printf("No hardware counters available; reporting wall time only.\n");
+    }
+
     // --- Plugin Loading and Client Creation ---
     handle = dlopen(plugin_path, RTLD_LAZY);
     if (!handle) {
@@ -658,16 +1965,16 @@ int main(int argc, const char **argv)
 
     print_plugin_attributes(api);
 
-    {
-        PJRT_Client_Create_Args create_args = {0};
-        create_args.struct_size = PJRT_Client_Create_Args_STRUCT_SIZE;
-        PJRT_Error* error = api->PJRT_Client_Create(&create_args);
-         if (handle_error(error, api, "PJRT_Client_Create")) {
-            close_plugin(handle, plugin_path, NULL);
-            return 1;
-        }
-        client = create_args.client;
-        printf("PJRT Client created successfully.\n");
+    client = create_client(api, &client_options);
+    if (client == NULL) {
+        close_plugin(handle, plugin_path, NULL);
+        return 1;
+    }
+    printf("PJRT Client created successfully.\n");
+    if (client_options.count > 0) {
+        char description[512];
+        client_options_describe(&client_options, description, sizeof(description));
+        printf("Client options: %s\n", description);
     }
 
     // --- Get Target Device ---
@@ -707,6 +2014,7 @@ int main(int argc, const char **argv)
     int64_t* add_input_dims[] = {add_dims, add_dims};
     size_t add_num_dims[] = {2, 2};
     PJRT_Buffer_Type add_types[] = {PJRT_Buffer_Type_F32, PJRT_Buffer_Type_F32};
+    static const char* const add_variants[] = {"./add.3x2.mlir.bc", NULL};
     TestCase add_test = {
         .name = "Add 3x2",
         .hlo_path = "./add.3x2.xla.pb",
@@ -715,7 +2023,8 @@ int main(int argc, const char **argv)
         .input_data = add_inputs,
         .input_dims = add_input_dims,
         .input_num_dims = add_num_dims,
-        .input_types = add_types
+        .input_types = add_types,
+        .program_variants = add_variants
     };
 
     // Test Case 2: Identity 2x2
@@ -725,6 +2034,7 @@ int main(int argc, const char **argv)
     int64_t* identity_input_dims[] = {identity_dims};
     size_t identity_num_dims[] = {2};
     PJRT_Buffer_Type identity_types[] = {PJRT_Buffer_Type_F32};
+    static const char* const identity_variants[] = {"./Identity.2x2.mlir.bc", NULL};
      TestCase identity_test = {
         .name = "Identity 2x2",
         .hlo_path = "./Identity.2x2.xla.pb",
@@ -733,15 +2043,146 @@ int main(int argc, const char **argv)
         .input_data = identity_inputs,
         .input_dims = identity_input_dims,
         .input_num_dims = identity_num_dims,
-        .input_types = identity_types
+        .input_types = identity_types,
+        .program_variants = identity_variants
+    };
+
+    // Test Case 3: axpy (alpha * x + y) as StableHLO bytecode written by stablehlo_compile_test
+    float madx4_alpha = 3.14f;
+    float madx4_x[4] = {1.0f, 2.0f, 3.0f, 4.0f};
+    float madx4_y[4] = {10.5f, 20.5f, 30.5f, 40.5f};
+    void* madx4_inputs[] = {&madx4_alpha, madx4_x, madx4_y};
+    int64_t madx4_dims[1] = {4};
+    int64_t* madx4_input_dims[] = {NULL, madx4_dims, madx4_dims};
+    size_t madx4_num_dims[] = {0, 1, 1};
+    PJRT_Buffer_Type madx4_types[] = {PJRT_Buffer_Type_F32, PJRT_Buffer_Type_F32, PJRT_Buffer_Type_F32};
+    TestCase madx4_test = {
+        .name = "madx4",
+        .hlo_path = "./madx4.mlir.bc",
+        .format = "mlir",
+        .compile_options_path = "./compile_options.0.pb",
+        .num_inputs = 3,
+        .input_data = madx4_inputs,
+        .input_dims = madx4_input_dims,
+        .input_num_dims = madx4_num_dims,
+        .input_types = madx4_types
     };
 
-    TestCase* all_tests[] = {&add_test, &identity_test};
-    size_t num_tests = sizeof(all_tests) / sizeof(all_tests[0]);
+    // --memory-kind places every input of the test cases above in one memory kind
+    const char* forced_kinds[] = {memory_kind, memory_kind, memory_kind};
+    if (memory_kind != NULL) {
+        add_test.input_memory_kinds = forced_kinds;
+        identity_test.input_memory_kinds = forced_kinds;
+        madx4_test.input_memory_kinds = forced_kinds;
+    }
+
+    const TestCase** all_tests = (const TestCase**)calloc(4 + num_corpus_tests + num_synthetic + num_bundle_tests,
+                                                        sizeof(*all_tests));
+    if (all_tests == NULL) {
+        fprintf(stderr, "Failed to allocate the test case list\n");
+        destroy_client(api, client);
+        close_plugin(handle, plugin_path, NULL);
+        free_corpus(corpus_tests, num_corpus_tests);
+        bundle_free_tests(bundle_tests, num_bundle_tests);
+        bundle_close();
+        return 1;
+    }
+    all_tests[0] = &add_test;
+    all_tests[1] = &identity_test;
+    all_tests[2] = &madx4_test;
+    size_t num_tests = 3;
+
+    // Test Case 4: host SIMD kernel called through the FFI, when the plugin supports it
+    if (register_ffi_handlers(api) == 0) {
+        all_tests[num_tests++] = ffi_rms_norm_test_case(1);
+    }
+
+    // A bundle replaces the test cases above, which read loose files (--bundle)
+    if (bundle_input != NULL) {
+        num_tests = 0;
+        for (size_t i = 0; i < num_bundle_tests; ++i) all_tests[num_tests++] = bundle_tests[i];
+    }
+
+    // Imported test cases with recorded results (--corpus)
+    for (size_t i = 0; i < num_corpus_tests; ++i) all_tests[num_tests++] = corpus_tests[i];
+
+    // Programs with generated inputs (--synthetic)
+    size_t first_synthetic = num_tests;
+    for (size_t i = 0; i < num_synthetic; ++i) {
+        const TestCase* synthetic = synthetic_test_case(api, client, synthetic_paths[i], seed);
+        if (synthetic == NULL) {
+            overall_rc = 1;
+            continue;
+        }
+        all_tests[num_tests++] = synthetic;
+    }
+    size_t end_synthetic = num_tests;
 
     // --- Run Tests ---
+    if (ffi_benchmark) {
+        overall_rc = run_ffi_benchmark(api, client, target_device, iterations, tolerance);
+        num_tests = 0;
+    } else if (context_benchmark) {
+        overall_rc = run_execute_context_benchmark(api, client, target_device, iterations);
+        num_tests = 0;
+    } else if (shape_cache) {
+        overall_rc = run_shape_cache_benchmark(api, client, target_device, requests, tolerance);
+        num_tests = 0;
+    } else if (dynamic_readback) {
+        overall_rc = run_dynamic_readback_benchmark(api, client, target_device, iterations);
+        num_tests = 0;
+    } else if (transfer) {
+        overall_rc = run_transfer_benchmark(api, client, iterations);
+        num_tests = 0;
+    } else if (convert) {
+        overall_rc = run_convert_benchmark(api, client, target_device, iterations);
+        num_tests = 0;
+    } else if (num_weights > 0) {
+        overall_rc = run_weights_benchmark(api, client, target_device, weight_paths, num_weights, iterations);
+        num_tests = 0;
+    } else if (dag) {
+        overall_rc = run_dag_benchmark(api, client, target_device, load_options.workers, iterations, tolerance);
+        num_tests = 0;
+    } else if (roofline_dir != NULL) {
+        overall_rc = run_roofline_benchmark(api, client, target_device, roofline_dir, iterations);
+        num_tests = 0;
+    } else if (memory_kinds) {
+        overall_rc = run_memory_kind_benchmark(api, client, target_device, iterations, tolerance);
+        num_tests = 0;
+    } else if (numa) {
+        overall_rc = run_numa_benchmark(api, &client_options, requests, tolerance);
+        num_tests = 0;
+    } else if (bundle_output != NULL) {
+        overall_rc = bundle_create(api, client, bundle_output, all_tests, num_tests, bundle_zstd_level);
+        num_tests = 0;
+    } else if (bench_path != NULL) {
+        overall_rc = run_bench(api, client, target_device, all_tests, num_tests, iterations, bench_path,
+                               baseline_path);
+        num_tests = 0;
+    }
     for (size_t i = 0; i < num_tests; ++i) {
-        int test_rc = run_computation_test(api, client, target_device, all_tests[i]);
+        int test_rc;
+        stage_timers_set_workload(all_tests[i]->name);
+        if (compare_formats) {
+            test_rc = compare_program_formats(api, client, all_tests[i], iterations);
+        } else if (autotune) {
+            test_rc = autotune_test_case(api, client, target_device, all_tests[i], iterations, tolerance);
+        } else if (pipeline) {
+            test_rc = run_pipeline_benchmark(api, client, target_device, all_tests[i], frames, tolerance);
+        } else if (load) {
+            test_rc = run_load_test(api, client, target_device, all_tests[i], &load_options);
+        } else if (client_sweep) {
+            test_rc = run_client_option_sweep(api, &client_options, sweep_options, num_sweep_options, all_tests[i],
+                                              iterations, load_options.workers);
+        } else if (perf_counters) {
+            test_rc = run_perf_counter_test(api, client, target_device, all_tests[i], iterations);
+        } else if (soak) {
+            test_rc = run_soak_test(api, client, target_device, all_tests[i], &soak_options);
+        } else if (prewarm_runs > 0) {
+            test_rc = run_prewarm_test(api, client, target_device, all_tests[i], prewarm_runs, iterations);
+        } else {
+            test_rc = run_computation_test(api, client, target_device, all_tests[i], tolerance);
+        }
         if (test_rc != 0) {
             overall_rc = 1; // Mark overall failure if any test fails
         }
@@ -761,6 +2202,13 @@ int main(int argc, const char **argv)
         printf("Closing plugin handle.\n");
         close_plugin(handle, plugin_path, NULL);
     }
+    perf_counters_close();
+    client_options_free(&client_options);
+    for (size_t i = first_synthetic; i < end_synthetic; ++i) free_synthetic_test_case(all_tests[i]);
+    free(all_tests);
+    free_corpus(corpus_tests, num_corpus_tests);
+    bundle_free_tests(bundle_tests, num_bundle_tests);
+    bundle_close();
 
     if (overall_rc == 0) {
         printf("\nAll hlo_tests completed successfully.\n");
@@ -0,0 +1,427 @@
+#ifndef HLO_TEST_H
+#define HLO_TEST_H
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "pjrt_c_api.h"
+
+struct file_data {
+    void* data;
+    size_t size;
+};
+
+// --- Host copy of a device buffer ---
+#define HOST_TENSOR_MAX_DIMS 8
+struct host_tensor {
+    PJRT_Buffer_Type type;
+    int64_t dims[HOST_TENSOR_MAX_DIMS];
+    size_t num_dims;
+    void* data;
+    size_t size; // Size of data in bytes
+};
+
+// --- Test Case Definition ---
+typedef struct {
+    const char* name;
+    const char* hlo_path;
+    const char* format; // Program format: "hlo" or "mlir", NULL to derive from hlo_path
+    const char* compile_options_path;
+    size_t num_inputs;
+    void** input_data; // Array of pointers to host data arrays
+    int64_t** input_dims; // Array of pointers to dimension arrays
+    size_t* input_num_dims; // Array of number of dimensions per input
+    PJRT_Buffer_Type* input_types; // Array of buffer types per input
+    const char* const* program_variants; // NULL-terminated list of the same program in other formats
+    const char* const* input_memory_kinds; // Memory kind per input (e.g. "pinned_host"), NULL for the device default
+    const char* executable_path; // Serialized executable to load instead of compiling, NULL to compile
+    const struct host_tensor* expected_outputs; // Expected results in output order, NULL to skip the check
+    size_t num_expected_outputs;
+} TestCase;
+
+// Progress output of the per-request helpers; timed modes turn it off.
+extern int verbose;
+
+// --- hlo_test.c ---
+int handle_error(PJRT_Error* error, const PJRT_Api* api, const char* context);
+int read_file_to_buffer(const char* filename, struct file_data* file_data);
+void free_file_data(struct file_data* file_data);
+double now_seconds(void);
+int run_parallel_jobs(void* (*run_job)(void*), void* jobs, size_t job_size, size_t count);
+double median_of(double* samples, size_t count);
+size_t buffer_type_size(PJRT_Buffer_Type type);
+const char* program_format_from_path(const char* path);
+PJRT_LoadedExecutable* compile_program(const PJRT_Api* api, PJRT_Client* client,
+                                       const struct file_data* code, const char* format,
+                                       const struct file_data* compile_options);
+struct client_options;
+PJRT_Client* create_client(const PJRT_Api* api, const struct client_options* options);
+void destroy_client(const PJRT_Api* api, PJRT_Client* client);
+PJRT_Device* first_addressable_device(const PJRT_Api* api, PJRT_Client* client);
+void destroy_loaded_executable(const PJRT_Api* api, PJRT_LoadedExecutable* executable);
+PJRT_LoadedExecutable* load_serialized_executable(const PJRT_Api* api, PJRT_Client* client, const char* path);
+PJRT_Buffer* create_buffer_from_host(const PJRT_Api* api, PJRT_Client* client, PJRT_Device* device,
+                                     void* host_data, PJRT_Buffer_Type type,
+                                     const int64_t* dims, size_t num_dims,
+                                     const char* context_prefix);
+PJRT_Buffer* create_buffer_in_memory(const PJRT_Api* api, PJRT_Client* client, PJRT_Memory* memory,
+                                     void* host_data, PJRT_Buffer_Type type,
+                                     const int64_t* dims, size_t num_dims,
+                                     const char* context_prefix);
+PJRT_Buffer* create_buffer_from_host_async(const PJRT_Api* api, PJRT_Client* client, PJRT_Device* device,
+                                           void* host_data, PJRT_Buffer_Type type,
+                                           const int64_t* dims, size_t num_dims,
+                                           PJRT_Event** done_with_host, const char* context_prefix);
+PJRT_Buffer* create_buffer_zero_copy(const PJRT_Api* api, PJRT_Client* client, PJRT_Device* device,
+                                     const void* host_data, PJRT_Buffer_Type type,
+                                     const int64_t* dims, size_t num_dims,
+                                     PJRT_Event** done_with_host, const char* context_prefix);
+int buffer_aliases_host(const PJRT_Api* api, PJRT_Buffer* buffer, const void* host_data);
+PJRT_Buffer** create_input_buffers(const PJRT_Api* api, PJRT_Client* client, PJRT_Device* device,
+                                   const TestCase* test_case);
+PJRT_Memory* find_device_memory(const PJRT_Api* api, PJRT_Device* device, const char* kind);
+int memory_kind_of(const PJRT_Api* api, PJRT_Memory* memory, const char** kind, size_t* kind_size);
+int describe_output_memory_kinds(const PJRT_Api* api, PJRT_LoadedExecutable* executable, char* out, size_t size);
+int device_memory_stats(const PJRT_Api* api, PJRT_Device* device, int64_t* bytes_in_use, int64_t* peak_bytes);
+void destroy_buffers(const PJRT_Api* api, PJRT_Buffer** buffers, size_t num_buffers, const char* context);
+void destroy_buffer(const PJRT_Api* api, PJRT_Buffer* buffer, const char* context);
+int execute_hlo_program(const PJRT_Api* api, PJRT_LoadedExecutable* executable,
+                        PJRT_Buffer** input_buffers, size_t num_inputs,
+                        PJRT_Buffer*** output_buffers_ptr, size_t* num_outputs_ptr);
+int execute_hlo_program_with_context(const PJRT_Api* api, PJRT_LoadedExecutable* executable,
+                                     PJRT_Buffer** input_buffers, size_t num_inputs,
+                                     PJRT_ExecuteContext* context,
+                                     PJRT_Buffer*** output_buffers_ptr, size_t* num_outputs_ptr);
+int execute_hlo_program_on_device(const PJRT_Api* api, PJRT_LoadedExecutable* executable,
+                                  PJRT_Buffer** input_buffers, size_t num_inputs,
+                                  PJRT_ExecuteContext* context, PJRT_Device* device,
+                                  PJRT_Buffer*** output_buffers_ptr, size_t* num_outputs_ptr);
+int await_buffers_ready(const PJRT_Api* api, PJRT_Buffer** buffers, size_t num_buffers);
+int await_event(const PJRT_Api* api, PJRT_Event* event, const char* context);
+void destroy_event(const PJRT_Api* api, PJRT_Event* event);
+int buffer_to_host(const PJRT_Api* api, PJRT_Buffer* buffer, struct host_tensor* tensor);
+int buffer_to_host_unpadded(const PJRT_Api* api, PJRT_Buffer* buffer, struct host_tensor* tensor,
+                            size_t* copied_bytes);
+void copy_box(void* dst, const int64_t* dst_dims, const void* src, const int64_t* src_dims,
+              const int64_t* box, size_t num_dims, size_t element_size);
+int buffer_to_host_async(const PJRT_Api* api, PJRT_Buffer* buffer, struct host_tensor* tensor,
+                         PJRT_Event** event);
+void free_host_tensor(struct host_tensor* tensor);
+void free_host_tensors(struct host_tensor* tensors, size_t num_tensors);
+int execute_to_host(const PJRT_Api* api, PJRT_LoadedExecutable* executable,
+                    PJRT_Buffer** inputs, size_t num_inputs,
+                    struct host_tensor** outputs_ptr, size_t* num_outputs_ptr);
+int benchmark_executable_samples(const PJRT_Api* api, PJRT_LoadedExecutable* executable,
+                                 PJRT_Buffer** inputs, size_t num_inputs, int iterations, double* samples);
+int benchmark_executable(const PJRT_Api* api, PJRT_LoadedExecutable* executable,
+                         PJRT_Buffer** inputs, size_t num_inputs, int iterations, double* median_s);
+const PJRT_Extension_Base* find_extension(const PJRT_Api* api, PJRT_Extension_Type type);
+int host_tensors_match(const struct host_tensor* expected, const struct host_tensor* actual, double tolerance);
+
+// --- proto.c: protobuf wire format ---
+struct proto_buf {
+    uint8_t* data;
+    size_t size;
+    size_t capacity;
+};
+
+int proto_append(struct proto_buf* buf, const void* data, size_t size);
+int proto_put_varint(struct proto_buf* buf, uint64_t value);
+int proto_put_varint_field(struct proto_buf* buf, uint32_t field, uint64_t value);
+int proto_put_double_field(struct proto_buf* buf, uint32_t field, double value);
+int proto_put_bytes_field(struct proto_buf* buf, uint32_t field, const void* data, size_t size);
+void proto_buf_free(struct proto_buf* buf);
+
+struct proto_reader {
+    const uint8_t* data;
+    size_t size;
+    size_t pos;
+};
+struct proto_field {
+    uint32_t number;
+    int wire_type;
+    uint64_t value; // Varint and fixed32/fixed64 fields
+    const uint8_t* data; // Length-delimited fields, pointing into the reader's data
+    size_t size;
+};
+int proto_next_field(struct proto_reader* reader, struct proto_field* field);
+int proto_next_scalar(const struct proto_field* field, size_t* index, int width, uint64_t* value);
+
+// --- autotune.c ---
+int autotune_test_case(const PJRT_Api* api, PJRT_Client* client, PJRT_Device* device,
+                       const TestCase* test_case, int iterations, double tolerance);
+
+// --- Per-request state reachable from custom calls ---
+// Attached once to a pooled PJRT_ExecuteContext as FFI user data; the owner
+// rewrites the fields before every execution instead of creating a context.
+struct request_state {
+    void* user_data; // Caller supplied, per request
+    uint8_t* scratch; // Preallocated scratch arena
+    size_t scratch_size;
+    size_t scratch_used; // Bump allocation offset, reset per request
+};
+
+// User data understood by the hlo_test_rms_norm custom call.
+struct ffi_call_stats {
+    uint64_t calls;
+    uint64_t elements;
+    const float* row_scales; // Last per-row scales, inside the request's scratch arena
+};
+
+// --- ffi_kernels.c ---
+int register_ffi_handlers(const PJRT_Api* api);
+int ffi_attach_request_state(const PJRT_Api* api, PJRT_ExecuteContext* context, struct request_state* state);
+const TestCase* ffi_rms_norm_test_case(int use_custom_call);
+int run_ffi_benchmark(const PJRT_Api* api, PJRT_Client* client, PJRT_Device* device,
+                      int iterations, double tolerance);
+
+// --- execute_context.c ---
+struct execute_context {
+    PJRT_ExecuteContext* context;
+    struct request_state state;
+    struct execute_context* next_free;
+    struct execute_context* next_all;
+};
+
+// Thread-safe pool of execute contexts, grown on demand and never shrunk.
+struct execute_context_pool {
+    const PJRT_Api* api;
+    size_t scratch_size;
+    int with_user_data; // Contexts carry request_state as FFI user data; accessed atomically
+    pthread_mutex_t lock;
+    struct execute_context* free_list;
+    struct execute_context* all;
+    size_t created;
+    size_t acquired;
+    size_t misses; // Acquisitions that found the pool empty
+};
+
+int execute_context_pool_init(struct execute_context_pool* pool, const PJRT_Api* api, size_t count,
+                              size_t scratch_size);
+struct execute_context* execute_context_acquire(struct execute_context_pool* pool, void* user_data);
+void execute_context_release(struct execute_context_pool* pool, struct execute_context* context);
+void execute_context_pool_destroy(struct execute_context_pool* pool);
+void* request_scratch_alloc(struct request_state* state, size_t size, size_t alignment);
+int run_execute_context_benchmark(const PJRT_Api* api, PJRT_Client* client, PJRT_Device* device,
+                                  int iterations);
+
+// --- pipeline.c ---
+int run_pipeline_benchmark(const PJRT_Api* api, PJRT_Client* client, PJRT_Device* device,
+                           const TestCase* test_case, long frames, double tolerance);
+
+// --- shape_cache.c ---
+struct shape_program;
+struct shape_cache_entry;
+
+// Executables of one shape_program, one per shape bucket.
+struct shape_cache {
+    const PJRT_Api* api;
+    PJRT_Client* client;
+    const struct shape_program* program;
+    const struct file_data* compile_options;
+    int bucketing; // 0 keys by the exact request shape
+    struct shape_cache_entry* entries;
+    float* staging; // Padded input, grown on demand
+    size_t staging_size; // In elements
+    size_t lookups;
+    size_t hits;
+    size_t compiles;
+    double compile_s;
+    uint64_t valid_elements;
+    uint64_t padded_elements; // Elements computed, valid ones included
+};
+
+void shape_cache_init(struct shape_cache* cache, const PJRT_Api* api, PJRT_Client* client,
+                      const struct shape_program* program, const struct file_data* compile_options,
+                      int bucketing);
+void shape_cache_bucket(const struct shape_cache* cache, const int64_t* dims, int64_t* bucket_dims);
+PJRT_LoadedExecutable* shape_cache_get(struct shape_cache* cache, const int64_t* bucket_dims);
+int shape_cache_run(struct shape_cache* cache, PJRT_Device* device, const float* input, const int64_t* dims,
+                    float* output);
+void shape_cache_destroy(struct shape_cache* cache);
+int run_shape_cache_benchmark(const PJRT_Api* api, PJRT_Client* client, PJRT_Device* device,
+                              long requests, double tolerance);
+
+// --- dynamic_readback.c ---
+int run_dynamic_readback_benchmark(const PJRT_Api* api, PJRT_Client* client, PJRT_Device* device,
+                                   int iterations);
+
+// --- transfer.c ---
+PJRT_Buffer* copy_buffer_to_device(const PJRT_Api* api, PJRT_Buffer* buffer, PJRT_Device* dst_device);
+PJRT_Buffer* copy_buffer_to_memory(const PJRT_Api* api, PJRT_Buffer* buffer, PJRT_Memory* dst_memory);
+int run_transfer_benchmark(const PJRT_Api* api, PJRT_Client* client, int iterations);
+
+// --- convert.c ---
+int convert_from_f32(const float* src, void* dst, size_t count, PJRT_Buffer_Type type, float scale);
+int convert_to_f32(const void* src, float* dst, size_t count, PJRT_Buffer_Type type, float scale);
+PJRT_Buffer* create_buffer_from_f32(const PJRT_Api* api, PJRT_Client* client, PJRT_Device* device,
+                                    const float* host_data, PJRT_Buffer_Type type, const int64_t* dims,
+                                    size_t num_dims, float scale, const char* context_prefix);
+int buffer_to_host_f32(const PJRT_Api* api, PJRT_Buffer* buffer, float* out, float scale);
+int run_convert_benchmark(const PJRT_Api* api, PJRT_Client* client, PJRT_Device* device, int iterations);
+
+// --- weights.c ---
+#define WEIGHTS_MAX_FILES 16
+#define WEIGHTS_NAME_SIZE 128
+struct weight_tensor {
+    char name[WEIGHTS_NAME_SIZE];
+    PJRT_Buffer_Type type;
+    int64_t dims[HOST_TENSOR_MAX_DIMS];
+    size_t num_dims;
+    const void* data; // Inside the file's mapping
+    size_t size;
+};
+struct weight_file {
+    void* map; // NULL when the tensors point into a caller's buffer (weights_parse)
+    size_t map_size;
+    struct weight_tensor* tensors;
+    size_t num_tensors;
+};
+int weights_parse(const void* data, size_t size, const char* path, struct weight_file* file);
+int weights_open(const char* path, struct weight_file* file);
+void weights_close(struct weight_file* file);
+int weights_load(const PJRT_Api* api, PJRT_Client* client, PJRT_Device* device, const struct weight_file* file,
+                 PJRT_Buffer** buffers, PJRT_Event** done_events, size_t* num_aliased);
+void weights_release(const PJRT_Api* api, PJRT_Buffer** buffers, PJRT_Event** done_events, size_t count);
+int run_weights_benchmark(const PJRT_Api* api, PJRT_Client* client, PJRT_Device* device,
+                          const char* const* paths, size_t num_paths, int iterations);
+
+// --- dag.c ---
+#define DAG_MAX_ARGS 8
+struct dag_value {
+    int node; // Producing node, -1 for a graph input
+    int output; // Output of that node, or index of the graph input
+};
+struct dag_node {
+    const char* name;
+    PJRT_LoadedExecutable* executable;
+    struct dag_value inputs[DAG_MAX_ARGS];
+    size_t num_inputs;
+    size_t num_outputs;
+};
+struct dag {
+    const struct dag_node* nodes;
+    size_t num_nodes;
+    size_t num_inputs;
+    const struct dag_value* outputs;
+    size_t num_outputs;
+};
+struct dag_stats {
+    size_t live; // Intermediates held right now
+    size_t max_live;
+    size_t max_running; // Nodes executing at once
+    size_t freed_early; // Intermediates destroyed before the run ended
+};
+int dag_run(const PJRT_Api* api, const struct dag* dag, PJRT_Buffer** inputs, int workers, PJRT_Buffer** outputs,
+            struct dag_stats* stats);
+int run_dag_benchmark(const PJRT_Api* api, PJRT_Client* client, PJRT_Device* device, int workers, int iterations,
+                      double tolerance);
+
+// --- roofline.c ---
+int roofline_generate(const char* dir);
+int run_roofline_benchmark(const PJRT_Api* api, PJRT_Client* client, PJRT_Device* device, const char* dir,
+                           int iterations);
+
+// --- memory_kinds.c ---
+int run_memory_kind_benchmark(const PJRT_Api* api, PJRT_Client* client, PJRT_Device* device, int iterations,
+                              double tolerance);
+
+// --- loadgen.c ---
+struct load_options {
+    int workers; // Concurrent requests in flight at most
+    long requests; // Requests per load step
+    double rate; // Offered requests per second, 0 to sweep
+    const char* trace_path; // Arrival offsets in seconds, one per line, NULL for Poisson arrivals
+};
+int run_load_test(const PJRT_Api* api, PJRT_Client* client, PJRT_Device* device, const TestCase* test_case,
+                  const struct load_options* options);
+
+// --- stage_timers.c ---
+enum timer_stage {
+    TIMER_STAGE_FILE_READ,
+    TIMER_STAGE_BUFFER_FROM_HOST,
+    TIMER_STAGE_COMPILE,
+    TIMER_STAGE_EXECUTE, // The Execute call, which may return once the work is enqueued
+    TIMER_STAGE_EXECUTE_COMPLETE, // From the Execute call until the device reports completion
+    TIMER_STAGE_TO_HOST,
+    TIMER_STAGE_BUFFER_DESTROY,
+    NUM_TIMER_STAGES
+};
+extern int stage_timers_enabled;
+void stage_timers_enable(void);
+void stage_timers_set_workload(const char* name);
+uint64_t stage_timer_start(void); // 0 while timers are disabled
+void stage_timer_stop(enum timer_stage stage, uint64_t start_ns);
+void stage_timer_stop_on_ready(const PJRT_Api* api, enum timer_stage stage, uint64_t start_ns, PJRT_Event* event);
+
+// --- perf_counters.c ---
+int perf_counters_open(void);
+void perf_counters_close(void);
+int run_perf_counter_test(const PJRT_Api* api, PJRT_Client* client, PJRT_Device* device,
+                          const TestCase* test_case, int iterations);
+
+// --- client_options.c ---
+#define CLIENT_OPTIONS_MAX 16
+struct client_options {
+    PJRT_NamedValue values[CLIENT_OPTIONS_MAX]; // Passed to PJRT_Client_Create
+    char* specs[CLIENT_OPTIONS_MAX]; // NAME=VALUE each value was parsed from
+    size_t count;
+};
+int client_options_set(struct client_options* options, const char* spec);
+int client_options_load(struct client_options* options, const char* path);
+int client_options_copy(struct client_options* dst, const struct client_options* src);
+void client_options_free(struct client_options* options);
+void client_options_describe(const struct client_options* options, char* out, size_t size);
+int run_client_option_sweep(const PJRT_Api* api, const struct client_options* base, const char* const* sweeps,
+                            size_t num_sweeps, const TestCase* test_case, int iterations, int workers);
+
+// --- numa.c ---
+int run_numa_benchmark(const PJRT_Api* api, const struct client_options* options, long requests,
+                       double tolerance);
+
+// --- bench.c ---
+// Returns 0 when no workload regressed against the baseline, 2 on a regression, 1 on errors.
+int run_bench(const PJRT_Api* api, PJRT_Client* client, PJRT_Device* device, const TestCase* const* tests,
+              size_t num_tests, int iterations, const char* results_path, const char* baseline_path);
+
+// --- snapshot.c ---
+int import_snapshots(const char* dump_dir, const char* corpus_dir);
+int load_corpus(const char* corpus_dir, const TestCase*** tests_ptr, size_t* num_tests_ptr);
+void free_corpus(const TestCase** tests, size_t num_tests);
+int decode_array_shape(const uint8_t* data, size_t size, struct host_tensor* tensor);
+
+// --- bundle.c ---
+// Paths starting with BUNDLE_PATH_PREFIX name a section of the open bundle.
+#define BUNDLE_PATH_PREFIX "bundle:"
+int bundle_create(const PJRT_Api* api, PJRT_Client* client, const char* path, const TestCase* const* tests,
+                  size_t num_tests, int compression_level);
+int bundle_open(const char* path);
+int bundle_read_section(const char* name, struct file_data* file_data);
+int bundle_contains(const void* data);
+int bundle_load_tests(const TestCase*** tests_ptr, size_t* num_tests_ptr);
+void bundle_free_tests(const TestCase** tests, size_t num_tests);
+void bundle_close(void);
+
+// --- synthetic.c ---
+#define SYNTHETIC_MAX_PROGRAMS 16
+void fill_synthetic(struct host_tensor* tensor, uint64_t seed, uint64_t stream);
+const TestCase* synthetic_test_case(const PJRT_Api* api, PJRT_Client* client, const char* program_path,
+                                    uint64_t seed);
+void free_synthetic_test_case(const TestCase* test_case);
+
+// --- prewarm.c ---
+int run_prewarm_test(const PJRT_Api* api, PJRT_Client* client, PJRT_Device* device, const TestCase* test_case,
+                     int runs, int trials);
+
+// --- soak.c ---
+struct soak_options {
+    long cycles; // Create/compile/execute/destroy cycles, 0 until SIGINT
+    double window_s; // Seconds per reporting window
+    double tolerance; // For the output check
+};
+// Returns 0 when nothing drifted, 2 when a series drifted, 1 on errors.
+int run_soak_test(const PJRT_Api* api, PJRT_Client* client, PJRT_Device* device, const TestCase* test_case,
+                  const struct soak_options* options);
+
+#endif // HLO_TEST_H
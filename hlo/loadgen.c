@@ -0,0 +1,300 @@
+// Open-loop load generator.
+//
+// Request i has an intended start time taken from a Poisson process (or a
+// trace, rescaled to the offered rate). A pool of worker threads takes
+// requests in arrival order, sleeps until the intended start if it is early
+// and runs execute_hlo_program on a shared executable. Latency is measured
+// from the intended start, so time spent waiting for a free worker counts
+// against the request instead of silently slowing the generator down
+// (coordinated omission). A sweep over offered load finds the knee where
+// throughput stops following the offered rate or the tail grows.
+#include <errno.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "hlo_test.h"
+
+// Offered load of each sweep step, in multiples of the single-worker rate 1 / service time.
+static const double load_sweep_factors[] = {0.1, 0.25, 0.5, 0.75, 1.0, 1.5, 2.0, 3.0, 4.0, 6.0, 8.0, 12.0, 16.0};
+#define NUM_LOAD_SWEEP_STEPS (sizeof(load_sweep_factors) / sizeof(load_sweep_factors[0]))
+// A step is saturated below this share of the offered rate or above this multiple of the lightest p99.
+#define LOAD_MIN_ACHIEVED 0.95
+#define LOAD_MAX_P99_GROWTH 3.0
+
+struct load_shared {
+    const PJRT_Api* api;
+    PJRT_LoadedExecutable* executable;
+    PJRT_Buffer** inputs;
+    size_t num_inputs;
+    const double* arrivals; // Intended start, seconds after `start`
+    size_t count;
+    double start;
+    size_t next; // Next request to issue, taken with __atomic_fetch_add
+    double* latencies;
+    double* completions;
+    int failed;
+};
+
+struct load_step {
+    double offered;
+    double achieved;
+    double p50, p90, p99, p999, max;
+};
+
+
+// --- Function to read a trace of arrival times, one offset in seconds per line ---
+static int read_trace(const char* path, double** offsets_ptr, size_t* count_ptr) {
+    FILE* file = fopen(path, "r");
+    if (file == NULL) {
+        fprintf(stderr, "Error opening trace '%s'\n", path);
+        return 1;
+    }
+    size_t count = 0, capacity = 0;
+    double* offsets = NULL;
+    char line[256];
+    while (fgets(line, sizeof(line), file) != NULL) {
+        char* end = NULL;
+        double value = strtod(line, &end);
+        if (end == line || line[0] == '#') continue;
+        if (count == capacity) {
+            capacity = capacity ? capacity * 2 : 1024;
+            double* grown = (double*)realloc(offsets, capacity * sizeof(double));
+            if (grown == NULL) {
+                free(offsets);
+                fclose(file);
+                return 1;
+            }
+            offsets = grown;
+        }
+        offsets[count++] = value;
+    }
+    fclose(file);
+    if (count < 2) {
+        fprintf(stderr, "Trace '%s' needs at least two arrival times.\n", path);
+        free(offsets);
+        return 1;
+    }
+    for (size_t i = 1; i < count; ++i) {
+        if (offsets[i] < offsets[i - 1]) {
+            fprintf(stderr, "Trace '%s' is not sorted at line %zu.\n", path, i + 1);
+            free(offsets);
+            return 1;
+        }
+    }
+    if (!(offsets[count - 1] > offsets[0])) { // The gaps are scaled by the trace's mean rate
+        fprintf(stderr, "Trace '%s' has all its arrivals at the same time.\n", path);
+        free(offsets);
+        return 1;
+    }
+    *offsets_ptr = offsets;
+    *count_ptr = count;
+    return 0;
+}
+
+
+// --- Function to lay out `count` arrivals at `rate` requests per second ---
+// Without a trace, inter-arrival gaps are exponential (Poisson arrivals).
+// A trace is replayed cyclically, with its gaps scaled to the mean rate.
+static void make_arrivals(const double* trace, size_t trace_count, double rate, size_t count, uint32_t seed,
+                          double* arrivals) {
+    double t = 0.0;
+    double trace_rate = trace ? (trace_count - 1) / (trace[trace_count - 1] - trace[0]) : 0.0;
+    for (size_t i = 0; i < count; ++i) {
+        arrivals[i] = t;
+        double gap;
+        if (trace != NULL) {
+            size_t k = i % (trace_count - 1);
+            gap = (trace[k + 1] - trace[k]) * trace_rate / rate;
+        } else {
+            seed = seed * 1664525u + 1013904223u;
+            double u = ((seed >> 8) + 0.5) / 16777216.0; // (0, 1)
+            gap = -log(u) / rate;
+        }
+        t += gap;
+    }
+}
+
+
+static void sleep_until(double when) {
+    struct timespec ts;
+    ts.tv_sec = (time_t)when;
+    ts.tv_nsec = (long)((when - (double)ts.tv_sec) * 1e9);
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR) {
+    }
+}
+
+
+static void* load_worker(void* arg) {
+    struct load_shared* shared = (struct load_shared*)arg;
+    for (;;) {
+        size_t i = __atomic_fetch_add(&shared->next, 1, __ATOMIC_RELAXED);
+        if (i >= shared->count) break;
+        double intended = shared->start + shared->arrivals[i];
+        if (now_seconds() < intended) sleep_until(intended);
+
+        PJRT_Buffer** outputs = NULL;
+        size_t num_outputs = 0;
+        int rc = execute_hlo_program(shared->api, shared->executable, shared->inputs, shared->num_inputs,
+                                     &outputs, &num_outputs) ||
+                 await_buffers_ready(shared->api, outputs, num_outputs);
+        double done = now_seconds();
+        destroy_buffers(shared->api, outputs, num_outputs, "PJRT_Buffer_Destroy (load output)");
+        if (rc != 0) __atomic_store_n(&shared->failed, 1, __ATOMIC_RELAXED);
+        shared->latencies[i] = done - intended;
+        shared->completions[i] = done;
+    }
+    return NULL;
+}
+
+
+static double percentile(const double* sorted, size_t count, double q) {
+    size_t rank = (size_t)ceil(q * count);
+    return sorted[rank > 0 ? rank - 1 : 0];
+}
+
+
+// --- Function to run one load step at a given offered rate ---
+static int run_load_step(struct load_shared* shared, int workers, const double* trace, size_t trace_count,
+                         double rate, double* arrivals, struct load_step* step) {
+    make_arrivals(trace, trace_count, rate, shared->count, 12345, arrivals);
+    shared->arrivals = arrivals;
+    shared->next = 0;
+    shared->failed = 0;
+    pthread_t* threads = (pthread_t*)calloc(workers, sizeof(pthread_t));
+    if (threads == NULL) return 1;
+    shared->start = now_seconds() + 0.001; // Let every worker start before the first arrival
+    int started = 0;
+    for (; started < workers; ++started) {
+        if (pthread_create(&threads[started], NULL, load_worker, shared) != 0) {
+            fprintf(stderr, "Failed to start load worker %d.\n", started);
+            shared->failed = 1;
+            break;
+        }
+    }
+    for (int t = 0; t < started; ++t) pthread_join(threads[t], NULL);
+    free(threads);
+    if (started == 0 || shared->failed) return 1;
+
+    double last = shared->start;
+    for (size_t i = 0; i < shared->count; ++i) {
+        if (shared->completions[i] > last) last = shared->completions[i];
+    }
+    step->offered = rate;
+    step->achieved = shared->count / (last - shared->start);
+    step->p50 = median_of(shared->latencies, shared->count); // Sorts the latencies in place
+    step->p90 = percentile(shared->latencies, shared->count, 0.90);
+    step->p99 = percentile(shared->latencies, shared->count, 0.99);
+    step->p999 = percentile(shared->latencies, shared->count, 0.999);
+    step->max = shared->latencies[shared->count - 1];
+    return 0;
+}
+
+
+static void print_load_step(const struct load_step* step) {
+    printf("  %12.1f %12.1f %10.4f %10.4f %10.4f %10.4f %10.4f\n", step->offered, step->achieved, step->p50 * 1e3,
+           step->p90 * 1e3, step->p99 * 1e3, step->p999 * 1e3, step->max * 1e3);
+}
+
+
+// --- Function to run the open-loop load test for one test case ---
+// With options->rate > 0 only that rate is run, otherwise the offered load
+// is swept until two consecutive steps saturate.
+int run_load_test(const PJRT_Api* api, PJRT_Client* client, PJRT_Device* device, const TestCase* test_case,
+                  const struct load_options* options) {
+    int rc = 1;
+    struct file_data program = {NULL, 0};
+    struct file_data compile_options = {NULL, 0};
+    PJRT_LoadedExecutable* executable = NULL;
+    PJRT_Buffer** inputs = NULL;
+    double* trace = NULL;
+    size_t trace_count = 0;
+    size_t count = (size_t)options->requests;
+    double* arrivals = (double*)malloc(count * sizeof(double));
+    double* latencies = (double*)malloc(count * sizeof(double));
+    double* completions = (double*)malloc(count * sizeof(double));
+
+    printf("\n--- Open-loop load: %s (%d workers, %zu requests per step, %s arrivals) ---\n", test_case->name,
+           options->workers, count, options->trace_path ? options->trace_path : "Poisson");
+    if (arrivals == NULL || latencies == NULL || completions == NULL) goto cleanup_load;
+    if (options->trace_path != NULL && read_trace(options->trace_path, &trace, &trace_count) != 0) {
+        goto cleanup_load;
+    }
+    if (read_file_to_buffer(test_case->hlo_path, &program) != 0 ||
+        read_file_to_buffer(test_case->compile_options_path, &compile_options) != 0) {
+        goto cleanup_load;
+    }
+    const char* format = test_case->format ? test_case->format : program_format_from_path(test_case->hlo_path);
+    executable = compile_program(api, client, &program, format, &compile_options);
+    if (executable == NULL) goto cleanup_load;
+    inputs = create_input_buffers(api, client, device, test_case);
+    if (inputs == NULL) goto cleanup_load;
+
+    double service_s = 0.0;
+    if (benchmark_executable(api, executable, inputs, test_case->num_inputs, 20, &service_s) != 0) {
+        goto cleanup_load;
+    }
+    double unit_rate = 1.0 / service_s;
+    printf("Closed-loop service time %.4f ms, %.1f req/s for a single worker.\n", service_s * 1e3, unit_rate);
+
+    struct load_shared shared = {0};
+    shared.api = api;
+    shared.executable = executable;
+    shared.inputs = inputs;
+    shared.num_inputs = test_case->num_inputs;
+    shared.count = count;
+    shared.latencies = latencies;
+    shared.completions = completions;
+
+    printf("  %12s %12s %10s %10s %10s %10s %10s\n", "offered(/s)", "achieved(/s)", "p50(ms)", "p90(ms)",
+           "p99(ms)", "p99.9(ms)", "max(ms)");
+    if (options->rate > 0.0) {
+        struct load_step step;
+        if (run_load_step(&shared, options->workers, trace, trace_count, options->rate, arrivals, &step) != 0) {
+            goto cleanup_load;
+        }
+        print_load_step(&step);
+        rc = 0;
+        goto cleanup_load;
+    }
+
+    double base_p99 = 0.0;
+    double knee = 0.0;
+    int saturated_steps = 0;
+    for (size_t k = 0; k < NUM_LOAD_SWEEP_STEPS && saturated_steps < 2; ++k) {
+        struct load_step step;
+        double rate = unit_rate * load_sweep_factors[k];
+        if (run_load_step(&shared, options->workers, trace, trace_count, rate, arrivals, &step) != 0) {
+            goto cleanup_load;
+        }
+        print_load_step(&step);
+        if (k == 0) base_p99 = step.p99;
+        int saturated = step.achieved < LOAD_MIN_ACHIEVED * step.offered ||
+                        step.p99 > LOAD_MAX_P99_GROWTH * base_p99;
+        if (saturated) {
+            saturated_steps++;
+        } else {
+            saturated_steps = 0;
+            knee = rate;
+        }
+    }
+    if (knee > 0.0) {
+        printf("Saturation knee: about %.1f req/s (highest load with achieved >= %.0f%% of offered and "
+               "p99 <= %.0fx the lightest load).\n", knee, LOAD_MIN_ACHIEVED * 100, LOAD_MAX_P99_GROWTH);
+    } else {
+        printf("Saturated at every offered load.\n");
+    }
+    rc = 0;
+
+cleanup_load:
+    destroy_buffers(api, inputs, test_case->num_inputs, "PJRT_Buffer_Destroy (load input)");
+    if (executable != NULL) destroy_loaded_executable(api, executable);
+    free_file_data(&program);
+    free_file_data(&compile_options);
+    free(trace);
+    free(arrivals);
+    free(latencies);
+    free(completions);
+    return rc;
+}
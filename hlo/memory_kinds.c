@@ -0,0 +1,137 @@
+// Placement of inputs in named memory kinds.
+//
+// The benchmark places the activation of the RMS norm test case in each
+// memory kind its device exposes (for example "device", "pinned_host" and
+// "unpinned_host") while the weights stay in the default memory, and
+// reports latency, device memory use and the output memory kinds.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "hlo_test.h"
+
+#define MEMORY_KIND_MAX 16
+#define MEMORY_KIND_NAME_SIZE 32
+
+
+// --- Function to list the distinct memory kinds of a device ---
+static size_t device_memory_kinds(const PJRT_Api* api, PJRT_Device* device,
+                                  char kinds[MEMORY_KIND_MAX][MEMORY_KIND_NAME_SIZE]) {
+    PJRT_Device_AddressableMemories_Args memories_args = {0};
+    memories_args.struct_size = PJRT_Device_AddressableMemories_Args_STRUCT_SIZE;
+    memories_args.device = device;
+    if (handle_error(api->PJRT_Device_AddressableMemories(&memories_args), api,
+                     "PJRT_Device_AddressableMemories")) {
+        return 0;
+    }
+    size_t num_kinds = 0;
+    for (size_t i = 0; i < memories_args.num_memories && num_kinds < MEMORY_KIND_MAX; ++i) {
+        const char* kind = NULL;
+        size_t kind_size = 0;
+        if (memory_kind_of(api, memories_args.memories[i], &kind, &kind_size) != 0) continue;
+        snprintf(kinds[num_kinds], MEMORY_KIND_NAME_SIZE, "%.*s", (int)kind_size, kind);
+        int seen = 0;
+        for (size_t k = 0; k < num_kinds; ++k) seen |= strcmp(kinds[k], kinds[num_kinds]) == 0;
+        if (!seen) num_kinds++;
+    }
+    return num_kinds;
+}
+
+
+static void print_bytes(int64_t bytes) {
+    if (bytes < 0) {
+        printf(" %12s", "n/a");
+    } else {
+        printf(" %12.1f", bytes / 1024.0);
+    }
+}
+
+
+// --- Function to compare input placements across memory kinds ---
+int run_memory_kind_benchmark(const PJRT_Api* api, PJRT_Client* client, PJRT_Device* device, int iterations,
+                              double tolerance) {
+    const TestCase* base = ffi_rms_norm_test_case(0);
+    int rc = 1;
+    struct file_data program = {NULL, 0};
+    struct file_data compile_options = {NULL, 0};
+    PJRT_LoadedExecutable* executable = NULL;
+    struct host_tensor* reference = NULL;
+    size_t num_reference = 0;
+    char kinds[MEMORY_KIND_MAX][MEMORY_KIND_NAME_SIZE];
+
+    printf("\n--- Memory kind placement: %s ---\n", base->name);
+    size_t num_kinds = device_memory_kinds(api, device, kinds);
+    if (num_kinds == 0) {
+        fprintf(stderr, "The device reports no memories.\n");
+        return 1;
+    }
+    if (read_file_to_buffer(base->hlo_path, &program) != 0 ||
+        read_file_to_buffer(base->compile_options_path, &compile_options) != 0) {
+        goto cleanup_memory_kinds;
+    }
+    executable = compile_program(api, client, &program, program_format_from_path(base->hlo_path),
+                                 &compile_options);
+    if (executable == NULL) goto cleanup_memory_kinds;
+    char output_kinds[256];
+    if (describe_output_memory_kinds(api, executable, output_kinds, sizeof(output_kinds)) == 0) {
+        printf("Output memory kinds: %s\n", output_kinds);
+    }
+
+    // Reference output with every input in the default memory.
+    {
+        PJRT_Buffer** inputs = create_input_buffers(api, client, device, base);
+        if (inputs == NULL) goto cleanup_memory_kinds;
+        int ref_rc = execute_to_host(api, executable, inputs, base->num_inputs, &reference, &num_reference);
+        destroy_buffers(api, inputs, base->num_inputs, "PJRT_Buffer_Destroy (reference input)");
+        if (ref_rc != 0) goto cleanup_memory_kinds;
+    }
+
+    printf("  %-16s %11s %12s %12s  %s\n", "input 0 kind", "median(ms)", "in use(KiB)", "peak(KiB)", "result");
+    for (size_t k = 0; k < num_kinds; ++k) {
+        const char* input_kinds[2] = {kinds[k], NULL}; // Activation x moves, weights w stay put
+        TestCase test_case = *base;
+        test_case.input_memory_kinds = input_kinds;
+
+        int64_t in_use = -1, peak = -1;
+        double median_s = 0.0;
+        const char* result = "ok";
+        PJRT_Buffer** inputs = create_input_buffers(api, client, device, &test_case);
+        if (inputs == NULL) {
+            result = "placement rejected";
+        } else {
+            struct host_tensor* outputs = NULL;
+            size_t num_outputs = 0;
+            if (execute_to_host(api, executable, inputs, test_case.num_inputs, &outputs, &num_outputs) != 0) {
+                result = "execution rejected";
+            } else {
+                int match = num_outputs == num_reference;
+                for (size_t i = 0; match && i < num_outputs; ++i) {
+                    match = host_tensors_match(&reference[i], &outputs[i], tolerance);
+                }
+                free_host_tensors(outputs, num_outputs);
+                if (!match) {
+                    result = "MISMATCH";
+                } else if (benchmark_executable(api, executable, inputs, test_case.num_inputs, iterations,
+                                                &median_s) != 0) {
+                    result = "benchmark failed";
+                }
+            }
+            if (device_memory_stats(api, device, &in_use, &peak) != 0) in_use = peak = -1;
+            destroy_buffers(api, inputs, test_case.num_inputs, "PJRT_Buffer_Destroy (placed input)");
+        }
+        printf("  %-16s %11.4f", kinds[k], median_s * 1e3);
+        print_bytes(in_use);
+        print_bytes(peak);
+        printf("  %s\n", result);
+        if (strcmp(result, "MISMATCH") == 0) goto cleanup_memory_kinds;
+    }
+    printf("Device memory is read after each placement's runs; n/a when the plugin does not track it.\n");
+    rc = 0;
+
+cleanup_memory_kinds:
+    free_host_tensors(reference, num_reference);
+    if (executable != NULL) destroy_loaded_executable(api, executable);
+    free_file_data(&program);
+    free_file_data(&compile_options);
+    return rc;
+}
@@ -0,0 +1,341 @@
+// NUMA-aware clients and host memory.
+//
+// Nodes and their CPUs come from /sys/devices/system/node. For every node a
+// thread bound to that node's CPUs creates its own client, so the plugin's
+// worker threads inherit the binding, and compiles the RMS norm module.
+// Host inputs and output buffers are placed on a node by first touch from a
+// thread bound to it. The benchmark then measures upload + execute +
+// readback throughput for every (client node, host memory node) pair, and
+// all nodes at once with requests routed to node-local memory versus to the
+// next node's memory.
+#define _GNU_SOURCE
+#include <dirent.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include "hlo_test.h"
+
+#define NUMA_MAX_NODES 16
+
+struct numa_node {
+    int id;
+    cpu_set_t cpus;
+};
+
+// Host copies of the RMS norm inputs and an output buffer placed on one node.
+struct numa_host_data {
+    void* inputs[2];
+    size_t input_sizes[2];
+    void* output;
+    size_t output_size;
+};
+
+struct numa_client {
+    const struct numa_node* node;
+    PJRT_Client* client;
+    PJRT_Device* device;
+    PJRT_LoadedExecutable* executable;
+};
+
+struct numa_job {
+    const PJRT_Api* api;
+    const TestCase* test_case;
+    const struct client_options* options;
+    const struct file_data* program;
+    const struct file_data* compile_options;
+    struct numa_client* client;
+    const struct numa_host_data* data;
+    long requests;
+    double elapsed_s;
+    int rc;
+};
+
+
+// --- Function to parse a sysfs cpulist such as "0-3,8-11" ---
+static int parse_cpulist(const char* text, cpu_set_t* cpus) {
+    CPU_ZERO(cpus);
+    int count = 0;
+    while (*text != '\0' && *text != '\n') {
+        char* end = NULL;
+        long first = strtol(text, &end, 10);
+        if (end == text) return 0;
+        long last = first;
+        if (*end == '-') {
+            text = end + 1;
+            last = strtol(text, &end, 10);
+            if (end == text) return 0;
+        }
+        for (long cpu = first; cpu <= last && cpu < CPU_SETSIZE; ++cpu) {
+            CPU_SET(cpu, cpus);
+            count++;
+        }
+        text = *end == ',' ? end + 1 : end;
+    }
+    return count;
+}
+
+
+// --- Function to list the nodes that have CPUs ---
+// Without sysfs NUMA information the whole machine is one node.
+static int discover_nodes(struct numa_node* nodes) {
+    int num_nodes = 0;
+    DIR* dir = opendir("/sys/devices/system/node");
+    struct dirent* entry;
+    while (dir != NULL && (entry = readdir(dir)) != NULL && num_nodes < NUMA_MAX_NODES) {
+        int id;
+        char tail;
+        if (sscanf(entry->d_name, "node%d%c", &id, &tail) != 1) continue;
+        char path[300];
+        char cpulist[4096];
+        snprintf(path, sizeof(path), "/sys/devices/system/node/%s/cpulist", entry->d_name);
+        FILE* file = fopen(path, "r");
+        if (file == NULL) continue;
+        int ok = fgets(cpulist, sizeof(cpulist), file) != NULL;
+        fclose(file);
+        if (!ok || parse_cpulist(cpulist, &nodes[num_nodes].cpus) == 0) continue; // Memory-only node
+        nodes[num_nodes].id = id;
+        num_nodes++;
+    }
+    if (dir != NULL) closedir(dir);
+    // readdir order is arbitrary; keep nodes sorted by id.
+    for (int i = 1; i < num_nodes; ++i) {
+        for (int j = i; j > 0 && nodes[j].id < nodes[j - 1].id; --j) {
+            struct numa_node tmp = nodes[j];
+            nodes[j] = nodes[j - 1];
+            nodes[j - 1] = tmp;
+        }
+    }
+    if (num_nodes == 0) {
+        nodes[0].id = 0;
+        if (sched_getaffinity(0, sizeof(nodes[0].cpus), &nodes[0].cpus) != 0) return 0;
+        num_nodes = 1;
+    }
+    return num_nodes;
+}
+
+
+static int bind_to_node(const struct numa_node* node) {
+    int err = pthread_setaffinity_np(pthread_self(), sizeof(node->cpus), &node->cpus);
+    if (err != 0) fprintf(stderr, "Failed to bind to the CPUs of node %d: %s\n", node->id, strerror(err));
+    return err != 0;
+}
+
+
+// --- Function to allocate memory on a node by first touch ---
+// The calling thread moves to the node while it faults the pages in.
+static void* alloc_on_node(const struct numa_node* node, size_t size) {
+    cpu_set_t saved;
+    if (pthread_getaffinity_np(pthread_self(), sizeof(saved), &saved) != 0) return NULL;
+    if (bind_to_node(node) != 0) return NULL;
+    void* memory = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (memory == MAP_FAILED) {
+        memory = NULL;
+    } else {
+        memset(memory, 0, size);
+    }
+    pthread_setaffinity_np(pthread_self(), sizeof(saved), &saved);
+    return memory;
+}
+
+
+static void free_host_data(struct numa_host_data* data) {
+    for (int i = 0; i < 2; ++i) {
+        if (data->inputs[i] != NULL) munmap(data->inputs[i], data->input_sizes[i]);
+    }
+    if (data->output != NULL) munmap(data->output, data->output_size);
+    memset(data, 0, sizeof(*data));
+}
+
+
+// --- Thread body: create, on a bound thread, the client for one node ---
+static void* setup_client(void* arg) {
+    struct numa_job* job = (struct numa_job*)arg;
+    struct numa_client* c = job->client;
+    job->rc = 1;
+    if (bind_to_node(c->node) != 0) return NULL;
+    c->client = create_client(job->api, job->options);
+    if (c->client == NULL) return NULL;
+    c->device = first_addressable_device(job->api, c->client);
+    if (c->device == NULL) return NULL;
+    c->executable = compile_program(job->api, c->client, job->program,
+                                    program_format_from_path(job->test_case->hlo_path), job->compile_options);
+    job->rc = c->executable == NULL;
+    return NULL;
+}
+
+
+// --- Thread body: run requests on one node's client against one node's host memory ---
+static void* serve_requests(void* arg) {
+    struct numa_job* job = (struct numa_job*)arg;
+    const PJRT_Api* api = job->api;
+    const TestCase* test_case = job->test_case;
+    struct numa_client* c = job->client;
+    job->rc = bind_to_node(c->node);
+    double start = now_seconds();
+    for (long r = 0; r < job->requests && job->rc == 0; ++r) {
+        PJRT_Buffer* inputs[2] = {NULL, NULL};
+        PJRT_Buffer** outputs = NULL;
+        size_t num_outputs = 0;
+        for (size_t i = 0; i < 2 && job->rc == 0; ++i) {
+            inputs[i] = create_buffer_from_host(api, c->client, c->device, job->data->inputs[i],
+                                                test_case->input_types[i], test_case->input_dims[i],
+                                                test_case->input_num_dims[i], "NUMA input");
+            job->rc = inputs[i] == NULL;
+        }
+        if (job->rc == 0) {
+            job->rc = execute_hlo_program(api, c->executable, inputs, 2, &outputs, &num_outputs);
+        }
+        if (job->rc == 0 && num_outputs != 1) job->rc = 1;
+        if (job->rc == 0) {
+            PJRT_Buffer_ToHostBuffer_Args to_host_args = {0};
+            to_host_args.struct_size = PJRT_Buffer_ToHostBuffer_Args_STRUCT_SIZE;
+            to_host_args.src = outputs[0];
+            to_host_args.dst = job->data->output;
+            to_host_args.dst_size = job->data->output_size;
+            job->rc =
+                handle_error(api->PJRT_Buffer_ToHostBuffer(&to_host_args), api, "PJRT_Buffer_ToHostBuffer") ||
+                await_event(api, to_host_args.event, "PJRT_Event_Await (NUMA readback)");
+        }
+        destroy_buffers(api, outputs, num_outputs, "PJRT_Buffer_Destroy (NUMA output)");
+        destroy_buffer(api, inputs[0], "PJRT_Buffer_Destroy (NUMA input)");
+        destroy_buffer(api, inputs[1], "PJRT_Buffer_Destroy (NUMA input)");
+    }
+    job->elapsed_s = now_seconds() - start;
+    return NULL;
+}
+
+
+// --- Function to run one thread per job and wait for all of them ---
+static int run_jobs(void* (*body)(void*), struct numa_job* jobs, int num_jobs) {
+    pthread_t threads[NUMA_MAX_NODES];
+    int started = 0;
+    int rc = 0;
+    for (; started < num_jobs; ++started) {
+        if (pthread_create(&threads[started], NULL, body, &jobs[started]) != 0) {
+            fprintf(stderr, "Failed to start a NUMA worker.\n");
+            rc = 1;
+            break;
+        }
+    }
+    for (int i = 0; i < started; ++i) {
+        pthread_join(threads[i], NULL);
+        rc |= jobs[i].rc;
+    }
+    return rc;
+}
+
+
+// --- Function to compare node-local with cross-node clients and host memory ---
+int run_numa_benchmark(const PJRT_Api* api, const struct client_options* options, long requests,
+                       double tolerance) {
+    const TestCase* test_case = ffi_rms_norm_test_case(0);
+    struct numa_node nodes[NUMA_MAX_NODES];
+    struct numa_client clients[NUMA_MAX_NODES];
+    struct numa_host_data data[NUMA_MAX_NODES];
+    struct numa_job jobs[NUMA_MAX_NODES];
+    struct file_data program = {NULL, 0};
+    struct file_data compile_options = {NULL, 0};
+    struct host_tensor reference = {0};
+    int rc = 1;
+
+    memset(clients, 0, sizeof(clients));
+    memset(data, 0, sizeof(data));
+    int num_nodes = discover_nodes(nodes);
+    printf("\n--- NUMA placement: %s, %d node(s), %ld requests per measurement ---\n", test_case->name,
+           num_nodes, requests);
+    if (num_nodes == 0) return 1;
+    if (num_nodes == 1) printf("Single node: only the node-local configuration can be measured.\n");
+    if (read_file_to_buffer(test_case->hlo_path, &program) != 0 ||
+        read_file_to_buffer(test_case->compile_options_path, &compile_options) != 0) {
+        goto cleanup_numa;
+    }
+
+    // One client per node, created by a thread bound to the node.
+    for (int n = 0; n < num_nodes; ++n) {
+        clients[n].node = &nodes[n];
+        jobs[n] = (struct numa_job){api, test_case, options, &program, &compile_options, &clients[n], NULL, 0, 0.0, 0};
+    }
+    if (run_jobs(setup_client, jobs, num_nodes) != 0) goto cleanup_numa;
+
+    // Reference output from the first client, to size and check the per-node outputs.
+    {
+        PJRT_Buffer** inputs = create_input_buffers(api, clients[0].client, clients[0].device, test_case);
+        struct host_tensor* outputs = NULL;
+        size_t num_outputs = 0;
+        int ref_rc = inputs == NULL ||
+                     execute_to_host(api, clients[0].executable, inputs, test_case->num_inputs, &outputs,
+                                     &num_outputs) != 0;
+        destroy_buffers(api, inputs, test_case->num_inputs, "PJRT_Buffer_Destroy (reference input)");
+        if (ref_rc != 0 || num_outputs != 1) {
+            free_host_tensors(outputs, num_outputs);
+            goto cleanup_numa;
+        }
+        reference = outputs[0];
+        free(outputs);
+    }
+
+    for (int n = 0; n < num_nodes; ++n) {
+        for (int i = 0; i < 2; ++i) {
+            size_t size = buffer_type_size(test_case->input_types[i]);
+            for (size_t d = 0; d < test_case->input_num_dims[i]; ++d) size *= test_case->input_dims[i][d];
+            data[n].input_sizes[i] = size;
+            data[n].inputs[i] = alloc_on_node(&nodes[n], size);
+            if (data[n].inputs[i] == NULL) goto cleanup_numa;
+            memcpy(data[n].inputs[i], test_case->input_data[i], size);
+        }
+        data[n].output_size = reference.size;
+        data[n].output = alloc_on_node(&nodes[n], reference.size);
+        if (data[n].output == NULL) goto cleanup_numa;
+    }
+
+    printf("Requests per second, one thread on the client node (upload, execute and readback):\n");
+    printf("  %-14s", "client \\ host");
+    for (int m = 0; m < num_nodes; ++m) printf(" %9s%-3d", "node ", nodes[m].id);
+    printf("\n");
+    for (int c = 0; c < num_nodes; ++c) {
+        printf("  node %-9d", nodes[c].id);
+        for (int m = 0; m < num_nodes; ++m) {
+            jobs[0] = (struct numa_job){api, test_case, NULL, NULL, NULL, &clients[c], &data[m], requests, 0.0, 0};
+            if (run_jobs(serve_requests, jobs, 1) != 0) goto cleanup_numa;
+            struct host_tensor output = reference;
+            output.data = data[m].output;
+            if (!host_tensors_match(&reference, &output, tolerance)) {
+                fprintf(stderr, "\nOutput of client node %d with host node %d does not match.\n", nodes[c].id,
+                        nodes[m].id);
+                goto cleanup_numa;
+            }
+            printf(" %12.1f", requests / jobs[0].elapsed_s);
+            fflush(stdout);
+        }
+        printf("\n");
+    }
+
+    // Every node at once: requests routed to node-local memory, then to the next node's memory.
+    for (int routing = 0; routing < (num_nodes > 1 ? 2 : 1); ++routing) {
+        for (int n = 0; n < num_nodes; ++n) {
+            const struct numa_host_data* host = &data[routing == 0 ? n : (n + 1) % num_nodes];
+            jobs[n] = (struct numa_job){api, test_case, NULL, NULL, NULL, &clients[n], host, requests, 0.0, 0};
+        }
+        if (run_jobs(serve_requests, jobs, num_nodes) != 0) goto cleanup_numa;
+        double total = 0.0;
+        for (int n = 0; n < num_nodes; ++n) total += requests / jobs[n].elapsed_s;
+        printf("All nodes concurrently, %-10s host memory: %10.1f req/s\n",
+               routing == 0 ? "node-local" : "cross-node", total);
+    }
+    rc = 0;
+
+cleanup_numa:
+    for (int n = 0; n < num_nodes; ++n) {
+        free_host_data(&data[n]);
+        if (clients[n].executable != NULL) destroy_loaded_executable(api, clients[n].executable);
+        if (clients[n].client != NULL) destroy_client(api, clients[n].client);
+    }
+    free_host_tensor(&reference);
+    free_file_data(&program);
+    free_file_data(&compile_options);
+    return rc;
+}
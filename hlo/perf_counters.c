@@ -0,0 +1,200 @@
+// Hardware performance counters around execution.
+//
+// perf_counters_open opens one perf_event_open group on the calling thread
+// with `inherit` set, before the plugin creates its thread pool, so the
+// counts include every thread the runtime starts afterwards. Counters keep
+// running; run_perf_counter_test reads them before and after each
+// execute-and-wait and reports the deltas. Counters are read one by one
+// (PERF_FORMAT_GROUP cannot be combined with inherit on older kernels), but
+// they are scheduled together and read while the runtime is idle. Any
+// counter the kernel or the container refuses is reported as n/a.
+#include <errno.h>
+#include <linux/perf_event.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "hlo_test.h"
+
+enum perf_counter {
+    PERF_CYCLES,
+    PERF_INSTRUCTIONS,
+    PERF_LLC_MISSES,
+    PERF_BRANCH_MISSES,
+    PERF_DTLB_MISSES,
+    NUM_PERF_COUNTERS
+};
+
+static const struct {
+    const char* name;
+    uint32_t type;
+    uint64_t config;
+} perf_counter_defs[NUM_PERF_COUNTERS] = {
+    {"cycles", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+    {"instructions", PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+    {"LLC misses", PERF_TYPE_HW_CACHE,
+     PERF_COUNT_HW_CACHE_LL | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16)},
+    {"branch misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+    {"dTLB misses", PERF_TYPE_HW_CACHE,
+     PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16)},
+};
+
+static int perf_fds[NUM_PERF_COUNTERS] = {-1, -1, -1, -1, -1};
+
+struct perf_reading {
+    uint64_t value;
+    uint64_t time_enabled;
+    uint64_t time_running;
+};
+
+
+// --- Function to open the counter group; returns the number of counters opened ---
+// Call before the PJRT client is created so its threads inherit the counters.
+int perf_counters_open(void) {
+    int opened = 0;
+    for (int c = 0; c < NUM_PERF_COUNTERS; ++c) {
+        struct perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = perf_counter_defs[c].type;
+        attr.config = perf_counter_defs[c].config;
+        attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+        attr.inherit = 1;
+        attr.exclude_kernel = 1; // Allowed with perf_event_paranoid up to 2
+        attr.exclude_hv = 1;
+        int group = perf_fds[PERF_CYCLES];
+        int fd = (int)syscall(SYS_perf_event_open, &attr, 0, -1, group, 0);
+        if (fd < 0 && group >= 0) {
+            // Some PMUs cannot schedule this event with the group; count it on its own.
+            fd = (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+        }
+        if (fd < 0) {
+            fprintf(stderr, "perf_event_open(%s): %s%s\n", perf_counter_defs[c].name, strerror(errno),
+                    errno == EACCES || errno == EPERM ? " (see /proc/sys/kernel/perf_event_paranoid)" : "");
+            continue;
+        }
+        perf_fds[c] = fd;
+        opened++;
+    }
+    return opened;
+}
+
+
+void perf_counters_close(void) {
+    for (int c = 0; c < NUM_PERF_COUNTERS; ++c) {
+        if (perf_fds[c] >= 0) close(perf_fds[c]);
+        perf_fds[c] = -1;
+    }
+}
+
+
+static void read_counters(struct perf_reading readings[NUM_PERF_COUNTERS]) {
+    for (int c = 0; c < NUM_PERF_COUNTERS; ++c) {
+        memset(&readings[c], 0, sizeof(readings[c]));
+        if (perf_fds[c] >= 0 && read(perf_fds[c], &readings[c], sizeof(readings[c])) != sizeof(readings[c])) {
+            memset(&readings[c], 0, sizeof(readings[c]));
+        }
+    }
+}
+
+
+// Count over an interval, scaled up when the kernel multiplexed the counter.
+static double counter_delta(const struct perf_reading* before, const struct perf_reading* after) {
+    double value = (double)(after->value - before->value);
+    uint64_t enabled = after->time_enabled - before->time_enabled;
+    uint64_t running = after->time_running - before->time_running;
+    if (running == 0) return enabled == 0 ? value : -1.0; // -1: never scheduled
+    return running < enabled ? value * (double)enabled / (double)running : value;
+}
+
+
+static size_t input_elements(const TestCase* test_case) {
+    size_t total = 0;
+    for (size_t i = 0; i < test_case->num_inputs; ++i) {
+        size_t elements = 1;
+        for (size_t d = 0; d < test_case->input_num_dims[i]; ++d) elements *= test_case->input_dims[i][d];
+        total += elements;
+    }
+    return total;
+}
+
+
+// --- Function to report hardware counters per execution of a test case ---
+// Misses are normalized by the number of input elements of the test case.
+int run_perf_counter_test(const PJRT_Api* api, PJRT_Client* client, PJRT_Device* device,
+                          const TestCase* test_case, int iterations) {
+    int rc = 1;
+    struct file_data program = {NULL, 0};
+    struct file_data compile_options = {NULL, 0};
+    PJRT_LoadedExecutable* executable = NULL;
+    PJRT_Buffer** inputs = NULL;
+    double totals[NUM_PERF_COUNTERS] = {0};
+    int valid[NUM_PERF_COUNTERS];
+    double wall_s = 0.0;
+
+    printf("\n--- Hardware counters: %s ---\n", test_case->name);
+    for (int c = 0; c < NUM_PERF_COUNTERS; ++c) valid[c] = perf_fds[c] >= 0;
+    if (read_file_to_buffer(test_case->hlo_path, &program) != 0 ||
+        read_file_to_buffer(test_case->compile_options_path, &compile_options) != 0) {
+        goto cleanup_perf;
+    }
+    const char* format = test_case->format ? test_case->format : program_format_from_path(test_case->hlo_path);
+    executable = compile_program(api, client, &program, format, &compile_options);
+    if (executable == NULL) goto cleanup_perf;
+    inputs = create_input_buffers(api, client, device, test_case);
+    if (inputs == NULL) goto cleanup_perf;
+
+    for (int i = -1; i < iterations; ++i) { // One warm-up run
+        struct perf_reading before[NUM_PERF_COUNTERS], after[NUM_PERF_COUNTERS];
+        PJRT_Buffer** outputs = NULL;
+        size_t num_outputs = 0;
+        read_counters(before);
+        double start = now_seconds();
+        int run_rc = execute_hlo_program(api, executable, inputs, test_case->num_inputs, &outputs, &num_outputs) ||
+                     await_buffers_ready(api, outputs, num_outputs);
+        double elapsed = now_seconds() - start;
+        read_counters(after);
+        destroy_buffers(api, outputs, num_outputs, "PJRT_Buffer_Destroy (perf output)");
+        if (run_rc != 0) goto cleanup_perf;
+        if (i < 0) continue;
+        wall_s += elapsed;
+        for (int c = 0; c < NUM_PERF_COUNTERS; ++c) {
+            double delta = counter_delta(&before[c], &after[c]);
+            if (delta < 0.0) valid[c] = 0;
+            totals[c] += delta;
+        }
+    }
+
+    double elements = (double)input_elements(test_case);
+    printf("  %-14s %16s %14s\n", "counter", "per execution", "per element");
+    printf("  %-14s %16.4f %14s\n", "wall (ms)", wall_s / iterations * 1e3, "");
+    for (int c = 0; c < NUM_PERF_COUNTERS; ++c) {
+        if (!valid[c]) {
+            printf("  %-14s %16s %14s\n", perf_counter_defs[c].name, "n/a", "n/a");
+            continue;
+        }
+        double per_run = totals[c] / iterations;
+        printf("  %-14s %16.0f ", perf_counter_defs[c].name, per_run);
+        if (elements > 0.0) {
+            printf("%14.4f\n", per_run / elements);
+        } else {
+            printf("%14s\n", "n/a"); // No inputs to divide by
+        }
+    }
+    if (valid[PERF_CYCLES] && valid[PERF_INSTRUCTIONS] && totals[PERF_CYCLES] > 0.0) {
+        printf("  IPC %.3f over %.0f input elements\n", totals[PERF_INSTRUCTIONS] / totals[PERF_CYCLES], elements);
+    } else {
+        printf("  IPC n/a: cycle and instruction counters are not available here.\n");
+    }
+    rc = 0;
+
+cleanup_perf:
+    destroy_buffers(api, inputs, test_case->num_inputs, "PJRT_Buffer_Destroy (perf input)");
+    if (executable != NULL) destroy_loaded_executable(api, executable);
+    free_file_data(&program);
+    free_file_data(&compile_options);
+    return rc;
+}
@@ -0,0 +1,427 @@
+// Double-buffered upload/execute/readback pipeline for frame streams.
+//
+// Frames cycle through PIPELINE_DEPTH slots. Each step uploads frame k + 2,
+// executes frame k + 1 and starts reading back frame k without waiting in
+// between; a slot is only retired (outputs checked, buffers destroyed) when
+// its next frame needs it. Stage completion times come from
+// PJRT_Event_OnReady callbacks, so the per-stage timings show how much of
+// each stage ran while another one was in flight.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "hlo_test.h"
+
+#define PIPELINE_DEPTH 3
+
+enum pipeline_stage { STAGE_UPLOAD, STAGE_EXECUTE, STAGE_READBACK, NUM_STAGES };
+static const char* const stage_names[NUM_STAGES] = {"upload", "execute", "readback"};
+
+struct pipeline_sync {
+    const PJRT_Api* api;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+};
+
+struct stage_timing {
+    struct pipeline_sync* sync;
+    double issued;
+    double done; // Latest completion among the stage's events
+    int pending; // Completion callbacks that have not run yet
+    int failed;
+};
+
+struct pipeline_slot {
+    long frame; // -1 when free
+    void** staging; // Host copy of each input, alive until its upload completes
+    PJRT_Event** input_done; // done_with_host_buffer per input
+    PJRT_Buffer** inputs; // Owned by the frame in the slot
+    PJRT_Buffer** outputs;
+    size_t num_outputs;
+    struct host_tensor* results;
+};
+
+struct pipeline {
+    const PJRT_Api* api;
+    PJRT_Client* client;
+    PJRT_Device* device;
+    PJRT_LoadedExecutable* executable;
+    const TestCase* test_case;
+    size_t* input_sizes;
+    struct pipeline_sync sync;
+    struct stage_timing* timings; // frames * NUM_STAGES
+    struct pipeline_slot slots[PIPELINE_DEPTH];
+    const struct host_tensor* reference;
+    size_t num_reference;
+    double tolerance;
+};
+
+
+static struct stage_timing* stage_timing_of(struct pipeline* p, long frame, int stage) {
+    return &p->timings[frame * NUM_STAGES + stage];
+}
+
+
+static void stage_begin(struct pipeline* p, struct stage_timing* t) {
+    t->sync = &p->sync;
+    t->issued = now_seconds();
+    t->done = t->issued;
+    t->pending = 0;
+    t->failed = 0;
+}
+
+
+// Runs on a plugin thread once a tracked event is ready.
+static void stage_event_ready(PJRT_Error* error, void* user_arg) {
+    struct stage_timing* t = (struct stage_timing*)user_arg;
+    double now = now_seconds();
+    int failed = handle_error(error, t->sync->api, "Pipeline stage");
+    pthread_mutex_lock(&t->sync->lock);
+    if (now > t->done) t->done = now;
+    t->failed |= failed;
+    t->pending--;
+    pthread_cond_broadcast(&t->sync->cond);
+    pthread_mutex_unlock(&t->sync->lock);
+}
+
+
+// --- Function to record the completion of `event` in a stage ---
+// Takes ownership of `event`; the callback stays registered after it is destroyed.
+static int track_event(struct pipeline* p, struct stage_timing* t, PJRT_Event* event) {
+    pthread_mutex_lock(&p->sync.lock);
+    if (event == NULL) {
+        t->done = now_seconds(); // Already complete
+    } else {
+        t->pending++;
+    }
+    pthread_mutex_unlock(&p->sync.lock);
+    if (event == NULL) return 0;
+
+    PJRT_Event_OnReady_Args on_ready_args = {0};
+    on_ready_args.struct_size = PJRT_Event_OnReady_Args_STRUCT_SIZE;
+    on_ready_args.event = event;
+    on_ready_args.callback = stage_event_ready;
+    on_ready_args.user_arg = t;
+    PJRT_Error* error = p->api->PJRT_Event_OnReady(&on_ready_args);
+    destroy_event(p->api, event);
+    if (handle_error(error, p->api, "PJRT_Event_OnReady")) {
+        pthread_mutex_lock(&p->sync.lock);
+        t->pending--;
+        t->failed = 1;
+        pthread_mutex_unlock(&p->sync.lock);
+        return 1;
+    }
+    return 0;
+}
+
+
+static int track_buffer_ready(struct pipeline* p, struct stage_timing* t, PJRT_Buffer* buffer) {
+    PJRT_Buffer_ReadyEvent_Args ready_args = {0};
+    ready_args.struct_size = PJRT_Buffer_ReadyEvent_Args_STRUCT_SIZE;
+    ready_args.buffer = buffer;
+    if (handle_error(p->api->PJRT_Buffer_ReadyEvent(&ready_args), p->api, "PJRT_Buffer_ReadyEvent")) {
+        return 1;
+    }
+    return track_event(p, t, ready_args.event);
+}
+
+
+static int wait_stage(struct pipeline* p, struct stage_timing* t) {
+    pthread_mutex_lock(&p->sync.lock);
+    while (t->pending > 0) pthread_cond_wait(&p->sync.cond, &p->sync.lock);
+    int failed = t->failed;
+    pthread_mutex_unlock(&p->sync.lock);
+    return failed;
+}
+
+
+// --- Stage 1: copy the frame into the slot's staging memory and start the upload ---
+static int pipeline_upload(struct pipeline* p, struct pipeline_slot* slot, long frame) {
+    const TestCase* test_case = p->test_case;
+    struct stage_timing* t = stage_timing_of(p, frame, STAGE_UPLOAD);
+    slot->frame = frame;
+    stage_begin(p, t);
+    slot->inputs = (PJRT_Buffer**)calloc(test_case->num_inputs ? test_case->num_inputs : 1, sizeof(PJRT_Buffer*));
+    if (slot->inputs == NULL) return 1;
+    for (size_t i = 0; i < test_case->num_inputs; ++i) {
+        memcpy(slot->staging[i], test_case->input_data[i], p->input_sizes[i]);
+        slot->inputs[i] = create_buffer_from_host_async(p->api, p->client, p->device, slot->staging[i],
+                                                        test_case->input_types[i], test_case->input_dims[i],
+                                                        test_case->input_num_dims[i], &slot->input_done[i],
+                                                        "Pipeline input");
+        if (slot->inputs[i] == NULL || track_buffer_ready(p, t, slot->inputs[i]) != 0) return 1;
+    }
+    return 0;
+}
+
+
+// --- Stage 2: launch the executable on the uploaded inputs ---
+static int pipeline_execute(struct pipeline* p, struct pipeline_slot* slot) {
+    struct stage_timing* t = stage_timing_of(p, slot->frame, STAGE_EXECUTE);
+    stage_begin(p, t);
+    if (execute_hlo_program(p->api, p->executable, slot->inputs, p->test_case->num_inputs,
+                            &slot->outputs, &slot->num_outputs) != 0) {
+        return 1;
+    }
+    for (size_t i = 0; i < slot->num_outputs; ++i) {
+        if (track_buffer_ready(p, t, slot->outputs[i]) != 0) return 1;
+    }
+    return 0;
+}
+
+
+// --- Stage 3: start copying the outputs back to the host ---
+static int pipeline_readback(struct pipeline* p, struct pipeline_slot* slot) {
+    struct stage_timing* t = stage_timing_of(p, slot->frame, STAGE_READBACK);
+    stage_begin(p, t);
+    slot->results = (struct host_tensor*)calloc(slot->num_outputs ? slot->num_outputs : 1,
+                                                sizeof(struct host_tensor));
+    if (slot->results == NULL) return 1;
+    for (size_t i = 0; i < slot->num_outputs; ++i) {
+        PJRT_Event* event = NULL;
+        if (buffer_to_host_async(p->api, slot->outputs[i], &slot->results[i], &event) != 0 ||
+            track_event(p, t, event) != 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+
+// --- Function to wait for a slot's frame, check its outputs and free the slot ---
+static int pipeline_retire(struct pipeline* p, struct pipeline_slot* slot) {
+    if (slot->frame < 0) return 0;
+    int rc = 0;
+    for (int stage = 0; stage < NUM_STAGES; ++stage) {
+        rc |= wait_stage(p, stage_timing_of(p, slot->frame, stage));
+    }
+    for (size_t i = 0; i < p->test_case->num_inputs; ++i) {
+        rc |= await_event(p->api, slot->input_done[i], "PJRT_Event_Await (done with host buffer)");
+        slot->input_done[i] = NULL;
+    }
+    if (rc == 0 && slot->results != NULL) {
+        int match = slot->num_outputs == p->num_reference;
+        for (size_t i = 0; match && i < slot->num_outputs; ++i) {
+            match = host_tensors_match(&p->reference[i], &slot->results[i], p->tolerance);
+        }
+        if (!match) {
+            fprintf(stderr, "Pipelined frame %ld does not match the serial result.\n", slot->frame);
+            rc = 1;
+        }
+    }
+    free_host_tensors(slot->results, slot->num_outputs);
+    slot->results = NULL;
+    destroy_buffers(p->api, slot->outputs, slot->num_outputs, "PJRT_Buffer_Destroy (pipeline output)");
+    slot->outputs = NULL;
+    slot->num_outputs = 0;
+    destroy_buffers(p->api, slot->inputs, p->test_case->num_inputs, "PJRT_Buffer_Destroy (pipeline input)");
+    slot->inputs = NULL;
+    slot->frame = -1;
+    return rc;
+}
+
+
+// --- Per-stage busy and overlapped time over all frames ---
+// `busy` is the union of the stage's [issued, done] intervals, `overlapped`
+// the part of it during which another stage was also in flight.
+struct stage_edge {
+    double time;
+    int stage;
+    int delta; // +1 when the interval opens, -1 when it closes
+};
+
+static int compare_edges(const void* a, const void* b) {
+    const struct stage_edge* x = (const struct stage_edge*)a;
+    const struct stage_edge* y = (const struct stage_edge*)b;
+    if (x->time != y->time) return (x->time > y->time) - (x->time < y->time);
+    return x->delta - y->delta; // Close before open at equal times
+}
+
+static int stage_overlap(const struct stage_timing* timings, long frames, double busy[NUM_STAGES],
+                         double overlapped[NUM_STAGES]) {
+    size_t num_edges = (size_t)frames * NUM_STAGES * 2;
+    struct stage_edge* edges = (struct stage_edge*)malloc(num_edges * sizeof(*edges));
+    if (edges == NULL) return 1;
+    for (long f = 0; f < frames; ++f) {
+        for (int stage = 0; stage < NUM_STAGES; ++stage) {
+            const struct stage_timing* t = &timings[f * NUM_STAGES + stage];
+            struct stage_edge* e = &edges[(f * NUM_STAGES + stage) * 2];
+            e[0] = (struct stage_edge){t->issued, stage, +1};
+            e[1] = (struct stage_edge){t->done, stage, -1};
+        }
+    }
+    qsort(edges, num_edges, sizeof(*edges), compare_edges);
+
+    int active[NUM_STAGES] = {0};
+    for (int stage = 0; stage < NUM_STAGES; ++stage) busy[stage] = overlapped[stage] = 0.0;
+    for (size_t i = 0; i + 1 < num_edges; ++i) {
+        active[edges[i].stage] += edges[i].delta;
+        double span = edges[i + 1].time - edges[i].time;
+        int num_active = 0;
+        for (int stage = 0; stage < NUM_STAGES; ++stage) num_active += active[stage] > 0;
+        for (int stage = 0; stage < NUM_STAGES; ++stage) {
+            if (active[stage] <= 0) continue;
+            busy[stage] += span;
+            if (num_active > 1) overlapped[stage] += span;
+        }
+    }
+    free(edges);
+    return 0;
+}
+
+
+// --- Function to process frames one at a time: upload, execute, read back, repeat ---
+static int run_serial_frames(const PJRT_Api* api, PJRT_Client* client, PJRT_Device* device,
+                             PJRT_LoadedExecutable* executable, const TestCase* test_case, long frames,
+                             struct host_tensor** reference, size_t* num_reference, double* elapsed_s) {
+    double start = now_seconds();
+    for (long f = 0; f < frames; ++f) {
+        PJRT_Buffer** inputs = create_input_buffers(api, client, device, test_case);
+        if (inputs == NULL) return 1;
+        struct host_tensor* outputs = NULL;
+        size_t num_outputs = 0;
+        int rc = execute_to_host(api, executable, inputs, test_case->num_inputs, &outputs, &num_outputs);
+        destroy_buffers(api, inputs, test_case->num_inputs, "PJRT_Buffer_Destroy (serial input)");
+        if (rc != 0) return 1;
+        if (f == 0) {
+            *reference = outputs;
+            *num_reference = num_outputs;
+        } else {
+            free_host_tensors(outputs, num_outputs);
+        }
+    }
+    *elapsed_s = now_seconds() - start;
+    return 0;
+}
+
+
+// --- Function to stream `frames` frames of a test case through the pipeline ---
+// Compares against processing the same frames serially and reports per-stage
+// latency, busy time and how much of each stage overlapped with the others.
+int run_pipeline_benchmark(const PJRT_Api* api, PJRT_Client* client, PJRT_Device* device,
+                           const TestCase* test_case, long frames, double tolerance) {
+    printf("\n--- Pipeline: %s (%ld frames, %d slots) ---\n", test_case->name, frames, PIPELINE_DEPTH);
+    int rc = 1;
+    struct file_data program = {NULL, 0};
+    struct file_data compile_options = {NULL, 0};
+    struct host_tensor* reference = NULL;
+    size_t num_reference = 0;
+    size_t num_inputs = test_case->num_inputs;
+    int sync_ready = 0;
+    struct pipeline p;
+    memset(&p, 0, sizeof(p));
+    p.api = api;
+    p.client = client;
+    p.device = device;
+    p.test_case = test_case;
+    p.tolerance = tolerance;
+    for (int s = 0; s < PIPELINE_DEPTH; ++s) p.slots[s].frame = -1;
+
+    if (read_file_to_buffer(test_case->hlo_path, &program) != 0 ||
+        read_file_to_buffer(test_case->compile_options_path, &compile_options) != 0) {
+        goto cleanup_pipeline;
+    }
+    const char* format = test_case->format ? test_case->format : program_format_from_path(test_case->hlo_path);
+    p.executable = compile_program(api, client, &program, format, &compile_options);
+    if (p.executable == NULL) goto cleanup_pipeline;
+
+    // --- Serial baseline, also the reference output ---
+    double serial_s = 0.0;
+    if (run_serial_frames(api, client, device, p.executable, test_case, frames, &reference, &num_reference,
+                          &serial_s) != 0) {
+        goto cleanup_pipeline;
+    }
+    p.reference = reference;
+    p.num_reference = num_reference;
+
+    // --- Pipeline state ---
+    p.sync.api = api;
+    pthread_mutex_init(&p.sync.lock, NULL);
+    pthread_cond_init(&p.sync.cond, NULL);
+    sync_ready = 1;
+    p.timings = (struct stage_timing*)calloc((size_t)frames * NUM_STAGES, sizeof(struct stage_timing));
+    p.input_sizes = (size_t*)calloc(num_inputs ? num_inputs : 1, sizeof(size_t));
+    if (p.timings == NULL || p.input_sizes == NULL) goto cleanup_pipeline;
+    for (size_t i = 0; i < num_inputs; ++i) {
+        p.input_sizes[i] = buffer_type_size(test_case->input_types[i]);
+        for (size_t d = 0; d < test_case->input_num_dims[i]; ++d) p.input_sizes[i] *= test_case->input_dims[i][d];
+    }
+    for (int s = 0; s < PIPELINE_DEPTH; ++s) {
+        struct pipeline_slot* slot = &p.slots[s];
+        slot->staging = (void**)calloc(num_inputs ? num_inputs : 1, sizeof(void*));
+        slot->input_done = (PJRT_Event**)calloc(num_inputs ? num_inputs : 1, sizeof(PJRT_Event*));
+        if (slot->staging == NULL || slot->input_done == NULL) goto cleanup_pipeline;
+        for (size_t i = 0; i < num_inputs; ++i) {
+            slot->staging[i] = malloc(p.input_sizes[i] ? p.input_sizes[i] : 1);
+            if (slot->staging[i] == NULL) goto cleanup_pipeline;
+        }
+    }
+
+    // --- Step k: upload frame k, execute frame k - 1, read back frame k - 2 ---
+    double start = now_seconds();
+    int step_rc = 0;
+    for (long step = 0; step < frames + 2 && step_rc == 0; ++step) {
+        if (step < frames) {
+            struct pipeline_slot* slot = &p.slots[step % PIPELINE_DEPTH];
+            step_rc = pipeline_retire(&p, slot) || pipeline_upload(&p, slot, step);
+        }
+        if (step_rc == 0 && step >= 1 && step - 1 < frames) {
+            step_rc = pipeline_execute(&p, &p.slots[(step - 1) % PIPELINE_DEPTH]);
+        }
+        if (step_rc == 0 && step >= 2) {
+            step_rc = pipeline_readback(&p, &p.slots[(step - 2) % PIPELINE_DEPTH]);
+        }
+    }
+    for (int s = 0; s < PIPELINE_DEPTH; ++s) step_rc |= pipeline_retire(&p, &p.slots[s]);
+    double pipelined_s = now_seconds() - start;
+    if (step_rc != 0) goto cleanup_pipeline;
+
+    // --- Report ---
+    printf("  %-12s %12s %12s\n", "mode", "ms/frame", "frames/s");
+    printf("  %-12s %12.4f %12.1f\n", "serial", serial_s * 1e3 / frames, frames / serial_s);
+    printf("  %-12s %12.4f %12.1f\n", "pipelined", pipelined_s * 1e3 / frames, frames / pipelined_s);
+
+    double busy[NUM_STAGES], overlapped[NUM_STAGES];
+    double* latencies = (double*)malloc((size_t)frames * sizeof(double));
+    if (latencies == NULL || stage_overlap(p.timings, frames, busy, overlapped) != 0) {
+        free(latencies);
+        goto cleanup_pipeline;
+    }
+    printf("  %-12s %12s %12s %12s\n", "stage", "median(ms)", "busy(ms)", "overlapped");
+    double busy_total = 0.0;
+    for (int stage = 0; stage < NUM_STAGES; ++stage) {
+        for (long f = 0; f < frames; ++f) {
+            const struct stage_timing* t = stage_timing_of(&p, f, stage);
+            latencies[f] = t->done - t->issued;
+        }
+        busy_total += busy[stage];
+        printf("  %-12s %12.4f %12.3f %11.1f%%\n", stage_names[stage], median_of(latencies, frames) * 1e3,
+               busy[stage] * 1e3, busy[stage] > 0.0 ? 100.0 * overlapped[stage] / busy[stage] : 0.0);
+    }
+    free(latencies);
+    printf("Speedup over serial: %.2fx, %.2f stages in flight on average.\n",
+           serial_s / pipelined_s, busy_total / pipelined_s);
+    rc = 0;
+
+cleanup_pipeline:
+    for (int s = 0; s < PIPELINE_DEPTH; ++s) {
+        struct pipeline_slot* slot = &p.slots[s];
+        if (sync_ready) pipeline_retire(&p, slot);
+        if (slot->staging != NULL) {
+            for (size_t i = 0; i < num_inputs; ++i) free(slot->staging[i]);
+        }
+        free(slot->staging);
+        free(slot->input_done);
+    }
+    if (sync_ready) {
+        pthread_cond_destroy(&p.sync.cond);
+        pthread_mutex_destroy(&p.sync.lock);
+    }
+    free(p.timings);
+    free(p.input_sizes);
+    free_host_tensors(reference, num_reference);
+    if (p.executable != NULL) destroy_loaded_executable(api, p.executable);
+    free_file_data(&program);
+    free_file_data(&compile_options);
+    return rc;
+}
@@ -0,0 +1,244 @@
+// Background prewarming with ready-gating.
+//
+// The first execution of a freshly loaded executable pays for faulting in its
+// code, spinning up the runtime's thread pool and warming the allocator. With
+// prewarming a background thread runs the executable `runs` times on
+// synthetic inputs right after it is loaded, then marks it warm; requests wait
+// at the gate until it is. Every trial loads the program twice, once served
+// cold and once prewarmed, so both first requests hit a fresh executable. The
+// request arrives as soon as the executable is loaded: its time at the gate
+// is reported apart from the execution itself, which is what prewarming buys
+// when a server loads programs before it starts taking traffic.
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "hlo_test.h"
+
+#define PREWARM_SEED 1
+
+enum prewarm_state {
+    PREWARM_WARMING,
+    PREWARM_WARM,
+    PREWARM_FAILED,
+};
+
+struct prewarm_job {
+    const PJRT_Api* api;
+    PJRT_LoadedExecutable* executable;
+    PJRT_Buffer** inputs; // Synthetic, shared by all trials
+    size_t num_inputs;
+    int runs;
+    pthread_mutex_t lock;
+    pthread_cond_t warm;
+    enum prewarm_state state; // Guarded by lock
+    double ready_at; // now_seconds() when the state left PREWARM_WARMING
+};
+
+// Per trial, in seconds.
+enum prewarm_sample {
+    PREWARM_COLD_FIRST,
+    PREWARM_COLD_SECOND,
+    PREWARM_READY,
+    PREWARM_GATE_WAIT,
+    PREWARM_WARM_FIRST,
+    PREWARM_WARM_ARRIVAL, // Gate wait plus the first prewarmed request
+    NUM_PREWARM_SAMPLES
+};
+
+static const char* const prewarm_sample_names[NUM_PREWARM_SAMPLES] = {
+    "cold first request", "cold second request", "load to warm", "gate wait", "prewarmed first request",
+    "prewarmed arrival to done",
+};
+
+
+static void* prewarm_thread(void* arg) {
+    struct prewarm_job* job = (struct prewarm_job*)arg;
+    int rc = 0;
+    for (int i = 0; i < job->runs && rc == 0; ++i) {
+        PJRT_Buffer** outputs = NULL;
+        size_t num_outputs = 0;
+        rc = execute_hlo_program(job->api, job->executable, job->inputs, job->num_inputs, &outputs, &num_outputs) ||
+             await_buffers_ready(job->api, outputs, num_outputs);
+        destroy_buffers(job->api, outputs, num_outputs, "PJRT_Buffer_Destroy (prewarm output)");
+    }
+    pthread_mutex_lock(&job->lock);
+    job->state = rc == 0 ? PREWARM_WARM : PREWARM_FAILED;
+    job->ready_at = now_seconds();
+    pthread_cond_broadcast(&job->warm);
+    pthread_mutex_unlock(&job->lock);
+    return NULL;
+}
+
+
+// Blocks until the executable is warm; a request is refused when prewarming failed.
+static int prewarm_admit(struct prewarm_job* job) {
+    pthread_mutex_lock(&job->lock);
+    while (job->state == PREWARM_WARMING) pthread_cond_wait(&job->warm, &job->lock);
+    int rc = job->state != PREWARM_WARM;
+    pthread_mutex_unlock(&job->lock);
+    return rc;
+}
+
+
+// The serialized executable when the test case has a usable one, else a compile.
+static PJRT_LoadedExecutable* load_executable(const PJRT_Api* api, PJRT_Client* client, const TestCase* test_case,
+                                              const struct file_data* program,
+                                              const struct file_data* compile_options) {
+    PJRT_LoadedExecutable* executable = NULL;
+    if (test_case->executable_path != NULL) {
+        executable = load_serialized_executable(api, client, test_case->executable_path);
+    }
+    if (executable == NULL) {
+        const char* format = test_case->format ? test_case->format : program_format_from_path(test_case->hlo_path);
+        executable = compile_program(api, client, program, format, compile_options);
+    }
+    return executable;
+}
+
+
+// Time of one request: execute and copy every output back to the host.
+static int timed_request(const PJRT_Api* api, PJRT_LoadedExecutable* executable, PJRT_Buffer** inputs,
+                         size_t num_inputs, double* elapsed_s) {
+    struct host_tensor* outputs = NULL;
+    size_t num_outputs = 0;
+    double start = now_seconds();
+    int rc = execute_to_host(api, executable, inputs, num_inputs, &outputs, &num_outputs);
+    *elapsed_s = now_seconds() - start;
+    free_host_tensors(outputs, num_outputs);
+    return rc;
+}
+
+
+// Uploads inputs of the test case's shapes and types filled by fill_synthetic.
+static PJRT_Buffer** create_synthetic_inputs(const PJRT_Api* api, PJRT_Client* client, PJRT_Device* device,
+                                             const TestCase* test_case) {
+    PJRT_Buffer** buffers = (PJRT_Buffer**)calloc(test_case->num_inputs ? test_case->num_inputs : 1,
+                                                  sizeof(PJRT_Buffer*));
+    if (buffers == NULL) return NULL;
+    for (size_t i = 0; i < test_case->num_inputs; ++i) {
+        struct host_tensor tensor = {0};
+        tensor.type = test_case->input_types[i];
+        tensor.num_dims = test_case->input_num_dims[i];
+        tensor.size = buffer_type_size(tensor.type);
+        for (size_t d = 0; d < tensor.num_dims && d < HOST_TENSOR_MAX_DIMS; ++d) {
+            tensor.dims[d] = test_case->input_dims[i][d];
+            tensor.size *= (size_t)tensor.dims[d];
+        }
+        tensor.data = malloc(tensor.size ? tensor.size : 1);
+        if (tensor.data != NULL) {
+            fill_synthetic(&tensor, PREWARM_SEED, i);
+            // create_buffer_from_host waits until the host data is copied.
+            buffers[i] = create_buffer_from_host(api, client, device, tensor.data, tensor.type, tensor.dims,
+                                                 tensor.num_dims, "Prewarm input");
+        }
+        free_host_tensor(&tensor);
+        if (buffers[i] == NULL) {
+            destroy_buffers(api, buffers, i, "PJRT_Buffer_Destroy (prewarm input)");
+            return NULL;
+        }
+    }
+    return buffers;
+}
+
+
+static void print_prewarm_row(const char* name, double* samples, int trials) {
+    double min = samples[0], max = samples[0];
+    for (int i = 1; i < trials; ++i) {
+        if (samples[i] < min) min = samples[i];
+        if (samples[i] > max) max = samples[i];
+    }
+    printf("  %-28s %12.3f %12.3f %12.3f\n", name, median_of(samples, trials) * 1e3, min * 1e3, max * 1e3);
+}
+
+
+// --- Function to compare first-request latency of cold and prewarmed executables ---
+// `runs` background executions before the executable is marked warm, `trials` cold/prewarmed pairs.
+int run_prewarm_test(const PJRT_Api* api, PJRT_Client* client, PJRT_Device* device, const TestCase* test_case,
+                     int runs, int trials) {
+    int rc = 1;
+    struct file_data program = {NULL, 0};
+    struct file_data compile_options = {NULL, 0};
+    PJRT_Buffer** inputs = NULL;
+    PJRT_Buffer** synthetic = NULL;
+    double* samples[NUM_PREWARM_SAMPLES] = {NULL};
+
+    printf("\n--- Prewarm: %s (%d background run(s), %d trial(s)) ---\n", test_case->name, runs, trials);
+    if (trials < 1) trials = 1;
+    for (int s = 0; s < NUM_PREWARM_SAMPLES; ++s) {
+        samples[s] = (double*)calloc(trials, sizeof(double));
+        if (samples[s] == NULL) goto cleanup_prewarm;
+    }
+    if (read_file_to_buffer(test_case->hlo_path, &program) != 0 ||
+        read_file_to_buffer(test_case->compile_options_path, &compile_options) != 0) {
+        goto cleanup_prewarm;
+    }
+    inputs = create_input_buffers(api, client, device, test_case);
+    synthetic = inputs != NULL ? create_synthetic_inputs(api, client, device, test_case) : NULL;
+    if (synthetic == NULL) goto cleanup_prewarm;
+
+    for (int t = 0; t < trials; ++t) {
+        // Cold: the request is served by the first execution.
+        PJRT_LoadedExecutable* executable = load_executable(api, client, test_case, &program, &compile_options);
+        if (executable == NULL) goto cleanup_prewarm;
+        int run_rc = timed_request(api, executable, inputs, test_case->num_inputs, &samples[PREWARM_COLD_FIRST][t]) ||
+                     timed_request(api, executable, inputs, test_case->num_inputs, &samples[PREWARM_COLD_SECOND][t]);
+        destroy_loaded_executable(api, executable);
+        if (run_rc != 0) goto cleanup_prewarm;
+
+        // Prewarmed: the same request arrives at load time and waits at the gate.
+        struct prewarm_job job;
+        memset(&job, 0, sizeof(job));
+        job.api = api;
+        job.inputs = synthetic;
+        job.num_inputs = test_case->num_inputs;
+        job.runs = runs;
+        job.state = PREWARM_WARMING;
+        job.executable = load_executable(api, client, test_case, &program, &compile_options);
+        if (job.executable == NULL) goto cleanup_prewarm;
+        pthread_mutex_init(&job.lock, NULL);
+        pthread_cond_init(&job.warm, NULL);
+        double loaded_at = now_seconds();
+        pthread_t thread;
+        if (pthread_create(&thread, NULL, prewarm_thread, &job) != 0) {
+            fprintf(stderr, "Failed to start the prewarm thread\n");
+            prewarm_thread(&job); // Warm on this thread instead
+            thread = pthread_self();
+        }
+        run_rc = prewarm_admit(&job);
+        double admitted_at = now_seconds();
+        if (run_rc == 0) {
+            run_rc = timed_request(api, job.executable, inputs, test_case->num_inputs,
+                                   &samples[PREWARM_WARM_FIRST][t]);
+        } else {
+            fprintf(stderr, "Prewarming failed; request refused\n");
+        }
+        if (!pthread_equal(thread, pthread_self())) pthread_join(thread, NULL);
+        samples[PREWARM_READY][t] = job.ready_at - loaded_at;
+        samples[PREWARM_GATE_WAIT][t] = admitted_at - loaded_at;
+        samples[PREWARM_WARM_ARRIVAL][t] = samples[PREWARM_GATE_WAIT][t] + samples[PREWARM_WARM_FIRST][t];
+        destroy_loaded_executable(api, job.executable);
+        pthread_cond_destroy(&job.warm);
+        pthread_mutex_destroy(&job.lock);
+        if (run_rc != 0) goto cleanup_prewarm;
+    }
+
+    double cold_first = median_of(samples[PREWARM_COLD_FIRST], trials);
+    double warm_first = median_of(samples[PREWARM_WARM_FIRST], trials);
+    printf("  %-28s %12s %12s %12s\n", "", "median ms", "min ms", "max ms");
+    for (int s = 0; s < NUM_PREWARM_SAMPLES; ++s) print_prewarm_row(prewarm_sample_names[s], samples[s], trials);
+    printf("  First request %.2fx faster when prewarmed (%.3f -> %.3f ms); "
+           "a request arriving at load time waits %.3f ms at the gate.\n",
+           warm_first > 0.0 ? cold_first / warm_first : 0.0, cold_first * 1e3, warm_first * 1e3,
+           median_of(samples[PREWARM_GATE_WAIT], trials) * 1e3);
+    rc = 0;
+
+cleanup_prewarm:
+    destroy_buffers(api, synthetic, test_case->num_inputs, "PJRT_Buffer_Destroy (prewarm input)");
+    destroy_buffers(api, inputs, test_case->num_inputs, "PJRT_Buffer_Destroy (input)");
+    for (int s = 0; s < NUM_PREWARM_SAMPLES; ++s) free(samples[s]);
+    free_file_data(&program);
+    free_file_data(&compile_options);
+    return rc;
+}
@@ -0,0 +1,160 @@
+// Minimal protobuf wire format support, enough to edit the serialized
+// CompileOptionsProto and friends and to read HloSnapshot / HloModuleProto
+// fields without linking libprotobuf.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "hlo_test.h"
+
+enum {
+    PROTO_WIRE_VARINT = 0,
+    PROTO_WIRE_FIXED64 = 1,
+    PROTO_WIRE_BYTES = 2,
+    PROTO_WIRE_FIXED32 = 5,
+};
+
+
+// --- Append raw bytes, growing the buffer as needed ---
+int proto_append(struct proto_buf* buf, const void* data, size_t size) {
+    if (buf->size + size > buf->capacity) {
+        size_t capacity = buf->capacity ? buf->capacity : 64;
+        while (capacity < buf->size + size) capacity *= 2;
+        uint8_t* grown = (uint8_t*)realloc(buf->data, capacity);
+        if (grown == NULL) {
+            fprintf(stderr, "proto_append: out of memory (%zu bytes)\n", capacity);
+            return 1;
+        }
+        buf->data = grown;
+        buf->capacity = capacity;
+    }
+    if (size) memcpy(buf->data + buf->size, data, size);
+    buf->size += size;
+    return 0;
+}
+
+
+int proto_put_varint(struct proto_buf* buf, uint64_t value) {
+    uint8_t bytes[10];
+    size_t n = 0;
+    do {
+        bytes[n] = (uint8_t)(value & 0x7f);
+        value >>= 7;
+        if (value) bytes[n] |= 0x80;
+        n++;
+    } while (value);
+    return proto_append(buf, bytes, n);
+}
+
+
+static int proto_put_tag(struct proto_buf* buf, uint32_t field, int wire_type) {
+    return proto_put_varint(buf, ((uint64_t)field << 3) | (uint64_t)wire_type);
+}
+
+
+int proto_put_varint_field(struct proto_buf* buf, uint32_t field, uint64_t value) {
+    return proto_put_tag(buf, field, PROTO_WIRE_VARINT) || proto_put_varint(buf, value);
+}
+
+
+int proto_put_double_field(struct proto_buf* buf, uint32_t field, double value) {
+    uint64_t bits;
+    uint8_t bytes[8];
+    memcpy(&bits, &value, sizeof(bits));
+    for (int i = 0; i < 8; ++i) bytes[i] = (uint8_t)(bits >> (8 * i)); // Little endian on the wire
+    return proto_put_tag(buf, field, PROTO_WIRE_FIXED64) || proto_append(buf, bytes, sizeof(bytes));
+}
+
+
+int proto_put_bytes_field(struct proto_buf* buf, uint32_t field, const void* data, size_t size) {
+    return proto_put_tag(buf, field, PROTO_WIRE_BYTES) || proto_put_varint(buf, size) ||
+           proto_append(buf, data, size);
+}
+
+
+void proto_buf_free(struct proto_buf* buf) {
+    free(buf->data);
+    buf->data = NULL;
+    buf->size = 0;
+    buf->capacity = 0;
+}
+
+
+// --- Reading ---
+
+static int proto_read_varint(struct proto_reader* reader, uint64_t* value) {
+    uint64_t result = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        if (reader->pos >= reader->size) return 1;
+        uint8_t byte = reader->data[reader->pos++];
+        result |= (uint64_t)(byte & 0x7f) << shift;
+        if ((byte & 0x80) == 0) {
+            *value = result;
+            return 0;
+        }
+    }
+    return 1;
+}
+
+
+// --- Function to read the next field; returns 1 for a field, 0 at the end, -1 on malformed input ---
+// Varint and fixed values are returned in `value`, length-delimited fields
+// as a pointer into the reader's data.
+int proto_next_field(struct proto_reader* reader, struct proto_field* field) {
+    if (reader->pos >= reader->size) return 0;
+    uint64_t tag;
+    if (proto_read_varint(reader, &tag) != 0) return -1;
+    field->number = (uint32_t)(tag >> 3);
+    field->wire_type = (int)(tag & 7);
+    field->data = NULL;
+    field->size = 0;
+    field->value = 0;
+    switch (field->wire_type) {
+        case PROTO_WIRE_VARINT:
+            return proto_read_varint(reader, &field->value) == 0 ? 1 : -1;
+        case PROTO_WIRE_FIXED64:
+        case PROTO_WIRE_FIXED32: {
+            size_t width = field->wire_type == PROTO_WIRE_FIXED64 ? 8 : 4;
+            if (reader->size - reader->pos < width) return -1;
+            for (size_t i = 0; i < width; ++i) field->value |= (uint64_t)reader->data[reader->pos + i] << (8 * i);
+            reader->pos += width;
+            return 1;
+        }
+        case PROTO_WIRE_BYTES: {
+            uint64_t size;
+            if (proto_read_varint(reader, &size) != 0 || size > reader->size - reader->pos) return -1;
+            field->data = reader->data + reader->pos;
+            field->size = (size_t)size;
+            reader->pos += (size_t)size;
+            return 1;
+        }
+        default:
+            return -1; // Groups are not used by XLA protos
+    }
+}
+
+
+// --- Function to read one element of a repeated scalar field ---
+// Handles both packed (length-delimited) and unpacked encodings: call with
+// the field and an `index` cursor until it returns 0. `width` is 0 for
+// varints, 4 or 8 for fixed32/fixed64 (float/double).
+int proto_next_scalar(const struct proto_field* field, size_t* index, int width, uint64_t* value) {
+    if (field->wire_type != PROTO_WIRE_BYTES) {
+        if (*index > 0) return 0;
+        *index = 1;
+        *value = field->value;
+        return 1;
+    }
+    if (*index >= field->size) return 0;
+    if (width == 0) {
+        struct proto_reader reader = {field->data, field->size, *index};
+        if (proto_read_varint(&reader, value) != 0) return -1;
+        *index = reader.pos;
+        return 1;
+    }
+    if (field->size - *index < (size_t)width) return -1;
+    *value = 0;
+    for (int i = 0; i < width; ++i) *value |= (uint64_t)field->data[*index + i] << (8 * i);
+    *index += width;
+    return 1;
+}
@@ -0,0 +1,19 @@
+// RMS normalization over the last dimension in plain StableHLO, the reference
+// for ffi_rms_norm.mlir: y = x * rsqrt(mean(x * x) + 1e-6) * w
+module @rms_norm {
+  func.func public @main(%x: tensor<256x4096xf32>, %w: tensor<4096xf32>) -> tensor<256x4096xf32> {
+    %sq = stablehlo.multiply %x, %x : tensor<256x4096xf32>
+    %zero = stablehlo.constant dense<0.000000e+00> : tensor<f32>
+    %sum = stablehlo.reduce(%sq init: %zero) applies stablehlo.add across dimensions = [1] : (tensor<256x4096xf32>, tensor<f32>) -> tensor<256xf32>
+    %inv_n = stablehlo.constant dense<2.44140625e-04> : tensor<256xf32>
+    %mean = stablehlo.multiply %sum, %inv_n : tensor<256xf32>
+    %eps = stablehlo.constant dense<1.000000e-06> : tensor<256xf32>
+    %var = stablehlo.add %mean, %eps : tensor<256xf32>
+    %scale = stablehlo.rsqrt %var : tensor<256xf32>
+    %scale_b = stablehlo.broadcast_in_dim %scale, dims = [0] : (tensor<256xf32>) -> tensor<256x4096xf32>
+    %w_b = stablehlo.broadcast_in_dim %w, dims = [1] : (tensor<4096xf32>) -> tensor<256x4096xf32>
+    %xs = stablehlo.multiply %x, %scale_b : tensor<256x4096xf32>
+    %y = stablehlo.multiply %xs, %w_b : tensor<256x4096xf32>
+    return %y : tensor<256x4096xf32>
+  }
+}
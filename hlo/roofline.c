@@ -0,0 +1,644 @@
+// Roofline microbenchmarks of generated HLO kernels.
+//
+// roofline_generate writes one HLO text module per kernel and size:
+// elementwise add, reduce, dot, convolution, transpose and gather, all F32.
+// The top-level `make roofline` turns them into MLIR bytecode with
+// xla-translate, as `make run` does for the sample modules. The benchmark
+// measures the host's ceilings first: STREAM triad bandwidth and peak F32 FMA
+// throughput, both over all CPUs. Then it times every kernel and places it
+// under the roofline min(peak, intensity * bandwidth); kernels without
+// arithmetic (transpose, gather) are held against the bandwidth alone. The
+// results go to roofline.csv with a gnuplot script, roofline.gp, that plots
+// them against both ceilings.
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HAVE_X86_KERNELS 1
+#endif
+
+#include "hlo_test.h"
+
+#define ROOFLINE_MAX_THREADS 64
+#define ROOFLINE_STREAM_ELEMENTS (1 << 24) // Doubles per array, 128 MiB: well beyond the last-level cache
+#define ROOFLINE_STREAM_TRIALS 10 // Best of, as STREAM reports
+#define ROOFLINE_FMA_ITERATIONS (1 << 22) // Per thread and trial
+#define ROOFLINE_FAR_OFF 0.25 // Flag kernels below this fraction of their roof
+#define ROOFLINE_CONV_CHANNELS 64
+#define ROOFLINE_GATHER_ROWS 65536
+#define ROOFLINE_GATHER_WIDTH 128
+#define ROOFLINE_HLO_TEXT_SIZE 2048
+#define ROOFLINE_MAX_SIZES 6
+#define ROOFLINE_CSV_PATH "./roofline.csv"
+#define ROOFLINE_GNUPLOT_PATH "./roofline.gp"
+
+enum roofline_kind {
+    ROOFLINE_ELEMENTWISE,
+    ROOFLINE_REDUCE,
+    ROOFLINE_DOT,
+    ROOFLINE_CONVOLUTION,
+    ROOFLINE_TRANSPOSE,
+    ROOFLINE_GATHER,
+    NUM_ROOFLINE_KINDS
+};
+
+static const char* const roofline_kind_names[NUM_ROOFLINE_KINDS] = {
+    "elementwise", "reduce", "dot", "convolution", "transpose", "gather",
+};
+
+// Swept size per kind, 0-terminated.
+static const int64_t roofline_sizes[NUM_ROOFLINE_KINDS][ROOFLINE_MAX_SIZES] = {
+    {1 << 12, 1 << 16, 1 << 20, 1 << 24}, // Elements added
+    {1 << 12, 1 << 16, 1 << 20, 1 << 24}, // Elements summed
+    {64, 128, 256, 512, 1024}, // M of an MxM by MxM product
+    {16, 32, 64, 128}, // H = W of a 3x3, 64 to 64 channel convolution
+    {256, 512, 1024, 2048, 4096}, // M of an MxM transpose
+    {1 << 10, 1 << 12, 1 << 14, 1 << 16}, // Rows gathered from a 65536x128 table
+};
+
+
+// --- Kernels: HLO text, cost and parameters ---
+
+// FLOPs and the bytes every parameter and the result take, each counted once.
+static void roofline_cost(enum roofline_kind kind, int64_t n, double* flops, double* bytes) {
+    double c = ROOFLINE_CONV_CHANNELS;
+    switch (kind) {
+        case ROOFLINE_ELEMENTWISE:
+            *flops = (double)n;
+            *bytes = 12.0 * n;
+            break;
+        case ROOFLINE_REDUCE:
+            *flops = (double)n;
+            *bytes = 4.0 * n + 4.0;
+            break;
+        case ROOFLINE_DOT:
+            *flops = 2.0 * n * n * n;
+            *bytes = 12.0 * n * n;
+            break;
+        case ROOFLINE_CONVOLUTION:
+            *flops = 2.0 * n * n * c * c * 9.0;
+            *bytes = 4.0 * (2.0 * n * n * c + 9.0 * c * c);
+            break;
+        case ROOFLINE_TRANSPOSE:
+            *flops = 0.0;
+            *bytes = 8.0 * n * n;
+            break;
+        default:
+            *flops = 0.0;
+            *bytes = 8.0 * n * ROOFLINE_GATHER_WIDTH + 4.0 * n;
+            break;
+    }
+}
+
+
+static int render_roofline_hlo(enum roofline_kind kind, int64_t n, char* text, size_t size) {
+    long long s = (long long)n;
+    int c = ROOFLINE_CONV_CHANNELS;
+    int length = -1;
+    switch (kind) {
+        case ROOFLINE_ELEMENTWISE:
+            length = snprintf(text, size,
+                "HloModule elementwise_%1$lld\n\n"
+                "ENTRY main {\n"
+                "  x = f32[%1$lld]{0} parameter(0)\n"
+                "  y = f32[%1$lld]{0} parameter(1)\n"
+                "  ROOT sum = f32[%1$lld]{0} add(x, y)\n"
+                "}\n",
+                s);
+            break;
+        case ROOFLINE_REDUCE:
+            length = snprintf(text, size,
+                "HloModule reduce_%1$lld\n\n"
+                "add {\n"
+                "  a = f32[] parameter(0)\n"
+                "  b = f32[] parameter(1)\n"
+                "  ROOT sum = f32[] add(a, b)\n"
+                "}\n\n"
+                "ENTRY main {\n"
+                "  x = f32[%1$lld]{0} parameter(0)\n"
+                "  zero = f32[] constant(0)\n"
+                "  ROOT total = f32[] reduce(x, zero), dimensions={0}, to_apply=add\n"
+                "}\n",
+                s);
+            break;
+        case ROOFLINE_DOT:
+            length = snprintf(text, size,
+                "HloModule dot_%1$lld\n\n"
+                "ENTRY main {\n"
+                "  a = f32[%1$lld,%1$lld]{1,0} parameter(0)\n"
+                "  b = f32[%1$lld,%1$lld]{1,0} parameter(1)\n"
+                "  ROOT product = f32[%1$lld,%1$lld]{1,0} dot(a, b), lhs_contracting_dims={1}, "
+                "rhs_contracting_dims={0}\n"
+                "}\n",
+                s);
+            break;
+        case ROOFLINE_CONVOLUTION:
+            length = snprintf(text, size,
+                "HloModule convolution_%1$lld\n\n"
+                "ENTRY main {\n"
+                "  x = f32[1,%1$lld,%1$lld,%2$d]{3,2,1,0} parameter(0)\n"
+                "  k = f32[3,3,%2$d,%2$d]{3,2,1,0} parameter(1)\n"
+                "  ROOT y = f32[1,%1$lld,%1$lld,%2$d]{3,2,1,0} convolution(x, k), window={size=3x3 pad=1_1x1_1}, "
+                "dim_labels=b01f_01io->b01f\n"
+                "}\n",
+                s, c);
+            break;
+        case ROOFLINE_TRANSPOSE:
+            length = snprintf(text, size,
+                "HloModule transpose_%1$lld\n\n"
+                "ENTRY main {\n"
+                "  x = f32[%1$lld,%1$lld]{1,0} parameter(0)\n"
+                "  ROOT t = f32[%1$lld,%1$lld]{1,0} transpose(x), dimensions={1,0}\n"
+                "}\n",
+                s);
+            break;
+        default:
+            length = snprintf(text, size,
+                "HloModule gather_%1$lld\n\n"
+                "ENTRY main {\n"
+                "  table = f32[%2$d,%3$d]{1,0} parameter(0)\n"
+                "  rows = s32[%1$lld,1]{1,0} parameter(1)\n"
+                "  ROOT g = f32[%1$lld,%3$d]{1,0} gather(table, rows), offset_dims={1}, collapsed_slice_dims={0}, "
+                "start_index_map={0}, index_vector_dim=1, slice_sizes={1,%3$d}\n"
+                "}\n",
+                s, ROOFLINE_GATHER_ROWS, ROOFLINE_GATHER_WIDTH);
+            break;
+    }
+    return length > 0 && (size_t)length < size ? length : -1;
+}
+
+
+// Parameter shapes of a kernel; returns how many there are.
+static size_t roofline_params(enum roofline_kind kind, int64_t n, struct host_tensor* params) {
+    memset(params, 0, 2 * sizeof(struct host_tensor));
+    size_t count = 1;
+    params[0].type = params[1].type = PJRT_Buffer_Type_F32;
+    switch (kind) {
+        case ROOFLINE_ELEMENTWISE:
+            count = 2;
+            params[0].num_dims = params[1].num_dims = 1;
+            params[0].dims[0] = params[1].dims[0] = n;
+            break;
+        case ROOFLINE_REDUCE:
+            params[0].num_dims = 1;
+            params[0].dims[0] = n;
+            break;
+        case ROOFLINE_DOT:
+            count = 2;
+            params[0].num_dims = params[1].num_dims = 2;
+            params[0].dims[0] = params[0].dims[1] = params[1].dims[0] = params[1].dims[1] = n;
+            break;
+        case ROOFLINE_CONVOLUTION: {
+            static const int64_t kernel_dims[4] = {3, 3, ROOFLINE_CONV_CHANNELS, ROOFLINE_CONV_CHANNELS};
+            int64_t input_dims[4] = {1, n, n, ROOFLINE_CONV_CHANNELS};
+            count = 2;
+            params[0].num_dims = params[1].num_dims = 4;
+            memcpy(params[0].dims, input_dims, sizeof(input_dims));
+            memcpy(params[1].dims, kernel_dims, sizeof(kernel_dims));
+            break;
+        }
+        case ROOFLINE_TRANSPOSE:
+            params[0].num_dims = 2;
+            params[0].dims[0] = params[0].dims[1] = n;
+            break;
+        default:
+            count = 2;
+            params[0].num_dims = params[1].num_dims = 2;
+            params[0].dims[0] = ROOFLINE_GATHER_ROWS;
+            params[0].dims[1] = ROOFLINE_GATHER_WIDTH;
+            params[1].type = PJRT_Buffer_Type_S32;
+            params[1].dims[0] = n;
+            params[1].dims[1] = 1;
+            break;
+    }
+    for (size_t p = 0; p < count; ++p) {
+        params[p].size = buffer_type_size(params[p].type);
+        for (size_t d = 0; d < params[p].num_dims; ++d) params[p].size *= (size_t)params[p].dims[d];
+    }
+    return count;
+}
+
+
+// --- Function to write the HLO text of every kernel to DIR/<kind>.<size>.hlo.txt ---
+int roofline_generate(const char* dir) {
+    if (mkdir(dir, 0777) != 0 && errno != EEXIST) {
+        fprintf(stderr, "Could not create '%s': %s\n", dir, strerror(errno));
+        return 1;
+    }
+    size_t written = 0;
+    for (int k = 0; k < NUM_ROOFLINE_KINDS; ++k) {
+        for (int s = 0; s < ROOFLINE_MAX_SIZES && roofline_sizes[k][s] != 0; ++s) {
+            char text[ROOFLINE_HLO_TEXT_SIZE];
+            char path[1024];
+            int length = render_roofline_hlo((enum roofline_kind)k, roofline_sizes[k][s], text, sizeof(text));
+            snprintf(path, sizeof(path), "%s/%s.%lld.hlo.txt", dir, roofline_kind_names[k],
+                     (long long)roofline_sizes[k][s]);
+            FILE* file = length > 0 ? fopen(path, "w") : NULL;
+            if (file == NULL || fwrite(text, 1, (size_t)length, file) != (size_t)length) {
+                fprintf(stderr, "Could not write '%s'\n", path);
+                if (file != NULL) fclose(file);
+                return 1;
+            }
+            fclose(file);
+            written++;
+        }
+    }
+    printf("Wrote %zu HLO module(s) to %s.\n", written, dir);
+    return 0;
+}
+
+
+// --- Host ceilings ---
+
+// Holds the threads of a measurement until all of them have started.
+struct ceiling_gate {
+    pthread_mutex_t lock;
+    pthread_cond_t opened;
+    int open;
+    double start; // When the gate opened
+};
+
+struct ceiling_job {
+    struct ceiling_gate* gate;
+    int opens_gate; // Set on the last job, which the calling thread runs once every thread has been created
+    double* a;
+    double* b;
+    double* c;
+    size_t begin;
+    size_t end;
+    int init; // First touch instead of the triad, so pages land on the node of the thread using them
+    double (*fma_kernel)(long iterations);
+    double result; // Stored so the FMA chains are not optimized away
+};
+
+
+static double fma_scalar(long iterations) {
+    float acc[8] = {1, 2, 3, 4, 5, 6, 7, 8};
+    const float m = 0.999999f, c = 1e-6f;
+    for (long i = 0; i < iterations; ++i) {
+        for (int k = 0; k < 8; ++k) acc[k] = acc[k] * m + c;
+    }
+    return acc[0] + acc[1] + acc[2] + acc[3] + acc[4] + acc[5] + acc[6] + acc[7];
+}
+
+
+#ifdef HAVE_X86_KERNELS
+// 12 independent chains cover two FMA ports at a latency of up to 6 cycles.
+__attribute__((target("avx2,fma")))
+static double fma_avx2(long iterations) {
+    __m256 acc[12];
+    const __m256 m = _mm256_set1_ps(0.999999f), c = _mm256_set1_ps(1e-6f);
+    for (int k = 0; k < 12; ++k) acc[k] = _mm256_set1_ps((float)k);
+    for (long i = 0; i < iterations; ++i) {
+        for (int k = 0; k < 12; ++k) acc[k] = _mm256_fmadd_ps(acc[k], m, c);
+    }
+    __m256 sum = acc[0];
+    for (int k = 1; k < 12; ++k) sum = _mm256_add_ps(sum, acc[k]);
+    float lanes[8];
+    _mm256_storeu_ps(lanes, sum);
+    return lanes[0] + lanes[7];
+}
+
+
+__attribute__((target("avx512f")))
+static double fma_avx512(long iterations) {
+    __m512 acc[12];
+    const __m512 m = _mm512_set1_ps(0.999999f), c = _mm512_set1_ps(1e-6f);
+    for (int k = 0; k < 12; ++k) acc[k] = _mm512_set1_ps((float)k);
+    for (long i = 0; i < iterations; ++i) {
+        for (int k = 0; k < 12; ++k) acc[k] = _mm512_fmadd_ps(acc[k], m, c);
+    }
+    __m512 sum = acc[0];
+    for (int k = 1; k < 12; ++k) sum = _mm512_add_ps(sum, acc[k]);
+    return _mm512_reduce_add_ps(sum);
+}
+#endif
+
+
+// FLOPs per iteration of each kernel: chains times lanes times 2 for the multiply-add.
+static void select_fma_kernel(double (**kernel)(long), double* flops_per_iteration, const char** name) {
+    *kernel = fma_scalar;
+    *flops_per_iteration = 8 * 2;
+    *name = "scalar";
+#ifdef HAVE_X86_KERNELS
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+        *kernel = fma_avx2;
+        *flops_per_iteration = 12 * 8 * 2;
+        *name = "AVX2 FMA";
+    }
+    if (__builtin_cpu_supports("avx512f")) {
+        *kernel = fma_avx512;
+        *flops_per_iteration = 12 * 16 * 2;
+        *name = "AVX-512 FMA";
+    }
+#endif
+}
+
+
+static void* ceiling_thread(void* arg) {
+    struct ceiling_job* job = (struct ceiling_job*)arg;
+    struct ceiling_gate* gate = job->gate;
+    pthread_mutex_lock(&gate->lock);
+    if (job->opens_gate) {
+        gate->open = 1;
+        gate->start = now_seconds();
+        pthread_cond_broadcast(&gate->opened);
+    }
+    while (!gate->open) pthread_cond_wait(&gate->opened, &gate->lock);
+    pthread_mutex_unlock(&gate->lock);
+    if (job->fma_kernel != NULL) {
+        job->result = job->fma_kernel(ROOFLINE_FMA_ITERATIONS);
+    } else if (job->init) {
+        for (size_t i = job->begin; i < job->end; ++i) {
+            job->a[i] = 0.0;
+            job->b[i] = 1.0;
+            job->c[i] = 2.0;
+        }
+    } else {
+        double* a = job->a;
+        const double* b = job->b;
+        const double* c = job->c;
+        for (size_t i = job->begin; i < job->end; ++i) a[i] = b[i] + 3.0 * c[i];
+    }
+    return NULL;
+}
+
+
+// Runs the jobs on one thread each; the calling thread takes the last. The clock starts once every thread
+// has been created. Returns the elapsed seconds, or -1 when a thread could not be started: its job would
+// have run serially and lowered the ceiling.
+static double run_ceiling_jobs(struct ceiling_job* jobs, size_t threads) {
+    struct ceiling_gate gate;
+    pthread_mutex_init(&gate.lock, NULL);
+    pthread_cond_init(&gate.opened, NULL);
+    gate.open = 0;
+    gate.start = 0.0;
+    for (size_t t = 0; t < threads; ++t) {
+        jobs[t].gate = &gate;
+        jobs[t].opens_gate = t + 1 == threads;
+    }
+    int rc = run_parallel_jobs(ceiling_thread, jobs, sizeof(jobs[0]), threads);
+    double elapsed = now_seconds() - gate.start;
+    pthread_cond_destroy(&gate.opened);
+    pthread_mutex_destroy(&gate.lock);
+    if (rc != 0) {
+        fprintf(stderr, "Could not start %zu threads for the roofline ceilings.\n", threads);
+        return -1.0;
+    }
+    return elapsed;
+}
+
+
+static size_t ceiling_threads(void) {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    size_t threads = cpus > 0 ? (size_t)cpus : 1;
+    return threads > ROOFLINE_MAX_THREADS ? ROOFLINE_MAX_THREADS : threads;
+}
+
+
+// --- Function to measure STREAM triad bandwidth in GB/s, over all CPUs ---
+static double measure_stream_triad(size_t threads) {
+    size_t n = ROOFLINE_STREAM_ELEMENTS;
+    double* a = (double*)malloc(n * sizeof(double));
+    double* b = (double*)malloc(n * sizeof(double));
+    double* c = (double*)malloc(n * sizeof(double));
+    double best = 0.0;
+    if (a != NULL && b != NULL && c != NULL) {
+        struct ceiling_job jobs[ROOFLINE_MAX_THREADS];
+        memset(jobs, 0, sizeof(jobs));
+        for (size_t t = 0; t < threads; ++t) {
+            jobs[t].a = a;
+            jobs[t].b = b;
+            jobs[t].c = c;
+            jobs[t].begin = n * t / threads;
+            jobs[t].end = n * (t + 1) / threads;
+            jobs[t].init = 1;
+        }
+        int trial = run_ceiling_jobs(jobs, threads) < 0.0 ? ROOFLINE_STREAM_TRIALS : 0;
+        for (size_t t = 0; t < threads; ++t) jobs[t].init = 0;
+        for (; trial < ROOFLINE_STREAM_TRIALS; ++trial) {
+            double elapsed = run_ceiling_jobs(jobs, threads);
+            if (elapsed < 0.0) {
+                best = 0.0; // Not a measurement over all threads
+                break;
+            }
+            double gbs = 3.0 * sizeof(double) * n / elapsed * 1e-9;
+            if (gbs > best) best = gbs;
+        }
+    }
+    free(a);
+    free(b);
+    free(c);
+    return best;
+}
+
+
+// --- Function to measure peak F32 FMA throughput in GFLOP/s, over all CPUs ---
+static double measure_peak_flops(size_t threads, const char** kernel_name) {
+    double (*kernel)(long);
+    double flops_per_iteration;
+    select_fma_kernel(&kernel, &flops_per_iteration, kernel_name);
+    struct ceiling_job jobs[ROOFLINE_MAX_THREADS];
+    memset(jobs, 0, sizeof(jobs));
+    for (size_t t = 0; t < threads; ++t) jobs[t].fma_kernel = kernel;
+    double best = 0.0;
+    for (int trial = 0; trial < ROOFLINE_STREAM_TRIALS; ++trial) {
+        double elapsed = run_ceiling_jobs(jobs, threads);
+        if (elapsed < 0.0) return 0.0; // Not a measurement over all threads
+        double gflops = flops_per_iteration * ROOFLINE_FMA_ITERATIONS * threads / elapsed * 1e-9;
+        if (gflops > best) best = gflops;
+    }
+    return best;
+}
+
+
+// --- Kernel timing ---
+
+static PJRT_Buffer** create_roofline_inputs(const PJRT_Api* api, PJRT_Client* client, PJRT_Device* device,
+                                            struct host_tensor* params, size_t num_params) {
+    PJRT_Buffer** buffers = (PJRT_Buffer**)calloc(num_params, sizeof(PJRT_Buffer*));
+    if (buffers == NULL) return NULL;
+    for (size_t p = 0; p < num_params; ++p) {
+        params[p].data = malloc(params[p].size);
+        if (params[p].data == NULL) break;
+        if (params[p].type == PJRT_Buffer_Type_S32) {
+            // Gather rows spread over the whole table, all in range.
+            int32_t* rows = (int32_t*)params[p].data;
+            for (size_t i = 0; i < params[p].size / sizeof(int32_t); ++i) {
+                rows[i] = (int32_t)((i * 2654435761u) % ROOFLINE_GATHER_ROWS);
+            }
+        } else {
+            fill_synthetic(&params[p], 1, p);
+        }
+        buffers[p] = create_buffer_from_host(api, client, device, params[p].data, params[p].type, params[p].dims,
+                                             params[p].num_dims, "Roofline input");
+        free(params[p].data);
+        params[p].data = NULL;
+        if (buffers[p] == NULL) break;
+    }
+    for (size_t p = 0; p < num_params; ++p) {
+        if (buffers[p] == NULL) {
+            destroy_buffers(api, buffers, num_params, "PJRT_Buffer_Destroy (roofline input)");
+            return NULL;
+        }
+    }
+    return buffers;
+}
+
+
+// Compiles a kernel's module. Returns 0 on success, 1 when the module exists but cannot be read or
+// compiled and 2 when `make roofline` has not produced it.
+static int load_roofline_kernel(const PJRT_Api* api, PJRT_Client* client, const char* dir, const char* name,
+                                const struct file_data* compile_options, PJRT_LoadedExecutable** executable) {
+    static const char* const suffixes[] = {".mlir.bc", ".mlir"};
+    *executable = NULL;
+    for (size_t i = 0; i < sizeof(suffixes) / sizeof(suffixes[0]); ++i) {
+        char path[1024];
+        snprintf(path, sizeof(path), "%s/%s%s", dir, name, suffixes[i]);
+        if (access(path, R_OK) != 0) continue;
+        struct file_data code = {NULL, 0};
+        if (read_file_to_buffer(path, &code) != 0) return 1;
+        *executable = compile_program(api, client, &code, "mlir", compile_options);
+        free_file_data(&code);
+        return *executable == NULL;
+    }
+    return 2;
+}
+
+
+static void write_roofline_gnuplot(double bandwidth_gbs, double peak_gflops) {
+    FILE* gp = fopen(ROOFLINE_GNUPLOT_PATH, "w");
+    if (gp == NULL) {
+        fprintf(stderr, "Could not open '%s'\n", ROOFLINE_GNUPLOT_PATH);
+        return;
+    }
+    fprintf(gp,
+        "# Plots %1$s: gnuplot %2$s writes roofline.svg and roofline_bandwidth.svg.\n"
+        "bw = %3$.3f # STREAM triad, GB/s\n"
+        "peak = %4$.3f # F32 FMA, GFLOP/s\n"
+        "roof(x) = x * bw < peak ? x * bw : peak\n"
+        "set datafile separator ','\n"
+        "set terminal svg size 960,640\n"
+        "set grid\n"
+        "set key left top\n"
+        "set output 'roofline.svg'\n"
+        "set logscale xy\n"
+        "set xlabel 'Arithmetic intensity (FLOP/byte)'\n"
+        "set ylabel 'GFLOP/s'\n"
+        "set title 'XLA CPU kernels against the host roofline'\n"
+        "plot [0.01:1000] roof(x) title sprintf('min(%%.0f GFLOP/s, %%.1f GB/s x intensity)', peak, bw) lw 2, \\\n"
+        "    for [k in 'elementwise reduce dot convolution'] '%1$s' every ::1 \\\n"
+        "        using (strcol(1) eq k ? $8 : 1/0):6 title k with linespoints pt 7\n"
+        "set output 'roofline_bandwidth.svg'\n"
+        "set logscale x\n"
+        "unset logscale y\n"
+        "set xlabel 'Size'\n"
+        "set ylabel 'GB/s'\n"
+        "set title 'Bandwidth of memory-bound kernels against STREAM triad'\n"
+        "plot bw title sprintf('STREAM triad %%.1f GB/s', bw) lw 2, \\\n"
+        "    for [k in 'elementwise reduce transpose gather'] '%1$s' every ::1 \\\n"
+        "        using (strcol(1) eq k ? $2 : 1/0):7 title k with linespoints pt 7\n",
+        ROOFLINE_CSV_PATH, ROOFLINE_GNUPLOT_PATH, bandwidth_gbs, peak_gflops);
+    fclose(gp);
+}
+
+
+// --- Function to time the generated kernels and place them under the host's roofline ---
+int run_roofline_benchmark(const PJRT_Api* api, PJRT_Client* client, PJRT_Device* device, const char* dir,
+                           int iterations) {
+    int rc = 1;
+    struct file_data compile_options = {NULL, 0};
+    FILE* csv = NULL;
+    size_t measured = 0, missing = 0, failed = 0, far_off = 0;
+    if (read_file_to_buffer("./compile_options.0.pb", &compile_options) != 0) return 1;
+
+    size_t threads = ceiling_threads();
+    const char* fma_name = NULL;
+    printf("\n--- Roofline: kernels from %s, %d iteration(s), ceilings over %zu thread(s) ---\n", dir, iterations,
+           threads);
+    double bandwidth = measure_stream_triad(threads);
+    double peak = measure_peak_flops(threads, &fma_name);
+    printf("  STREAM triad %.1f GB/s, peak F32 %.1f GFLOP/s (%s); ridge at %.1f FLOP/byte\n", bandwidth, peak,
+           fma_name, bandwidth > 0.0 ? peak / bandwidth : 0.0);
+    if (bandwidth <= 0.0 || peak <= 0.0) goto cleanup_roofline;
+
+    csv = fopen(ROOFLINE_CSV_PATH, "w");
+    if (csv == NULL) {
+        fprintf(stderr, "Could not open '%s'; printing the table only.\n", ROOFLINE_CSV_PATH);
+    } else {
+        fprintf(csv, "kernel,size,flops,bytes,median_ms,gflops,gbs,intensity,roof,fraction_of_roof\n");
+    }
+    printf("  %-12s %8s %10s %10s %9s %10s %10s %8s\n", "kernel", "size", "median ms", "GFLOP/s", "GB/s", "FLOP/B",
+           "roof", "of roof");
+    for (int k = 0; k < NUM_ROOFLINE_KINDS; ++k) {
+        for (int s = 0; s < ROOFLINE_MAX_SIZES && roofline_sizes[k][s] != 0; ++s) {
+            enum roofline_kind kind = (enum roofline_kind)k;
+            int64_t n = roofline_sizes[k][s];
+            char name[64];
+            snprintf(name, sizeof(name), "%s.%lld", roofline_kind_names[k], (long long)n);
+            PJRT_LoadedExecutable* executable = NULL;
+            int load_rc = load_roofline_kernel(api, client, dir, name, &compile_options, &executable);
+            if (load_rc == 2) {
+                missing++;
+                continue;
+            }
+            if (load_rc != 0) {
+                printf("  %-12s %8lld %10s\n", roofline_kind_names[k], (long long)n, "failed to compile");
+                failed++;
+                continue;
+            }
+            struct host_tensor params[2];
+            size_t num_params = roofline_params(kind, n, params);
+            PJRT_Buffer** inputs = create_roofline_inputs(api, client, device, params, num_params);
+            double median_s = 0.0;
+            int run_rc = inputs == NULL ||
+                         benchmark_executable(api, executable, inputs, num_params, iterations, &median_s) != 0;
+            destroy_buffers(api, inputs, num_params, "PJRT_Buffer_Destroy (roofline input)");
+            destroy_loaded_executable(api, executable);
+            if (run_rc != 0) goto cleanup_roofline;
+
+            double flops, bytes;
+            roofline_cost(kind, n, &flops, &bytes);
+            double gflops = flops / median_s * 1e-9;
+            double gbs = bytes / median_s * 1e-9;
+            double intensity = flops / bytes;
+            // Without arithmetic the roof is the bandwidth; the fraction is then of STREAM.
+            double roof = flops > 0.0 ? (intensity * bandwidth < peak ? intensity * bandwidth : peak) : bandwidth;
+            double fraction = (flops > 0.0 ? gflops : gbs) / roof;
+            int flagged = fraction < ROOFLINE_FAR_OFF;
+            far_off += flagged;
+            measured++;
+            printf("  %-12s %8lld %10.3f %10.2f %9.2f %10.3f %10.1f %7.1f%%%s\n", roofline_kind_names[k], (long long)n,
+                   median_s * 1e3, gflops, gbs, intensity, roof, fraction * 100.0, flagged ? "  far off" : "");
+            if (csv != NULL) {
+                fprintf(csv, "%s,%lld,%.0f,%.0f,%.6f,%.4f,%.4f,%.6f,%.4f,%.4f\n", roofline_kind_names[k],
+                        (long long)n, flops, bytes, median_s * 1e3, gflops, gbs, intensity, roof, fraction);
+            }
+        }
+    }
+    if (missing > 0) {
+        printf("  %zu kernel(s) not found in %s; `make roofline` in the top directory generates them.\n", missing,
+               dir);
+    }
+    if (failed > 0) printf("  %zu kernel(s) in %s failed to compile.\n", failed, dir);
+    if (measured == 0) goto cleanup_roofline;
+    printf("  %zu of %zu kernel(s) below %.0f%% of their roof (roof: GFLOP/s, GB/s without FLOPs).\n", far_off,
+           measured, ROOFLINE_FAR_OFF * 100.0);
+    if (csv != NULL) {
+        write_roofline_gnuplot(bandwidth, peak);
+        printf("Wrote %s and %s.\n", ROOFLINE_CSV_PATH, ROOFLINE_GNUPLOT_PATH);
+    }
+    rc = failed > 0;
+
+cleanup_roofline:
+    if (csv != NULL) fclose(csv);
+    free_file_data(&compile_options);
+    return rc;
+}
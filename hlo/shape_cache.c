@@ -0,0 +1,294 @@
+// Executable cache keyed by shape bucket.
+//
+// A shape_program renders the StableHLO text of one computation for any
+// input shape. The cache rounds the chosen dimensions of each request up to
+// the next power of two, compiles one executable per bucket on first use,
+// pads the input with zeros to the bucket shape and slices the valid region
+// out of the output. With bucketing off it keys by the exact shape, which is
+// what variable-shape traffic costs without the cache.
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "hlo_test.h"
+
+#define SHAPE_PROGRAM_TEXT_SIZE 8192
+#define SHAPE_CACHE_MIN_BUCKET 8
+
+struct shape_program {
+    const char* name;
+    size_t num_dims; // Rank of the single f32 input and of the output
+    int bucketed[HOST_TENSOR_MAX_DIMS]; // Dimensions rounded up to a power of two
+    int64_t max_dims[HOST_TENSOR_MAX_DIMS]; // Largest request shape the benchmark sends
+    int (*render)(const int64_t* dims, size_t num_dims, char* text, size_t size);
+    float (*reference)(float x); // Elementwise host reference
+};
+
+struct shape_cache_entry {
+    int64_t dims[HOST_TENSOR_MAX_DIMS];
+    PJRT_LoadedExecutable* executable;
+    uint64_t hits;
+    struct shape_cache_entry* next;
+};
+
+
+// --- GELU, tanh approximation: 0.5 * x * (1 + tanh(sqrt(2 / pi) * (x + 0.044715 * x^3))) ---
+static int render_gelu(const int64_t* dims, size_t num_dims, char* text, size_t size) {
+    char type[64] = "tensor<";
+    for (size_t i = 0; i < num_dims; ++i) {
+        snprintf(type + strlen(type), sizeof(type) - strlen(type), "%ldx", (long)dims[i]);
+    }
+    strncat(type, "f32>", sizeof(type) - strlen(type) - 1);
+    int length = snprintf(text, size,
+        "module @gelu {\n"
+        "  func.func public @main(%%x: %1$s) -> %1$s {\n"
+        "    %%half = stablehlo.constant dense<5.000000e-01> : %1$s\n"
+        "    %%one = stablehlo.constant dense<1.000000e+00> : %1$s\n"
+        "    %%c = stablehlo.constant dense<0.797884583> : %1$s\n"
+        "    %%k = stablehlo.constant dense<4.471500e-02> : %1$s\n"
+        "    %%x2 = stablehlo.multiply %%x, %%x : %1$s\n"
+        "    %%x3 = stablehlo.multiply %%x2, %%x : %1$s\n"
+        "    %%kx3 = stablehlo.multiply %%k, %%x3 : %1$s\n"
+        "    %%inner = stablehlo.add %%x, %%kx3 : %1$s\n"
+        "    %%arg = stablehlo.multiply %%c, %%inner : %1$s\n"
+        "    %%t = stablehlo.tanh %%arg : %1$s\n"
+        "    %%onept = stablehlo.add %%one, %%t : %1$s\n"
+        "    %%hx = stablehlo.multiply %%half, %%x : %1$s\n"
+        "    %%y = stablehlo.multiply %%hx, %%onept : %1$s\n"
+        "    return %%y : %1$s\n"
+        "  }\n"
+        "}\n",
+        type);
+    return length > 0 && (size_t)length < size ? length : -1;
+}
+
+static float gelu_reference(float x) {
+    return 0.5f * x * (1.0f + tanhf(0.797884583f * (x + 0.044715f * x * x * x)));
+}
+
+// [batch, sequence] activations with both dimensions bucketed.
+static const struct shape_program gelu_program = {
+    .name = "gelu",
+    .num_dims = 2,
+    .bucketed = {1, 1},
+    .max_dims = {64, 512},
+    .render = render_gelu,
+    .reference = gelu_reference,
+};
+
+
+static int64_t element_count(const int64_t* dims, size_t num_dims) {
+    int64_t count = 1;
+    for (size_t i = 0; i < num_dims; ++i) count *= dims[i];
+    return count;
+}
+
+
+void shape_cache_init(struct shape_cache* cache, const PJRT_Api* api, PJRT_Client* client,
+                      const struct shape_program* program, const struct file_data* compile_options,
+                      int bucketing) {
+    memset(cache, 0, sizeof(*cache));
+    cache->api = api;
+    cache->client = client;
+    cache->program = program;
+    cache->compile_options = compile_options;
+    cache->bucketing = bucketing;
+}
+
+
+// --- Function to round a request shape up to its bucket ---
+void shape_cache_bucket(const struct shape_cache* cache, const int64_t* dims, int64_t* bucket_dims) {
+    for (size_t i = 0; i < cache->program->num_dims; ++i) {
+        bucket_dims[i] = dims[i];
+        if (!cache->bucketing || !cache->program->bucketed[i]) continue;
+        int64_t bucket = SHAPE_CACHE_MIN_BUCKET;
+        while (bucket < dims[i]) bucket <<= 1;
+        bucket_dims[i] = bucket;
+    }
+}
+
+
+// --- Function to find or compile the executable for a bucket ---
+PJRT_LoadedExecutable* shape_cache_get(struct shape_cache* cache, const int64_t* bucket_dims) {
+    size_t num_dims = cache->program->num_dims;
+    cache->lookups++;
+    for (struct shape_cache_entry* entry = cache->entries; entry != NULL; entry = entry->next) {
+        if (memcmp(entry->dims, bucket_dims, num_dims * sizeof(int64_t)) == 0) {
+            entry->hits++;
+            cache->hits++;
+            return entry->executable;
+        }
+    }
+
+    struct shape_cache_entry* entry = (struct shape_cache_entry*)calloc(1, sizeof(*entry));
+    char* text = (char*)malloc(SHAPE_PROGRAM_TEXT_SIZE);
+    if (entry == NULL || text == NULL) {
+        fprintf(stderr, "Failed to allocate shape cache entry.\n");
+        free(entry);
+        free(text);
+        return NULL;
+    }
+    int length = cache->program->render(bucket_dims, num_dims, text, SHAPE_PROGRAM_TEXT_SIZE);
+    if (length < 0) {
+        fprintf(stderr, "Failed to render program '%s'.\n", cache->program->name);
+        free(entry);
+        free(text);
+        return NULL;
+    }
+    struct file_data code = {text, (size_t)length};
+    double start = now_seconds();
+    entry->executable = compile_program(cache->api, cache->client, &code, "mlir", cache->compile_options);
+    cache->compile_s += now_seconds() - start;
+    free(text);
+    if (entry->executable == NULL) {
+        free(entry);
+        return NULL;
+    }
+    cache->compiles++;
+    memcpy(entry->dims, bucket_dims, num_dims * sizeof(int64_t));
+    entry->next = cache->entries;
+    cache->entries = entry;
+    return entry->executable;
+}
+
+
+// --- Function to run one request of any shape through the cache ---
+// `input` and `output` hold element_count(dims) floats.
+int shape_cache_run(struct shape_cache* cache, PJRT_Device* device, const float* input, const int64_t* dims,
+                    float* output) {
+    const PJRT_Api* api = cache->api;
+    size_t num_dims = cache->program->num_dims;
+    int64_t bucket_dims[HOST_TENSOR_MAX_DIMS];
+    shape_cache_bucket(cache, dims, bucket_dims);
+    PJRT_LoadedExecutable* executable = shape_cache_get(cache, bucket_dims);
+    if (executable == NULL) return 1;
+
+    int64_t valid = element_count(dims, num_dims);
+    int64_t padded = element_count(bucket_dims, num_dims);
+    cache->valid_elements += valid;
+    cache->padded_elements += padded;
+    const float* staging = input;
+    if (padded != valid) {
+        if ((size_t)padded > cache->staging_size) {
+            free(cache->staging);
+            cache->staging = (float*)malloc(padded * sizeof(float));
+            cache->staging_size = cache->staging ? (size_t)padded : 0;
+            if (cache->staging == NULL) {
+                fprintf(stderr, "Failed to allocate padding buffer.\n");
+                return 1;
+            }
+        }
+        memset(cache->staging, 0, padded * sizeof(float));
+        copy_box(cache->staging, bucket_dims, input, dims, dims, num_dims, sizeof(float));
+        staging = cache->staging;
+    }
+
+    PJRT_Buffer* buffer = create_buffer_from_host(api, cache->client, device, (void*)staging, PJRT_Buffer_Type_F32,
+                                                  bucket_dims, num_dims, "Bucketed input");
+    if (buffer == NULL) return 1;
+    struct host_tensor* outputs = NULL;
+    size_t num_outputs = 0;
+    int rc = execute_to_host(api, executable, &buffer, 1, &outputs, &num_outputs);
+    destroy_buffer(api, buffer, "PJRT_Buffer_Destroy (bucketed input)");
+    if (rc != 0) return 1;
+    if (num_outputs != 1 || outputs[0].type != PJRT_Buffer_Type_F32 || outputs[0].num_dims != num_dims ||
+        memcmp(outputs[0].dims, bucket_dims, num_dims * sizeof(int64_t)) != 0) {
+        fprintf(stderr, "Unexpected output of the '%s' bucket executable.\n", cache->program->name);
+        free_host_tensors(outputs, num_outputs);
+        return 1;
+    }
+    copy_box(output, dims, outputs[0].data, bucket_dims, dims, num_dims, sizeof(float));
+    free_host_tensors(outputs, num_outputs);
+    return 0;
+}
+
+
+void shape_cache_destroy(struct shape_cache* cache) {
+    struct shape_cache_entry* entry = cache->entries;
+    while (entry != NULL) {
+        struct shape_cache_entry* next = entry->next;
+        destroy_loaded_executable(cache->api, entry->executable);
+        free(entry);
+        entry = next;
+    }
+    cache->entries = NULL;
+    free(cache->staging);
+    cache->staging = NULL;
+    cache->staging_size = 0;
+}
+
+
+// --- Function to compare exact-shape and bucketed caching on variable-shape traffic ---
+// Both caches see the same request shapes; every output is checked against
+// the host reference on the valid region.
+int run_shape_cache_benchmark(const PJRT_Api* api, PJRT_Client* client, PJRT_Device* device,
+                              long requests, double tolerance) {
+    static const char* const cache_names[] = {"exact shape", "pow2 buckets"};
+    const struct shape_program* program = &gelu_program;
+    size_t num_dims = program->num_dims;
+    double check_tolerance = tolerance > 1e-4 ? tolerance : 1e-4; // tanh differs from libm
+    int rc = 1;
+    struct file_data compile_options = {NULL, 0};
+    int64_t max_elements = element_count(program->max_dims, num_dims);
+    float* input = (float*)malloc(max_elements * sizeof(float));
+    float* output = (float*)malloc(max_elements * sizeof(float));
+    double* latencies = (double*)malloc(requests * sizeof(double));
+
+    printf("\n--- Shape-bucketed executable cache: %s (%ld requests) ---\n", program->name, requests);
+    if (input == NULL || output == NULL || latencies == NULL) goto cleanup_shape_cache;
+    if (read_file_to_buffer("./compile_options.0.pb", &compile_options) != 0) goto cleanup_shape_cache;
+
+    printf("  %-14s %9s %11s %9s %9s %11s %9s %9s\n", "cache", "compiles", "compile(s)", "hit rate",
+           "padding", "median(ms)", "max(ms)", "total(s)");
+    for (int bucketing = 0; bucketing <= 1; ++bucketing) {
+        struct shape_cache cache;
+        shape_cache_init(&cache, api, client, program, &compile_options, bucketing);
+        uint32_t seed = 12345; // Same request shapes and data for both caches
+        int run_rc = 0;
+        double start = now_seconds();
+        for (long r = 0; r < requests && run_rc == 0; ++r) {
+            int64_t dims[HOST_TENSOR_MAX_DIMS];
+            for (size_t d = 0; d < num_dims; ++d) {
+                seed = seed * 1664525u + 1013904223u;
+                dims[d] = 1 + (int64_t)(seed >> 8) % program->max_dims[d];
+            }
+            int64_t count = element_count(dims, num_dims);
+            for (int64_t i = 0; i < count; ++i) {
+                seed = seed * 1664525u + 1013904223u;
+                input[i] = (float)(seed >> 8) * (6.0f / 16777216.0f) - 3.0f;
+            }
+
+            double request_start = now_seconds();
+            run_rc = shape_cache_run(&cache, device, input, dims, output);
+            latencies[r] = now_seconds() - request_start;
+            for (int64_t i = 0; i < count && run_rc == 0; ++i) {
+                float expected = program->reference(input[i]);
+                if (fabsf(output[i] - expected) > check_tolerance * fmaxf(1.0f, fabsf(expected))) {
+                    fprintf(stderr, "Request %ld element %ld: got %f, expected %f.\n", r, (long)i, output[i],
+                            expected);
+                    run_rc = 1;
+                }
+            }
+        }
+        double total_s = now_seconds() - start;
+        if (run_rc == 0) {
+            double median_s = median_of(latencies, requests); // Sorts the samples
+            printf("  %-14s %9zu %11.3f %8.1f%% %8.1f%% %11.4f %9.3f %9.3f\n", cache_names[bucketing],
+                   cache.compiles, cache.compile_s, 100.0 * cache.hits / cache.lookups,
+                   100.0 * (cache.padded_elements - cache.valid_elements) / cache.padded_elements,
+                   median_s * 1e3, latencies[requests - 1] * 1e3, total_s);
+        }
+        shape_cache_destroy(&cache);
+        if (run_rc != 0) goto cleanup_shape_cache;
+    }
+    printf("Padding is the share of computed elements that were padding.\n");
+    rc = 0;
+
+cleanup_shape_cache:
+    free_file_data(&compile_options);
+    free(input);
+    free(output);
+    free(latencies);
+    return rc;
+}
@@ -0,0 +1,592 @@
+// Test corpus built from XLA HloSnapshot dumps.
+//
+// With XLA_FLAGS="--xla_dump_to=DIR --xla_dump_hlo_snapshots" every module
+// the CPU client executes is dumped as an HloSnapshot: the HloModuleProto,
+// the argument literals and the result literal. import_snapshots turns each
+// snapshot into a corpus entry directory holding module.xla.pb, raw
+// row-major little-endian tensors (input<i>.bin, output<i>.bin) and a
+// manifest.txt describing them:
+//
+//   name module_0001.Identity.snapshot.0
+//   module module.xla.pb
+//   input f32 2x2 input0.bin
+//   output f32 2x2 output0.bin
+//
+// load_corpus reads the entries back as test cases whose outputs are
+// checked against the recorded results.
+#include <dirent.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "hlo_test.h"
+
+// LiteralProto stores elements in one field per type: a packed scalar
+// field (width 0 = varint, 4 = fixed32, 8 = fixed64) or a bytes field.
+struct literal_type {
+    int xla_type; // xla.PrimitiveType
+    PJRT_Buffer_Type type;
+    const char* name;
+    uint32_t field;
+    int width; // -1 for bytes fields
+    int scalars_per_element; // 2 for complex types
+};
+
+static const struct literal_type literal_types[] = {
+    {1, PJRT_Buffer_Type_PRED, "pred", 2, 0, 1},
+    {2, PJRT_Buffer_Type_S8, "s8", 15, -1, 1},
+    {3, PJRT_Buffer_Type_S16, "s16", 17, -1, 1},
+    {4, PJRT_Buffer_Type_S32, "s32", 4, 0, 1},
+    {5, PJRT_Buffer_Type_S64, "s64", 5, 0, 1},
+    {6, PJRT_Buffer_Type_U8, "u8", 3, -1, 1},
+    {7, PJRT_Buffer_Type_U16, "u16", 16, -1, 1},
+    {8, PJRT_Buffer_Type_U32, "u32", 6, 0, 1},
+    {9, PJRT_Buffer_Type_U64, "u64", 7, 0, 1},
+    {10, PJRT_Buffer_Type_F16, "f16", 11, -1, 1},
+    {11, PJRT_Buffer_Type_F32, "f32", 8, 4, 1},
+    {12, PJRT_Buffer_Type_F64, "f64", 9, 8, 1},
+    {15, PJRT_Buffer_Type_C64, "c64", 12, 4, 2},
+    {16, PJRT_Buffer_Type_BF16, "bf16", 13, -1, 1},
+    {18, PJRT_Buffer_Type_C128, "c128", 18, 8, 2},
+};
+#define NUM_LITERAL_TYPES (sizeof(literal_types) / sizeof(literal_types[0]))
+#define XLA_TYPE_TUPLE 13
+#define CORPUS_MAX_TENSORS 64
+
+struct shape_info {
+    int xla_type;
+    int64_t dims[HOST_TENSOR_MAX_DIMS];
+    size_t num_dims;
+    int64_t minor_to_major[HOST_TENSOR_MAX_DIMS];
+    size_t num_minor_to_major;
+};
+
+// A loaded corpus entry owns everything its TestCase points to.
+struct corpus_case {
+    TestCase test_case;
+    char name[256];
+    char* hlo_path;
+    void** input_data;
+    int64_t** input_dims;
+    size_t* input_num_dims;
+    PJRT_Buffer_Type* input_types;
+    struct host_tensor* expected;
+};
+
+
+static const struct literal_type* literal_type_by_xla(int xla_type) {
+    for (size_t i = 0; i < NUM_LITERAL_TYPES; ++i) {
+        if (literal_types[i].xla_type == xla_type) return &literal_types[i];
+    }
+    return NULL;
+}
+
+
+static const struct literal_type* literal_type_by_name(const char* name) {
+    for (size_t i = 0; i < NUM_LITERAL_TYPES; ++i) {
+        if (strcmp(literal_types[i].name, name) == 0) return &literal_types[i];
+    }
+    return NULL;
+}
+
+
+static const struct literal_type* literal_type_by_pjrt(PJRT_Buffer_Type type) {
+    for (size_t i = 0; i < NUM_LITERAL_TYPES; ++i) {
+        if (literal_types[i].type == type) return &literal_types[i];
+    }
+    return NULL;
+}
+
+
+// --- Function to decode a ShapeProto (element_type 2, dimensions 3, layout 5) ---
+static int decode_shape(const uint8_t* data, size_t size, struct shape_info* shape) {
+    memset(shape, 0, sizeof(*shape));
+    struct proto_reader reader = {data, size, 0};
+    struct proto_field field;
+    int status;
+    while ((status = proto_next_field(&reader, &field)) == 1) {
+        uint64_t value;
+        size_t index = 0;
+        if (field.number == 2 && field.wire_type == 0) {
+            shape->xla_type = (int)field.value;
+        } else if (field.number == 3) {
+            while ((status = proto_next_scalar(&field, &index, 0, &value)) == 1) {
+                if (shape->num_dims == HOST_TENSOR_MAX_DIMS) return 1;
+                shape->dims[shape->num_dims++] = (int64_t)value;
+            }
+            if (status < 0) return 1;
+        } else if (field.number == 5 && field.wire_type == 2) {
+            struct proto_reader layout = {field.data, field.size, 0};
+            struct proto_field layout_field;
+            while ((status = proto_next_field(&layout, &layout_field)) == 1) {
+                if (layout_field.number != 1) continue; // minor_to_major
+                index = 0;
+                while ((status = proto_next_scalar(&layout_field, &index, 0, &value)) == 1) {
+                    if (shape->num_minor_to_major == HOST_TENSOR_MAX_DIMS) return 1;
+                    shape->minor_to_major[shape->num_minor_to_major++] = (int64_t)value;
+                }
+                if (status < 0) return 1;
+            }
+            if (status < 0) return 1;
+        }
+    }
+    return status < 0;
+}
+
+
+// --- Function to read the element type and dimensions of an array ShapeProto ---
+// Leaves tensor->data NULL; fails for tuples and unsupported element types.
+int decode_array_shape(const uint8_t* data, size_t size, struct host_tensor* tensor) {
+    struct shape_info shape;
+    if (decode_shape(data, size, &shape) != 0) return 1;
+    const struct literal_type* type = literal_type_by_xla(shape.xla_type);
+    if (type == NULL) {
+        fprintf(stderr, "Shape element type %d is not supported.\n", shape.xla_type);
+        return 1;
+    }
+    memset(tensor, 0, sizeof(*tensor));
+    tensor->type = type->type;
+    tensor->num_dims = shape.num_dims;
+    tensor->size = buffer_type_size(type->type);
+    for (size_t d = 0; d < shape.num_dims; ++d) {
+        tensor->dims[d] = shape.dims[d];
+        tensor->size *= (size_t)shape.dims[d];
+    }
+    return 0;
+}
+
+
+// --- Function to reorder elements stored in layout order into row-major order ---
+static void layout_to_row_major(const struct shape_info* shape, const void* src, void* dst, size_t element_size,
+                                size_t count) {
+    int64_t strides[HOST_TENSOR_MAX_DIMS]; // Physical stride of each logical dimension
+    int64_t stride = 1;
+    for (size_t i = 0; i < shape->num_minor_to_major; ++i) {
+        strides[shape->minor_to_major[i]] = stride;
+        stride *= shape->dims[shape->minor_to_major[i]];
+    }
+    int64_t index[HOST_TENSOR_MAX_DIMS] = {0};
+    for (size_t n = 0; n < count; ++n) {
+        int64_t offset = 0;
+        for (size_t d = 0; d < shape->num_dims; ++d) offset += index[d] * strides[d];
+        memcpy((char*)dst + n * element_size, (const char*)src + offset * element_size, element_size);
+        for (int d = (int)shape->num_dims - 1; d >= 0; --d) {
+            if (++index[d] < shape->dims[d]) break;
+            index[d] = 0;
+        }
+    }
+}
+
+
+// --- Function to decode an array LiteralProto into a row-major host tensor ---
+static int decode_array_literal(const uint8_t* data, size_t size, const struct shape_info* shape,
+                                struct host_tensor* tensor) {
+    const struct literal_type* type = literal_type_by_xla(shape->xla_type);
+    if (type == NULL) {
+        fprintf(stderr, "Literal element type %d is not supported.\n", shape->xla_type);
+        return 1;
+    }
+    memset(tensor, 0, sizeof(*tensor));
+    tensor->type = type->type;
+    tensor->num_dims = shape->num_dims;
+    size_t count = 1;
+    for (size_t d = 0; d < shape->num_dims; ++d) {
+        tensor->dims[d] = shape->dims[d];
+        count *= (size_t)shape->dims[d];
+    }
+    size_t element_size = buffer_type_size(type->type);
+    tensor->size = count * element_size;
+    uint8_t* stored = (uint8_t*)calloc(tensor->size ? tensor->size : 1, 1);
+    if (stored == NULL) return 1;
+
+    size_t filled = 0; // Bytes of `stored` written so far
+    struct proto_reader reader = {data, size, 0};
+    struct proto_field field;
+    int status;
+    while ((status = proto_next_field(&reader, &field)) == 1) {
+        if (field.number != type->field) continue;
+        if (type->width < 0) {
+            size_t n = field.size < tensor->size - filled ? field.size : tensor->size - filled;
+            memcpy(stored + filled, field.data, n);
+            filled += n;
+            continue;
+        }
+        size_t scalar_size = element_size / type->scalars_per_element;
+        size_t index = 0;
+        uint64_t value;
+        while ((status = proto_next_scalar(&field, &index, type->width, &value)) == 1 && filled < tensor->size) {
+            for (size_t b = 0; b < scalar_size; ++b) stored[filled + b] = (uint8_t)(value >> (8 * b));
+            filled += scalar_size;
+        }
+        if (status < 0) break;
+    }
+    if (status < 0 || filled != tensor->size) {
+        fprintf(stderr, "Literal holds %zu of %zu bytes.\n", filled, tensor->size);
+        free(stored);
+        return 1;
+    }
+
+    int row_major = 1;
+    for (size_t i = 0; i < shape->num_minor_to_major; ++i) {
+        row_major &= shape->minor_to_major[i] == (int64_t)(shape->num_minor_to_major - 1 - i);
+    }
+    if (row_major || shape->num_minor_to_major != shape->num_dims) {
+        tensor->data = stored;
+        return 0;
+    }
+    tensor->data = malloc(tensor->size ? tensor->size : 1);
+    if (tensor->data != NULL) layout_to_row_major(shape, stored, tensor->data, element_size, count);
+    free(stored);
+    return tensor->data == NULL;
+}
+
+
+// --- Function to decode a LiteralProto, flattening one level of tuple ---
+static int decode_literal(const uint8_t* data, size_t size, struct host_tensor* tensors, size_t* num_tensors,
+                          int flatten_tuple) {
+    struct shape_info shape = {0};
+    struct proto_reader reader = {data, size, 0};
+    struct proto_field field;
+    int status;
+    while ((status = proto_next_field(&reader, &field)) == 1) {
+        if (field.number == 1 && field.wire_type == 2 && decode_shape(field.data, field.size, &shape) != 0) {
+            return 1;
+        }
+    }
+    if (status < 0) return 1;
+    if (shape.xla_type != XLA_TYPE_TUPLE) {
+        if (*num_tensors == CORPUS_MAX_TENSORS) return 1;
+        if (decode_array_literal(data, size, &shape, &tensors[*num_tensors]) != 0) return 1;
+        (*num_tensors)++;
+        return 0;
+    }
+    if (!flatten_tuple) {
+        fprintf(stderr, "Nested tuple literals are not supported.\n");
+        return 1;
+    }
+    reader.pos = 0;
+    while ((status = proto_next_field(&reader, &field)) == 1) {
+        if (field.number == 10 && decode_literal(field.data, field.size, tensors, num_tensors, 0) != 0) return 1;
+    }
+    return status < 0;
+}
+
+
+static void format_dims(const struct host_tensor* tensor, char* out, size_t size) {
+    size_t used = 0;
+    if (tensor->num_dims == 0) snprintf(out, size, "scalar");
+    for (size_t d = 0; d < tensor->num_dims && used < size; ++d) {
+        used += snprintf(out + used, size - used, "%s%lld", d ? "x" : "", (long long)tensor->dims[d]);
+    }
+}
+
+
+// Writes dir/name into out; fails on paths longer than the buffer.
+static int join_path(char* out, size_t size, const char* dir, const char* name) {
+    if (snprintf(out, size, "%s/%s", dir, name) < (int)size) return 0;
+    fprintf(stderr, "Path too long: %s/%s\n", dir, name);
+    return 1;
+}
+
+
+static int write_file(const char* path, const void* data, size_t size) {
+    FILE* file = fopen(path, "wb");
+    if (file == NULL) {
+        fprintf(stderr, "Error creating '%s': %s\n", path, strerror(errno));
+        return 1;
+    }
+    int rc = fwrite(data, 1, size, file) != size;
+    rc |= fclose(file) != 0;
+    if (rc) fprintf(stderr, "Error writing '%s'\n", path);
+    return rc;
+}
+
+
+// --- Function to turn one HloSnapshot into a corpus entry ---
+static int import_snapshot(const char* snapshot_path, const char* entry_dir, const char* name) {
+    struct file_data file = {NULL, 0};
+    if (read_file_to_buffer(snapshot_path, &file) != 0) return 1;
+    struct host_tensor tensors[2][CORPUS_MAX_TENSORS]; // Arguments, results
+    size_t num_tensors[2] = {0, 0};
+    const uint8_t* module = NULL;
+    size_t module_size = 0;
+    int rc = 1;
+
+    // HloSnapshot: hlo 1 (HloProto: hlo_module 1), arguments 2, result 3.
+    struct proto_reader reader = {(const uint8_t*)file.data, file.size, 0};
+    struct proto_field field;
+    int status;
+    while ((status = proto_next_field(&reader, &field)) == 1) {
+        if (field.wire_type != 2) continue;
+        if (field.number == 1) {
+            struct proto_reader hlo = {field.data, field.size, 0};
+            struct proto_field hlo_field;
+            while (proto_next_field(&hlo, &hlo_field) == 1) {
+                if (hlo_field.number == 1 && hlo_field.wire_type == 2) {
+                    module = hlo_field.data;
+                    module_size = hlo_field.size;
+                }
+            }
+        } else if (field.number == 2 || field.number == 3) {
+            int kind = field.number == 3;
+            if (decode_literal(field.data, field.size, tensors[kind], &num_tensors[kind], kind) != 0) {
+                fprintf(stderr, "%s: unsupported or malformed literal.\n", snapshot_path);
+                goto cleanup_import;
+            }
+        }
+    }
+    if (status < 0 || module == NULL || num_tensors[1] == 0) {
+        fprintf(stderr, "%s: not an HloSnapshot with a module and a result.\n", snapshot_path);
+        goto cleanup_import;
+    }
+
+    if (mkdir(entry_dir, 0755) != 0 && errno != EEXIST) {
+        fprintf(stderr, "Error creating '%s': %s\n", entry_dir, strerror(errno));
+        goto cleanup_import;
+    }
+    char path[1024];
+    if (join_path(path, sizeof(path), entry_dir, "module.xla.pb") != 0 ||
+        write_file(path, module, module_size) != 0 ||
+        join_path(path, sizeof(path), entry_dir, "manifest.txt") != 0) {
+        goto cleanup_import;
+    }
+    FILE* manifest = fopen(path, "w");
+    if (manifest == NULL) goto cleanup_import;
+    fprintf(manifest, "name %s\nmodule module.xla.pb\n", name);
+    int write_rc = 0;
+    for (int kind = 0; kind < 2 && write_rc == 0; ++kind) {
+        for (size_t i = 0; i < num_tensors[kind] && write_rc == 0; ++i) {
+            const char* role = kind ? "output" : "input";
+            char dims[128];
+            char file_name[32];
+            format_dims(&tensors[kind][i], dims, sizeof(dims));
+            snprintf(file_name, sizeof(file_name), "%s%zu.bin", role, i);
+            fprintf(manifest, "%s %s %s %s\n", role, literal_type_by_pjrt(tensors[kind][i].type)->name, dims,
+                    file_name);
+            write_rc = join_path(path, sizeof(path), entry_dir, file_name) ||
+                       write_file(path, tensors[kind][i].data, tensors[kind][i].size);
+        }
+    }
+    write_rc |= fclose(manifest) != 0;
+    if (write_rc != 0) goto cleanup_import;
+    printf("  %-56s %3zu input(s) %3zu output(s)\n", name, num_tensors[0], num_tensors[1]);
+    rc = 0;
+
+cleanup_import:
+    for (int kind = 0; kind < 2; ++kind) {
+        for (size_t i = 0; i < num_tensors[kind]; ++i) free_host_tensor(&tensors[kind][i]);
+    }
+    free_file_data(&file);
+    return rc;
+}
+
+
+// --- Function to convert every *.snapshot.*.pb in dump_dir into corpus_dir/<name>/ ---
+int import_snapshots(const char* dump_dir, const char* corpus_dir) {
+    DIR* dir = opendir(dump_dir);
+    if (dir == NULL) {
+        fprintf(stderr, "Error opening snapshot directory '%s': %s\n", dump_dir, strerror(errno));
+        return 1;
+    }
+    if (mkdir(corpus_dir, 0755) != 0 && errno != EEXIST) {
+        fprintf(stderr, "Error creating '%s': %s\n", corpus_dir, strerror(errno));
+        closedir(dir);
+        return 1;
+    }
+    printf("Importing HloSnapshots from %s into %s:\n", dump_dir, corpus_dir);
+    int imported = 0, failed = 0;
+    struct dirent* entry;
+    while ((entry = readdir(dir)) != NULL) {
+        size_t length = strlen(entry->d_name);
+        if (strstr(entry->d_name, ".snapshot.") == NULL || length < 3 ||
+            strcmp(entry->d_name + length - 3, ".pb") != 0) {
+            continue;
+        }
+        char name[256];
+        char snapshot_path[1024];
+        char entry_dir[1024];
+        snprintf(name, sizeof(name), "%.*s", (int)(length - 3), entry->d_name);
+        if (join_path(snapshot_path, sizeof(snapshot_path), dump_dir, entry->d_name) == 0 &&
+            join_path(entry_dir, sizeof(entry_dir), corpus_dir, name) == 0 &&
+            import_snapshot(snapshot_path, entry_dir, name) == 0) {
+            imported++;
+        } else {
+            failed++;
+        }
+    }
+    closedir(dir);
+    printf("Imported %d snapshot(s), skipped %d.\n", imported, failed);
+    return imported == 0;
+}
+
+
+static int parse_dims(const char* text, int64_t* dims, size_t* num_dims) {
+    *num_dims = 0;
+    if (strcmp(text, "scalar") == 0) return 0;
+    while (*text != '\0') {
+        char* end = NULL;
+        long long value = strtoll(text, &end, 10);
+        if (end == text || value < 0 || *num_dims == HOST_TENSOR_MAX_DIMS) return 1;
+        dims[(*num_dims)++] = value;
+        text = *end == 'x' ? end + 1 : end;
+        if (*end != 'x' && *end != '\0') return 1;
+    }
+    return 0;
+}
+
+
+static void free_corpus_case(struct corpus_case* c) {
+    for (size_t i = 0; i < c->test_case.num_inputs; ++i) {
+        free(c->input_data[i]);
+        free(c->input_dims[i]);
+    }
+    free_host_tensors(c->expected, c->test_case.num_expected_outputs);
+    free(c->input_data);
+    free(c->input_dims);
+    free(c->input_num_dims);
+    free(c->input_types);
+    free(c->hlo_path);
+    free(c);
+}
+
+
+// --- Function to read a corpus entry into a test case ---
+static struct corpus_case* load_corpus_entry(const char* entry_dir, const char* entry_name) {
+    char path[1024];
+    if (join_path(path, sizeof(path), entry_dir, "manifest.txt") != 0) return NULL;
+    FILE* manifest = fopen(path, "r");
+    if (manifest == NULL) return NULL;
+    struct corpus_case* c = (struct corpus_case*)calloc(1, sizeof(*c));
+    if (c == NULL) {
+        fclose(manifest);
+        return NULL;
+    }
+    c->input_data = (void**)calloc(CORPUS_MAX_TENSORS, sizeof(void*));
+    c->input_dims = (int64_t**)calloc(CORPUS_MAX_TENSORS, sizeof(int64_t*));
+    c->input_num_dims = (size_t*)calloc(CORPUS_MAX_TENSORS, sizeof(size_t));
+    c->input_types = (PJRT_Buffer_Type*)calloc(CORPUS_MAX_TENSORS, sizeof(PJRT_Buffer_Type));
+    c->expected = (struct host_tensor*)calloc(CORPUS_MAX_TENSORS, sizeof(struct host_tensor));
+    TestCase* t = &c->test_case;
+    int rc = c->input_data == NULL || c->input_dims == NULL || c->input_num_dims == NULL ||
+             c->input_types == NULL || c->expected == NULL;
+    snprintf(c->name, sizeof(c->name), "%.*s", (int)sizeof(c->name) - 1, entry_name);
+
+    char line[1024];
+    while (rc == 0 && fgets(line, sizeof(line), manifest) != NULL) {
+        char key[32], a[256], b[256], file_name[256];
+        int fields = sscanf(line, "%31s %255s %255s %255s", key, a, b, file_name);
+        if (fields <= 0) continue;
+        if (strcmp(key, "name") == 0 && fields >= 2) {
+            snprintf(c->name, sizeof(c->name), "%s", a);
+        } else if (strcmp(key, "module") == 0 && fields >= 2) {
+            free(c->hlo_path);
+            c->hlo_path = join_path(path, sizeof(path), entry_dir, a) == 0 ? strdup(path) : NULL;
+            rc = c->hlo_path == NULL;
+        } else if ((strcmp(key, "input") == 0 || strcmp(key, "output") == 0) && fields == 4) {
+            int is_input = key[0] == 'i';
+            size_t* count = is_input ? &t->num_inputs : &t->num_expected_outputs;
+            const struct literal_type* type = literal_type_by_name(a);
+            struct host_tensor tensor = {0};
+            struct file_data data = {NULL, 0};
+            if (*count == CORPUS_MAX_TENSORS || type == NULL ||
+                parse_dims(b, tensor.dims, &tensor.num_dims) != 0) {
+                fprintf(stderr, "%s: bad manifest line: %s", entry_dir, line);
+                rc = 1;
+                break;
+            }
+            tensor.type = type->type;
+            tensor.size = buffer_type_size(type->type);
+            for (size_t d = 0; d < tensor.num_dims; ++d) tensor.size *= (size_t)tensor.dims[d];
+            if (join_path(path, sizeof(path), entry_dir, file_name) != 0 ||
+                read_file_to_buffer(path, &data) != 0 || data.size != tensor.size) {
+                fprintf(stderr, "%s: '%s' does not hold %zu bytes.\n", entry_dir, file_name, tensor.size);
+                free_file_data(&data);
+                rc = 1;
+                break;
+            }
+            tensor.data = data.data;
+            if (!is_input) {
+                c->expected[(*count)++] = tensor;
+                continue;
+            }
+            int64_t* dims = (int64_t*)calloc(tensor.num_dims ? tensor.num_dims : 1, sizeof(int64_t));
+            if (dims == NULL) {
+                free(tensor.data);
+                rc = 1;
+                break;
+            }
+            memcpy(dims, tensor.dims, tensor.num_dims * sizeof(int64_t));
+            c->input_data[*count] = tensor.data;
+            c->input_dims[*count] = dims;
+            c->input_num_dims[*count] = tensor.num_dims;
+            c->input_types[*count] = tensor.type;
+            (*count)++;
+        }
+    }
+    fclose(manifest);
+    if (rc != 0 || c->hlo_path == NULL) {
+        free_corpus_case(c);
+        return NULL;
+    }
+    t->name = c->name;
+    t->hlo_path = c->hlo_path;
+    t->format = "hlo";
+    t->compile_options_path = "./compile_options.0.pb";
+    t->input_data = c->input_data;
+    t->input_dims = c->input_dims;
+    t->input_num_dims = c->input_num_dims;
+    t->input_types = c->input_types;
+    t->expected_outputs = c->expected;
+    return c;
+}
+
+
+static int compare_names(const void* a, const void* b) {
+    return strcmp((*(const struct corpus_case* const*)a)->name, (*(const struct corpus_case* const*)b)->name);
+}
+
+
+// --- Function to load every entry of a corpus directory, sorted by name ---
+// The test cases stay valid until free_corpus.
+int load_corpus(const char* corpus_dir, const TestCase*** tests_ptr, size_t* num_tests_ptr) {
+    DIR* dir = opendir(corpus_dir);
+    if (dir == NULL) {
+        fprintf(stderr, "Error opening corpus '%s': %s\n", corpus_dir, strerror(errno));
+        return 1;
+    }
+    struct corpus_case** cases = NULL;
+    size_t count = 0, capacity = 0;
+    struct dirent* entry;
+    while ((entry = readdir(dir)) != NULL) {
+        if (entry->d_name[0] == '.') continue;
+        char entry_dir[1024];
+        if (join_path(entry_dir, sizeof(entry_dir), corpus_dir, entry->d_name) != 0) continue;
+        struct corpus_case* c = load_corpus_entry(entry_dir, entry->d_name);
+        if (c == NULL) continue;
+        if (count == capacity) {
+            capacity = capacity ? capacity * 2 : 16;
+            struct corpus_case** grown = (struct corpus_case**)realloc(cases, capacity * sizeof(*cases));
+            if (grown == NULL) {
+                free_corpus_case(c);
+                break;
+            }
+            cases = grown;
+        }
+        cases[count++] = c;
+    }
+    closedir(dir);
+    if (count > 0) qsort(cases, count, sizeof(cases[0]), compare_names);
+    // The first member of corpus_case is its TestCase, so the array doubles as a TestCase list.
+    *tests_ptr = (const TestCase**)cases;
+    *num_tests_ptr = count;
+    printf("Loaded %zu test case(s) from corpus %s\n", count, corpus_dir);
+    return 0;
+}
+
+
+void free_corpus(const TestCase** tests, size_t num_tests) {
+    for (size_t i = 0; i < num_tests; ++i) free_corpus_case((struct corpus_case*)tests[i]);
+    free(tests);
+}
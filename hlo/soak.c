@@ -0,0 +1,337 @@
+// Soak test: leak and latency-drift detection over long runs.
+//
+// One cycle is what run_computation_test does for a test case, without the
+// printing: read the program and compile options, upload the inputs, compile
+// (or load the serialized executable), execute, copy every output back, check
+// it against the expected results and destroy everything again. Cycles are
+// grouped into windows of `window_s` seconds; at the end of each window the
+// process RSS, the device's PJRT_Device_MemoryStats and the window's latency
+// percentiles are recorded.
+//
+// A series drifts when a one-sided Mann-Kendall test finds it increasing
+// (p < SOAK_ALPHA) and its Sen slope, the median of the pairwise slopes,
+// extrapolates to more than a minimum growth over the run. The test makes no
+// assumption about the distribution of the window values and a single
+// outlier window cannot fake a trend. The first SOAK_WARMUP_WINDOWS windows
+// are left out, since allocator pools and caches fill up at the start. Runs
+// with more windows than SOAK_MAX_TREND_POINTS are tested on the means of
+// consecutive groups of windows, which keeps the pairwise test cheap.
+//
+// SIGINT ends the run after the current cycle and still prints the report.
+#include <math.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "hlo_test.h"
+
+#define SOAK_ALPHA 0.01
+#define SOAK_MIN_WINDOWS 8 // After the warm-up windows
+#define SOAK_WARMUP_WINDOWS 1
+#define SOAK_MAX_TREND_POINTS 1000 // Longer runs average runs of windows into this many points
+#define SOAK_MIN_MEMORY_GROWTH (1 << 20) // Bytes over the run
+#define SOAK_MIN_LATENCY_DRIFT 0.05 // Share of the first window's value over the run
+
+struct soak_window {
+    double end_s; // Seconds since the start of the run
+    size_t cycles;
+    size_t failures;
+    double p50, p99, max; // Cycle latency, seconds
+    int64_t rss; // Bytes
+    int64_t bytes_in_use; // -1 when the plugin has no memory stats
+    int64_t peak_bytes_in_use;
+};
+
+enum soak_series {
+    SOAK_RSS,
+    SOAK_BYTES_IN_USE,
+    SOAK_P50,
+    SOAK_P99,
+    NUM_SOAK_SERIES
+};
+
+// Set by SIGINT and never cleared, so one interrupt ends the whole soak rather than one test case.
+static volatile sig_atomic_t soak_stop;
+
+
+static void soak_interrupt(int signal_number) {
+    (void)signal_number;
+    soak_stop = 1;
+}
+
+
+// --- Function to read the resident set size of this process ---
+static int64_t resident_bytes(void) {
+    FILE* file = fopen("/proc/self/statm", "r");
+    long long size = 0, resident = -1;
+    if (file == NULL) return -1;
+    if (fscanf(file, "%lld %lld", &size, &resident) != 2) resident = -1;
+    fclose(file);
+    return resident < 0 ? -1 : (int64_t)resident * sysconf(_SC_PAGESIZE);
+}
+
+
+static double percentile(const double* sorted, size_t count, double q) {
+    size_t rank = (size_t)ceil(q * count);
+    return sorted[rank > 0 ? rank - 1 : 0];
+}
+
+
+// --- Function to run one create/compile/execute/destroy cycle quietly ---
+static int soak_cycle(const PJRT_Api* api, PJRT_Client* client, PJRT_Device* device, const TestCase* test_case,
+                      double tolerance) {
+    int rc = 1;
+    struct file_data program = {NULL, 0};
+    struct file_data compile_options = {NULL, 0};
+    PJRT_LoadedExecutable* executable = NULL;
+    PJRT_Buffer** inputs = NULL;
+    PJRT_Buffer** outputs = NULL;
+    size_t num_outputs = 0;
+
+    if (test_case->executable_path != NULL) {
+        executable = load_serialized_executable(api, client, test_case->executable_path);
+    }
+    if (executable == NULL) {
+        if (read_file_to_buffer(test_case->hlo_path, &program) != 0 ||
+            read_file_to_buffer(test_case->compile_options_path, &compile_options) != 0) {
+            goto cleanup_cycle;
+        }
+    }
+    inputs = create_input_buffers(api, client, device, test_case);
+    if (inputs == NULL) goto cleanup_cycle;
+    if (executable == NULL) {
+        const char* format = test_case->format ? test_case->format : program_format_from_path(test_case->hlo_path);
+        executable = compile_program(api, client, &program, format, &compile_options);
+        if (executable == NULL) goto cleanup_cycle;
+    }
+    if (execute_hlo_program(api, executable, inputs, test_case->num_inputs, &outputs, &num_outputs) != 0) {
+        goto cleanup_cycle;
+    }
+    if (test_case->expected_outputs != NULL && num_outputs != test_case->num_expected_outputs) {
+        fprintf(stderr, "Expected %zu output(s), got %zu.\n", test_case->num_expected_outputs, num_outputs);
+        goto cleanup_cycle;
+    }
+    for (size_t i = 0; i < num_outputs; ++i) {
+        struct host_tensor output;
+        if (buffer_to_host_unpadded(api, outputs[i], &output, NULL) != 0) goto cleanup_cycle;
+        int match = test_case->expected_outputs == NULL ||
+                    host_tensors_match(&test_case->expected_outputs[i], &output, tolerance);
+        free_host_tensor(&output);
+        if (!match) {
+            fprintf(stderr, "Output %zu does not match the expected result.\n", i);
+            goto cleanup_cycle;
+        }
+    }
+    rc = 0;
+
+cleanup_cycle:
+    destroy_buffers(api, outputs, num_outputs, "PJRT_Buffer_Destroy (soak output)");
+    destroy_buffers(api, inputs, test_case->num_inputs, "PJRT_Buffer_Destroy (soak input)");
+    if (executable != NULL) destroy_loaded_executable(api, executable);
+    free_file_data(&program);
+    free_file_data(&compile_options);
+    return rc;
+}
+
+
+static double series_value(const struct soak_window* window, enum soak_series series) {
+    switch (series) {
+        case SOAK_RSS: return (double)window->rss;
+        case SOAK_BYTES_IN_USE: return (double)window->bytes_in_use;
+        case SOAK_P50: return window->p50;
+        case SOAK_P99: return window->p99;
+        default: return 0.0;
+    }
+}
+
+
+static int compare_doubles(const void* a, const void* b) {
+    double x = *(const double*)a, y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+
+// --- Function to test a series for an increasing trend ---
+// Mann-Kendall S with the variance corrected for ties; returns the one-sided
+// p-value of an increase and stores the Sen slope per second in *slope.
+static double mann_kendall(const double* t, const double* x, size_t n, double* slope) {
+    double s = 0.0;
+    size_t num_slopes = 0;
+    double* slopes = (double*)malloc((n * (n - 1) / 2 + 1) * sizeof(double));
+    for (size_t i = 0; i < n; ++i) {
+        for (size_t j = i + 1; j < n; ++j) {
+            s += (x[j] > x[i]) - (x[j] < x[i]);
+            if (slopes != NULL && t[j] > t[i]) slopes[num_slopes++] = (x[j] - x[i]) / (t[j] - t[i]);
+        }
+    }
+    *slope = 0.0;
+    if (slopes != NULL && num_slopes > 0) *slope = median_of(slopes, num_slopes);
+    free(slopes);
+
+    double* sorted = (double*)malloc(n * sizeof(double));
+    double ties = 0.0;
+    if (sorted != NULL) {
+        memcpy(sorted, x, n * sizeof(double));
+        qsort(sorted, n, sizeof(double), compare_doubles);
+        for (size_t i = 0; i < n;) {
+            size_t j = i;
+            while (j < n && sorted[j] == sorted[i]) ++j;
+            double group = (double)(j - i);
+            ties += group * (group - 1) * (2 * group + 5);
+            i = j;
+        }
+        free(sorted);
+    }
+    double variance = ((double)n * (n - 1) * (2.0 * n + 5) - ties) / 18.0;
+    if (variance <= 0.0) return 1.0; // Constant series
+    double z = (s > 0 ? s - 1 : s < 0 ? s + 1 : 0) / sqrt(variance); // Continuity correction
+    return 0.5 * erfc(z / sqrt(2.0));
+}
+
+
+// --- Function to report and flag the trend of every series ---
+// Returns the number of series that drifted.
+static int report_trends(const struct soak_window* windows, size_t num_windows) {
+    static const char* const names[NUM_SOAK_SERIES] = {"RSS", "device bytes in use", "latency p50", "latency p99"};
+    size_t first = num_windows > SOAK_WARMUP_WINDOWS ? SOAK_WARMUP_WINDOWS : 0;
+    size_t n = num_windows - first;
+    if (n < SOAK_MIN_WINDOWS) {
+        printf("  Only %zu window(s) after warm-up; at least %d are needed to test for drift.\n", n,
+               SOAK_MIN_WINDOWS);
+        return 0;
+    }
+    size_t group = (n + SOAK_MAX_TREND_POINTS - 1) / SOAK_MAX_TREND_POINTS;
+    size_t m = (n + group - 1) / group;
+    double* t = (double*)malloc(m * sizeof(double));
+    double* x = (double*)malloc(m * sizeof(double));
+    int drifted = 0;
+    if (t == NULL || x == NULL) {
+        free(t);
+        free(x);
+        return 0;
+    }
+    double span = windows[num_windows - 1].end_s - windows[first].end_s;
+    printf("  %-20s %14s %14s %12s %10s  %s\n", "series", "first", "last", "slope/hour", "p", "verdict");
+    for (int s = 0; s < NUM_SOAK_SERIES; ++s) {
+        if (s == SOAK_BYTES_IN_USE && windows[first].bytes_in_use < 0) {
+            printf("  %-20s %14s\n", names[s], "n/a");
+            continue;
+        }
+        for (size_t k = 0; k < m; ++k) {
+            size_t begin = first + k * group;
+            size_t end = begin + group < num_windows ? begin + group : num_windows;
+            t[k] = x[k] = 0.0;
+            for (size_t i = begin; i < end; ++i) {
+                t[k] += windows[i].end_s / (double)(end - begin);
+                x[k] += series_value(&windows[i], (enum soak_series)s) / (double)(end - begin);
+            }
+        }
+        double slope;
+        double p = mann_kendall(t, x, m, &slope);
+        double growth = slope * span;
+        int memory = s == SOAK_RSS || s == SOAK_BYTES_IN_USE;
+        double threshold = memory ? SOAK_MIN_MEMORY_GROWTH : SOAK_MIN_LATENCY_DRIFT * x[0];
+        int drift = p < SOAK_ALPHA && growth > threshold;
+        drifted += drift;
+        double scale = memory ? 1.0 / (1 << 20) : 1e3; // MiB or ms
+        printf("  %-20s %14.3f %14.3f %12.4f %10.2g  %s\n", names[s], x[0] * scale, x[m - 1] * scale,
+               slope * 3600.0 * scale, p, drift ? "DRIFT" : p < SOAK_ALPHA ? "rising, below threshold" : "stable");
+    }
+    printf("  (memory in MiB, latency in ms; drift: p < %.2g and growth over the run above %d MiB or %.0f%%)\n",
+           SOAK_ALPHA, SOAK_MIN_MEMORY_GROWTH >> 20, SOAK_MIN_LATENCY_DRIFT * 100);
+    free(t);
+    free(x);
+    return drifted;
+}
+
+
+// --- Function to soak a test case ---
+// Returns 0 when nothing drifted, 2 on drift, 1 on errors.
+int run_soak_test(const PJRT_Api* api, PJRT_Client* client, PJRT_Device* device, const TestCase* test_case,
+                  const struct soak_options* options) {
+    int rc = 1;
+    struct soak_window* windows = NULL;
+    size_t num_windows = 0, windows_capacity = 0;
+    double* latencies = NULL;
+    size_t num_latencies = 0, latencies_capacity = 0;
+    size_t failures = 0;
+    int memory_stats = 1;
+    long cycle = 0;
+
+    if (soak_stop) return 0; // Interrupted during an earlier test case
+
+    printf("\n--- Soak: %s (%ld cycle(s), %.0f s windows) ---\n", test_case->name, options->cycles,
+           options->window_s);
+    printf("  %8s %10s %8s %10s %10s %10s %12s %12s\n", "time s", "cycles", "failed", "p50 ms", "p99 ms", "max ms",
+           "RSS MiB", "device MiB");
+    void (*previous_handler)(int) = signal(SIGINT, soak_interrupt);
+    double start = now_seconds();
+    double window_end = start + options->window_s;
+    while (!soak_stop && (options->cycles <= 0 || cycle < options->cycles)) {
+        double cycle_start = now_seconds();
+        int cycle_rc = soak_cycle(api, client, device, test_case, options->tolerance);
+        double cycle_end = now_seconds();
+        ++cycle;
+        if (cycle_rc != 0) failures++;
+        if (num_latencies == latencies_capacity) {
+            size_t capacity = latencies_capacity ? 2 * latencies_capacity : 1024;
+            double* grown = (double*)realloc(latencies, capacity * sizeof(double));
+            if (grown == NULL) goto cleanup_soak;
+            latencies = grown;
+            latencies_capacity = capacity;
+        }
+        latencies[num_latencies++] = cycle_end - cycle_start;
+        if (cycle_end < window_end && !soak_stop && cycle != options->cycles) continue;
+
+        // --- Close the window ---
+        if (num_windows == windows_capacity) {
+            size_t capacity = windows_capacity ? 2 * windows_capacity : 64;
+            struct soak_window* grown = (struct soak_window*)realloc(windows, capacity * sizeof(*windows));
+            if (grown == NULL) goto cleanup_soak;
+            windows = grown;
+            windows_capacity = capacity;
+        }
+        struct soak_window* window = &windows[num_windows++];
+        memset(window, 0, sizeof(*window));
+        window->end_s = cycle_end - start;
+        window->cycles = num_latencies;
+        window->failures = failures;
+        window->p50 = median_of(latencies, num_latencies); // Sorts the latencies in place
+        window->p99 = percentile(latencies, num_latencies, 0.99);
+        window->max = latencies[num_latencies - 1];
+        window->rss = resident_bytes();
+        window->bytes_in_use = -1;
+        window->peak_bytes_in_use = -1;
+        if (memory_stats && device_memory_stats(api, device, &window->bytes_in_use, &window->peak_bytes_in_use)) {
+            memory_stats = 0; // Not supported by the plugin; do not ask again
+            window->bytes_in_use = -1;
+        }
+        printf("  %8.0f %10zu %8zu %10.3f %10.3f %10.3f %12.1f ", window->end_s, window->cycles, window->failures,
+               window->p50 * 1e3, window->p99 * 1e3, window->max * 1e3, window->rss / 1048576.0);
+        if (window->bytes_in_use >= 0) {
+            printf("%12.1f\n", window->bytes_in_use / 1048576.0);
+        } else {
+            printf("%12s\n", "n/a");
+        }
+        fflush(stdout);
+        num_latencies = 0;
+        failures = 0;
+        window_end = cycle_end + options->window_s;
+    }
+
+    size_t total_failures = 0;
+    for (size_t w = 0; w < num_windows; ++w) total_failures += windows[w].failures;
+    printf("  %ld cycle(s) in %.1f s%s, %zu failed\n", cycle, now_seconds() - start,
+           soak_stop ? " (interrupted)" : "", total_failures);
+    int drifted = report_trends(windows, num_windows);
+    if (drifted > 0) printf("  %d series drifted.\n", drifted);
+    rc = total_failures > 0 ? 1 : drifted > 0 ? 2 : 0;
+
+cleanup_soak:
+    signal(SIGINT, previous_handler);
+    free(latencies);
+    free(windows);
+    return rc;
+}
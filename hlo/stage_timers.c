@@ -0,0 +1,217 @@
+// Per-stage timers for the PJRT hot path.
+//
+// The helpers in hlo_test.c bracket file reads, host-to-device uploads,
+// compiles, executes, device-to-host readbacks and buffer destruction with
+// stage_timer_start / stage_timer_stop; executions are also timed until the
+// device reports them complete. Each (workload, stage) pair feeds a
+// log-linear histogram: 16 linear sub-buckets per power of two of
+// nanoseconds, so any recorded value is known to within 1/16 of itself.
+// Recording is lock-free and only happens after stage_timers_enable, which
+// also arranges for the histograms to be printed at exit.
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "hlo_test.h"
+
+#define STAGE_SUB_BITS 4
+#define STAGE_SUB_BUCKETS (1 << STAGE_SUB_BITS)
+#define STAGE_MAX_EXPONENT 47 // About 39 hours; longer scopes land in the last bucket
+#define STAGE_HIST_BUCKETS ((STAGE_MAX_EXPONENT - STAGE_SUB_BITS + 2) * STAGE_SUB_BUCKETS)
+#define STAGE_MAX_WORKLOADS 16
+#define STAGE_WORKLOAD_NAME_MAX 128
+
+static const char* const stage_names[NUM_TIMER_STAGES] = {
+    "file read", "buffer from host", "compile", "execute (enqueue)", "execute (complete)", "to host",
+    "buffer destroy",
+};
+
+struct stage_histogram {
+    uint64_t count;
+    uint64_t total_ns;
+    uint64_t max_ns;
+    uint64_t buckets[STAGE_HIST_BUCKETS];
+};
+
+int stage_timers_enabled = 0;
+static char workload_names[STAGE_MAX_WORKLOADS][STAGE_WORKLOAD_NAME_MAX] = {"(outside test cases)"};
+static size_t num_workloads = 1;
+static size_t current_workload = 0;
+static struct stage_histogram histograms[STAGE_MAX_WORKLOADS][NUM_TIMER_STAGES];
+
+
+static uint64_t monotonic_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+
+static size_t bucket_of(uint64_t ns) {
+    if (ns < STAGE_SUB_BUCKETS) return (size_t)ns;
+    int exponent = 63 - __builtin_clzll(ns);
+    if (exponent > STAGE_MAX_EXPONENT) return STAGE_HIST_BUCKETS - 1;
+    size_t sub = (size_t)(ns >> (exponent - STAGE_SUB_BITS)) & (STAGE_SUB_BUCKETS - 1);
+    return (size_t)(exponent - STAGE_SUB_BITS + 1) * STAGE_SUB_BUCKETS + sub;
+}
+
+
+// Lower bound of a bucket; the bucket ends at the next bucket's lower bound.
+static uint64_t bucket_lower_ns(size_t bucket) {
+    if (bucket < STAGE_SUB_BUCKETS) return bucket;
+    int exponent = (int)(bucket / STAGE_SUB_BUCKETS) + STAGE_SUB_BITS - 1;
+    uint64_t sub = bucket % STAGE_SUB_BUCKETS;
+    return (STAGE_SUB_BUCKETS + sub) << (exponent - STAGE_SUB_BITS);
+}
+
+
+// --- Function to time a scope: pass the result to stage_timer_stop ---
+uint64_t stage_timer_start(void) {
+    return stage_timers_enabled ? monotonic_ns() : 0;
+}
+
+
+static void record_sample(size_t workload, enum timer_stage stage, uint64_t elapsed) {
+    struct stage_histogram* h = &histograms[workload][stage];
+    __atomic_fetch_add(&h->count, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&h->total_ns, elapsed, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&h->buckets[bucket_of(elapsed)], 1, __ATOMIC_RELAXED);
+    uint64_t max = __atomic_load_n(&h->max_ns, __ATOMIC_RELAXED);
+    while (elapsed > max &&
+           !__atomic_compare_exchange_n(&h->max_ns, &max, elapsed, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+    }
+}
+
+
+void stage_timer_stop(enum timer_stage stage, uint64_t start_ns) {
+    if (!stage_timers_enabled || start_ns == 0) return;
+    record_sample(__atomic_load_n(&current_workload, __ATOMIC_RELAXED), stage, monotonic_ns() - start_ns);
+}
+
+
+struct pending_stage {
+    const PJRT_Api* api;
+    enum timer_stage stage;
+    size_t workload;
+    uint64_t start_ns;
+};
+
+
+// Runs on a plugin thread once the event is ready.
+static void pending_stage_ready(PJRT_Error* error, void* user_arg) {
+    struct pending_stage* pending = (struct pending_stage*)user_arg;
+    if (!handle_error(error, pending->api, "Timed stage")) {
+        record_sample(pending->workload, pending->stage, monotonic_ns() - pending->start_ns);
+    }
+    free(pending);
+}
+
+
+// --- Function to stop a timer when `event` is ready rather than now ---
+// Takes ownership of `event`. The sample goes to the workload that is current at the call.
+void stage_timer_stop_on_ready(const PJRT_Api* api, enum timer_stage stage, uint64_t start_ns, PJRT_Event* event) {
+    if (event == NULL) {
+        stage_timer_stop(stage, start_ns); // Already complete
+        return;
+    }
+    struct pending_stage* pending = (struct pending_stage*)malloc(sizeof(*pending));
+    if (!stage_timers_enabled || start_ns == 0 || pending == NULL) {
+        free(pending);
+        destroy_event(api, event);
+        return;
+    }
+    pending->api = api;
+    pending->stage = stage;
+    pending->workload = __atomic_load_n(&current_workload, __ATOMIC_RELAXED);
+    pending->start_ns = start_ns;
+    PJRT_Event_OnReady_Args on_ready_args = {0};
+    on_ready_args.struct_size = PJRT_Event_OnReady_Args_STRUCT_SIZE;
+    on_ready_args.event = event;
+    on_ready_args.callback = pending_stage_ready;
+    on_ready_args.user_arg = pending;
+    PJRT_Error* error = api->PJRT_Event_OnReady(&on_ready_args);
+    destroy_event(api, event); // The callback stays registered
+    if (handle_error(error, api, "PJRT_Event_OnReady")) free(pending);
+}
+
+
+// --- Function to attribute the following stages to a workload ---
+// `name` is copied: corpus, bundle and synthetic test names are freed before the atexit dump.
+void stage_timers_set_workload(const char* name) {
+    char key[STAGE_WORKLOAD_NAME_MAX];
+    snprintf(key, sizeof(key), "%s", name);
+    size_t index = 0;
+    while (index < num_workloads && strcmp(workload_names[index], key) != 0) ++index;
+    if (index == num_workloads) {
+        if (num_workloads == STAGE_MAX_WORKLOADS) {
+            index = 0;
+        } else {
+            memcpy(workload_names[num_workloads++], key, sizeof(key));
+        }
+    }
+    __atomic_store_n(&current_workload, index, __ATOMIC_RELAXED);
+}
+
+
+// Upper bound of the bucket holding the sample of rank ceil(q * count), capped at the maximum.
+static double histogram_quantile_us(const struct stage_histogram* h, double q) {
+    uint64_t rank = (uint64_t)ceil(q * (double)h->count);
+    if (rank == 0) rank = 1;
+    uint64_t seen = 0;
+    for (size_t b = 0; b < STAGE_HIST_BUCKETS; ++b) {
+        seen += h->buckets[b];
+        if (seen >= rank) {
+            uint64_t upper = b + 1 < STAGE_HIST_BUCKETS ? bucket_lower_ns(b + 1) : h->max_ns;
+            return (upper < h->max_ns ? upper : h->max_ns) * 1e-3;
+        }
+    }
+    return h->max_ns * 1e-3;
+}
+
+
+static void stage_timers_dump(void) {
+    for (size_t w = 0; w < num_workloads; ++w) {
+        uint64_t workload_ns = 0;
+        // Completed executions overlap the enqueue and readback stages, so they are left out of the shares.
+        for (int s = 0; s < NUM_TIMER_STAGES; ++s) {
+            if (s != TIMER_STAGE_EXECUTE_COMPLETE) workload_ns += histograms[w][s].total_ns;
+        }
+        if (workload_ns == 0) continue;
+        printf("\n--- Stage timers: %s ---\n", workload_names[w]);
+        printf("  %-18s %8s %12s %7s %11s %11s %11s %11s\n", "stage", "count", "total(ms)", "share", "p50(us)",
+               "p90(us)", "p99(us)", "max(us)");
+        for (int s = 0; s < NUM_TIMER_STAGES; ++s) {
+            const struct stage_histogram* h = &histograms[w][s];
+            if (h->count == 0) continue;
+            printf("  %-18s %8llu %12.3f ", stage_names[s], (unsigned long long)h->count, h->total_ns * 1e-6);
+            if (s == TIMER_STAGE_EXECUTE_COMPLETE) {
+                printf("%7s", "-");
+            } else {
+                printf("%6.1f%%", 100.0 * h->total_ns / workload_ns);
+            }
+            printf(" %11.1f %11.1f %11.1f %11.1f\n", histogram_quantile_us(h, 0.50), histogram_quantile_us(h, 0.90), histogram_quantile_us(h, 0.99),
+                   h->max_ns * 1e-3);
+        }
+        for (int s = 0; s < NUM_TIMER_STAGES; ++s) {
+            const struct stage_histogram* h = &histograms[w][s];
+            if (h->count == 0) continue;
+            printf("  %s histogram:\n", stage_names[s]);
+            for (size_t b = 0; b < STAGE_HIST_BUCKETS; ++b) {
+                if (h->buckets[b] == 0) continue;
+                printf("    [%12.3f, %12.3f) us %8llu\n", bucket_lower_ns(b) * 1e-3,
+                       (b + 1 < STAGE_HIST_BUCKETS ? bucket_lower_ns(b + 1) : h->max_ns) * 1e-3,
+                       (unsigned long long)h->buckets[b]);
+            }
+        }
+    }
+}
+
+
+// --- Function to start recording and print the histograms at exit ---
+void stage_timers_enable(void) {
+    if (stage_timers_enabled) return;
+    stage_timers_enabled = 1;
+    atexit(stage_timers_dump);
+}
@@ -0,0 +1,596 @@
+// Synthetic inputs for any module.
+//
+// Parameter shapes come from host_program_shape (field 4) of the
+// HloModuleProto, whose ProgramShapeProto lists one ShapeProto per
+// parameter (field 1). Programs in other formats are compiled first and the
+// shapes are read from the optimized HloModuleProto the plugin returns.
+//
+// Every element is a hash of (seed, parameter, element index), so the data
+// does not depend on how the tensor is split between threads. Floats are
+// uniform in [-1, 1); integers are small (|x| < 64) so that sums and products
+// of them stay exact. Besides the scalar reference kernel there is an AVX2
+// kernel (4 hashes per step, 64-bit multiplies built from 32-bit ones) and an
+// AVX-512 kernel (8 per step), picked at run time; large tensors are also
+// split across threads. Before a vector kernel is used it is checked against
+// the scalar one on every type, and dropped if any bit differs.
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HAVE_X86_KERNELS 1
+#endif
+
+#include "hlo_test.h"
+
+#define SYNTHETIC_MAX_PARAMETERS 64
+#define SYNTHETIC_MAX_THREADS 64
+#define SYNTHETIC_MIN_BYTES_PER_THREAD (1 << 20)
+#define SYNTHETIC_HASH_STEP 0x9e3779b97f4a7c15ull
+#define SYNTHETIC_CHECK_SCALARS 203 // Per kernel check; not a multiple of any vector width
+
+struct synthetic_case {
+    TestCase test_case;
+    char name[256];
+    char* program_path;
+    struct host_tensor inputs[SYNTHETIC_MAX_PARAMETERS];
+    void* input_data[SYNTHETIC_MAX_PARAMETERS];
+    int64_t* input_dims[SYNTHETIC_MAX_PARAMETERS];
+    size_t input_num_dims[SYNTHETIC_MAX_PARAMETERS];
+    PJRT_Buffer_Type input_types[SYNTHETIC_MAX_PARAMETERS];
+};
+
+struct fill_job {
+    struct host_tensor* tensor;
+    uint64_t key;
+    size_t scalar_size;
+    size_t begin; // Scalar range of this thread (complex types have two scalars per element)
+    size_t end;
+};
+
+typedef void (*fill_range_fn)(const struct fill_job* job);
+
+struct fill_impl {
+    const char* name;
+    fill_range_fn fill;
+};
+
+
+// splitmix64 finalizer
+static inline uint64_t mix64(uint64_t x) {
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+    return x ^ (x >> 31);
+}
+
+
+static inline uint64_t element_hash(uint64_t key, size_t i) {
+    return mix64(key + (uint64_t)i * SYNTHETIC_HASH_STEP);
+}
+
+
+// --- Scalar reference kernel ---
+static void fill_range(const struct fill_job* job) {
+    void* data = job->tensor->data;
+    uint64_t key = job->key;
+    size_t i;
+    switch (job->tensor->type) {
+        case PJRT_Buffer_Type_F32:
+        case PJRT_Buffer_Type_C64:
+            for (i = job->begin; i < job->end; ++i) {
+                ((float*)data)[i] = (float)(int32_t)(element_hash(key, i) >> 32) * 0x1p-31f;
+            }
+            break;
+        case PJRT_Buffer_Type_F64:
+        case PJRT_Buffer_Type_C128:
+            for (i = job->begin; i < job->end; ++i) {
+                ((double*)data)[i] = (double)((int64_t)element_hash(key, i) >> 11) * 0x1p-52;
+            }
+            break;
+        case PJRT_Buffer_Type_BF16:
+            // Random sign and mantissa, exponent for magnitudes in [2^-8, 1)
+            for (i = job->begin; i < job->end; ++i) {
+                uint64_t h = element_hash(key, i);
+                ((uint16_t*)data)[i] = (uint16_t)((h & 0x807f) | ((119 + (h >> 61)) << 7));
+            }
+            break;
+        case PJRT_Buffer_Type_F16:
+            for (i = job->begin; i < job->end; ++i) {
+                uint64_t h = element_hash(key, i);
+                ((uint16_t*)data)[i] = (uint16_t)((h & 0x83ff) | ((7 + (h >> 61)) << 10));
+            }
+            break;
+        case PJRT_Buffer_Type_PRED:
+            for (i = job->begin; i < job->end; ++i) ((uint8_t*)data)[i] = (uint8_t)(element_hash(key, i) >> 63);
+            break;
+        case PJRT_Buffer_Type_S8:
+            for (i = job->begin; i < job->end; ++i) ((int8_t*)data)[i] = (int8_t)((int64_t)element_hash(key, i) >> 57);
+            break;
+        case PJRT_Buffer_Type_U8:
+            for (i = job->begin; i < job->end; ++i) ((uint8_t*)data)[i] = (uint8_t)(element_hash(key, i) >> 58);
+            break;
+        case PJRT_Buffer_Type_S16:
+            for (i = job->begin; i < job->end; ++i) {
+                ((int16_t*)data)[i] = (int16_t)((int64_t)element_hash(key, i) >> 57);
+            }
+            break;
+        case PJRT_Buffer_Type_U16:
+            for (i = job->begin; i < job->end; ++i) ((uint16_t*)data)[i] = (uint16_t)(element_hash(key, i) >> 58);
+            break;
+        case PJRT_Buffer_Type_S32:
+            for (i = job->begin; i < job->end; ++i) {
+                ((int32_t*)data)[i] = (int32_t)((int64_t)element_hash(key, i) >> 57);
+            }
+            break;
+        case PJRT_Buffer_Type_U32:
+            for (i = job->begin; i < job->end; ++i) ((uint32_t*)data)[i] = (uint32_t)(element_hash(key, i) >> 58);
+            break;
+        case PJRT_Buffer_Type_S64:
+            for (i = job->begin; i < job->end; ++i) ((int64_t*)data)[i] = (int64_t)element_hash(key, i) >> 57;
+            break;
+        case PJRT_Buffer_Type_U64:
+            for (i = job->begin; i < job->end; ++i) ((uint64_t*)data)[i] = element_hash(key, i) >> 58;
+            break;
+        default:
+            memset((char*)data + job->begin * job->scalar_size, 0, (job->end - job->begin) * job->scalar_size);
+            break;
+    }
+}
+
+
+#ifdef HAVE_X86_KERNELS
+// --- AVX2 kernel: 4 elements per step ---
+// AVX2 has no 64-bit multiply; a * b mod 2^64 is lo*lo + ((hi*lo + lo*hi) << 32).
+__attribute__((target("avx2")))
+static inline __m256i mullo64_avx2(__m256i a, __m256i b) {
+    __m256i cross = _mm256_add_epi64(_mm256_mul_epu32(_mm256_srli_epi64(a, 32), b),
+                                     _mm256_mul_epu32(a, _mm256_srli_epi64(b, 32)));
+    return _mm256_add_epi64(_mm256_mul_epu32(a, b), _mm256_slli_epi64(cross, 32));
+}
+
+__attribute__((target("avx2")))
+static inline __m256i mix64_avx2(__m256i x) {
+    x = mullo64_avx2(_mm256_xor_si256(x, _mm256_srli_epi64(x, 30)), _mm256_set1_epi64x((long long)0xbf58476d1ce4e5b9ull));
+    x = mullo64_avx2(_mm256_xor_si256(x, _mm256_srli_epi64(x, 27)), _mm256_set1_epi64x((long long)0x94d049bb133111ebull));
+    return _mm256_xor_si256(x, _mm256_srli_epi64(x, 31));
+}
+
+// (int64_t)h >> 57 without an arithmetic 64-bit shift: sign-extend the top 7 bits.
+__attribute__((target("avx2")))
+static inline __m256i small_signed_avx2(__m256i h) {
+    __m256i sign = _mm256_set1_epi64x(0x40);
+    return _mm256_sub_epi64(_mm256_xor_si256(_mm256_srli_epi64(h, 57), sign), sign);
+}
+
+// Each element widened to 64 bits, for the integer and half-precision types.
+__attribute__((target("avx2")))
+static inline __m256i integer_lanes_avx2(PJRT_Buffer_Type type, __m256i h) {
+    switch (type) {
+        case PJRT_Buffer_Type_BF16:
+            return _mm256_or_si256(_mm256_and_si256(h, _mm256_set1_epi64x(0x807f)),
+                                   _mm256_slli_epi64(_mm256_add_epi64(_mm256_srli_epi64(h, 61),
+                                                                      _mm256_set1_epi64x(119)), 7));
+        case PJRT_Buffer_Type_F16:
+            return _mm256_or_si256(_mm256_and_si256(h, _mm256_set1_epi64x(0x83ff)),
+                                   _mm256_slli_epi64(_mm256_add_epi64(_mm256_srli_epi64(h, 61),
+                                                                      _mm256_set1_epi64x(7)), 10));
+        case PJRT_Buffer_Type_PRED:
+            return _mm256_srli_epi64(h, 63);
+        case PJRT_Buffer_Type_S8: case PJRT_Buffer_Type_S16: case PJRT_Buffer_Type_S32: case PJRT_Buffer_Type_S64:
+            return small_signed_avx2(h);
+        default:
+            return _mm256_srli_epi64(h, 58);
+    }
+}
+
+__attribute__((target("avx2"), always_inline))
+static inline void fill_vectors_avx2(const struct fill_job* job, PJRT_Buffer_Type type) {
+    char* data = (char*)job->tensor->data;
+    const __m256i low_dwords = _mm256_setr_epi32(0, 2, 4, 6, 0, 2, 4, 6);
+    const __m256i high_dwords = _mm256_setr_epi32(1, 3, 5, 7, 1, 3, 5, 7);
+    const __m128i low_words = _mm_setr_epi8(0, 1, 4, 5, 8, 9, 12, 13, -1, -1, -1, -1, -1, -1, -1, -1);
+    const __m128i low_bytes = _mm_setr_epi8(0, 4, 8, 12, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+    const __m256i stride = _mm256_set1_epi64x((long long)(4 * SYNTHETIC_HASH_STEP));
+    size_t i = job->begin;
+    uint64_t base = job->key + (uint64_t)i * SYNTHETIC_HASH_STEP;
+    // Hash inputs are key + i * step; keep them in a register and add 4 steps per iteration.
+    __m256i x = _mm256_setr_epi64x((long long)base, (long long)(base + SYNTHETIC_HASH_STEP),
+                                   (long long)(base + 2 * SYNTHETIC_HASH_STEP),
+                                   (long long)(base + 3 * SYNTHETIC_HASH_STEP));
+    for (; i + 4 <= job->end; i += 4) {
+        __m256i h = mix64_avx2(x);
+        x = _mm256_add_epi64(x, stride);
+        if (type == PJRT_Buffer_Type_F32 || type == PJRT_Buffer_Type_C64) {
+            __m128i high = _mm256_castsi256_si128(_mm256_permutevar8x32_epi32(h, high_dwords));
+            _mm_storeu_ps((float*)data + i, _mm_mul_ps(_mm_cvtepi32_ps(high), _mm_set1_ps(0x1p-31f)));
+        } else if (type == PJRT_Buffer_Type_F64 || type == PJRT_Buffer_Type_C128) {
+            // ((int64_t)h >> 11) = (int32_t)(h >> 32) * 2^21 + low 21 bits; both parts and the sum are exact.
+            __m128i high = _mm256_castsi256_si128(_mm256_permutevar8x32_epi32(h, high_dwords));
+            __m256i low21 = _mm256_and_si256(_mm256_srli_epi64(h, 11), _mm256_set1_epi64x(0x1fffff));
+            __m128i low = _mm256_castsi256_si128(_mm256_permutevar8x32_epi32(low21, low_dwords));
+            __m256d value = _mm256_add_pd(_mm256_mul_pd(_mm256_cvtepi32_pd(high), _mm256_set1_pd(0x1p-31)),
+                                          _mm256_mul_pd(_mm256_cvtepi32_pd(low), _mm256_set1_pd(0x1p-52)));
+            _mm256_storeu_pd((double*)data + i, value);
+        } else {
+            __m256i lanes = integer_lanes_avx2(type, h);
+            __m128i dwords = _mm256_castsi256_si128(_mm256_permutevar8x32_epi32(lanes, low_dwords));
+            switch (job->scalar_size) {
+                case 8: _mm256_storeu_si256((__m256i*)(data + i * 8), lanes); break;
+                case 4: _mm_storeu_si128((__m128i*)(data + i * 4), dwords); break;
+                case 2: _mm_storel_epi64((__m128i*)(data + i * 2), _mm_shuffle_epi8(dwords, low_words)); break;
+                default: {
+                    int bytes = _mm_cvtsi128_si32(_mm_shuffle_epi8(dwords, low_bytes));
+                    memcpy(data + i, &bytes, sizeof(bytes));
+                    break;
+                }
+            }
+        }
+    }
+    struct fill_job tail = *job;
+    tail.begin = i;
+    fill_range(&tail);
+}
+
+__attribute__((target("avx2")))
+static void fill_range_avx2(const struct fill_job* job) {
+    switch (job->tensor->type) {
+        case PJRT_Buffer_Type_F32: fill_vectors_avx2(job, PJRT_Buffer_Type_F32); break;
+        case PJRT_Buffer_Type_C64: fill_vectors_avx2(job, PJRT_Buffer_Type_C64); break;
+        case PJRT_Buffer_Type_F64: fill_vectors_avx2(job, PJRT_Buffer_Type_F64); break;
+        case PJRT_Buffer_Type_C128: fill_vectors_avx2(job, PJRT_Buffer_Type_C128); break;
+        case PJRT_Buffer_Type_BF16: fill_vectors_avx2(job, PJRT_Buffer_Type_BF16); break;
+        case PJRT_Buffer_Type_F16: fill_vectors_avx2(job, PJRT_Buffer_Type_F16); break;
+        case PJRT_Buffer_Type_PRED: fill_vectors_avx2(job, PJRT_Buffer_Type_PRED); break;
+        case PJRT_Buffer_Type_S8: fill_vectors_avx2(job, PJRT_Buffer_Type_S8); break;
+        case PJRT_Buffer_Type_U8: fill_vectors_avx2(job, PJRT_Buffer_Type_U8); break;
+        case PJRT_Buffer_Type_S16: fill_vectors_avx2(job, PJRT_Buffer_Type_S16); break;
+        case PJRT_Buffer_Type_U16: fill_vectors_avx2(job, PJRT_Buffer_Type_U16); break;
+        case PJRT_Buffer_Type_S32: fill_vectors_avx2(job, PJRT_Buffer_Type_S32); break;
+        case PJRT_Buffer_Type_U32: fill_vectors_avx2(job, PJRT_Buffer_Type_U32); break;
+        case PJRT_Buffer_Type_S64: fill_vectors_avx2(job, PJRT_Buffer_Type_S64); break;
+        case PJRT_Buffer_Type_U64: fill_vectors_avx2(job, PJRT_Buffer_Type_U64); break;
+        default: fill_range(job); break;
+    }
+}
+
+// --- AVX-512 kernel: 8 elements per step ---
+__attribute__((target("avx512f,avx512dq")))
+static inline __m512i mix64_avx512(__m512i x) {
+    x = _mm512_mullo_epi64(_mm512_xor_si512(x, _mm512_srli_epi64(x, 30)), _mm512_set1_epi64((long long)0xbf58476d1ce4e5b9ull));
+    x = _mm512_mullo_epi64(_mm512_xor_si512(x, _mm512_srli_epi64(x, 27)), _mm512_set1_epi64((long long)0x94d049bb133111ebull));
+    return _mm512_xor_si512(x, _mm512_srli_epi64(x, 31));
+}
+
+__attribute__((target("avx512f,avx512dq")))
+static inline __m512i integer_lanes_avx512(PJRT_Buffer_Type type, __m512i h) {
+    switch (type) {
+        case PJRT_Buffer_Type_BF16:
+            return _mm512_or_si512(_mm512_and_si512(h, _mm512_set1_epi64(0x807f)),
+                                   _mm512_slli_epi64(_mm512_add_epi64(_mm512_srli_epi64(h, 61),
+                                                                      _mm512_set1_epi64(119)), 7));
+        case PJRT_Buffer_Type_F16:
+            return _mm512_or_si512(_mm512_and_si512(h, _mm512_set1_epi64(0x83ff)),
+                                   _mm512_slli_epi64(_mm512_add_epi64(_mm512_srli_epi64(h, 61),
+                                                                      _mm512_set1_epi64(7)), 10));
+        case PJRT_Buffer_Type_PRED:
+            return _mm512_srli_epi64(h, 63);
+        case PJRT_Buffer_Type_S8: case PJRT_Buffer_Type_S16: case PJRT_Buffer_Type_S32: case PJRT_Buffer_Type_S64:
+            return _mm512_srai_epi64(h, 57);
+        default:
+            return _mm512_srli_epi64(h, 58);
+    }
+}
+
+__attribute__((target("avx512f,avx512dq"), always_inline))
+static inline void fill_vectors_avx512(const struct fill_job* job, PJRT_Buffer_Type type) {
+    char* data = (char*)job->tensor->data;
+    const __m512i stride = _mm512_set1_epi64((long long)(8 * SYNTHETIC_HASH_STEP));
+    size_t i = job->begin;
+    uint64_t base = job->key + (uint64_t)i * SYNTHETIC_HASH_STEP;
+    __m512i x = _mm512_add_epi64(_mm512_set1_epi64((long long)base),
+                                 _mm512_mullo_epi64(_mm512_setr_epi64(0, 1, 2, 3, 4, 5, 6, 7),
+                                                    _mm512_set1_epi64((long long)SYNTHETIC_HASH_STEP)));
+    for (; i + 8 <= job->end; i += 8) {
+        __m512i h = mix64_avx512(x);
+        x = _mm512_add_epi64(x, stride);
+        if (type == PJRT_Buffer_Type_F32 || type == PJRT_Buffer_Type_C64) {
+            __m256i high = _mm512_cvtepi64_epi32(_mm512_srli_epi64(h, 32));
+            _mm256_storeu_ps((float*)data + i, _mm256_mul_ps(_mm256_cvtepi32_ps(high), _mm256_set1_ps(0x1p-31f)));
+        } else if (type == PJRT_Buffer_Type_F64 || type == PJRT_Buffer_Type_C128) {
+            __m512d value = _mm512_cvtepi64_pd(_mm512_srai_epi64(h, 11));
+            _mm512_storeu_pd((double*)data + i, _mm512_mul_pd(value, _mm512_set1_pd(0x1p-52)));
+        } else {
+            __m512i lanes = integer_lanes_avx512(type, h);
+            switch (job->scalar_size) {
+                case 8: _mm512_storeu_si512(data + i * 8, lanes); break;
+                case 4: _mm256_storeu_si256((__m256i*)(data + i * 4), _mm512_cvtepi64_epi32(lanes)); break;
+                case 2: _mm_storeu_si128((__m128i*)(data + i * 2), _mm512_cvtepi64_epi16(lanes)); break;
+                default: _mm_storel_epi64((__m128i*)(data + i), _mm512_cvtepi64_epi8(lanes)); break;
+            }
+        }
+    }
+    struct fill_job tail = *job;
+    tail.begin = i;
+    fill_range(&tail);
+}
+
+__attribute__((target("avx512f,avx512dq")))
+static void fill_range_avx512(const struct fill_job* job) {
+    switch (job->tensor->type) {
+        case PJRT_Buffer_Type_F32: fill_vectors_avx512(job, PJRT_Buffer_Type_F32); break;
+        case PJRT_Buffer_Type_C64: fill_vectors_avx512(job, PJRT_Buffer_Type_C64); break;
+        case PJRT_Buffer_Type_F64: fill_vectors_avx512(job, PJRT_Buffer_Type_F64); break;
+        case PJRT_Buffer_Type_C128: fill_vectors_avx512(job, PJRT_Buffer_Type_C128); break;
+        case PJRT_Buffer_Type_BF16: fill_vectors_avx512(job, PJRT_Buffer_Type_BF16); break;
+        case PJRT_Buffer_Type_F16: fill_vectors_avx512(job, PJRT_Buffer_Type_F16); break;
+        case PJRT_Buffer_Type_PRED: fill_vectors_avx512(job, PJRT_Buffer_Type_PRED); break;
+        case PJRT_Buffer_Type_S8: fill_vectors_avx512(job, PJRT_Buffer_Type_S8); break;
+        case PJRT_Buffer_Type_U8: fill_vectors_avx512(job, PJRT_Buffer_Type_U8); break;
+        case PJRT_Buffer_Type_S16: fill_vectors_avx512(job, PJRT_Buffer_Type_S16); break;
+        case PJRT_Buffer_Type_U16: fill_vectors_avx512(job, PJRT_Buffer_Type_U16); break;
+        case PJRT_Buffer_Type_S32: fill_vectors_avx512(job, PJRT_Buffer_Type_S32); break;
+        case PJRT_Buffer_Type_U32: fill_vectors_avx512(job, PJRT_Buffer_Type_U32); break;
+        case PJRT_Buffer_Type_S64: fill_vectors_avx512(job, PJRT_Buffer_Type_S64); break;
+        case PJRT_Buffer_Type_U64: fill_vectors_avx512(job, PJRT_Buffer_Type_U64); break;
+        default: fill_range(job); break;
+    }
+}
+#endif
+
+
+// --- Function to check a kernel against the scalar one on every type it vectorizes ---
+// Uneven begin/end offsets exercise the scalar tails too.
+static int fill_kernel_agrees(fill_range_fn fill) {
+    static const PJRT_Buffer_Type types[] = {
+        PJRT_Buffer_Type_F32, PJRT_Buffer_Type_C64, PJRT_Buffer_Type_F64, PJRT_Buffer_Type_C128,
+        PJRT_Buffer_Type_BF16, PJRT_Buffer_Type_F16, PJRT_Buffer_Type_PRED, PJRT_Buffer_Type_S8,
+        PJRT_Buffer_Type_U8, PJRT_Buffer_Type_S16, PJRT_Buffer_Type_U16, PJRT_Buffer_Type_S32,
+        PJRT_Buffer_Type_U32, PJRT_Buffer_Type_S64, PJRT_Buffer_Type_U64};
+    uint64_t expected[SYNTHETIC_CHECK_SCALARS];
+    uint64_t actual[SYNTHETIC_CHECK_SCALARS];
+    for (size_t t = 0; t < sizeof(types) / sizeof(types[0]); ++t) {
+        for (size_t begin = 0; begin < 3; ++begin) {
+            struct host_tensor tensor = {0};
+            tensor.type = types[t];
+            size_t scalar_size = buffer_type_size(types[t]);
+            if (types[t] == PJRT_Buffer_Type_C64 || types[t] == PJRT_Buffer_Type_C128) scalar_size /= 2;
+            struct fill_job job = {&tensor, mix64(begin), scalar_size, begin, SYNTHETIC_CHECK_SCALARS - begin};
+            memset(expected, 0, sizeof(expected));
+            memset(actual, 0, sizeof(actual));
+            tensor.data = expected;
+            fill_range(&job);
+            tensor.data = actual;
+            fill(&job);
+            if (memcmp(expected, actual, sizeof(expected)) != 0) return 0;
+        }
+    }
+    return 1;
+}
+
+
+// Available implementations, best last.
+static struct fill_impl fill_impls[3];
+static size_t num_fill_impls;
+static pthread_once_t fill_impls_once = PTHREAD_ONCE_INIT;
+
+static void add_fill_kernel(const char* name, fill_range_fn fill) {
+    if (!fill_kernel_agrees(fill)) {
+        fprintf(stderr, "The %s synthetic fill kernel does not match the scalar one; not using it.\n", name);
+        return;
+    }
+    fill_impls[num_fill_impls++] = (struct fill_impl){name, fill};
+}
+
+// Runs once per process: fill_synthetic is also called from prewarm threads.
+static void select_fill_kernels(void) {
+    fill_impls[num_fill_impls++] = (struct fill_impl){"scalar", fill_range};
+#ifdef HAVE_X86_KERNELS
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) add_fill_kernel("avx2", fill_range_avx2);
+    if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512dq")) {
+        add_fill_kernel("avx512", fill_range_avx512);
+    }
+#endif
+}
+
+
+static void* fill_thread(void* arg) {
+    fill_impls[num_fill_impls - 1].fill((const struct fill_job*)arg);
+    return NULL;
+}
+
+
+// --- Function to fill tensor->data with the deterministic values of parameter `stream` ---
+void fill_synthetic(struct host_tensor* tensor, uint64_t seed, uint64_t stream) {
+    size_t scalar_size = buffer_type_size(tensor->type);
+    if (tensor->type == PJRT_Buffer_Type_C64 || tensor->type == PJRT_Buffer_Type_C128) scalar_size /= 2;
+    if (scalar_size == 0) scalar_size = 1; // Sub-byte types are zero-filled
+    size_t scalars = tensor->size / scalar_size;
+    uint64_t key = mix64(seed ^ mix64(stream + 1));
+    pthread_once(&fill_impls_once, select_fill_kernels);
+
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    size_t threads = tensor->size / SYNTHETIC_MIN_BYTES_PER_THREAD;
+    if (threads > (size_t)(cpus > 0 ? cpus : 1)) threads = (size_t)(cpus > 0 ? cpus : 1);
+    if (threads > SYNTHETIC_MAX_THREADS) threads = SYNTHETIC_MAX_THREADS;
+    if (threads < 1) threads = 1;
+
+    struct fill_job jobs[SYNTHETIC_MAX_THREADS];
+    for (size_t t = 0; t < threads; ++t) {
+        jobs[t].tensor = tensor;
+        jobs[t].key = key;
+        jobs[t].scalar_size = scalar_size;
+        jobs[t].begin = scalars * t / threads;
+        jobs[t].end = scalars * (t + 1) / threads;
+    }
+    run_parallel_jobs(fill_thread, jobs, sizeof(jobs[0]), threads);
+}
+
+
+// --- Function to read the parameter shapes from a serialized HloModuleProto ---
+static int module_parameter_shapes(const uint8_t* module, size_t size, struct host_tensor* params,
+                                   size_t* num_params) {
+    *num_params = 0;
+    struct proto_reader reader = {module, size, 0};
+    struct proto_field field;
+    int status;
+    int found = 0;
+    while ((status = proto_next_field(&reader, &field)) == 1) {
+        if (field.number != 4 || field.wire_type != 2) continue; // host_program_shape
+        found = 1;
+        struct proto_reader program_shape = {field.data, field.size, 0};
+        struct proto_field shape_field;
+        while ((status = proto_next_field(&program_shape, &shape_field)) == 1) {
+            if (shape_field.number != 1 || shape_field.wire_type != 2) continue; // parameters
+            if (*num_params == SYNTHETIC_MAX_PARAMETERS) {
+                fprintf(stderr, "More than %d parameters.\n", SYNTHETIC_MAX_PARAMETERS);
+                return 1;
+            }
+            if (decode_array_shape(shape_field.data, shape_field.size, &params[*num_params]) != 0) {
+                fprintf(stderr, "Parameter %zu is not an array of a supported type.\n", *num_params);
+                return 1;
+            }
+            (*num_params)++;
+        }
+        if (status < 0) break;
+    }
+    if (status < 0 || !found) {
+        fprintf(stderr, "Not an HloModuleProto with a host_program_shape.\n");
+        return 1;
+    }
+    return 0;
+}
+
+
+// --- Function to fetch the optimized HloModuleProto of a compiled program ---
+static int optimized_program(const PJRT_Api* api, PJRT_LoadedExecutable* loaded_executable,
+                             struct file_data* module) {
+    PJRT_LoadedExecutable_GetExecutable_Args get_exec_args = {0};
+    get_exec_args.struct_size = PJRT_LoadedExecutable_GetExecutable_Args_STRUCT_SIZE;
+    get_exec_args.loaded_executable = loaded_executable;
+    if (handle_error(api->PJRT_LoadedExecutable_GetExecutable(&get_exec_args), api,
+                     "PJRT_LoadedExecutable_GetExecutable")) {
+        return 1;
+    }
+    PJRT_Program program = {0};
+    program.struct_size = PJRT_Program_STRUCT_SIZE;
+    PJRT_Executable_OptimizedProgram_Args program_args = {0};
+    program_args.struct_size = PJRT_Executable_OptimizedProgram_Args_STRUCT_SIZE;
+    program_args.executable = get_exec_args.executable;
+    program_args.program = &program;
+    // The first call reports the size, the second copies the code.
+    int rc = handle_error(api->PJRT_Executable_OptimizedProgram(&program_args), api,
+                          "PJRT_Executable_OptimizedProgram (size)");
+    if (rc == 0) {
+        program.code = (char*)malloc(program.code_size ? program.code_size : 1);
+        rc = program.code == NULL ||
+             handle_error(api->PJRT_Executable_OptimizedProgram(&program_args), api,
+                          "PJRT_Executable_OptimizedProgram");
+    }
+    if (rc == 0 && (program.format_size != 3 || memcmp(program.format, "hlo", 3) != 0)) {
+        fprintf(stderr, "Optimized program has format '%.*s', expected 'hlo'.\n", (int)program.format_size,
+                program.format);
+        rc = 1;
+    }
+    if (rc == 0) {
+        module->data = program.code;
+        module->size = program.code_size;
+    } else {
+        free(program.code);
+    }
+    PJRT_Executable_Destroy_Args destroy_args = {0};
+    destroy_args.struct_size = PJRT_Executable_Destroy_Args_STRUCT_SIZE;
+    destroy_args.executable = get_exec_args.executable;
+    handle_error(api->PJRT_Executable_Destroy(&destroy_args), api, "PJRT_Executable_Destroy");
+    return rc;
+}
+
+
+void free_synthetic_test_case(const TestCase* test_case) {
+    struct synthetic_case* c = (struct synthetic_case*)test_case;
+    if (c == NULL) return;
+    for (size_t i = 0; i < c->test_case.num_inputs; ++i) free_host_tensor(&c->inputs[i]);
+    free(c->program_path);
+    free(c);
+}
+
+
+// --- Function to build a test case with generated inputs for a program file ---
+// Compiled with ./compile_options.0.pb; returns NULL on errors.
+const TestCase* synthetic_test_case(const PJRT_Api* api, PJRT_Client* client, const char* program_path,
+                                    uint64_t seed) {
+    static const char compile_options_path[] = "./compile_options.0.pb";
+    struct file_data program = {NULL, 0};
+    struct file_data module = {NULL, 0};
+    struct synthetic_case* c = (struct synthetic_case*)calloc(1, sizeof(*c));
+    const char* format = program_format_from_path(program_path);
+    size_t num_params = 0;
+    int rc = 1;
+    if (c == NULL || (c->program_path = strdup(program_path)) == NULL) goto cleanup_synthetic;
+    if (read_file_to_buffer(program_path, &program) != 0) goto cleanup_synthetic;
+
+    if (strcmp(format, "hlo") == 0) {
+        rc = module_parameter_shapes((const uint8_t*)program.data, program.size, c->inputs, &num_params);
+    } else {
+        // Only the compiler knows the shapes of other formats; ask for the program it produced.
+        struct file_data compile_options = {NULL, 0};
+        PJRT_LoadedExecutable* executable = NULL;
+        if (read_file_to_buffer(compile_options_path, &compile_options) == 0) {
+            executable = compile_program(api, client, &program, format, &compile_options);
+        }
+        if (executable != NULL && optimized_program(api, executable, &module) == 0) {
+            rc = module_parameter_shapes((const uint8_t*)module.data, module.size, c->inputs, &num_params);
+        }
+        if (executable != NULL) destroy_loaded_executable(api, executable);
+        free_file_data(&compile_options);
+    }
+    if (rc != 0) {
+        fprintf(stderr, "Cannot derive the parameter shapes of '%s'.\n", program_path);
+        goto cleanup_synthetic;
+    }
+
+    size_t total_bytes = 0;
+    double start = now_seconds();
+    for (size_t i = 0; i < num_params; ++i) {
+        struct host_tensor* input = &c->inputs[i];
+        input->data = malloc(input->size ? input->size : 1);
+        if (input->data == NULL) {
+            fprintf(stderr, "Failed to allocate %zu bytes for parameter %zu\n", input->size, i);
+            c->test_case.num_inputs = i;
+            rc = 1;
+            goto cleanup_synthetic;
+        }
+        c->test_case.num_inputs = i + 1;
+        fill_synthetic(input, seed, i);
+        c->input_data[i] = input->data;
+        c->input_dims[i] = input->dims;
+        c->input_num_dims[i] = input->num_dims;
+        c->input_types[i] = input->type;
+        total_bytes += input->size;
+    }
+    double elapsed = now_seconds() - start;
+    printf("Synthetic inputs for %s: %zu parameter(s), %.1f MB generated in %.3f ms (%.2f GB/s)\n", program_path,
+           num_params, total_bytes / 1e6, elapsed * 1e3, elapsed > 0.0 ? total_bytes / elapsed / 1e9 : 0.0);
+
+    snprintf(c->name, sizeof(c->name), "%s (synthetic)", program_path);
+    c->test_case.name = c->name;
+    c->test_case.hlo_path = c->program_path;
+    c->test_case.format = format;
+    c->test_case.compile_options_path = compile_options_path;
+    c->test_case.input_data = c->input_data;
+    c->test_case.input_dims = c->input_dims;
+    c->test_case.input_num_dims = c->input_num_dims;
+    c->test_case.input_types = c->input_types;
+
+cleanup_synthetic:
+    free_file_data(&program);
+    free_file_data(&module);
+    if (rc != 0) {
+        free_synthetic_test_case((const TestCase*)c);
+        return NULL;
+    }
+    return &c->test_case;
+}
@@ -0,0 +1,262 @@
+// Copies between devices and memory spaces.
+//
+// copy_buffer_to_device and copy_buffer_to_memory wrap PJRT_Buffer_CopyToDevice
+// and PJRT_Buffer_CopyToMemory. The benchmark measures latency (small copy)
+// and bandwidth (large copy) between every pair of addressable devices and
+// every pair of addressable memories, prints both matrices and writes them
+// to transfer_matrix.csv for placement decisions.
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "hlo_test.h"
+
+#define TRANSFER_LATENCY_BYTES 64
+#define TRANSFER_BANDWIDTH_BYTES (16 << 20)
+#define TRANSFER_CSV_PATH "./transfer_matrix.csv"
+
+struct transfer_endpoint {
+    char label[16]; // Matrix heading, "dev<id>" or "mem<index>"
+    char description[96];
+    PJRT_Device* device; // Device endpoint, or a device that addresses the memory
+    PJRT_Memory* memory; // Memory endpoint, NULL for devices
+};
+
+
+// --- Function to copy a buffer to another device ---
+// The copy may still be in flight; wait with await_buffers_ready.
+PJRT_Buffer* copy_buffer_to_device(const PJRT_Api* api, PJRT_Buffer* buffer, PJRT_Device* dst_device) {
+    PJRT_Buffer_CopyToDevice_Args copy_args = {0};
+    copy_args.struct_size = PJRT_Buffer_CopyToDevice_Args_STRUCT_SIZE;
+    copy_args.buffer = buffer;
+    copy_args.dst_device = dst_device;
+    if (handle_error(api->PJRT_Buffer_CopyToDevice(&copy_args), api, "PJRT_Buffer_CopyToDevice")) {
+        return NULL;
+    }
+    return copy_args.dst_buffer;
+}
+
+
+// --- Function to copy a buffer to another memory space of the same client ---
+PJRT_Buffer* copy_buffer_to_memory(const PJRT_Api* api, PJRT_Buffer* buffer, PJRT_Memory* dst_memory) {
+    PJRT_Buffer_CopyToMemory_Args copy_args = {0};
+    copy_args.struct_size = PJRT_Buffer_CopyToMemory_Args_STRUCT_SIZE;
+    copy_args.buffer = buffer;
+    copy_args.dst_memory = dst_memory;
+    if (handle_error(api->PJRT_Buffer_CopyToMemory(&copy_args), api, "PJRT_Buffer_CopyToMemory")) {
+        return NULL;
+    }
+    return copy_args.dst_buffer;
+}
+
+
+static int device_id(const PJRT_Api* api, PJRT_Device* device) {
+    PJRT_Device_GetDescription_Args desc_args = {0};
+    desc_args.struct_size = PJRT_Device_GetDescription_Args_STRUCT_SIZE;
+    desc_args.device = device;
+    if (handle_error(api->PJRT_Device_GetDescription(&desc_args), api, "PJRT_Device_GetDescription")) return -1;
+    PJRT_DeviceDescription_Id_Args id_args = {0};
+    id_args.struct_size = PJRT_DeviceDescription_Id_Args_STRUCT_SIZE;
+    id_args.device_description = desc_args.device_description;
+    if (handle_error(api->PJRT_DeviceDescription_Id(&id_args), api, "PJRT_DeviceDescription_Id")) return -1;
+    return id_args.id;
+}
+
+
+// --- Functions to list the endpoints of both matrices ---
+static struct transfer_endpoint* device_endpoints(const PJRT_Api* api, PJRT_Client* client, size_t* count) {
+    PJRT_Client_AddressableDevices_Args devices_args = {0};
+    devices_args.struct_size = PJRT_Client_AddressableDevices_Args_STRUCT_SIZE;
+    devices_args.client = client;
+    if (handle_error(api->PJRT_Client_AddressableDevices(&devices_args), api, "PJRT_Client_AddressableDevices")) {
+        return NULL;
+    }
+    size_t n = devices_args.num_addressable_devices;
+    struct transfer_endpoint* endpoints = (struct transfer_endpoint*)calloc(n ? n : 1, sizeof(*endpoints));
+    if (endpoints == NULL) return NULL;
+    for (size_t i = 0; i < n; ++i) {
+        PJRT_Device* device = devices_args.addressable_devices[i];
+        int id = device_id(api, device);
+        endpoints[i].device = device;
+        snprintf(endpoints[i].label, sizeof(endpoints[i].label), "dev%d", id);
+        snprintf(endpoints[i].description, sizeof(endpoints[i].description), "device %d", id);
+    }
+    *count = n;
+    return endpoints;
+}
+
+static struct transfer_endpoint* memory_endpoints(const PJRT_Api* api, PJRT_Client* client, size_t* count) {
+    PJRT_Client_AddressableMemories_Args memories_args = {0};
+    memories_args.struct_size = PJRT_Client_AddressableMemories_Args_STRUCT_SIZE;
+    memories_args.client = client;
+    if (handle_error(api->PJRT_Client_AddressableMemories(&memories_args), api,
+                     "PJRT_Client_AddressableMemories")) {
+        return NULL;
+    }
+    size_t n = memories_args.num_addressable_memories;
+    struct transfer_endpoint* endpoints = (struct transfer_endpoint*)calloc(n ? n : 1, sizeof(*endpoints));
+    if (endpoints == NULL) return NULL;
+    size_t kept = 0;
+    for (size_t i = 0; i < n; ++i) {
+        PJRT_Memory* memory = memories_args.addressable_memories[i];
+        PJRT_Memory_Id_Args id_args = {0};
+        id_args.struct_size = PJRT_Memory_Id_Args_STRUCT_SIZE;
+        id_args.memory = memory;
+        PJRT_Memory_Kind_Args kind_args = {0};
+        kind_args.struct_size = PJRT_Memory_Kind_Args_STRUCT_SIZE;
+        kind_args.memory = memory;
+        PJRT_Memory_AddressableByDevices_Args by_args = {0};
+        by_args.struct_size = PJRT_Memory_AddressableByDevices_Args_STRUCT_SIZE;
+        by_args.memory = memory;
+        if (handle_error(api->PJRT_Memory_Id(&id_args), api, "PJRT_Memory_Id") ||
+            handle_error(api->PJRT_Memory_Kind(&kind_args), api, "PJRT_Memory_Kind") ||
+            handle_error(api->PJRT_Memory_AddressableByDevices(&by_args), api,
+                         "PJRT_Memory_AddressableByDevices")) {
+            continue;
+        }
+        if (by_args.num_devices == 0) continue; // No device to create the source buffer on
+        struct transfer_endpoint* e = &endpoints[kept];
+        e->memory = memory;
+        e->device = by_args.devices[0];
+        snprintf(e->label, sizeof(e->label), "mem%zu", kept++); // Memory ids are only unique per kind
+        snprintf(e->description, sizeof(e->description), "memory %d, kind '%.*s', device %d", id_args.id,
+                 (int)kind_args.kind_size, kind_args.kind, device_id(api, e->device));
+    }
+    *count = kept;
+    return endpoints;
+}
+
+
+// --- Function to create a source buffer of `size` bytes on an endpoint ---
+static PJRT_Buffer* endpoint_buffer(const PJRT_Api* api, PJRT_Client* client, const struct transfer_endpoint* e,
+                                    void* host_data, int64_t size) {
+    PJRT_Buffer* buffer = create_buffer_from_host(api, client, e->device, host_data, PJRT_Buffer_Type_U8, &size, 1,
+                                                  "Transfer source");
+    if (buffer == NULL || e->memory == NULL) return buffer;
+    PJRT_Buffer* moved = copy_buffer_to_memory(api, buffer, e->memory);
+    if (moved != NULL && await_buffers_ready(api, &moved, 1) != 0) {
+        destroy_buffer(api, moved, "PJRT_Buffer_Destroy (transfer source)");
+        moved = NULL;
+    }
+    destroy_buffer(api, buffer, "PJRT_Buffer_Destroy (transfer staging)");
+    return moved;
+}
+
+
+// --- Function to time copies of `src` to `dst`, one warm-up plus `iterations` ---
+static int time_copy(const PJRT_Api* api, PJRT_Buffer* src, const struct transfer_endpoint* dst, int iterations,
+                     double* samples, double* median_s) {
+    for (int i = -1; i < iterations; ++i) {
+        double start = now_seconds();
+        PJRT_Buffer* copy = dst->memory != NULL ? copy_buffer_to_memory(api, src, dst->memory)
+                                                : copy_buffer_to_device(api, src, dst->device);
+        if (copy == NULL) return 1;
+        int rc = await_buffers_ready(api, &copy, 1);
+        double elapsed = now_seconds() - start;
+        destroy_buffer(api, copy, "PJRT_Buffer_Destroy (transfer copy)");
+        if (rc != 0) return 1;
+        if (i >= 0) samples[i] = elapsed;
+    }
+    *median_s = median_of(samples, iterations);
+    return 0;
+}
+
+
+static void print_matrix(const char* title, const struct transfer_endpoint* endpoints, size_t n,
+                         const double* values, const char* format) {
+    printf("%s (rows: source, columns: destination)\n  %-8s", title, "");
+    for (size_t j = 0; j < n; ++j) printf(" %10s", endpoints[j].label);
+    printf("\n");
+    for (size_t i = 0; i < n; ++i) {
+        printf("  %-8s", endpoints[i].label);
+        for (size_t j = 0; j < n; ++j) {
+            if (isnan(values[i * n + j])) {
+                printf(" %10s", "n/a");
+            } else {
+                printf(" ");
+                printf(format, values[i * n + j]);
+            }
+        }
+        printf("\n");
+    }
+}
+
+
+// --- Function to measure one matrix and append it to the CSV file ---
+static int measure_matrix(const PJRT_Api* api, PJRT_Client* client, const char* kind,
+                          const struct transfer_endpoint* endpoints, size_t n, int iterations, uint8_t* host_data,
+                          FILE* csv) {
+    double* latency_us = (double*)malloc(n * n * sizeof(double));
+    double* bandwidth_gbs = (double*)malloc(n * n * sizeof(double));
+    double* samples = (double*)calloc(iterations, sizeof(double));
+    int rc = latency_us == NULL || bandwidth_gbs == NULL || samples == NULL;
+    for (size_t i = 0; i < n && rc == 0; ++i) {
+        PJRT_Buffer* small = endpoint_buffer(api, client, &endpoints[i], host_data, TRANSFER_LATENCY_BYTES);
+        PJRT_Buffer* large = endpoint_buffer(api, client, &endpoints[i], host_data, TRANSFER_BANDWIDTH_BYTES);
+        for (size_t j = 0; j < n; ++j) {
+            double small_s = 0.0, large_s = 0.0;
+            int ok = small != NULL && large != NULL &&
+                     time_copy(api, small, &endpoints[j], iterations, samples, &small_s) == 0 &&
+                     time_copy(api, large, &endpoints[j], iterations, samples, &large_s) == 0;
+            latency_us[i * n + j] = ok ? small_s * 1e6 : NAN;
+            bandwidth_gbs[i * n + j] = ok && large_s > 0.0 ? TRANSFER_BANDWIDTH_BYTES / large_s * 1e-9 : NAN;
+            if (ok && csv != NULL) {
+                fprintf(csv, "%s,%s,%s,%.3f,%.3f\n", kind, endpoints[i].label, endpoints[j].label,
+                        latency_us[i * n + j], bandwidth_gbs[i * n + j]);
+            }
+        }
+        destroy_buffer(api, small, "PJRT_Buffer_Destroy (transfer source)");
+        destroy_buffer(api, large, "PJRT_Buffer_Destroy (transfer source)");
+    }
+    if (rc == 0) {
+        for (size_t i = 0; i < n; ++i) printf("  %-8s %s\n", endpoints[i].label, endpoints[i].description);
+        print_matrix("Latency (us)", endpoints, n, latency_us, "%10.1f");
+        print_matrix("Bandwidth (GB/s)", endpoints, n, bandwidth_gbs, "%10.2f");
+    }
+    free(latency_us);
+    free(bandwidth_gbs);
+    free(samples);
+    return rc;
+}
+
+
+// --- Function to benchmark copies between all addressable devices and memories ---
+int run_transfer_benchmark(const PJRT_Api* api, PJRT_Client* client, int iterations) {
+    int rc = 1;
+    size_t num_devices = 0, num_memories = 0;
+    struct transfer_endpoint* devices = device_endpoints(api, client, &num_devices);
+    struct transfer_endpoint* memories = memory_endpoints(api, client, &num_memories);
+    uint8_t* host_data = (uint8_t*)malloc(TRANSFER_BANDWIDTH_BYTES);
+    FILE* csv = NULL;
+
+    printf("\n--- Transfer benchmark (latency: %d B, bandwidth: %d MiB copies) ---\n", TRANSFER_LATENCY_BYTES,
+           TRANSFER_BANDWIDTH_BYTES >> 20);
+    if (devices == NULL || memories == NULL || host_data == NULL) goto cleanup_transfer;
+    for (size_t i = 0; i < TRANSFER_BANDWIDTH_BYTES; ++i) host_data[i] = (uint8_t)(i * 131);
+    csv = fopen(TRANSFER_CSV_PATH, "w");
+    if (csv == NULL) {
+        fprintf(stderr, "Could not open '%s'; printing matrices only.\n", TRANSFER_CSV_PATH);
+    } else {
+        fprintf(csv, "kind,src,dst,latency_us,bandwidth_gbs\n");
+    }
+
+    printf("Device to device (PJRT_Buffer_CopyToDevice), %zu device(s):\n", num_devices);
+    if (measure_matrix(api, client, "device", devices, num_devices, iterations, host_data, csv) != 0) {
+        goto cleanup_transfer;
+    }
+    printf("Memory to memory (PJRT_Buffer_CopyToMemory), %zu memor%s:\n", num_memories,
+           num_memories == 1 ? "y" : "ies");
+    if (measure_matrix(api, client, "memory", memories, num_memories, iterations, host_data, csv) != 0) {
+        goto cleanup_transfer;
+    }
+    if (csv != NULL) printf("Wrote %s.\n", TRANSFER_CSV_PATH);
+    rc = 0;
+
+cleanup_transfer:
+    if (csv != NULL) fclose(csv);
+    free(devices);
+    free(memories);
+    free(host_data);
+    return rc;
+}
@@ -0,0 +1,578 @@
+// Zero-copy weight loading from .npy and safetensors files.
+//
+// weights_open maps a file read-only and parses its header; the tensors
+// point into the mapping. weights_load creates one PJRT buffer per tensor
+// with kImmutableZeroCopy, so a plugin that can alias host memory (the CPU
+// plugin does for suitably aligned data) uses the mapped pages in place:
+// weights already in the page cache are neither copied nor counted twice in
+// RSS, and loading costs per tensor rather than per byte. Tensors whose data
+// is not WEIGHTS_ZERO_COPY_ALIGNMENT aligned are copied
+// (kImmutableOnlyDuringCall) instead. The mapping must outlive the buffers:
+// weights_release destroys them and waits for every done_with_host event
+// before weights_close unmaps the file.
+//
+// .npy: format versions 1 to 3, little-endian or byte-sized types, C order.
+// safetensors: an 8-byte little-endian header size, a JSON header mapping
+// names to {"dtype", "shape", "data_offsets"}, then the data.
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "hlo_test.h"
+
+// Data alignment the CPU plugin needs to alias a host buffer; others are copied.
+#define WEIGHTS_ZERO_COPY_ALIGNMENT 64
+#define NPY_MAGIC "\x93NUMPY"
+
+struct dtype_name {
+    const char* name;
+    PJRT_Buffer_Type type;
+};
+
+// .npy descr without the byte order character.
+static const struct dtype_name npy_dtypes[] = {
+    {"b1", PJRT_Buffer_Type_PRED}, {"i1", PJRT_Buffer_Type_S8}, {"u1", PJRT_Buffer_Type_U8},
+    {"i2", PJRT_Buffer_Type_S16}, {"u2", PJRT_Buffer_Type_U16}, {"f2", PJRT_Buffer_Type_F16},
+    {"i4", PJRT_Buffer_Type_S32}, {"u4", PJRT_Buffer_Type_U32}, {"f4", PJRT_Buffer_Type_F32},
+    {"i8", PJRT_Buffer_Type_S64}, {"u8", PJRT_Buffer_Type_U64}, {"f8", PJRT_Buffer_Type_F64},
+    {"c8", PJRT_Buffer_Type_C64}, {"c16", PJRT_Buffer_Type_C128},
+};
+
+static const struct dtype_name safetensors_dtypes[] = {
+    {"BOOL", PJRT_Buffer_Type_PRED}, {"I8", PJRT_Buffer_Type_S8}, {"U8", PJRT_Buffer_Type_U8},
+    {"I16", PJRT_Buffer_Type_S16}, {"U16", PJRT_Buffer_Type_U16}, {"F16", PJRT_Buffer_Type_F16},
+    {"BF16", PJRT_Buffer_Type_BF16}, {"I32", PJRT_Buffer_Type_S32}, {"U32", PJRT_Buffer_Type_U32},
+    {"F32", PJRT_Buffer_Type_F32}, {"I64", PJRT_Buffer_Type_S64}, {"U64", PJRT_Buffer_Type_U64},
+    {"F64", PJRT_Buffer_Type_F64}, {"C64", PJRT_Buffer_Type_C64}, {"F8_E4M3", PJRT_Buffer_Type_F8E4M3FN},
+    {"F8_E5M2", PJRT_Buffer_Type_F8E5M2},
+};
+
+
+static int lookup_dtype(const struct dtype_name* table, size_t count, const char* name, PJRT_Buffer_Type* type) {
+    for (size_t i = 0; i < count; ++i) {
+        if (strcmp(table[i].name, name) == 0) {
+            *type = table[i].type;
+            return 0;
+        }
+    }
+    return 1;
+}
+
+
+static struct weight_tensor* add_tensor(struct weight_file* file) {
+    if (file->num_tensors % 64 == 0) {
+        struct weight_tensor* grown = (struct weight_tensor*)realloc(
+            file->tensors, (file->num_tensors + 64) * sizeof(struct weight_tensor));
+        if (grown == NULL) return NULL;
+        file->tensors = grown;
+    }
+    struct weight_tensor* tensor = &file->tensors[file->num_tensors++];
+    memset(tensor, 0, sizeof(*tensor));
+    return tensor;
+}
+
+
+// Checks that the tensor's bytes match its shape and lie inside [data, data + size).
+// A shape whose byte count overflows is rejected; it could otherwise wrap to a size that fits the file.
+static int check_tensor(const struct weight_tensor* tensor, const uint8_t* data, size_t size) {
+    size_t expected = buffer_type_size(tensor->type);
+    for (size_t d = 0; d < tensor->num_dims; ++d) {
+        if (tensor->dims[d] < 0 || __builtin_mul_overflow(expected, (size_t)tensor->dims[d], &expected)) {
+            fprintf(stderr, "Tensor '%s' has a shape too large to address\n", tensor->name);
+            return 1;
+        }
+    }
+    if (tensor->size != expected) {
+        fprintf(stderr, "Tensor '%s' has %zu bytes, its shape needs %zu\n", tensor->name, tensor->size, expected);
+        return 1;
+    }
+    const uint8_t* begin = (const uint8_t*)tensor->data;
+    if (begin < data || tensor->size > size || begin > data + size - tensor->size) {
+        fprintf(stderr, "Tensor '%s' extends past the end of the file\n", tensor->name);
+        return 1;
+    }
+    return 0;
+}
+
+
+// --- .npy ---
+
+// Value of 'key' in the header dict, NULL when missing.
+static const char* npy_value(const char* header, const char* end, const char* key) {
+    size_t key_length = strlen(key);
+    for (const char* p = header; p + key_length + 2 <= end; ++p) {
+        if ((*p == '\'' || *p == '"') && memcmp(p + 1, key, key_length) == 0 && p[key_length + 1] == *p) {
+            p += key_length + 2;
+            while (p < end && (isspace((unsigned char)*p) || *p == ':')) ++p;
+            return p;
+        }
+    }
+    return NULL;
+}
+
+
+static int parse_npy(const uint8_t* data, size_t size, const char* name, struct weight_file* file) {
+    if (size < 10 || data[6] < 1 || data[6] > 3) {
+        fprintf(stderr, "'%s' is a .npy file of an unsupported version\n", name);
+        return 1;
+    }
+    size_t header_offset = data[6] == 1 ? 10 : 12;
+    size_t header_size = data[6] == 1 ? (size_t)data[8] | (size_t)data[9] << 8
+                                      : (size_t)data[8] | (size_t)data[9] << 8 | (size_t)data[10] << 16 |
+                                            (size_t)data[11] << 24;
+    if (header_offset > size || header_size > size - header_offset) {
+        fprintf(stderr, "'%s' has a truncated .npy header\n", name);
+        return 1;
+    }
+    const char* header = (const char*)data + header_offset;
+    const char* end = header + header_size;
+    const char* descr = npy_value(header, end, "descr");
+    const char* order = npy_value(header, end, "fortran_order");
+    const char* shape = npy_value(header, end, "shape");
+    if (descr == NULL || order == NULL || shape == NULL || (*descr != '\'' && *descr != '"') || *shape != '(') {
+        fprintf(stderr, "'%s' lacks descr, fortran_order or shape\n", name);
+        return 1;
+    }
+    char dtype[16];
+    size_t n = 0;
+    for (++descr; descr < end && *descr != '\'' && *descr != '"' && n + 1 < sizeof(dtype); ++descr) {
+        dtype[n++] = *descr;
+    }
+    dtype[n] = '\0';
+    struct weight_tensor* tensor = add_tensor(file);
+    if (tensor == NULL) return 1;
+    snprintf(tensor->name, sizeof(tensor->name), "%s", name);
+    char byte_order = dtype[0];
+    int single_byte = strcmp(dtype + 1, "b1") == 0 || strcmp(dtype + 1, "i1") == 0 || strcmp(dtype + 1, "u1") == 0;
+    if ((byte_order != '<' && byte_order != '|' && !(byte_order == '>' && single_byte)) ||
+        lookup_dtype(npy_dtypes, sizeof(npy_dtypes) / sizeof(npy_dtypes[0]), dtype + 1, &tensor->type) != 0) {
+        fprintf(stderr, "'%s' has unsupported dtype '%s'\n", name, dtype);
+        return 1;
+    }
+    if (strncmp(order, "False", 5) != 0) {
+        fprintf(stderr, "'%s' is in Fortran order; only C order can be used in place\n", name);
+        return 1;
+    }
+    size_t elements = 1;
+    for (const char* p = shape + 1; p < end && *p != ')';) {
+        char* number_end = NULL;
+        long long dim = strtoll(p, &number_end, 10);
+        if (number_end == p) {
+            ++p; // Spaces and commas
+            continue;
+        }
+        if (tensor->num_dims == HOST_TENSOR_MAX_DIMS || dim < 0) {
+            fprintf(stderr, "'%s' has an unsupported shape\n", name);
+            return 1;
+        }
+        tensor->dims[tensor->num_dims++] = dim;
+        if (__builtin_mul_overflow(elements, (size_t)dim, &elements)) {
+            fprintf(stderr, "'%s' has a shape too large to address\n", name);
+            return 1;
+        }
+        p = number_end;
+    }
+    tensor->data = data + header_offset + header_size;
+    if (__builtin_mul_overflow(elements, buffer_type_size(tensor->type), &tensor->size)) {
+        fprintf(stderr, "'%s' has a shape too large to address\n", name);
+        return 1;
+    }
+    return check_tensor(tensor, data, size);
+}
+
+
+// --- safetensors: just enough JSON for the header ---
+struct json {
+    const char* p;
+    const char* end;
+};
+
+static void json_space(struct json* j) {
+    while (j->p < j->end && isspace((unsigned char)*j->p)) j->p++;
+}
+
+static int json_expect(struct json* j, char c) {
+    json_space(j);
+    if (j->p == j->end || *j->p != c) return 1;
+    j->p++;
+    return 0;
+}
+
+// Reads a string; escapes other than \" and \\ are kept as they are, longer strings are truncated.
+static int json_string(struct json* j, char* out, size_t size) {
+    if (json_expect(j, '"')) return 1;
+    size_t n = 0;
+    while (j->p < j->end && *j->p != '"') {
+        if (*j->p == '\\' && j->p + 1 < j->end && (j->p[1] == '"' || j->p[1] == '\\')) j->p++;
+        if (n + 1 < size) out[n++] = *j->p;
+        j->p++;
+    }
+    if (size > 0) out[n] = '\0';
+    return json_expect(j, '"');
+}
+
+static int json_int(struct json* j, int64_t* value) {
+    json_space(j);
+    char* number_end = NULL;
+    long long parsed = strtoll(j->p, &number_end, 10);
+    if (number_end == j->p || number_end > j->end) return 1;
+    j->p = number_end;
+    *value = parsed;
+    return 0;
+}
+
+// Array of integers; stores at most `capacity` of them.
+static int json_int_array(struct json* j, int64_t* values, size_t capacity, size_t* count) {
+    *count = 0;
+    if (json_expect(j, '[')) return 1;
+    json_space(j);
+    if (j->p < j->end && *j->p == ']') return json_expect(j, ']');
+    for (;;) {
+        int64_t value;
+        if (json_int(j, &value)) return 1;
+        if (*count == capacity) return 1;
+        values[(*count)++] = value;
+        json_space(j);
+        if (j->p < j->end && *j->p == ',') {
+            j->p++;
+            continue;
+        }
+        return json_expect(j, ']');
+    }
+}
+
+// Skips any value.
+static int json_skip(struct json* j) {
+    json_space(j);
+    if (j->p == j->end) return 1;
+    if (*j->p == '"') return json_string(j, NULL, 0);
+    if (*j->p != '{' && *j->p != '[') {
+        while (j->p < j->end && *j->p != ',' && *j->p != '}' && *j->p != ']') j->p++;
+        return 0;
+    }
+    char close = *j->p == '{' ? '}' : ']';
+    j->p++;
+    json_space(j);
+    if (j->p < j->end && *j->p == close) {
+        j->p++;
+        return 0;
+    }
+    for (;;) {
+        if (close == '}' && (json_string(j, NULL, 0) || json_expect(j, ':'))) return 1;
+        if (json_skip(j)) return 1;
+        json_space(j);
+        if (j->p < j->end && *j->p == ',') {
+            j->p++;
+            continue;
+        }
+        return json_expect(j, close);
+    }
+}
+
+
+static int parse_safetensors(const uint8_t* data, size_t size, const char* name, struct weight_file* file) {
+    uint64_t header_size = 0;
+    for (int i = 7; i >= 0 && size >= 8; --i) header_size = header_size << 8 | data[i];
+    if (size < 8 || header_size > size - 8) {
+        fprintf(stderr, "'%s' is neither a .npy nor a safetensors file\n", name);
+        return 1;
+    }
+    const uint8_t* tensor_data = data + 8 + header_size;
+    size_t data_size = size - 8 - header_size;
+    struct json j = {(const char*)data + 8, (const char*)tensor_data};
+    if (json_expect(&j, '{')) goto bad_header;
+    json_space(&j);
+    if (j.p < j.end && *j.p == '}') return 0;
+    for (;;) {
+        char key[WEIGHTS_NAME_SIZE];
+        if (json_string(&j, key, sizeof(key)) || json_expect(&j, ':')) goto bad_header;
+        if (strcmp(key, "__metadata__") == 0) {
+            if (json_skip(&j)) goto bad_header;
+        } else {
+            struct weight_tensor* tensor = add_tensor(file);
+            char dtype[16] = "";
+            int64_t offsets[2];
+            size_t num_offsets = 0;
+            if (tensor == NULL || json_expect(&j, '{')) goto bad_header;
+            snprintf(tensor->name, sizeof(tensor->name), "%s", key);
+            for (;;) {
+                char field[32];
+                if (json_string(&j, field, sizeof(field)) || json_expect(&j, ':')) goto bad_header;
+                int rc;
+                if (strcmp(field, "dtype") == 0) {
+                    rc = json_string(&j, dtype, sizeof(dtype));
+                } else if (strcmp(field, "shape") == 0) {
+                    rc = json_int_array(&j, tensor->dims, HOST_TENSOR_MAX_DIMS, &tensor->num_dims);
+                } else if (strcmp(field, "data_offsets") == 0) {
+                    rc = json_int_array(&j, offsets, 2, &num_offsets);
+                } else {
+                    rc = json_skip(&j);
+                }
+                if (rc) goto bad_header;
+                json_space(&j);
+                if (j.p < j.end && *j.p == ',') {
+                    j.p++;
+                    continue;
+                }
+                if (json_expect(&j, '}')) goto bad_header;
+                break;
+            }
+            if (lookup_dtype(safetensors_dtypes, sizeof(safetensors_dtypes) / sizeof(safetensors_dtypes[0]), dtype,
+                             &tensor->type) != 0) {
+                fprintf(stderr, "Tensor '%s' in '%s' has unsupported dtype '%s'\n", key, name, dtype);
+                return 1;
+            }
+            if (num_offsets != 2 || offsets[0] < 0 || offsets[1] < offsets[0] || (uint64_t)offsets[1] > data_size) {
+                fprintf(stderr, "Tensor '%s' in '%s' has bad data_offsets\n", key, name);
+                return 1;
+            }
+            tensor->data = tensor_data + offsets[0];
+            tensor->size = (size_t)(offsets[1] - offsets[0]);
+            if (check_tensor(tensor, tensor_data, data_size) != 0) return 1;
+        }
+        json_space(&j);
+        if (j.p < j.end && *j.p == ',') {
+            j.p++;
+            continue;
+        }
+        if (json_expect(&j, '}')) goto bad_header;
+        return 0;
+    }
+
+bad_header:
+    fprintf(stderr, "'%s' has a malformed safetensors header\n", name);
+    return 1;
+}
+
+
+// --- Function to parse weights held in memory; the tensors point into `data` ---
+int weights_parse(const void* data, size_t size, const char* path, struct weight_file* file) {
+    const char* slash = strrchr(path, '/');
+    const char* name = slash != NULL ? slash + 1 : path;
+    int rc = size >= 6 && memcmp(data, NPY_MAGIC, 6) == 0 ? parse_npy((const uint8_t*)data, size, name, file)
+                                                          : parse_safetensors((const uint8_t*)data, size, name, file);
+    if (rc != 0) {
+        free(file->tensors);
+        file->tensors = NULL;
+        file->num_tensors = 0;
+    }
+    return rc;
+}
+
+
+// --- Function to map a weight file and parse its header ---
+int weights_open(const char* path, struct weight_file* file) {
+    memset(file, 0, sizeof(*file));
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        fprintf(stderr, "Error opening '%s': %s\n", path, strerror(errno));
+        return 1;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        fprintf(stderr, "'%s' is empty\n", path);
+        close(fd);
+        return 1;
+    }
+    void* map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        fprintf(stderr, "Error mapping '%s': %s\n", path, strerror(errno));
+        return 1;
+    }
+    file->map = map;
+    file->map_size = (size_t)st.st_size;
+    if (weights_parse(map, file->map_size, path, file) != 0) {
+        weights_close(file);
+        return 1;
+    }
+    return 0;
+}
+
+
+void weights_close(struct weight_file* file) {
+    if (file->map != NULL) munmap(file->map, file->map_size);
+    free(file->tensors);
+    memset(file, 0, sizeof(*file));
+}
+
+
+// --- Function to create a buffer per tensor, aliasing the data where it is aligned ---
+// `buffers` and `done_events` hold file->num_tensors entries each; release them with weights_release.
+int weights_load(const PJRT_Api* api, PJRT_Client* client, PJRT_Device* device, const struct weight_file* file,
+                 PJRT_Buffer** buffers, PJRT_Event** done_events, size_t* num_aliased) {
+    *num_aliased = 0;
+    memset(buffers, 0, file->num_tensors * sizeof(*buffers));
+    memset(done_events, 0, file->num_tensors * sizeof(*done_events));
+    for (size_t i = 0; i < file->num_tensors; ++i) {
+        const struct weight_tensor* tensor = &file->tensors[i];
+        if ((uintptr_t)tensor->data % WEIGHTS_ZERO_COPY_ALIGNMENT == 0) {
+            buffers[i] = create_buffer_zero_copy(api, client, device, tensor->data, tensor->type, tensor->dims,
+                                                 tensor->num_dims, &done_events[i], tensor->name);
+            if (buffers[i] != NULL && buffer_aliases_host(api, buffers[i], tensor->data)) (*num_aliased)++;
+        } else {
+            buffers[i] = create_buffer_from_host(api, client, device, (void*)tensor->data, tensor->type,
+                                                 tensor->dims, tensor->num_dims, tensor->name);
+        }
+        if (buffers[i] == NULL) {
+            weights_release(api, buffers, done_events, i);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+
+// --- Function to destroy weight buffers and wait until the host data is no longer used ---
+void weights_release(const PJRT_Api* api, PJRT_Buffer** buffers, PJRT_Event** done_events, size_t count) {
+    for (size_t i = 0; i < count; ++i) {
+        destroy_buffer(api, buffers[i], "PJRT_Buffer_Destroy (weights)");
+        buffers[i] = NULL;
+        if (done_events[i] != NULL) {
+            await_event(api, done_events[i], "PJRT_Event_Await (weights done with host)");
+            done_events[i] = NULL;
+        }
+    }
+}
+
+
+// --- Benchmark ---
+
+// Anonymous resident memory of this process: resident minus file-backed pages.
+static int64_t anonymous_resident_bytes(void) {
+    FILE* file = fopen("/proc/self/statm", "r");
+    long long size = 0, resident = 0, shared = 0;
+    if (file == NULL) return -1;
+    int fields = fscanf(file, "%lld %lld %lld", &size, &resident, &shared);
+    fclose(file);
+    return fields == 3 ? (int64_t)(resident - shared) * sysconf(_SC_PAGESIZE) : -1;
+}
+
+
+// Brings the file into the page cache so both load paths start from it.
+static void warm_page_cache(const char* path) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return;
+    char chunk[1 << 16];
+    while (read(fd, chunk, sizeof(chunk)) > 0) {
+    }
+    close(fd);
+}
+
+
+// Compares every buffer with the tensor data it was created from.
+static size_t count_corrupt_tensors(const PJRT_Api* api, const struct weight_file* file, PJRT_Buffer** buffers) {
+    size_t corrupt = 0;
+    for (size_t i = 0; i < file->num_tensors; ++i) {
+        struct host_tensor tensor;
+        if (buffer_to_host(api, buffers[i], &tensor) != 0) {
+            corrupt++;
+            continue;
+        }
+        corrupt += tensor.size != file->tensors[i].size || memcmp(tensor.data, file->tensors[i].data, tensor.size);
+        free_host_tensor(&tensor);
+    }
+    return corrupt;
+}
+
+
+// --- Function to compare zero-copy and read-and-copy loading of weight files ---
+int run_weights_benchmark(const PJRT_Api* api, PJRT_Client* client, PJRT_Device* device,
+                          const char* const* paths, size_t num_paths, int iterations) {
+    int rc = 0;
+    double* samples[2] = {(double*)calloc(iterations, sizeof(double)), (double*)calloc(iterations, sizeof(double))};
+    double* rss[2] = {(double*)calloc(iterations, sizeof(double)), (double*)calloc(iterations, sizeof(double))};
+    if (samples[0] == NULL || samples[1] == NULL || rss[0] == NULL || rss[1] == NULL) {
+        rc = 1;
+        goto cleanup_weights;
+    }
+
+    for (size_t f = 0; f < num_paths; ++f) {
+        struct weight_file file;
+        if (weights_open(paths[f], &file) != 0) {
+            rc = 1;
+            continue;
+        }
+        size_t aligned = 0, total_bytes = 0;
+        for (size_t i = 0; i < file.num_tensors; ++i) {
+            aligned += (uintptr_t)file.tensors[i].data % WEIGHTS_ZERO_COPY_ALIGNMENT == 0;
+            total_bytes += file.tensors[i].size;
+        }
+        printf("\n--- Weights: %s (%zu tensor(s), %.1f MiB, %zu of them %d-byte aligned) ---\n", paths[f],
+               file.num_tensors, total_bytes / 1048576.0, aligned, WEIGHTS_ZERO_COPY_ALIGNMENT);
+        size_t count = file.num_tensors;
+        PJRT_Buffer** buffers = (PJRT_Buffer**)calloc(count ? count : 1, sizeof(PJRT_Buffer*));
+        PJRT_Event** events = (PJRT_Event**)calloc(count ? count : 1, sizeof(PJRT_Event*));
+        size_t num_aliased = 0, corrupt[2] = {0, 0};
+        weights_close(&file);
+        if (buffers == NULL || events == NULL) {
+            free(buffers);
+            free(events);
+            rc = 1;
+            continue;
+        }
+        warm_page_cache(paths[f]);
+
+        int file_rc = 0;
+        for (int i = 0; i < iterations && file_rc == 0; ++i) {
+            for (int mode = 0; mode < 2 && file_rc == 0; ++mode) {
+                struct file_data data = {NULL, 0};
+                int64_t rss_before = anonymous_resident_bytes();
+                double start = now_seconds();
+                if (mode == 0) { // Map and alias
+                    file_rc = weights_open(paths[f], &file) ||
+                              weights_load(api, client, device, &file, buffers, events, &num_aliased);
+                } else { // Read into memory and copy
+                    memset(&file, 0, sizeof(file));
+                    file_rc = read_file_to_buffer(paths[f], &data) ||
+                              weights_parse(data.data, data.size, paths[f], &file);
+                    for (size_t t = 0; t < file.num_tensors && file_rc == 0; ++t) {
+                        const struct weight_tensor* tensor = &file.tensors[t];
+                        buffers[t] = create_buffer_from_host(api, client, device, (void*)tensor->data, tensor->type,
+                                                             tensor->dims, tensor->num_dims, tensor->name);
+                        file_rc = buffers[t] == NULL;
+                    }
+                }
+                file_rc = file_rc || await_buffers_ready(api, buffers, count);
+                samples[mode][i] = now_seconds() - start;
+                rss[mode][i] = (double)(anonymous_resident_bytes() - rss_before);
+                if (file_rc == 0 && i == iterations - 1) corrupt[mode] = count_corrupt_tensors(api, &file, buffers);
+                weights_release(api, buffers, events, count);
+                if (mode == 0) {
+                    weights_close(&file);
+                } else {
+                    free(file.tensors);
+                    free_file_data(&data);
+                }
+            }
+        }
+        if (file_rc == 0) {
+            static const char* const names[2] = {"mmap, zero-copy", "read, copy"};
+            printf("  %-18s %10s %12s %14s %10s\n", "load", "median ms", "us/tensor", "anon RSS MiB", "corrupt");
+            for (int mode = 0; mode < 2; ++mode) {
+                double median = median_of(samples[mode], iterations);
+                printf("  %-18s %10.3f %12.2f %14.1f %10zu\n", names[mode], median * 1e3,
+                       count ? median / count * 1e6 : 0.0, median_of(rss[mode], iterations) / 1048576.0,
+                       corrupt[mode]);
+                if (corrupt[mode] != 0) file_rc = 1;
+            }
+            printf("  %zu of %zu tensor(s) aliased the mapped file; the others were copied.\n", num_aliased, count);
+        }
+        if (file_rc != 0) rc = 1;
+        free(buffers);
+        free(events);
+    }
+
+cleanup_weights:
+    for (int mode = 0; mode < 2; ++mode) {
+        free(samples[mode]);
+        free(rss[mode]);
+    }
+    return rc;
+}